@@ -2,6 +2,8 @@
 #include "StdAfx.h"
 #include "Player.h"
 #include "GamePlugin.h"
+#include "Systems/PlayerMovementSystem.h"
+#include "Systems/PlayerPool.h"
 #include <CryPhysics/RayCastQueue.h>
 #include <CryPhysics/physinterface.h>
 #include <CryEntitySystem/IEntitySystem.h>
@@ -10,6 +12,8 @@
 #include <CryRenderer/IRenderAuxGeom.h>
 #include <CryCore/StaticInstanceList.h>
 #include <CrySchematyc/Env/IEnvRegistrar.h>
+#include <CryNetwork/Rmi.h>
+#include <CryGame/IGameFramework.h>
 
 #include <DefaultComponents/Cameras/CameraComponent.h>
 #include <DefaultComponents/Input/InputComponent.h>
@@ -27,495 +31,453 @@ namespace
 	}
 
 	CRY_STATIC_AUTO_REGISTER_FUNCTION(&RegisterPlayerComponent);
+
+	enum class EInputBindingKind : uint8
+	{
+		// Held while the key is down, the tick sees the press and release edges
+		Button,
+		MouseYaw,
+		MousePitch
+	};
+
+	struct SInputBinding
+	{
+		const char* szName;
+		EKeyId keyId;
+		EInputBindingKind kind;
+		EPlayerInputAction action;
+	};
+
+	// Every input the player reacts to, registered once per component. Jump covers the double jump as well,
+	// the simulation decides which of the two a press is.
+	const SInputBinding InputBindings[] =
+	{
+		{ "moveforward", eKI_W,      EInputBindingKind::Button,     ePIA_MoveForward },
+		{ "moveback",    eKI_S,      EInputBindingKind::Button,     ePIA_MoveBack },
+		{ "moveright",   eKI_D,      EInputBindingKind::Button,     ePIA_MoveRight },
+		{ "moveleft",    eKI_A,      EInputBindingKind::Button,     ePIA_MoveLeft },
+		{ "sprint",      eKI_LShift, EInputBindingKind::Button,     ePIA_Sprint },
+		{ "jump",        eKI_Space,  EInputBindingKind::Button,     ePIA_Jump },
+		{ "crouch",      eKI_LCtrl,  EInputBindingKind::Button,     ePIA_Crouch },
+		{ "yaw",         eKI_MouseX, EInputBindingKind::MouseYaw,   ePIA_None },
+		{ "pitch",       eKI_MouseY, EInputBindingKind::MousePitch, ePIA_None },
+	};
+
+	// Carries whether the player is parked, clients hide parked players and drop them from their movement system as well
+	const EEntityAspects ParkedAspect = eEA_GameServerA;
+
+	// Difference in collider height that is not worth moving the collider for, in meters
+	const float ColliderHeightTolerance = 0.001f;
+
+	// Height of the collider center above the entity origin for the bottom of the collider to rest on it
+	float GetColliderHeight(const Cry::DefaultComponents::CCharacterControllerComponent::SPhysics& physParams)
+	{
+		float heightOffset = physParams.m_height * 0.5f;
+		if (physParams.m_bCapsule)
+		{
+			heightOffset = heightOffset * 0.5f + physParams.m_radius * 0.5f;
+		}
+		return 0.005f + heightOffset;
+	}
+
+	void SerializePlayerInput(TSerialize ser, SPlayerInput& input)
+	{
+		ser.Value("movementDelta", input.movementDelta);
+		ser.Value("mouseDeltaRotation", input.mouseDeltaRotation);
+		ser.Value("held", input.held);
+		ser.Value("pressed", input.pressed);
+		ser.Value("released", input.released);
+	}
 }
 
 CPlayerComponent::CPlayerComponent() :
-	m_pCameraComponent(nullptr),
-	m_pInputComponent(nullptr),
-	m_pCharacterController(nullptr),
-	m_pAdvancedAnimationComponent(nullptr),
-	m_currentYaw(IDENTITY),
-	m_currentPitch(0.f),
-	m_movementDelta(ZERO),
-	m_mouseDeltaRotation(ZERO),
-	m_currentPlayerState(DEFAULT_STATE),
-	m_currentStance(DEFAULT_STANCE)
-	, m_desiredStance(DEFAULT_STANCE)
-	, m_cameraEndOffset(Vec3(0.f, 0.f, DEFAULT_CAMERA_HEIGHT_STANDING))
-	, m_cameraOffsetStanding(Vec3(0.f, 0.f, DEFAULT_CAMERA_HEIGHT_STANDING))
-	, m_cameraOffsetCrouching(Vec3(0.f, 0.f, DEFAULT_CAMERA_HEIGHT_CROUCHING))
-	, m_capsuleHeightStanding(DEFAULT_CAPSULE_HEIGHT_STANDING)
-	, m_capsuleHeightCrouching(DEFAULT_CAPSULE_HEIGHT_CROUCHING)
-	, m_capsuleGroundOffset(DEFAULT_CAPSULE_GROUND_OFFSET),
-	m_wallrunFOV(DEFAULT_WALLRUN_FOV),
-	m_FOV(DEFAULT_PLAYER_FOV),
-	m_rotationSpeed(DEFAULT_ROTATION_SPEED),
-	m_walkSpeed(DEFAULT_SPEED_WALKING),
-	m_runSpeed(DEFAULT_SPEED_RUNNING),
-	m_jumpheight(DEFAULT_JUMP_ENERGY),
-	m_walljumpside(DEFAULT_WALLJUMP_SIDE_ENERGY),
-	m_walljumpheight(DEFAULT_WALLJUMP_HEIGHT_ENERGY),
-	m_doublejumpheight(DEFAULT_DOUBLE_JUMP_ENERGY),
-	m_rotationLimitsMaxPitch(DEFAULT_ROT_LIMIT_PITCH_MAX),
-	m_rotationLimitsMinPitch(DEFAULT_ROT_LIMIT_PITCH_MIN)
-
+	m_movementId(InvalidPlayerMovementId)
 {}
 
-void CPlayerComponent::Initialize()
+CPlayerComponent::~CPlayerComponent()
 {
-	m_pCameraComponent = m_pEntity->GetOrCreateComponent<Cry::DefaultComponents::CCameraComponent>();
-	m_pInputComponent = m_pEntity->GetOrCreateComponent<Cry::DefaultComponents::CInputComponent>();
-	m_pCharacterController = m_pEntity->GetOrCreateComponent<Cry::DefaultComponents::CCharacterControllerComponent>();
-	m_pAdvancedAnimationComponent = m_pEntity->GetOrCreateComponent<Cry::DefaultComponents::CAdvancedAnimationComponent>();
-
-	Reset();
+	if (CPlayerMovementSystem* pMovementSystem = CGamePlugin::GetInstance()->GetPlayerMovementSystem())
+	{
+		pMovementSystem->RemovePlayer(m_movementId);
+	}
 }
 
-void CPlayerComponent::Reset()
+void CPlayerComponent::Initialize()
 {
-	InitializeInput();
-
-	m_currentPlayerState = EPlayerState::Walking;
-	m_currentStance = EPlayerStance::Standing;
-	m_desiredStance = m_currentStance;
-
-	m_movementDelta = ZERO;
-	m_mouseDeltaRotation = ZERO;
-	m_currentYaw = Quat::CreateRotationZ(m_pEntity->GetWorldRotation().GetRotZ());
-	m_currentPitch = 0.f;
-
-	m_cameraEndOffset = m_cameraOffsetStanding;
-}
+	// The camera and input are created once the player turns out to be the local one, see UpdateLocalPlayer
+	m_pCharacterController = m_pEntity->GetOrCreateComponent<Cry::DefaultComponents::CCharacterControllerComponent>();
+	m_pAdvancedAnimationComponent = m_pEntity->GetOrCreateComponent<Cry::DefaultComponents::CAdvancedAnimationComponent>();
 
-void CPlayerComponent::RecenterCollider()
-{
-	static bool skip = false;
-	if (skip)
+	// The controller physicalizes as soon as it is created, before this component hears of PhysicalTypeChanged,
+	// so that physicalization is counted here and its collider moved in place. Later ones read the offset set by RecenterCollider.
+	if (m_pEntity->GetPhysicalEntity() != nullptr)
 	{
-		skip = false;
-		return;
+		if (CPlayerPool* pPlayerPool = CGamePlugin::GetInstance()->GetPlayerPool())
+		{
+			pPlayerPool->OnPlayerPhysicalized();
+		}
 	}
+	RecenterCollider();
 
-	auto pCharacterController = m_pEntity->GetComponent<Cry::DefaultComponents::CCharacterControllerComponent>();
-	if (pCharacterController == nullptr)
-	{
-		return;
-	}
-	const auto& physParams = pCharacterController->GetPhysicsParameters();
-	float heightOffset = physParams.m_height * 0.5f;
+	m_movementPhysics.Initialize(m_pEntity, m_pCharacterController);
+	m_pMovementProfile = &CGamePlugin::GetInstance()->GetMovementProfiles()->Get(m_movementProfileName.c_str());
+	m_movementId = CGamePlugin::GetInstance()->GetPlayerMovementSystem()->AddPlayer(*m_pEntity, m_pMovementProfile->params, m_movementPhysics);
 
-	if (physParams.m_bCapsule)
+	// Players waiting in the pool are kept off the network until they are first acquired
+	const CPlayerPool* pPlayerPool = CGamePlugin::GetInstance()->GetPlayerPool();
+	m_isPooled = pPlayerPool != nullptr && pPlayerPool->IsSpawning();
+	if (!m_isPooled)
 	{
-		heightOffset = heightOffset * 0.5f + physParams.m_radius * 0.5f;
+		m_pEntity->GetNetEntity()->BindToNetwork();
+		m_isBoundToNetwork = true;
 	}
 
-	pCharacterController->SetTransformMatrix(Matrix34(IDENTITY, Vec3(0.f, 0.f, 0.005f + heightOffset)));
-	skip = true;
-	pCharacterController->Physicalize();
+	// Unreliable, newer messages carry everything an older one would have
+	SRmi<RMI_WRAP(&CPlayerComponent::SvReceiveInput)>::Register(this, eRAT_NoAttach, false, eNRT_UnreliableUnordered);
+	SRmi<RMI_WRAP(&CPlayerComponent::ClReceiveSnapshots)>::Register(this, eRAT_NoAttach, false, eNRT_UnreliableUnordered);
 
+	Reset();
 }
 
-void CPlayerComponent::InitializeInput()
+void CPlayerComponent::Park()
 {
-	m_pInputComponent->RegisterAction("player", "moveforward", [this](int activationMode, float value) {m_movementDelta.y = value; m_isMovingForward = value > 0.0f; });
-	m_pInputComponent->BindAction("player", "moveforward", eAID_KeyboardMouse, eKI_W);
-
-	m_pInputComponent->RegisterAction("player", "moveback", [this](int activationMode, float value) {m_movementDelta.y = -value; });
-	m_pInputComponent->BindAction("player", "moveback", eAID_KeyboardMouse, eKI_S);
-
-	m_pInputComponent->RegisterAction("player", "moveright", [this](int activationMode, float value) {m_movementDelta.x = value; });
-	m_pInputComponent->BindAction("player", "moveright", eAID_KeyboardMouse, eKI_D);
+	if (m_isParked)
+		return;
 
-	m_pInputComponent->RegisterAction("player", "moveleft", [this](int activationMode, float value) {m_movementDelta.x = -value; });
-	m_pInputComponent->BindAction("player", "moveleft", eAID_KeyboardMouse, eKI_A);
+	CGamePlugin::GetInstance()->GetPlayerMovementSystem()->RemovePlayer(m_movementId);
+	m_movementId = InvalidPlayerMovementId;
+	m_isParked = true;
 
-	m_pInputComponent->RegisterAction("player", "sprint", [this](int activationMode, float value)
-		{
-			if (activationMode == (int)eAAM_OnPress && m_currentStance == EPlayerStance::Standing)
-			{
-				m_currentPlayerState = EPlayerState::Sprinting;
-			}
-			else if (activationMode == eAAM_OnRelease)
-			{
-				m_currentPlayerState = EPlayerState::Walking;
-			}
-		});
-	m_pInputComponent->BindAction("player", "sprint", eAID_KeyboardMouse, eKI_LShift);
+	m_pEntity->Hide(true);
+	// Suspends the physical entity instead of destroying it, enabling it again is cheaper than physicalizing
+	m_pEntity->EnablePhysics(false);
+	MarkParkedDirty();
+}
 
-	m_pInputComponent->RegisterAction("player", "jump", [this](int activationMode, float value)
-		{
-			if (activationMode == eAAM_OnPress && canJump)
-			{
-				if (wallrunning)
-				{
-					canWallrun = false;
-					m_wallrunTimer = 0.0f;
-					Vec3 forceApply = (Vec3(0.0f, 0.0f, m_walljumpheight)) + m_wallNormal * m_walljumpside;
-					m_pCharacterController->AddVelocity(forceApply);
-				}
-				else {
-					m_pCharacterController->AddVelocity(Vec3(0.0f, 0.0f, m_jumpheight));
-				}
-			}
+void CPlayerComponent::Respawn(const Vec3& position, const Quat& rotation)
+{
+	Unpark();
 
-		});
-	m_pInputComponent->BindAction("player", "jump", eAID_KeyboardMouse, eKI_Space);
+	m_pEntity->SetPosRotScale(position, rotation, Vec3(1.f));
+	m_movementPhysics.SetVelocity(ZERO);
+	Reset();
 
-	m_pInputComponent->RegisterAction("player", "double_jump", [this](int activationMode, float value)
-		{
-			if (activationMode == eAAM_OnPress && !m_pCharacterController->IsOnGround() && !wallrunning && canDoubleJump)
-			{
-				Vec3 currentVelocity = m_pCharacterController->GetVelocity();
-				Vec3 desiredVelocity = Vec3(0.0f, 0.0f, abs(currentVelocity.z) + m_doublejumpheight);
-				m_pCharacterController->AddVelocity(desiredVelocity);
-				canDoubleJump = false;
-			}
+	// Bound once it is in place and unparked, the entity reaches clients in the state it is played in
+	if (!m_isBoundToNetwork)
+	{
+		m_pEntity->GetNetEntity()->BindToNetwork();
+		m_isBoundToNetwork = true;
+	}
+}
 
-		});
-	m_pInputComponent->BindAction("player", "double_jump", eAID_KeyboardMouse, eKI_Space);
+void CPlayerComponent::Unpark()
+{
+	if (!m_isParked)
+		return;
 
-	m_pInputComponent->RegisterAction("player", "crouch", [this](int activationMode, float value)
-		{
-			if (m_pCharacterController->IsOnGround() && activationMode == eAAM_OnPress)
-			{
-				m_desiredStance = EPlayerStance::Crouching;
-				m_currentPlayerState = EPlayerState::Walking;
-			}
-			else if (activationMode == (int)eAAM_OnRelease)
-			{
-				m_desiredStance = EPlayerStance::Standing;
-			}
+	m_pEntity->Hide(false);
+	m_pEntity->EnablePhysics(true);
+	m_movementId = CGamePlugin::GetInstance()->GetPlayerMovementSystem()->AddPlayer(*m_pEntity, m_pMovementProfile->params, m_movementPhysics);
+	m_isParked = false;
+	MarkParkedDirty();
+}
 
-		});
-	m_pInputComponent->BindAction("player", "crouch", eAID_KeyboardMouse, eKI_LCtrl);
+void CPlayerComponent::MarkParkedDirty()
+{
+	if (gEnv->bServer && m_isBoundToNetwork)
+	{
+		m_pEntity->GetNetEntity()->MarkAspectsDirty(ParkedAspect);
+	}
+}
 
-	m_pInputComponent->RegisterAction("player", "yaw", [this](int activationMode, float value) {m_mouseDeltaRotation.y = -value; });
-	m_pInputComponent->BindAction("player", "yaw", eAID_KeyboardMouse, eKI_MouseY);
+void CPlayerComponent::Reset()
+{
+	// The profile property may have been changed in the editor, edits to the profile itself reach the player without a reset
+	m_pMovementProfile = &CGamePlugin::GetInstance()->GetMovementProfiles()->Get(m_movementProfileName.c_str());
+	if (m_isParked)
+		return;
 
-	m_pInputComponent->RegisterAction("player", "pitch", [this](int activationMode, float value) {m_mouseDeltaRotation.x = -value; });
-	m_pInputComponent->BindAction("player", "pitch", eAID_KeyboardMouse, eKI_MouseX);
+	CGamePlugin::GetInstance()->GetPlayerMovementSystem()->SetMovementParams(m_movementId, m_pMovementProfile->params);
+	CGamePlugin::GetInstance()->GetPlayerMovementSystem()->ResetPlayer(m_movementId, m_pEntity->GetWorldRotation().GetRotZ());
+	UpdateNetworkRole();
 }
 
-Cry::Entity::EventFlags CPlayerComponent::GetEventMask() const
+bool CPlayerComponent::IsLocalPlayer() const
 {
-	return Cry::Entity::EEvent::GameplayStarted | Cry::Entity::EEvent::Update | Cry::Entity::EEvent::Reset | Cry::Entity::EEvent::EditorPropertyChanged | Cry::Entity::EEvent::PhysicalTypeChanged;
+	if (!gEnv->bServer)
+		return m_hasClientAuthority;
+
+	// A dedicated server has nobody playing on it
+	return !gEnv->IsDedicated() && !m_isPooled;
 }
 
-void CPlayerComponent::ProcessEvent(const SEntityEvent& event)
+void CPlayerComponent::UpdateLocalPlayer()
 {
-	switch (event.event)
-	{
-	case Cry::Entity::EEvent::GameplayStarted:
+	const bool isLocalPlayer = IsLocalPlayer();
+	const uint32 flags = m_pEntity->GetFlags();
+	const uint32 localFlags = isLocalPlayer ? flags | ENTITY_FLAG_LOCAL_PLAYER : flags & ~ENTITY_FLAG_LOCAL_PLAYER;
+	if (localFlags != flags)
 	{
-		Reset();
+		m_pEntity->SetFlags(localFlags);
 	}
-	break;
-	case Cry::Entity::EEvent::Update:
-	{
-		frametime = event.fParam[0];
-
-		TryUpdateStance();
-		UpdateMovement();
-		UpdateRotation();
-		UpdateCamera(frametime);
-		onGroundCollision();
-		IsWall();
-		TransitionFOV();
-	}break;
 
-	case Cry::Entity::EEvent::PhysicalTypeChanged:
+	// A camera takes over the view when it is created, and every input component hears the local keyboard
+	if (isLocalPlayer && m_pCameraComponent == nullptr)
 	{
-		RecenterCollider();
-	} break;
-
-	case Cry::Entity::EEvent::EditorPropertyChanged:
-	case Cry::Entity::EEvent::Reset:
+		m_pCameraComponent = m_pEntity->GetOrCreateComponent<Cry::DefaultComponents::CCameraComponent>();
+		m_pInputComponent = m_pEntity->GetOrCreateComponent<Cry::DefaultComponents::CInputComponent>();
+		InitializeInput();
+	}
+	else if (!isLocalPlayer && m_pCameraComponent != nullptr)
 	{
-		Reset();
-	} break;
-
+		m_pEntity->RemoveComponent(m_pInputComponent);
+		m_pEntity->RemoveComponent(m_pCameraComponent);
+		m_pInputComponent = nullptr;
+		m_pCameraComponent = nullptr;
+		// Keys held when control moved elsewhere must not stay held
+		GetMovementInput() = SPlayerInput();
 	}
+
+	// The movement system forgets the camera whenever the player is parked
+	CGamePlugin::GetInstance()->GetPlayerMovementSystem()->SetCamera(m_movementId, m_pCameraComponent);
 }
 
-void CPlayerComponent::TryUpdateStance()
+void CPlayerComponent::UpdateNetworkRole()
 {
-	if (m_desiredStance == m_currentStance)
+	if (m_isParked)
 		return;
 
-	IPhysicalEntity* pPhysEnt = m_pEntity->GetPhysicalEntity();
-
-	if (pPhysEnt == nullptr)
-		return;
+	UpdateLocalPlayer();
 
-	const float radius = m_pCharacterController->GetPhysicsParameters().m_radius * 0.5f;
+	// Predicted on the client playing it, the server simulates it from that client's input
+	const bool isLocalPlayer = IsLocalPlayer();
+	INetEntity* pNetEntity = m_pEntity->GetNetEntity();
 
-	float height = 0.f;
-	Vec3 camOffset = ZERO;
-	switch (m_desiredStance)
-	{
-	case EPlayerStance::Crouching:
+	EPlayerNetRole role = EPlayerNetRole::Authority;
+	if (gEnv->bServer)
 	{
-		height = m_capsuleHeightCrouching;
-		camOffset = m_cameraOffsetCrouching;
-	} break;
-
-	case EPlayerStance::Standing:
+		// Players without a channel are spawned by the server itself, e.g. bots
+		const bool isRemotelyOwned = !isLocalPlayer && pNetEntity != nullptr && pNetEntity->GetChannelId() != 0;
+		role = isRemotelyOwned ? EPlayerNetRole::RemoteAuthority : EPlayerNetRole::Authority;
+	}
+	else
 	{
-		height = m_capsuleHeightStanding;
-		camOffset = m_cameraOffsetStanding;
-
-		primitives::capsule capsule;
-
-		capsule.axis.Set(0, 0, 1);
-
-		capsule.center = m_pEntity->GetWorldPos() + Vec3(0, 0, m_capsuleGroundOffset + radius + height * 0.5f);
-		capsule.r = radius;
-		capsule.hh = height * 0.5f;
-
-		if (IsCapsuleIntersectingGeometry(capsule))
-		{
-			return;
-		}
-	}break;
+		role = isLocalPlayer ? EPlayerNetRole::Predicted : EPlayerNetRole::Proxy;
 	}
-	pe_player_dimensions playerDimensions;
-	pPhysEnt->GetParams(&playerDimensions);
-
-	playerDimensions.heightCollider = m_capsuleGroundOffset + radius + height * 0.5f;
-	playerDimensions.sizeCollider = Vec3(radius, radius, height * 0.5f);
-	m_cameraEndOffset = camOffset;
-	m_currentStance = m_desiredStance;
 
-	pPhysEnt->SetParams(&playerDimensions);
+	// The editor game runs without a network session
+	IPlayerMovementTransport* pTransport = gEnv->IsEditor() ? nullptr : this;
+	CGamePlugin::GetInstance()->GetPlayerMovementSystem()->SetNetworkRole(m_movementId, role, pTransport);
 }
 
-bool CPlayerComponent::IsCapsuleIntersectingGeometry(const primitives::capsule& capsule) const
+void CPlayerComponent::SendInput(const SPlayerInputCommand* pCommands, uint32 count, uint32 snapshotAck)
 {
-	IPhysicalEntity* pPhysEnt = m_pEntity->GetPhysicalEntity();
+	SInputParams params;
+	params.snapshotAck = snapshotAck;
+	params.count = std::min(count, MaxInputCommandsPerPacket);
+	std::copy(pCommands, pCommands + params.count, params.commands.begin());
 
-	if (pPhysEnt == nullptr)
-		return false;
-
-	IPhysicalWorld::SPWIParams pwiParams;
-
-	pwiParams.itype = capsule.type;
-	pwiParams.pprim = &capsule;
-
-	pwiParams.pSkipEnts = &pPhysEnt;
-	pwiParams.nSkipEnts = 1;
-
-	intersection_params intersectionParams;
-	intersectionParams.bSweepTest = false;
-	pwiParams.pip = &intersectionParams;
-
-	const int contactCount = static_cast<int>(gEnv->pPhysicalWorld->PrimitiveWorldIntersection(pwiParams));
-	return contactCount > 0;
+	SRmi<RMI_WRAP(&CPlayerComponent::SvReceiveInput)>::InvokeOnServer(this, std::move(params));
 }
 
-void CPlayerComponent::IsWall()
+void CPlayerComponent::SendSnapshots(const uint8* pData, uint32 numBits)
 {
-	const float halfRenderWidth = static_cast<float>(gEnv->pRenderer->GetWidth()) * 0.5f;
-	const float halfRenderHeight = static_cast<float>(gEnv->pRenderer->GetHeight()) * 0.5f;
+	SSnapshotParams params;
+	params.numBits = std::min(numBits, MaxSnapshotPacketBytes * 8);
+	std::copy(pData, pData + (params.numBits + 7) / 8, params.data.begin());
 
-	const float searchRange = 0.5f;
-	Vec3 cameraCenterNear, cameraCenterFar;
-	gEnv->pRenderer->UnProjectFromScreen(halfRenderWidth, halfRenderHeight, 0, &cameraCenterNear.x, &cameraCenterNear.y, &cameraCenterNear.z);
-	gEnv->pRenderer->UnProjectFromScreen(halfRenderWidth, halfRenderHeight, 1, &cameraCenterFar.x, &cameraCenterFar.y, &cameraCenterFar.z);
+	SRmi<RMI_WRAP(&CPlayerComponent::ClReceiveSnapshots)>::InvokeOnClient(this, std::move(params), m_pEntity->GetNetEntity()->GetChannelId());
+}
 
-	// Calculate the left and right direction
-	Vec3 playerRightDir = m_pEntity->GetRightDir().GetNormalized();
-	Vec3 checkLeft = -playerRightDir * searchRange;
-	Vec3 checkRight = playerRightDir * searchRange;
+bool CPlayerComponent::SvReceiveInput(SInputParams&& params, INetChannel* pNetChannel)
+{
+	// Only the client owning the player gets to drive it
+	if (gEnv->pGameFramework->GetGameChannelId(pNetChannel) != m_pEntity->GetNetEntity()->GetChannelId())
+		return false;
 
-	std::array<ray_hit, 1> left_hits;
-	std::array<ray_hit, 1> right_hits;
-	const uint32 queryFlags = ent_static;
-	const uint32 rayFlags = rwi_stop_at_pierceable;
+	CGamePlugin::GetInstance()->GetPlayerMovementSystem()->ReceiveInput(m_movementId, params.commands.data(), params.count, params.snapshotAck);
+	return true;
+}
 
-	IPhysicalEntity* playerEntity = m_pEntity->GetPhysicalEntity();
+bool CPlayerComponent::ClReceiveSnapshots(SSnapshotParams&& params, INetChannel* pNetChannel)
+{
+	CGamePlugin::GetInstance()->GetPlayerMovementSystem()->ReceiveSnapshots(params.data.data(), params.numBits);
+	return true;
+}
 
+void CPlayerComponent::SInputParams::SerializeWith(TSerialize ser)
+{
+	ser.Value("snapshotAck", snapshotAck);
+	ser.Value("count", count);
+	count = std::min(count, MaxInputCommandsPerPacket);
 
-	// Exclude the player entity from the raycast query
-	const int numHitsLeft = gEnv->pPhysicalWorld->RayWorldIntersection(cameraCenterNear, checkLeft, queryFlags, rayFlags, left_hits.data(), left_hits.max_size(), m_pEntity->GetPhysicalEntity());
-	const int numHitsRight = gEnv->pPhysicalWorld->RayWorldIntersection(cameraCenterNear, checkRight, queryFlags, rayFlags, right_hits.data(), right_hits.max_size(), m_pEntity->GetPhysicalEntity());
+	for (uint32 i = 0; i < count; ++i)
+	{
+		ser.Value("sequence", commands[i].sequence);
+		SerializePlayerInput(ser, commands[i].input);
+	}
+}
 
+void CPlayerComponent::SSnapshotParams::SerializeWith(TSerialize ser)
+{
+	ser.Value("numBits", numBits);
+	numBits = std::min(numBits, MaxSnapshotPacketBytes * 8);
 
-	if (numHitsLeft > 0)
+	for (uint32 i = 0, numBytes = (numBits + 7) / 8; i < numBytes; ++i)
 	{
-		const ray_hit& left_hit = left_hits[0];
-		IPhysicalEntity* pCollider = left_hit.pCollider;
-		IEntity* pEntity = gEnv->pEntitySystem->GetEntityFromPhysics(pCollider);
-
-		if (pEntity)
-		{
-			if (!m_pCharacterController->IsOnGround() && m_isMovingForward && canWallrun)
-			{
-				wallrunning = true;
+		ser.Value("data", data[i]);
+	}
+}
 
-				m_wallNormal = left_hit.n;
+SPlayerInput& CPlayerComponent::GetMovementInput()
+{
+	if (m_isParked)
+		return m_parkedInput;
 
-				m_desiredFOV = m_wallrunFOV;
-				m_wallrunYaw = 0.3f;
+	return CGamePlugin::GetInstance()->GetPlayerMovementSystem()->GetInput(m_movementId);
+}
 
-				Vec3 surfaceNormal = left_hit.n;
-				Vec3 upwardDirection(0.0f, 0.0f, 1.0f);
-				Vec3 surfaceForward = surfaceNormal.Cross(upwardDirection);
+void CPlayerComponent::RecenterCollider()
+{
+	if (m_isRecenteringCollider)
+		return;
 
-				Vec3 wallForce = -surfaceNormal * 2.0f;
-				Vec3 desiredVelocity = (-surfaceForward.GetNormalized() * m_runSpeed) + wallForce;
+	// Also called from PhysicalTypeChanged while the controller is still being created
+	auto pCharacterController = m_pEntity->GetComponent<Cry::DefaultComponents::CCharacterControllerComponent>();
+	if (pCharacterController == nullptr)
+		return;
 
-				pe_action_set_velocity setVelocityAction;
-				setVelocityAction.v = desiredVelocity;
-				playerEntity->Action(&setVelocityAction);
+	const float colliderHeight = GetColliderHeight(pCharacterController->GetPhysicsParameters());
+	m_isRecenteringCollider = true;
 
-				pe_player_dynamics playerDynamics;
-				playerEntity->GetParams(&playerDynamics);
-				playerDynamics.gravity = Vec3(0.0f, 0.0f, 0.0f);  // Disable gravity
-				playerEntity->SetParams(&playerDynamics);
-			}
-		}
+	// For the physicalizations to come, e.g. after the physics parameters were edited
+	if (fabsf(pCharacterController->GetTransformMatrix().GetTranslation().z - colliderHeight) > ColliderHeightTolerance)
+	{
+		pCharacterController->SetTransformMatrix(Matrix34(IDENTITY, Vec3(0.f, 0.f, colliderHeight)));
 	}
 
-	else if (numHitsRight > 0)
+	// The collider offset is a living entity parameter, so the one physicalized already is moved in place
+	IPhysicalEntity* pPhysicalEntity = m_pEntity->GetPhysicalEntity();
+	pe_player_dimensions dimensions;
+	if (pPhysicalEntity != nullptr && pPhysicalEntity->GetParams(&dimensions) && fabsf(dimensions.heightCollider - colliderHeight) > ColliderHeightTolerance)
 	{
-		const ray_hit& right_hit = right_hits[0];
-		IPhysicalEntity* pCollider = right_hit.pCollider;
-		IEntity* pEntity = gEnv->pEntitySystem->GetEntityFromPhysics(pCollider);
+		pe_player_dimensions recentered;
+		recentered.heightCollider = colliderHeight;
+		pPhysicalEntity->SetParams(&recentered);
 
-		if (pEntity)
+		if (CPlayerPool* pPlayerPool = CGamePlugin::GetInstance()->GetPlayerPool())
 		{
-			if (!m_pCharacterController->IsOnGround() && m_isMovingForward && canWallrun)
-			{
-				wallrunning = true;
-
-				m_wallNormal = right_hit.n;
-
-				m_desiredFOV = m_wallrunFOV;
-				m_wallrunYaw = -0.3f;
-
-				Vec3 surfaceNormal = right_hit.n;
-				Vec3 upwardDirection(0.0f, 0.0f, 1.0f);
-				Vec3 surfaceForward = surfaceNormal.Cross(upwardDirection);
-
-				Vec3 wallForce = -surfaceNormal * 2.0f;
-				Vec3 desiredVelocity = (surfaceForward.GetNormalized() * m_runSpeed) + wallForce;
-
-				pe_action_set_velocity setVelocityAction;
-				setVelocityAction.v = desiredVelocity;
-				playerEntity->Action(&setVelocityAction);
-
-				pe_player_dynamics playerDynamics;
-				playerEntity->GetParams(&playerDynamics);
-				playerDynamics.gravity = Vec3(0.0f, 0.0f, 0.0f);  // Disable gravity
-				playerEntity->SetParams(&playerDynamics);
-			}
-		}
-	}
-	else {
-		wallrunning = false;
-		m_desiredFOV = m_FOV;
-		m_wallrunTimer += frametime;
-		if (m_wallrunTimer >= m_wallrunCooldown)
-		{
-			canWallrun = true;
+			pPlayerPool->OnColliderRecentered();
 		}
 	}
+
+	m_isRecenteringCollider = false;
 }
 
-void CPlayerComponent::TransitionFOV()
+void CPlayerComponent::InitializeInput()
 {
-	CryTransform::CAngle fovAngle = m_pCameraComponent->GetFieldOfView();
-
-	if (fovAngle != m_desiredFOV)
+	for (uint32 i = 0; i < CRY_ARRAY_COUNT(InputBindings); ++i)
 	{
-		float currentFOV = fovAngle.ToDegrees();
-		float desiredFOV = m_desiredFOV.ToDegrees();
-
-		float fovChange = FOV_CHANGE_RATE * frametime;
+		// Captures two words, std::function keeps that inline without allocating
+		m_pInputComponent->RegisterAction("player", InputBindings[i].szName, [this, i](int activationMode, float value) { OnInputAction(i, activationMode, value); });
+		m_pInputComponent->BindAction("player", InputBindings[i].szName, eAID_KeyboardMouse, InputBindings[i].keyId);
+	}
+}
 
-		fovChange = std::min(fovChange, std::abs(desiredFOV - currentFOV));
+void CPlayerComponent::OnInputAction(uint32 bindingIndex, int activationMode, float value)
+{
+	const SInputBinding& binding = InputBindings[bindingIndex];
+	SPlayerInput& input = GetMovementInput();
 
-		if (desiredFOV > currentFOV)
+	switch (binding.kind)
+	{
+	case EInputBindingKind::Button:
+		if (activationMode == eAAM_OnPress)
 		{
-			currentFOV += fovChange;
+			input.SetHeld(binding.action, true);
 		}
-		else
+		else if (activationMode == eAAM_OnRelease)
 		{
-			currentFOV -= fovChange;
+			input.SetHeld(binding.action, false);
 		}
-
-		CryTransform::CAngle newFOV = CryTransform::CAngle::FromDegrees(currentFOV);
-		m_pCameraComponent->SetFieldOfView(newFOV);
+		input.UpdateMovementDelta();
+		break;
+
+	// Mouse deltas add up until a movement tick consumes them
+	case EInputBindingKind::MouseYaw:
+		input.mouseDeltaRotation.x -= value;
+		break;
+	case EInputBindingKind::MousePitch:
+		input.mouseDeltaRotation.y -= value;
+		break;
 	}
 }
 
-void CPlayerComponent::onGroundCollision()
+bool CPlayerComponent::NetSerialize(TSerialize ser, EEntityAspects aspect, uint8 profile, int flags)
 {
-	if (m_pCharacterController->IsOnGround() or wallrunning) {
-		canJump = true;
-		canDoubleJump = true;
-	}
-	else if (!m_pCharacterController->IsOnGround() && !wallrunning) {
-		canJump = false;
-	}
+	if (aspect == ParkedAspect)
+	{
+		bool isParked = m_isParked;
+		ser.Value("parked", isParked, 'bool');
 
+		// The server parks and respawns, clients follow. The position arrives with the snapshots.
+		if (ser.IsReading() && isParked != m_isParked)
+		{
+			if (isParked)
+			{
+				Park();
+			}
+			else
+			{
+				Unpark();
+				Reset();
+			}
+		}
+	}
+	return true;
 }
 
-
-void CPlayerComponent::UpdateMovement()
+NetworkAspectType CPlayerComponent::GetNetSerializeAspectMask() const
 {
-	Vec3 velocity = Vec3(m_movementDelta.x, m_movementDelta.y, 0.0f);
-	velocity.Normalize();
-	const float playerMoveSpeed = m_currentPlayerState == EPlayerState::Sprinting ? m_runSpeed : m_walkSpeed;
-	m_pCharacterController->SetVelocity(m_pEntity->GetWorldRotation() * velocity * playerMoveSpeed);
+	return ParkedAspect;
 }
 
-void CPlayerComponent::UpdateRotation()
+Cry::Entity::EventFlags CPlayerComponent::GetEventMask() const
 {
-	m_currentYaw *= Quat::CreateRotationZ(m_mouseDeltaRotation.x * m_rotationSpeed);
-	m_pEntity->SetRotation(m_currentYaw);
+	return Cry::Entity::EEvent::GameplayStarted | Cry::Entity::EEvent::Reset | Cry::Entity::EEvent::EditorPropertyChanged | Cry::Entity::EEvent::PhysicalTypeChanged | Cry::Entity::EEvent::SetAuthority;
 }
 
-void CPlayerComponent::UpdateCamera(float frametime)
+void CPlayerComponent::ProcessEvent(const SEntityEvent& event)
 {
-	m_currentPitch = crymath::clamp(m_currentPitch + m_mouseDeltaRotation.y * m_rotationSpeed, m_rotationLimitsMinPitch, m_rotationLimitsMaxPitch);
-
-	Vec3 currentCameraOffset = m_pCameraComponent->GetTransformMatrix().GetTranslation();
-
-	currentCameraOffset = Vec3::CreateLerp(currentCameraOffset, m_cameraEndOffset, 10.0f * frametime);
-	Matrix34 finalCamMatrix;
-
-	finalCamMatrix.SetTranslation(currentCameraOffset);
-
-	const float yawChangeSpeed = 2.0f;
-
-	if (wallrunning)
+	switch (event.event)
 	{
-
-		if (m_yaw < m_wallrunYaw && m_wallrunYaw > 0)
-		{
-			m_yaw = std::min(m_yaw + yawChangeSpeed * frametime, m_wallrunYaw);
-		}
-		else if (m_yaw > m_wallrunYaw && m_wallrunYaw < 0)
-		{
-			m_yaw = std::max(m_yaw - yawChangeSpeed * frametime, m_wallrunYaw);
-		}
+	case Cry::Entity::EEvent::GameplayStarted:
+	{
+		Reset();
 	}
-	else {
-		if (m_wallrunYaw > 0)
-		{
-			m_yaw = std::max(m_yaw - yawChangeSpeed * frametime, 0.0f);
-		}
-		else if (m_wallrunYaw < 0)
+	break;
+	case Cry::Entity::EEvent::PhysicalTypeChanged:
+	{
+		if (CPlayerPool* pPlayerPool = CGamePlugin::GetInstance()->GetPlayerPool())
 		{
-			m_yaw = std::min(m_yaw + yawChangeSpeed * frametime, 0.0f);
+			pPlayerPool->OnPlayerPhysicalized();
 		}
-	}
-	Quat yawRotation = Quat::CreateRotationY(m_yaw);
-	Quat pitchRotation = Quat::CreateRotationX(m_currentPitch);
+		RecenterCollider();
+		CGamePlugin::GetInstance()->GetPlayerMovementSystem()->InvalidatePhysics(m_movementId);
+	} break;
+
+	case Cry::Entity::EEvent::SetAuthority:
+	{
+		// Sent on the client taking over the player and on the one losing it
+		m_hasClientAuthority = event.nParam[0] != 0;
+		UpdateNetworkRole();
+	} break;
 
-	Quat combinedRotation = yawRotation * pitchRotation;
+	case Cry::Entity::EEvent::EditorPropertyChanged:
+	case Cry::Entity::EEvent::Reset:
+	{
+		Reset();
+	} break;
 
-	finalCamMatrix.SetRotation33(Matrix33(combinedRotation));
-	m_pCameraComponent->SetTransformMatrix(finalCamMatrix);
+	}
 }
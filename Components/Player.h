@@ -1,9 +1,12 @@
 // Copyright 2017-2019 Crytek GmbH / Crytek Group. All rights reserved.
 #pragma once
-namespace primitives
-{
-	struct capsule;
-}
+
+#include "Systems/PlayerMovementSystem.h"
+#include "Systems/MovementProfileLibrary.h"
+#include "PlayerMovementPhysics.h"
+
+#include <CrySchematyc/Utils/SharedString.h>
+
 namespace Cry::DefaultComponents
 {
 	class CCameraComponent;
@@ -14,140 +17,115 @@ namespace Cry::DefaultComponents
 
 ////////////////////////////////////////////////////////
 // Represents a player participating in gameplay
+// In multiplayer the owning client predicts its own movement and sends its input to the server,
+// which simulates the player and answers with snapshots (see CPlayerMovementSystem).
 ////////////////////////////////////////////////////////
-class CPlayerComponent final : public IEntityComponent
+class CPlayerComponent final
+	: public IEntityComponent
+	, public IPlayerMovementTransport
 {
 public:
-	enum class EPlayerState
-	{
-		Walking,
-		Sprinting
-	};
-	enum class EPlayerStance
-	{
-		Standing,
-		Crouching
-	};
-
-private:
-	static constexpr float DEFAULT_SPEED_WALKING = 3;
-	static constexpr float DEFAULT_SPEED_RUNNING = 6;
-	static constexpr float DEFAULT_JUMP_ENERGY = 4;
-	static constexpr float DEFAULT_WALLJUMP_SIDE_ENERGY = 5;
-	static constexpr float DEFAULT_WALLJUMP_HEIGHT_ENERGY = 4;
-	static constexpr float DEFAULT_DOUBLE_JUMP_ENERGY = 6;
-	static constexpr float DEFAULT_ROTATION_SPEED = 0.002;
-	static constexpr float DEFAULT_CAMERA_HEIGHT_CROUCHING = 1.0;
-	static constexpr float DEFAULT_CAPSULE_HEIGHT_CROUCHING = 0.75;
-	static constexpr float DEFAULT_CAPSULE_HEIGHT_STANDING = 1.7;
-	static constexpr float DEFAULT_CAPSULE_GROUND_OFFSET = 0.2;
-	static constexpr CryTransform::CAngle DEFAULT_WALLRUN_FOV = CryTransform::CAngle::FromDegrees(75.0f);
-	static constexpr CryTransform::CAngle DEFAULT_PLAYER_FOV = CryTransform::CAngle::FromDegrees(65.0f);
-	static constexpr float DEFAULT_CAMERA_HEIGHT_STANDING = 1.7;
-	static constexpr float DEFAULT_ROT_LIMIT_PITCH_MAX = 1.5;
-	static constexpr float DEFAULT_ROT_LIMIT_PITCH_MIN = -1.5;
-	static constexpr EPlayerState DEFAULT_STATE = EPlayerState::Walking;
-	static constexpr EPlayerStance DEFAULT_STANCE = EPlayerStance::Standing;
+	using EPlayerState = ::EPlayerState;
+	using EPlayerStance = ::EPlayerStance;
 
-public:
 	CPlayerComponent();
-	virtual ~CPlayerComponent() override {};
+	virtual ~CPlayerComponent() override;
 
 	virtual void Initialize() override;
 
 	virtual Cry::Entity::EventFlags GetEventMask() const override;
 	virtual void ProcessEvent(const SEntityEvent& event) override;
+	virtual bool NetSerialize(TSerialize ser, EEntityAspects aspect, uint8 profile, int flags) override;
+	virtual NetworkAspectType GetNetSerializeAspectMask() const override;
+
+	// IPlayerMovementTransport
+	virtual void SendInput(const SPlayerInputCommand* pCommands, uint32 count, uint32 snapshotAck) override;
+	virtual void SendSnapshots(const uint8* pData, uint32 numBits) override;
+	// ~IPlayerMovementTransport
+
+	PlayerMovementId GetMovementId() const { return m_movementId; }
+
+	// Takes the player out of the game for CPlayerPool: hidden, physics suspended and out of the movement system
+	// The components and the physical entity stay, so Respawn does not have to create them again.
+	void Park();
+	// Puts the player back into the game at the given transform with a fresh movement state, parked or not
+	// A player spawned parked goes on the network here, so clients never hear of players that are only waiting in the pool.
+	void Respawn(const Vec3& position, const Quat& rotation);
+	bool IsParked() const { return m_isParked; }
+
 	// Reflect type to set a unique identifier for this component
 	static void ReflectType(Schematyc::CTypeDesc<CPlayerComponent>& desc)
 	{
 		desc.SetGUID("{63F4C0C6-32AF-4ACB-8FB0-57D45DD14725}"_cry_guid);
-		desc.AddMember(&CPlayerComponent::m_walkSpeed, 'pws', "playerwalkspeed", "Player Walk Speed", "Sets the Player Walk Speed", DEFAULT_SPEED_WALKING);
-		desc.AddMember(&CPlayerComponent::m_runSpeed, 'prs', "playerrunspeed", "Player Run Speed", "Sets the Players Run Speed", DEFAULT_SPEED_RUNNING);
-		desc.AddMember(&CPlayerComponent::m_doublejumpheight, 'djh', "playerdoublejumpheight", "Player Double Jump Height", "Sets the Players Jump Height", DEFAULT_DOUBLE_JUMP_ENERGY);
-		desc.AddMember(&CPlayerComponent::m_jumpheight, 'pjh', "playerjumpheight", "Player Jump Height", "Sets the Players Jump Height", DEFAULT_JUMP_ENERGY);
-		desc.AddMember(&CPlayerComponent::m_walljumpside, 'wjs', "playerwalljumpside", "Player Wall Jump Side Height", "Sets the Players Wall Jump Side Height", DEFAULT_WALLJUMP_SIDE_ENERGY);
-		desc.AddMember(&CPlayerComponent::m_walljumpheight, 'wjh', "playerwalljumpheight", "Player Wall Jump Height", "Sets the Players Wall Jump Height", DEFAULT_WALLJUMP_HEIGHT_ENERGY);
-
-		desc.AddMember(&CPlayerComponent::m_cameraOffsetCrouching, 'camc', "cameraoffsetcrouching", "Camera Crouching Offset", "Offset of the camera while crouching", Vec3(0.f, 0.f, DEFAULT_CAMERA_HEIGHT_CROUCHING));
-		desc.AddMember(&CPlayerComponent::m_cameraOffsetStanding, 'cams', "cameraoffsetstanding", "Camera Standing Offset", "Offset of the camera while standing", Vec3(0.f, 0.f, DEFAULT_CAMERA_HEIGHT_STANDING));
-		desc.AddMember(&CPlayerComponent::m_capsuleHeightCrouching, 'capc', "capsuleheightcrouching", "Capsule Crouching Height", "Height of collision capsule while crouching", DEFAULT_CAPSULE_HEIGHT_CROUCHING);
-		desc.AddMember(&CPlayerComponent::m_capsuleHeightStanding, 'caps', "capsuleheightstanding", "Capsule Standing Height", "Height of collision capsule while standing", DEFAULT_CAPSULE_HEIGHT_STANDING);
-		desc.AddMember(&CPlayerComponent::m_capsuleGroundOffset, 'capo', "capsulegroundoffset", "Capsule Ground Offset", "Offset of the capsule from the entity floor", DEFAULT_CAPSULE_GROUND_OFFSET);
-		desc.AddMember(&CPlayerComponent::m_wallrunFOV, 'wfov', "wallrunfov", "Player Wall Run FOV", "Player FOV when wall running", DEFAULT_WALLRUN_FOV);
-		desc.AddMember(&CPlayerComponent::m_FOV, 'fov', "playerfov", "Player FOV", "Player FOV", DEFAULT_PLAYER_FOV);
-		desc.AddMember(&CPlayerComponent::m_rotationSpeed, 'pros', "playerrotationspeed", "Player Rotation Speed", "Sets player rotation speed", DEFAULT_ROTATION_SPEED);
-		desc.AddMember(&CPlayerComponent::m_rotationLimitsMaxPitch, 'cpm', "camerapitchmax", "Camera Pitch Max", "Maximum Rotation Value for camera pitch", DEFAULT_ROT_LIMIT_PITCH_MAX);
-		desc.AddMember(&CPlayerComponent::m_rotationLimitsMinPitch, 'cpmi', "camerapitchmin", "Camera Pitch Min", "Minimum Rotation Value for camera pitch", -DEFAULT_ROT_LIMIT_PITCH_MIN);
+		desc.AddMember(&CPlayerComponent::m_movementProfileName, 'mpro', "movementprofile", "Movement Profile", "Name of the tuning profile in pl_movementProfiles the player moves with", Schematyc::CSharedString(CMovementProfileLibrary::DefaultProfileName));
 	}
 protected:
-	void Reset();
-	void RecenterCollider();
-	void InitializeInput();
-
+	struct SInputParams
+	{
+		void SerializeWith(TSerialize ser);
 
-	void UpdateMovement();
-	void UpdateRotation();
-	void UpdateCamera(float frametime);
-	void TryUpdateStance();
-	bool IsCapsuleIntersectingGeometry(const primitives::capsule& capsule) const;
-	void IsWall();
-	void TransitionFOV();
-	void onGroundCollision();
-	bool canDoubleJump = true;
-	bool canJump = true;
-	bool wallrunning = false;
-	bool m_isMovingForward = false;
-	bool canWallrun = false;
+		uint32 snapshotAck = 0;
+		uint32 count = 0;
+		std::array<SPlayerInputCommand, MaxInputCommandsPerPacket> commands;
+	};
 
+	// Bit-packed by CPlayerMovementSystem, carried as opaque bytes
+	struct SSnapshotParams
+	{
+		void SerializeWith(TSerialize ser);
 
+		uint32 numBits = 0;
+		std::array<uint8, MaxSnapshotPacketBytes> data;
+	};
 
-private:
-	Cry::DefaultComponents::CCameraComponent* m_pCameraComponent;
-	Cry::DefaultComponents::CInputComponent* m_pInputComponent;
-	Cry::DefaultComponents::CCharacterControllerComponent* m_pCharacterController;
-	Cry::DefaultComponents::CAdvancedAnimationComponent* m_pAdvancedAnimationComponent;
+	// Client to server, the owning client's unacknowledged input commands
+	bool SvReceiveInput(SInputParams&& params, INetChannel* pNetChannel);
+	// Server to the owning client, authoritative movement state of every player
+	bool ClReceiveSnapshots(SSnapshotParams&& params, INetChannel* pNetChannel);
 
+	void Reset();
+	// Shows the player, resumes its physics and adds it to the movement system again
+	void Unpark();
+	// Server: tells clients that know the player whether it is parked
+	void MarkParkedDirty();
+	// Whether this machine plays the player: on a client the one it was given authority over,
+	// on a listen server or in single player the one placed in the level rather than taken from the pool
+	bool IsLocalPlayer() const;
+	// Marks the entity with ENTITY_FLAG_LOCAL_PLAYER while it is the local player, which is what CPlayerMovementSystem goes by.
+	// Only the local player has a camera and reads the keyboard and mouse, they are created when it becomes local.
+	void UpdateLocalPlayer();
+	void UpdateNetworkRole();
+	// Lifts the collider so its bottom rests on the entity origin, by adjusting the living entity instead of physicalizing again
+	void RecenterCollider();
+	// Registers the input bindings, once per input component
+	void InitializeInput();
+	void OnInputAction(uint32 bindingIndex, int activationMode, float value);
+	// Input for the next movement tick, owned by CPlayerMovementSystem
+	SPlayerInput& GetMovementInput();
 
-	Quat m_lookOrientation;
+private:
+	// Local player only
+	Cry::DefaultComponents::CCameraComponent* m_pCameraComponent = nullptr;
+	Cry::DefaultComponents::CInputComponent* m_pInputComponent = nullptr;
+	Cry::DefaultComponents::CCharacterControllerComponent* m_pCharacterController = nullptr;
+	Cry::DefaultComponents::CAdvancedAnimationComponent* m_pAdvancedAnimationComponent = nullptr;
 
 	// Runtime Variables
-	Quat m_currentYaw;
-	float m_currentPitch;
-	Vec2 m_movementDelta;
-	Vec2 m_mouseDeltaRotation;
-	EPlayerState m_currentPlayerState;
-	EPlayerStance m_currentStance;
-	EPlayerStance m_desiredStance;
-	Vec3 m_cameraEndOffset;
+	PlayerMovementId m_movementId;
+	// Shared with every player using the same profile, owned by CMovementProfileLibrary
+	const SMovementProfile* m_pMovementProfile = nullptr;
+	CEntityMovementPhysics m_movementPhysics;
+	bool m_isParked = false;
+	bool m_isBoundToNetwork = false;
+	// Spawned by CPlayerPool for joining clients and bots
+	bool m_isPooled = false;
+	// Client: the server handed this machine authority over the player
+	bool m_hasClientAuthority = false;
+	// Set while RecenterCollider runs, PhysicalTypeChanged events it causes itself are ignored
+	bool m_isRecenteringCollider = false;
+	// Input actions still arrive while parked, they end up here
+	SPlayerInput m_parkedInput;
 
 	// Component Properties
-	float m_rotationSpeed;
-
-	Vec3 m_wallNormal;
-	Vec3 m_cameraOffsetStanding;
-	Vec3 m_cameraOffsetCrouching;
-	float m_capsuleHeightStanding;
-	float m_capsuleHeightCrouching;
-	float m_capsuleGroundOffset;
-
-	float FOV_CHANGE_RATE = 35.0f;
-	CryTransform::CAngle m_wallrunFOV;
-	CryTransform::CAngle m_FOV;
-	CryTransform::CAngle m_desiredFOV = m_FOV;
-
-	float frametime = 0.0f;
-	float m_wallrunCooldown = 0.2f;
-	float m_wallrunTimer = 0.0f;
-	float m_wallrunYaw;
-	float m_yaw = 0.0f;
-
-	float m_walkSpeed;
-	float m_runSpeed;
-	float m_jumpheight;
-	float m_walljumpside;
-	float m_walljumpheight;
-	float m_doublejumpheight;
-
-	float m_rotationLimitsMinPitch;
-	float m_rotationLimitsMaxPitch;
-};
+	Schematyc::CSharedString m_movementProfileName = CMovementProfileLibrary::DefaultProfileName;
+};
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include "StdAfx.h"
+#include "PlayerMovementPhysics.h"
+#include "GamePlugin.h"
+
+#include <CryPhysics/physinterface.h>
+#include <CryEntitySystem/IEntitySystem.h>
+
+#include <DefaultComponents/Physics/CharacterControllerComponent.h>
+
+CEntityMovementPhysics::~CEntityMovementPhysics()
+{
+	if (m_wallProbeHandle != CWallProbeService::InvalidHandle)
+	{
+		if (CWallProbeService* pWallProbeService = CGamePlugin::GetInstance()->GetWallProbeService())
+		{
+			pWallProbeService->Unregister(m_wallProbeHandle);
+		}
+	}
+}
+
+void CEntityMovementPhysics::Initialize(IEntity* pEntity, Cry::DefaultComponents::CCharacterControllerComponent* pCharacterController)
+{
+	m_pEntity = pEntity;
+	m_pCharacterController = pCharacterController;
+}
+
+SMovementBody CEntityMovementPhysics::GetBody() const
+{
+	SMovementBody body;
+	body.position = m_pEntity->GetWorldPos();
+	body.velocity = m_pCharacterController->GetVelocity();
+	body.colliderRadius = m_pCharacterController->GetPhysicsParameters().m_radius * 0.5f;
+	body.isOnGround = m_pCharacterController->IsOnGround();
+	body.isPhysicalized = m_pEntity->GetPhysicalEntity() != nullptr;
+	return body;
+}
+
+void CEntityMovementPhysics::ProbeWalls(const Vec3& origin, const Vec3& rightDir, float range, SWallProbeHit& leftHit, SWallProbeHit& rightHit)
+{
+	CWallProbeService* pWallProbeService = CGamePlugin::GetInstance()->GetWallProbeService();
+	if (pWallProbeService != nullptr && pWallProbeService->ProbeSurfaceIndex(origin, rightDir, range, leftHit, rightHit))
+		return;
+
+	if (pWallProbeService == nullptr || m_isReplaying)
+	{
+		leftHit = CWallProbeService::CastImmediate(origin, -rightDir * range, m_pEntity->GetPhysicalEntity());
+		rightHit = CWallProbeService::CastImmediate(origin, rightDir * range, m_pEntity->GetPhysicalEntity());
+		return;
+	}
+
+	if (m_wallProbeHandle == CWallProbeService::InvalidHandle)
+	{
+		m_wallProbeHandle = pWallProbeService->Register();
+	}
+
+	pWallProbeService->Probe(m_wallProbeHandle, origin, rightDir, range, m_pEntity->GetPhysicalEntity(), leftHit, rightHit);
+}
+
+float CEntityMovementPhysics::MeasureHeadroom(const Vec3& base, float radius, float maxRise)
+{
+	IPhysicalEntity* pPhysEnt = m_pEntity->GetPhysicalEntity();
+
+	if (pPhysEnt == nullptr)
+		return maxRise;
+
+	primitives::sphere sphere;
+	sphere.center = base;
+	sphere.r = radius;
+
+	IPhysicalWorld::SPWIParams pwiParams;
+
+	pwiParams.itype = sphere.type;
+	pwiParams.pprim = &sphere;
+	pwiParams.sweepDir = Vec3(0.f, 0.f, maxRise);
+
+	pwiParams.pSkipEnts = &pPhysEnt;
+	pwiParams.nSkipEnts = 1;
+
+	intersection_params intersectionParams;
+	intersectionParams.bSweepTest = true;
+	pwiParams.pip = &intersectionParams;
+
+	geom_contact* pContact = nullptr;
+	pwiParams.ppcontact = &pContact;
+
+	// For sweeps the result is the distance to the first contact, but 0 both when the sphere got all the way and when it
+	// already overlaps something at the start, only the contact tells the two apart. The lock keeps the contacts alive until we are done.
+	WriteLockCond lockContacts;
+	const float distance = gEnv->pPhysicalWorld->PrimitiveWorldIntersection(pwiParams, &lockContacts);
+	if (pContact == nullptr)
+		return maxRise;
+
+	return distance > 0.f ? std::min(distance, maxRise) : 0.f;
+}
+
+void CEntityMovementPhysics::RequestMoveVelocity(const Vec3& velocity)
+{
+	m_pCharacterController->SetVelocity(velocity);
+}
+
+void CEntityMovementPhysics::AddVelocity(const Vec3& velocity)
+{
+	m_pCharacterController->AddVelocity(velocity);
+}
+
+void CEntityMovementPhysics::SetVelocity(const Vec3& velocity)
+{
+	if (IPhysicalEntity* pPhysEnt = m_pEntity->GetPhysicalEntity())
+	{
+		pe_action_set_velocity setVelocityAction;
+		setVelocityAction.v = velocity;
+		pPhysEnt->Action(&setVelocityAction);
+	}
+}
+
+void CEntityMovementPhysics::SetGravityEnabled(bool enabled)
+{
+	if (IPhysicalEntity* pPhysEnt = m_pEntity->GetPhysicalEntity())
+	{
+		// Parameters start out unused, so only gravity is touched and no GetParams round-trip is needed
+		pe_player_dynamics playerDynamics;
+		playerDynamics.gravity = enabled ? gEnv->pPhysicalWorld->GetPhysVars()->gravity : Vec3(ZERO);
+		pPhysEnt->SetParams(&playerDynamics);
+	}
+}
+
+void CEntityMovementPhysics::SetColliderDimensions(float heightCollider, const Vec3& sizeCollider)
+{
+	if (IPhysicalEntity* pPhysEnt = m_pEntity->GetPhysicalEntity())
+	{
+		pe_player_dimensions playerDimensions;
+		playerDimensions.heightCollider = heightCollider;
+		playerDimensions.sizeCollider = sizeCollider;
+
+		pPhysEnt->SetParams(&playerDimensions);
+	}
+}
+
+void CEntityMovementPhysics::SetBodyState(const Vec3& position, const Vec3& velocity)
+{
+	m_pEntity->SetPos(position);
+	SetVelocity(velocity);
+}
+
+void CEntityMovementPhysics::StepBody(float dt)
+{
+	if (IPhysicalEntity* pPhysEnt = m_pEntity->GetPhysicalEntity())
+	{
+		pPhysEnt->DoStep(dt);
+	}
+}
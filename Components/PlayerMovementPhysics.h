@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Movement/IMovementPhysics.h"
+#include "Systems/WallProbeService.h"
+
+namespace Cry::DefaultComponents
+{
+	class CCharacterControllerComponent;
+}
+
+////////////////////////////////////////////////////////
+// Connects the movement simulation to the player's living entity in the physics world
+////////////////////////////////////////////////////////
+class CEntityMovementPhysics final : public IMovementPhysics
+{
+public:
+	CEntityMovementPhysics() = default;
+	~CEntityMovementPhysics();
+
+	void Initialize(IEntity* pEntity, Cry::DefaultComponents::CCharacterControllerComponent* pCharacterController);
+
+	// IMovementPhysics
+	virtual SMovementBody GetBody() const override;
+	virtual void ProbeWalls(const Vec3& origin, const Vec3& rightDir, float range, SWallProbeHit& leftHit, SWallProbeHit& rightHit) override;
+	virtual float MeasureHeadroom(const Vec3& base, float radius, float maxRise) override;
+	virtual void RequestMoveVelocity(const Vec3& velocity) override;
+	virtual void AddVelocity(const Vec3& velocity) override;
+	virtual void SetVelocity(const Vec3& velocity) override;
+	virtual void SetGravityEnabled(bool enabled) override;
+	virtual void SetColliderDimensions(float heightCollider, const Vec3& sizeCollider) override;
+	virtual void SetBodyState(const Vec3& position, const Vec3& velocity) override;
+	virtual void StepBody(float dt) override;
+	virtual void SetReplaying(bool isReplaying) override { m_isReplaying = isReplaying; }
+	// ~IMovementPhysics
+
+private:
+	IEntity* m_pEntity = nullptr;
+	Cry::DefaultComponents::CCharacterControllerComponent* m_pCharacterController = nullptr;
+	CWallProbeService::ProbeHandle m_wallProbeHandle = CWallProbeService::InvalidHandle;
+	bool m_isReplaying = false;
+};
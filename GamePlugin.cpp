@@ -1,6 +1,12 @@
 // Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
 #include "StdAfx.h"
 #include "GamePlugin.h"
+#include "Systems/MovementProfileLibrary.h"
+#include "Systems/WallProbeService.h"
+#include "Systems/PlayerMovementSystem.h"
+#include "Systems/ProjectileSystem.h"
+#include "Systems/PlayerPool.h"
+#include "Systems/BotLoadTest.h"
 
 #include <CrySchematyc/Env/IEnvRegistry.h>
 #include <CrySchematyc/Env/EnvPackage.h>
@@ -16,6 +22,13 @@ CGamePlugin::~CGamePlugin()
 {
 	gEnv->pSystem->GetISystemEventDispatcher()->RemoveListener(this);
 
+	m_pBotLoadTest.reset();
+	m_pPlayerPool.reset();
+	m_pProjectileSystem.reset();
+	m_pPlayerMovementSystem.reset();
+	m_pWallProbeService.reset();
+	m_pMovementProfiles.reset();
+
 	if (gEnv->pSchematyc)
 	{
 		gEnv->pSchematyc->GetEnvRegistry().DeregisterPackage(CGamePlugin::GetCID());
@@ -26,10 +39,37 @@ bool CGamePlugin::Initialize(SSystemGlobalEnvironment& env, const SSystemInitPar
 {
 	// Register for engine system events, in our case we need ESYSTEM_EVENT_GAME_POST_INIT to load the map
 	gEnv->pSystem->GetISystemEventDispatcher()->RegisterListener(this, "CGamePlugin");
+
+	m_pMovementProfiles = stl::make_unique<CMovementProfileLibrary>();
+	m_pPlayerMovementSystem = stl::make_unique<CPlayerMovementSystem>();
+	m_pProjectileSystem = stl::make_unique<CProjectileSystem>();
+	m_pPlayerPool = stl::make_unique<CPlayerPool>();
+	m_pBotLoadTest = stl::make_unique<CBotLoadTest>();
+
+	// Flush the batched wall probes before physics runs, so results are back for the next movement update
+	EnableUpdate(EUpdateStep::BeforePhysics, true);
+	EnableUpdate(EUpdateStep::MainUpdate, true);
 	
 	return true;
 }
 
+void CGamePlugin::UpdateBeforePhysics(float frameTime)
+{
+	if (m_pWallProbeService)
+	{
+		m_pWallProbeService->Flush(frameTime);
+	}
+}
+
+void CGamePlugin::MainUpdate(float frameTime)
+{
+	// Bot input has to be in place before the movement ticks of this frame consume it
+	m_pBotLoadTest->Update(frameTime);
+	m_pPlayerMovementSystem->Update(frameTime);
+	// Sweeps against the players where this frame's movement left them
+	m_pProjectileSystem->Update(frameTime);
+}
+
 void CGamePlugin::OnSystemEvent(ESystemEvent event, UINT_PTR wparam, UINT_PTR lparam)
 {
 	switch (event)
@@ -37,6 +77,9 @@ void CGamePlugin::OnSystemEvent(ESystemEvent event, UINT_PTR wparam, UINT_PTR lp
 		// Called when the game framework has initialized and we are ready for game logic to start
 		case ESYSTEM_EVENT_GAME_POST_INIT:
 		{
+			m_pWallProbeService = stl::make_unique<CWallProbeService>();
+			m_pMovementProfiles->Load();
+
 			// Don't need to load the map in editor
 			if (!gEnv->IsEditor())
 			{
@@ -70,8 +113,35 @@ void CGamePlugin::OnSystemEvent(ESystemEvent event, UINT_PTR wparam, UINT_PTR lp
 		}
 		break;
 		
+		// Sent after loading in the launcher and on every switch to game mode in the editor, where walls may have been moved
+		case ESYSTEM_EVENT_LEVEL_GAMEPLAY_START:
+		{
+			if (m_pWallProbeService)
+			{
+				m_pWallProbeService->BuildSurfaceIndex();
+			}
+			m_pPlayerMovementSystem->InvalidateEnvironment();
+
+			// Players are spawned by the server, pay for their entities and physics now instead of when they join.
+			// The editor removes whatever game mode spawned on leaving it, so there the pool only fills on demand.
+			if (gEnv->bServer && !gEnv->IsEditor())
+			{
+				m_pPlayerPool->Prewarm();
+			}
+		}
+		break;
+
 		case ESYSTEM_EVENT_LEVEL_UNLOAD:
 		{
+			m_pBotLoadTest->Stop();
+			m_pPlayerPool->Clear();
+			m_pProjectileSystem->Clear();
+
+			if (m_pWallProbeService)
+			{
+				m_pWallProbeService->Reset();
+				m_pWallProbeService->ReleaseSurfaceIndex();
+			}
 		}
 		break;
 	}
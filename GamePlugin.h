@@ -4,6 +4,13 @@
 #include <CrySystem/ICryPlugin.h>
 #include <CryEntitySystem/IEntityClass.h>
 
+class CMovementProfileLibrary;
+class CWallProbeService;
+class CPlayerMovementSystem;
+class CProjectileSystem;
+class CBotLoadTest;
+class CPlayerPool;
+
 
 // The entry-point of the application
 // An instance of CGamePlugin is automatically created when the library is loaded
@@ -21,6 +28,8 @@ public:
 	// Cry::IEnginePlugin
 	virtual const char* GetCategory() const override { return "Game"; }
 	virtual bool Initialize(SSystemGlobalEnvironment& env, const SSystemInitParams& initParams) override;
+	virtual void UpdateBeforePhysics(float frameTime) override;
+	virtual void MainUpdate(float frameTime) override;
 	// ~Cry::IEnginePlugin
 
 	// ISystemEventListener
@@ -34,5 +43,24 @@ public:
 		return cryinterface_cast<CGamePlugin>(CGamePlugin::s_factory.CreateClassInstance().get());
 	}
 
+	// Named movement tuning shared by the players using it
+	CMovementProfileLibrary* GetMovementProfiles() const { return m_pMovementProfiles.get(); }
+	// Shared batch of player wall probes, null until the game framework has initialized
+	CWallProbeService* GetWallProbeService() const { return m_pWallProbeService.get(); }
+	// Simulates the movement of all players, CPlayerComponent registers itself here
+	CPlayerMovementSystem* GetPlayerMovementSystem() const { return m_pPlayerMovementSystem.get(); }
+	// Pool of projectiles in flight, simulated together every frame
+	CProjectileSystem* GetProjectileSystem() const { return m_pProjectileSystem.get(); }
+	// Parked player entities handed out to joining and respawning players, server only
+	CPlayerPool* GetPlayerPool() const { return m_pPlayerPool.get(); }
+	// Spawns and drives bot players for pl_botLoadTest
+	CBotLoadTest* GetBotLoadTest() const { return m_pBotLoadTest.get(); }
+
 protected:
+	std::unique_ptr<CMovementProfileLibrary> m_pMovementProfiles;
+	std::unique_ptr<CWallProbeService> m_pWallProbeService;
+	std::unique_ptr<CPlayerMovementSystem> m_pPlayerMovementSystem;
+	std::unique_ptr<CProjectileSystem> m_pProjectileSystem;
+	std::unique_ptr<CPlayerPool> m_pPlayerPool;
+	std::unique_ptr<CBotLoadTest> m_pBotLoadTest;
 };
\ No newline at end of file
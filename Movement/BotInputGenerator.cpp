@@ -0,0 +1,172 @@
+#include "StdAfx.h"
+#include "BotInputGenerator.h"
+
+namespace
+{
+	// Fastest a bot turns, in radians per second
+	const float TurnRate = 4.f;
+	// Bots line up this far from the wall and this far before the target point, then run along it
+	const float WallLineUpDistance = 1.2f;
+	const float WallRunUpLength = 3.f;
+	// Angle into the wall of the run, so the side probe finds it after the jump
+	const float WallRunInAngle = 0.35f;
+	// Walls further away than this are not worth walking to
+	const float WallSearchRadius = 20.f;
+	const uint32 WallSearchSamples = 16;
+
+	float GetYaw(const Vec3& direction)
+	{
+		// Inverse of CPlayerMovementSimulation::GetBodyRotation applied to forward
+		return atan2f(-direction.x, direction.y);
+	}
+
+	float WrapAngle(float angle)
+	{
+		while (angle > gf_PI)
+		{
+			angle -= gf_PI2;
+		}
+		while (angle < -gf_PI)
+		{
+			angle += gf_PI2;
+		}
+		return angle;
+	}
+}
+
+CBotInputGenerator::CBotInputGenerator(uint32 seed)
+	: m_random(seed != 0 ? seed : 1)
+{
+}
+
+uint32 CBotInputGenerator::NextRandom()
+{
+	// xorshift32, same sequence on every platform
+	m_random ^= m_random << 13;
+	m_random ^= m_random >> 17;
+	m_random ^= m_random << 5;
+	return m_random;
+}
+
+void CBotInputGenerator::Update(const SView& view, const SMovementParams& params, const std::vector<SBotWallTarget>& walls, float dt, SPlayerInput& input)
+{
+	m_behaviorTimeLeft -= dt;
+	if (m_behaviorTimeLeft <= 0.f || (m_behavior == EBehavior::Wallrun && m_wallIndex >= static_cast<int>(walls.size())))
+	{
+		PickBehavior(view, walls);
+	}
+
+	bool wantsJump = false;
+	switch (m_behavior)
+	{
+	case EBehavior::Wander:
+	case EBehavior::Sprint:
+		// Now and then a new heading, about every two seconds
+		if (GetRandom(0.f, 1.f) < dt * 0.5f)
+		{
+			m_targetYaw = WrapAngle(m_targetYaw + GetRandom(-1.5f, 1.5f));
+		}
+		break;
+
+	case EBehavior::Hop:
+		// Short intervals end up as double jumps
+		m_jumpTimer -= dt;
+		if (m_jumpTimer <= 0.f)
+		{
+			wantsJump = true;
+			m_jumpTimer = GetRandom(0.3f, 1.2f);
+		}
+		break;
+
+	case EBehavior::Wallrun:
+		if (view.isWallrunning)
+		{
+			// Hold the run for a while, then jump off the wall and move on
+			m_jumpTimer -= dt;
+			if (m_jumpTimer <= 0.f)
+			{
+				wantsJump = true;
+				m_behaviorTimeLeft = std::min(m_behaviorTimeLeft, 0.5f);
+			}
+		}
+		else
+		{
+			const SBotWallTarget& wall = walls[m_wallIndex];
+			m_targetYaw = GetWallrunYaw(view, wall);
+
+			// Jump once past the line-up point, the run along the wall does the rest
+			const Vec3 tangent = wall.normal.Cross(Vec3(0.f, 0.f, 1.f)).GetNormalizedSafe(Vec3(1.f, 0.f, 0.f)) * m_wallDirection;
+			const Vec3 lineUp = wall.point + wall.normal * WallLineUpDistance - tangent * WallRunUpLength;
+			wantsJump = view.isOnGround && (view.position - lineUp).Dot(tangent) > 0.5f;
+		}
+		break;
+	}
+
+	// Turn towards the heading through the mouse, like a player would
+	const float turn = crymath::clamp(WrapAngle(m_targetYaw - view.yaw), -TurnRate * dt, TurnRate * dt);
+	input.mouseDeltaRotation = Vec2(params.rotationSpeed > 0.f ? turn / params.rotationSpeed : 0.f, 0.f);
+	input.movementDelta = Vec2(0.f, 1.f);
+	input.SetHeld(ePIA_MoveForward, true);
+	input.SetHeld(ePIA_Sprint, m_behavior != EBehavior::Wander);
+
+	// A jump is a press in one update and the release in the next
+	if (m_isJumpHeld)
+	{
+		input.SetHeld(ePIA_Jump, false);
+		m_isJumpHeld = false;
+	}
+	else if (wantsJump)
+	{
+		input.SetHeld(ePIA_Jump, true);
+		m_isJumpHeld = true;
+	}
+}
+
+void CBotInputGenerator::PickBehavior(const SView& view, const std::vector<SBotWallTarget>& walls)
+{
+	m_behaviorTimeLeft = GetRandom(2.f, 6.f);
+	m_targetYaw = WrapAngle(view.yaw + GetRandom(-1.f, 1.f));
+	m_wallIndex = -1;
+
+	const float roll = GetRandom(0.f, 1.f);
+	if (roll < 0.3f && !walls.empty())
+	{
+		// The closest of a few random walls, searching all of them per bot would not scale
+		float closestDistanceSq = WallSearchRadius * WallSearchRadius;
+		for (uint32 sample = 0; sample < WallSearchSamples; ++sample)
+		{
+			const int index = static_cast<int>(NextRandom() % walls.size());
+			const float distanceSq = walls[index].point.GetSquaredDistance2D(view.position);
+			if (distanceSq < closestDistanceSq)
+			{
+				closestDistanceSq = distanceSq;
+				m_wallIndex = index;
+			}
+		}
+
+		if (m_wallIndex >= 0)
+		{
+			m_behavior = EBehavior::Wallrun;
+			m_behaviorTimeLeft = 10.f;
+			m_wallDirection = (NextRandom() & 1) != 0 ? 1.f : -1.f;
+			m_jumpTimer = GetRandom(0.6f, 1.5f);
+			return;
+		}
+	}
+
+	m_behavior = roll < 0.55f ? EBehavior::Sprint : (roll < 0.8f ? EBehavior::Hop : EBehavior::Wander);
+	m_jumpTimer = GetRandom(0.3f, 1.2f);
+}
+
+float CBotInputGenerator::GetWallrunYaw(const SView& view, const SBotWallTarget& wall) const
+{
+	const Vec3 tangent = wall.normal.Cross(Vec3(0.f, 0.f, 1.f)).GetNormalizedSafe(Vec3(1.f, 0.f, 0.f)) * m_wallDirection;
+	const Vec3 lineUp = wall.point + wall.normal * WallLineUpDistance - tangent * WallRunUpLength;
+
+	Vec3 toLineUp = lineUp - view.position;
+	toLineUp.z = 0.f;
+	if ((view.position - lineUp).Dot(tangent) < 0.f && toLineUp.GetLengthSquared() > 1.f)
+		return GetYaw(toLineUp);
+
+	return GetYaw(tangent * cosf(WallRunInAngle) - wall.normal * sinf(WallRunInAngle));
+}
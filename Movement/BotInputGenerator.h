@@ -0,0 +1,65 @@
+#pragma once
+
+#include "PlayerMovement.h"
+
+#include <vector>
+
+// A wall bots can try to wallrun along, a point on it and the normal facing away from it
+struct SBotWallTarget
+{
+	Vec3 point = ZERO;
+	Vec3 normal = ZERO;
+};
+
+////////////////////////////////////////////////////////
+// Synthetic player input for load tests
+// Each bot switches between wandering, sprinting, hopping and running at a known wall to wallrun along it,
+// turning through the mouse delta like a player would. Runs from its own seed, so the same bots do the same
+// things every run as long as the world answers the same.
+////////////////////////////////////////////////////////
+class CBotInputGenerator
+{
+public:
+	enum class EBehavior : uint8
+	{
+		Wander,
+		Sprint,
+		Hop,
+		Wallrun,
+	};
+
+	// What the generator sees of its player
+	struct SView
+	{
+		Vec3 position = ZERO;
+		float yaw = 0.f;
+		bool isOnGround = true;
+		bool isWallrunning = false;
+	};
+
+	explicit CBotInputGenerator(uint32 seed = 1);
+
+	// Writes the input for the time until the next call, walls may be empty
+	void Update(const SView& view, const SMovementParams& params, const std::vector<SBotWallTarget>& walls, float dt, SPlayerInput& input);
+
+	EBehavior GetBehavior() const { return m_behavior; }
+
+private:
+	uint32 NextRandom();
+	float GetRandom(float min, float max) { return min + (max - min) * static_cast<float>(NextRandom() & 0xFFFFFF) / static_cast<float>(0xFFFFFF); }
+
+	void PickBehavior(const SView& view, const std::vector<SBotWallTarget>& walls);
+	// Heading of the run along the wall target, or of the way there while still too far
+	float GetWallrunYaw(const SView& view, const SBotWallTarget& wall) const;
+
+	uint32 m_random;
+	EBehavior m_behavior = EBehavior::Wander;
+	float m_behaviorTimeLeft = 0.f;
+	float m_targetYaw = 0.f;
+	// Counts down to the next jump press, and the release one tick after it
+	float m_jumpTimer = 0.f;
+	bool m_isJumpHeld = false;
+	int m_wallIndex = -1;
+	// Side of the wall target the bot runs along, +1 along normal x up
+	float m_wallDirection = 1.f;
+};
@@ -0,0 +1,174 @@
+#include "StdAfx.h"
+#include "HeadlessMovementPhysics.h"
+
+CHeadlessMovementPhysics::CHeadlessMovementPhysics(const SWorld& world, const Vec3& position)
+	: m_world(world)
+	, m_position(position)
+{
+}
+
+SMovementBody CHeadlessMovementPhysics::GetBody() const
+{
+	SMovementBody body;
+	body.position = m_position;
+	body.velocity = m_velocity;
+	body.colliderRadius = m_colliderRadius;
+	body.isOnGround = m_isOnGround;
+	body.isPhysicalized = true;
+	return body;
+}
+
+void CHeadlessMovementPhysics::ProbeWalls(const Vec3& origin, const Vec3& rightDir, float range, SWallProbeHit& leftHit, SWallProbeHit& rightHit)
+{
+	leftHit = CastRay(origin, -rightDir * range);
+	rightHit = CastRay(origin, rightDir * range);
+}
+
+float CHeadlessMovementPhysics::MeasureHeadroom(const Vec3& base, float radius, float maxRise)
+{
+	float clearance = maxRise;
+
+	for (const AABB& box : m_world.boxes)
+	{
+		// Only boxes reaching above the sphere center and closer than the radius sideways are in the way
+		const float dx = std::max(box.min.x - base.x, 0.f) + std::max(base.x - box.max.x, 0.f);
+		const float dy = std::max(box.min.y - base.y, 0.f) + std::max(base.y - box.max.y, 0.f);
+		const float sideDistanceSq = dx * dx + dy * dy;
+		if (box.max.z <= base.z || sideDistanceSq >= radius * radius)
+			continue;
+
+		// The sphere touches the bottom of the box where it is closest sideways
+		const float rise = box.min.z - base.z - sqrtf(radius * radius - sideDistanceSq);
+		clearance = std::min(clearance, std::max(rise, 0.f));
+	}
+
+	return clearance;
+}
+
+bool CHeadlessMovementPhysics::IsCapsuleBlocked(const Vec3& center, float radius, float halfHeight) const
+{
+	const float bottom = center.z - halfHeight;
+	const float top = center.z + halfHeight;
+
+	for (const AABB& box : m_world.boxes)
+	{
+		// Closest height on the capsule axis to the box, then a sphere test from there
+		const float z = crymath::clamp(crymath::clamp(center.z, box.min.z, box.max.z), bottom, top);
+		const Vec3 point(center.x, center.y, z);
+
+		float distanceSq = 0.f;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float outside = std::max(box.min[axis] - point[axis], 0.f) + std::max(point[axis] - box.max[axis], 0.f);
+			distanceSq += outside * outside;
+		}
+
+		if (distanceSq < radius * radius)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void CHeadlessMovementPhysics::SetColliderDimensions(float heightCollider, const Vec3& sizeCollider)
+{
+	m_colliderHeight = heightCollider;
+	m_colliderRadius = sizeCollider.x;
+	m_colliderHalfHeight = sizeCollider.z;
+}
+
+void CHeadlessMovementPhysics::Integrate(float dt)
+{
+	if (m_isOnGround)
+	{
+		// Living entities walk with exactly the requested velocity while grounded
+		m_velocity.x = m_moveVelocity.x;
+		m_velocity.y = m_moveVelocity.y;
+	}
+
+	if (m_gravityEnabled && !m_isOnGround)
+	{
+		m_velocity.z += DefaultGravity * dt;
+	}
+
+	Vec3 newPosition = m_position + m_velocity * dt;
+
+	// Resolve each horizontal axis on its own so the body slides along walls
+	const Vec3 colliderOffset(0.f, 0.f, m_colliderHeight);
+	for (int axis = 0; axis < 2; ++axis)
+	{
+		Vec3 testPosition = m_position;
+		testPosition[axis] = newPosition[axis];
+		if (IsCapsuleBlocked(testPosition + colliderOffset, m_colliderRadius, m_colliderHalfHeight))
+		{
+			newPosition[axis] = m_position[axis];
+			m_velocity[axis] = 0.f;
+		}
+	}
+
+	if (newPosition.z <= m_world.groundHeight)
+	{
+		newPosition.z = m_world.groundHeight;
+		m_velocity.z = std::max(m_velocity.z, 0.f);
+	}
+
+	m_isOnGround = newPosition.z <= m_world.groundHeight && m_velocity.z <= 0.f;
+	m_position = newPosition;
+}
+
+SWallProbeHit CHeadlessMovementPhysics::CastRay(const Vec3& origin, const Vec3& direction) const
+{
+	SWallProbeHit result;
+	float closest = 1.f;
+
+	for (const AABB& box : m_world.boxes)
+	{
+		// Slab test, remembering which face we entered through
+		float tEnter = 0.f;
+		float tExit = closest;
+		int enterAxis = -1;
+		bool missed = false;
+
+		for (int axis = 0; axis < 3 && !missed; ++axis)
+		{
+			if (std::abs(direction[axis]) < 1e-6f)
+			{
+				missed = origin[axis] < box.min[axis] || origin[axis] > box.max[axis];
+				continue;
+			}
+
+			const float invDir = 1.f / direction[axis];
+			float t0 = (box.min[axis] - origin[axis]) * invDir;
+			float t1 = (box.max[axis] - origin[axis]) * invDir;
+			if (t0 > t1)
+			{
+				std::swap(t0, t1);
+			}
+
+			if (t0 > tEnter)
+			{
+				tEnter = t0;
+				enterAxis = axis;
+			}
+			tExit = std::min(tExit, t1);
+			missed = tEnter > tExit;
+		}
+
+		// Rays starting inside a box don't report it, same as the physics world
+		if (missed || enterAxis < 0)
+			continue;
+
+		closest = tEnter;
+
+		result.hit = true;
+		result.isWallrunnable = true;
+		result.distance = tEnter * direction.GetLength();
+		result.point = origin + direction * tEnter;
+		result.normal = ZERO;
+		result.normal[enterAxis] = direction[enterAxis] > 0.f ? -1.f : 1.f;
+	}
+
+	return result;
+}
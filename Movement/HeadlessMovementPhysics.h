@@ -0,0 +1,62 @@
+#pragma once
+
+#include "IMovementPhysics.h"
+
+#include <CryMath/Cry_Geo.h>
+
+////////////////////////////////////////////////////////
+// Minimal stand-in for the physics world, so the movement simulation can run without the engine
+// The world is a ground plane plus a list of static boxes. Every box counts as a wallrunnable entity.
+// Call Integrate once after each CPlayerMovementSimulation::Step.
+////////////////////////////////////////////////////////
+class CHeadlessMovementPhysics final : public IMovementPhysics
+{
+public:
+	static constexpr float DefaultGravity = -9.81f;
+	static constexpr float DefaultColliderRadius = 0.225f;
+
+	struct SWorld
+	{
+		float groundHeight = 0.f;
+		std::vector<AABB> boxes;
+	};
+
+	explicit CHeadlessMovementPhysics(const SWorld& world, const Vec3& position = ZERO);
+
+	// IMovementPhysics
+	virtual SMovementBody GetBody() const override;
+	virtual void ProbeWalls(const Vec3& origin, const Vec3& rightDir, float range, SWallProbeHit& leftHit, SWallProbeHit& rightHit) override;
+	virtual float MeasureHeadroom(const Vec3& base, float radius, float maxRise) override;
+	virtual void RequestMoveVelocity(const Vec3& velocity) override { m_moveVelocity = velocity; }
+	virtual void AddVelocity(const Vec3& velocity) override { m_velocity += velocity; }
+	virtual void SetVelocity(const Vec3& velocity) override { m_velocity = velocity; }
+	virtual void SetGravityEnabled(bool enabled) override { m_gravityEnabled = enabled; }
+	virtual void SetColliderDimensions(float heightCollider, const Vec3& sizeCollider) override;
+	virtual void SetBodyState(const Vec3& position, const Vec3& velocity) override { m_position = position; m_velocity = velocity; }
+	virtual void StepBody(float dt) override { Integrate(dt); }
+	virtual void SetReplaying(bool isReplaying) override {}
+	// ~IMovementPhysics
+
+	// Advances the body by dt seconds
+	void Integrate(float dt);
+
+	void SetPosition(const Vec3& position) { m_position = position; }
+
+	// Returns true if a vertical capsule at the given position would overlap one of the boxes
+	bool IsCapsuleBlocked(const Vec3& center, float radius, float halfHeight) const;
+
+private:
+	SWallProbeHit CastRay(const Vec3& origin, const Vec3& direction) const;
+
+	const SWorld& m_world;
+
+	Vec3 m_position;
+	Vec3 m_velocity = ZERO;
+	Vec3 m_moveVelocity = ZERO;
+	bool m_isOnGround = true;
+	bool m_gravityEnabled = true;
+
+	float m_colliderRadius = DefaultColliderRadius;
+	float m_colliderHalfHeight = 0.85f;
+	float m_colliderHeight = 1.275f;
+};
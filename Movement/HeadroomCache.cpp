@@ -0,0 +1,28 @@
+#include "StdAfx.h"
+#include "HeadroomCache.h"
+
+bool CHeadroomCache::IsRiseBlocked(SHeadroom& headroom, IMovementPhysics& physics, const SMovementParams& params, const Vec3& base, float radius, float rise, SMovementStageTimings* pTimings)
+{
+	const bool isReusable = headroom.isValid
+		&& headroom.radius == radius
+		&& headroom.measuredRise >= rise
+		&& static_cast<uint32>(headroom.age) + 1 < params.headroomMaxTicks
+		&& base.GetSquaredDistance(headroom.base) <= params.headroomMaxTravel * params.headroomMaxTravel;
+
+	if (isReusable)
+	{
+		++headroom.age;
+	}
+	else
+	{
+		CMovementStageScope scope(pTimings, EMovementStage::HeadroomQuery);
+		headroom.base = base;
+		headroom.radius = radius;
+		headroom.measuredRise = rise;
+		headroom.clearance = physics.MeasureHeadroom(base, radius, rise);
+		headroom.age = 0;
+		headroom.isValid = true;
+	}
+
+	return headroom.clearance < rise;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "PlayerMovement.h"
+#include "IMovementPhysics.h"
+#include "MovementStageTimings.h"
+
+// Clearance above a player's head, as last measured through IMovementPhysics::MeasureHeadroom
+struct SHeadroom
+{
+	// Top sphere center of the capsule and radius it was measured with
+	Vec3 base = ZERO;
+	float radius = 0.f;
+	// How far up was looked, and how much of that was free
+	float measuredRise = 0.f;
+	float clearance = 0.f;
+	uint16 age = 0;
+	bool isValid = false;
+};
+
+////////////////////////////////////////////////////////
+// Answers "can this crouching player stand up" from a remembered clearance
+// Standing up only adds the space the top of the capsule sweeps through on the way up, so one sweep of its
+// top sphere says how much taller the player can get. The measurement is reused until the player moved further than
+// SMovementParams::headroomMaxTravel or headroomMaxTicks passed, which is how moving geometry overhead is picked up.
+// Within that distance standing up can clip a ceiling edge the player slid under by at most headroomMaxTravel.
+////////////////////////////////////////////////////////
+class CHeadroomCache
+{
+public:
+	// Returns true if rising by rise from base is blocked, only measuring when the remembered clearance does not apply
+	static bool IsRiseBlocked(SHeadroom& headroom, IMovementPhysics& physics, const SMovementParams& params, const Vec3& base, float radius, float rise, SMovementStageTimings* pTimings);
+
+	// Forces the next check to measure again, e.g. after the level geometry changed (see CPlayerMovementSystem::InvalidateEnvironment)
+	static void Invalidate(SHeadroom& headroom) { headroom.isValid = false; }
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <CryMath/Cry_Math.h>
+
+// Snapshot of the physical body the movement simulation is driving
+struct SMovementBody
+{
+	Vec3 position = ZERO;
+	Vec3 velocity = ZERO;
+	// Radius of the collision capsule
+	float colliderRadius = 0.f;
+	bool isOnGround = false;
+	bool isPhysicalized = false;
+};
+
+// Result of a single wall probe
+struct SWallProbeHit
+{
+	Vec3 point = ZERO;
+	Vec3 normal = ZERO;
+	float distance = 0.f;
+	bool hit = false;
+	// Only set when the hit collider belongs to an entity, bare terrain and brushes can't be wallrun on
+	bool isWallrunnable = false;
+};
+
+// Physics writes one player requested during a tick
+// The simulation stages only record them here, so they can run on any thread.
+// CPlayerMovementSimulation::CommitPhysics applies them on the main thread, in the order the stages would have made them,
+// and drops the ones that would not change the body (see SMovementPhysicsApplied).
+struct SMovementPhysicsCommands
+{
+	enum EPending : uint8
+	{
+		ePending_AddVelocity = 1 << 0,
+		ePending_ColliderDimensions = 1 << 1,
+		ePending_MoveVelocity = 1 << 2,
+		ePending_SetVelocity = 1 << 3,
+		ePending_Gravity = 1 << 4,
+	};
+
+	void AddVelocity(const Vec3& velocity) { addVelocity = (pending & ePending_AddVelocity) ? addVelocity + velocity : velocity; pending |= ePending_AddVelocity; }
+	void SetColliderDimensions(float height, const Vec3& size) { colliderHeight = height; colliderSize = size; pending |= ePending_ColliderDimensions; }
+	void RequestMoveVelocity(const Vec3& velocity) { moveVelocity = velocity; pending |= ePending_MoveVelocity; }
+	void SetVelocity(const Vec3& velocity) { setVelocity = velocity; pending |= ePending_SetVelocity; }
+	void SetGravityEnabled(bool enabled) { gravityEnabled = enabled; pending |= ePending_Gravity; }
+
+	Vec3 addVelocity = ZERO;
+	Vec3 moveVelocity = ZERO;
+	Vec3 setVelocity = ZERO;
+	Vec3 colliderSize = ZERO;
+	float colliderHeight = 0.f;
+	bool gravityEnabled = true;
+	uint8 pending = 0;
+};
+
+// Persistent body settings as last committed to the physics world
+// Only the fields whose ePending bit is set in 'known' are trusted, everything else is always sent.
+struct SMovementPhysicsApplied
+{
+	Vec3 moveVelocity = ZERO;
+	Vec3 colliderSize = ZERO;
+	float colliderHeight = 0.f;
+	bool gravityEnabled = true;
+	uint8 known = 0;
+};
+
+////////////////////////////////////////////////////////
+// Everything the movement simulation needs from the physics world
+// Implemented on top of the CryPhysics player entity in game, and by CHeadlessMovementPhysics for simulation without the engine
+////////////////////////////////////////////////////////
+struct IMovementPhysics
+{
+	virtual ~IMovementPhysics() = default;
+
+	virtual SMovementBody GetBody() const = 0;
+
+	// Casts a ray to either side of the player, along -rightDir and +rightDir
+	virtual void ProbeWalls(const Vec3& origin, const Vec3& rightDir, float range, SWallProbeHit& leftHit, SWallProbeHit& rightHit) = 0;
+	// Sweeps a sphere straight up from base and returns how far it gets before touching static or dynamic geometry, at most maxRise
+	virtual float MeasureHeadroom(const Vec3& base, float radius, float maxRise) = 0;
+
+	// Velocity the character controller walks with until changed
+	virtual void RequestMoveVelocity(const Vec3& velocity) = 0;
+	// One-off impulse on top of the current velocity, used for jumps
+	virtual void AddVelocity(const Vec3& velocity) = 0;
+	// Overrides the current velocity of the body
+	virtual void SetVelocity(const Vec3& velocity) = 0;
+	virtual void SetGravityEnabled(bool enabled) = 0;
+	virtual void SetColliderDimensions(float heightCollider, const Vec3& sizeCollider) = 0;
+
+	// Used to replay ticks after a server correction: puts the body back, then advances it outside the regular physics step.
+	// Queries made while replaying have to be answered right away, deferred results would belong to the wrong tick.
+	virtual void SetBodyState(const Vec3& position, const Vec3& velocity) = 0;
+	virtual void StepBody(float dt) = 0;
+	virtual void SetReplaying(bool isReplaying) = 0;
+};
@@ -0,0 +1,453 @@
+#include "StdAfx.h"
+#include "MovementKernels.h"
+
+#include <chrono>
+#include <memory>
+
+#if CRY_PLATFORM_SSE2
+	#include <emmintrin.h>
+#endif
+#if CRY_PLATFORM_AVX
+	#include <immintrin.h>
+#endif
+
+namespace
+{
+	// pi / 2 in three parts, the first two have few enough bits that multiples of them are exact
+	constexpr float HalfPi1 = 1.5703125f;
+	constexpr float HalfPi2 = 4.837512969970703125e-4f;
+	constexpr float HalfPi3 = 7.54978995489188216e-8f;
+	constexpr float TwoOverPi = 0.636619772367581343f;
+
+	// Cephes minimax polynomials for sine and cosine on [-pi/4, pi/4]
+	constexpr float SinC0 = -1.9515295891e-4f;
+	constexpr float SinC1 = 8.3321608736e-3f;
+	constexpr float SinC2 = -1.6666654611e-1f;
+	constexpr float CosC0 = 2.443315711809948e-5f;
+	constexpr float CosC1 = -1.388731625493765e-3f;
+	constexpr float CosC2 = 4.166664568298827e-2f;
+
+	// One player at a time, also runs the remainder of the SIMD paths
+	struct SScalarLanes
+	{
+		typedef float TValue;
+		typedef bool TMask;
+		static constexpr uint32 Width = 1;
+
+		static TValue Load(const float* p) { return *p; }
+		static void Store(float* p, TValue value) { *p = value; }
+		static TMask LoadMask(const uint32* p) { return *p != 0; }
+
+		static TValue Sqrt(TValue value) { return sqrtf(value); }
+		// Same operand order as minps / maxps, so NaN and signed zeros come out the same
+		static TValue Min(TValue a, TValue b) { return a < b ? a : b; }
+		static TValue Max(TValue a, TValue b) { return a > b ? a : b; }
+		static TValue Abs(TValue value) { return fabsf(value); }
+		// Towards zero, the argument has to fit into an int32
+		static TValue Truncate(TValue value) { return static_cast<float>(static_cast<int32>(value)); }
+
+		static TMask Less(TValue a, TValue b) { return a < b; }
+		static TMask Greater(TValue a, TValue b) { return a > b; }
+		static TMask NotEqual(TValue a, TValue b) { return a != b; }
+		static TMask And(TMask a, TMask b) { return a && b; }
+		static TMask Xor(TMask a, TMask b) { return a != b; }
+		static TValue Select(TMask mask, TValue a, TValue b) { return mask ? a : b; }
+		static TMask SelectMask(TMask mask, TMask a, TMask b) { return mask ? a : b; }
+	};
+
+#if CRY_PLATFORM_SSE2
+	struct SFloat4
+	{
+		SFloat4(float value) : v(_mm_set1_ps(value)) {}
+		explicit SFloat4(__m128 value) : v(value) {}
+
+		__m128 v;
+	};
+
+	inline SFloat4 operator+(SFloat4 a, SFloat4 b) { return SFloat4(_mm_add_ps(a.v, b.v)); }
+	inline SFloat4 operator-(SFloat4 a, SFloat4 b) { return SFloat4(_mm_sub_ps(a.v, b.v)); }
+	inline SFloat4 operator*(SFloat4 a, SFloat4 b) { return SFloat4(_mm_mul_ps(a.v, b.v)); }
+	inline SFloat4 operator/(SFloat4 a, SFloat4 b) { return SFloat4(_mm_div_ps(a.v, b.v)); }
+	inline SFloat4 operator-(SFloat4 a) { return SFloat4(_mm_xor_ps(a.v, _mm_set1_ps(-0.f))); }
+
+	struct SSseLanes
+	{
+		typedef SFloat4 TValue;
+		typedef __m128 TMask;
+		static constexpr uint32 Width = 4;
+
+		static TValue Load(const float* p) { return TValue(_mm_loadu_ps(p)); }
+		static void Store(float* p, TValue value) { _mm_storeu_ps(p, value.v); }
+		static TMask LoadMask(const uint32* p) { return _mm_loadu_ps(reinterpret_cast<const float*>(p)); }
+
+		static TValue Sqrt(TValue value) { return TValue(_mm_sqrt_ps(value.v)); }
+		static TValue Min(TValue a, TValue b) { return TValue(_mm_min_ps(a.v, b.v)); }
+		static TValue Max(TValue a, TValue b) { return TValue(_mm_max_ps(a.v, b.v)); }
+		static TValue Abs(TValue value) { return TValue(_mm_andnot_ps(_mm_set1_ps(-0.f), value.v)); }
+		static TValue Truncate(TValue value) { return TValue(_mm_cvtepi32_ps(_mm_cvttps_epi32(value.v))); }
+
+		static TMask Less(TValue a, TValue b) { return _mm_cmplt_ps(a.v, b.v); }
+		static TMask Greater(TValue a, TValue b) { return _mm_cmpgt_ps(a.v, b.v); }
+		static TMask NotEqual(TValue a, TValue b) { return _mm_cmpneq_ps(a.v, b.v); }
+		static TMask And(TMask a, TMask b) { return _mm_and_ps(a, b); }
+		static TMask Xor(TMask a, TMask b) { return _mm_xor_ps(a, b); }
+		static TValue Select(TMask mask, TValue a, TValue b) { return TValue(_mm_or_ps(_mm_and_ps(mask, a.v), _mm_andnot_ps(mask, b.v))); }
+		static TMask SelectMask(TMask mask, TMask a, TMask b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	};
+#endif
+
+#if CRY_PLATFORM_AVX
+	struct SFloat8
+	{
+		SFloat8(float value) : v(_mm256_set1_ps(value)) {}
+		explicit SFloat8(__m256 value) : v(value) {}
+
+		__m256 v;
+	};
+
+	inline SFloat8 operator+(SFloat8 a, SFloat8 b) { return SFloat8(_mm256_add_ps(a.v, b.v)); }
+	inline SFloat8 operator-(SFloat8 a, SFloat8 b) { return SFloat8(_mm256_sub_ps(a.v, b.v)); }
+	inline SFloat8 operator*(SFloat8 a, SFloat8 b) { return SFloat8(_mm256_mul_ps(a.v, b.v)); }
+	inline SFloat8 operator/(SFloat8 a, SFloat8 b) { return SFloat8(_mm256_div_ps(a.v, b.v)); }
+	inline SFloat8 operator-(SFloat8 a) { return SFloat8(_mm256_xor_ps(a.v, _mm256_set1_ps(-0.f))); }
+
+	struct SAvxLanes
+	{
+		typedef SFloat8 TValue;
+		typedef __m256 TMask;
+		static constexpr uint32 Width = 8;
+
+		static TValue Load(const float* p) { return TValue(_mm256_loadu_ps(p)); }
+		static void Store(float* p, TValue value) { _mm256_storeu_ps(p, value.v); }
+		static TMask LoadMask(const uint32* p) { return _mm256_loadu_ps(reinterpret_cast<const float*>(p)); }
+
+		static TValue Sqrt(TValue value) { return TValue(_mm256_sqrt_ps(value.v)); }
+		static TValue Min(TValue a, TValue b) { return TValue(_mm256_min_ps(a.v, b.v)); }
+		static TValue Max(TValue a, TValue b) { return TValue(_mm256_max_ps(a.v, b.v)); }
+		static TValue Abs(TValue value) { return TValue(_mm256_andnot_ps(_mm256_set1_ps(-0.f), value.v)); }
+		static TValue Truncate(TValue value) { return TValue(_mm256_cvtepi32_ps(_mm256_cvttps_epi32(value.v))); }
+
+		// Ordered compares except for not-equal, like the scalar operators
+		static TMask Less(TValue a, TValue b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+		static TMask Greater(TValue a, TValue b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+		static TMask NotEqual(TValue a, TValue b) { return _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ); }
+		static TMask And(TMask a, TMask b) { return _mm256_and_ps(a, b); }
+		static TMask Xor(TMask a, TMask b) { return _mm256_xor_ps(a, b); }
+		// Bitwise like SSE, some compilers turn blendv with a compare mask into branches per lane
+		static TValue Select(TMask mask, TValue a, TValue b) { return TValue(_mm256_or_ps(_mm256_and_ps(mask, a.v), _mm256_andnot_ps(mask, b.v))); }
+		static TMask SelectMask(TMask mask, TMask a, TMask b) { return _mm256_or_ps(_mm256_and_ps(mask, a), _mm256_andnot_ps(mask, b)); }
+	};
+#endif
+
+	template<typename L>
+	inline void SinCosLanes(typename L::TValue angle, typename L::TValue& sine, typename L::TValue& cosine)
+	{
+		typedef typename L::TValue V;
+		typedef typename L::TMask M;
+
+		// Reduced to [-pi/4, pi/4] around the closest multiple of pi/2, the sign of the angle is put back at the end
+		const V x = L::Abs(angle);
+		const V quadrant = L::Truncate(x * V(TwoOverPi) + V(0.5f));
+		const V r = ((x - quadrant * V(HalfPi1)) - quadrant * V(HalfPi2)) - quadrant * V(HalfPi3);
+		const V z = r * r;
+
+		const V sinR = ((V(SinC0) * z + V(SinC1)) * z + V(SinC2)) * z * r + r;
+		const V cosR = ((V(CosC0) * z + V(CosC1)) * z + V(CosC2)) * z * z - V(0.5f) * z + V(1.f);
+
+		// Odd quadrants swap sine and cosine, the upper two negate both
+		const V half = L::Truncate(quadrant * V(0.5f));
+		const M isOdd = L::NotEqual(quadrant - half * V(2.f), V(0.f));
+		const M isNegated = L::NotEqual(half - L::Truncate(half * V(0.5f)) * V(2.f), V(0.f));
+		const V s = L::Select(isOdd, cosR, sinR);
+		const V c = L::Select(isOdd, sinR, cosR);
+		sine = L::Select(L::Xor(isNegated, L::Less(angle, V(0.f))), -s, s);
+		cosine = L::Select(L::Xor(isNegated, isOdd), -c, c);
+	}
+
+	template<typename L>
+	inline void ComputeMoveVelocityLanes(const float* pMoveX, const float* pMoveY, const float* pYaw, const float* pSpeed, float* pVelocityX, float* pVelocityY, uint32 i)
+	{
+		typedef typename L::TValue V;
+		typedef typename L::TMask M;
+
+		const V moveX = L::Load(pMoveX + i);
+		const V moveY = L::Load(pMoveY + i);
+		const V lengthSq = moveX * moveX + moveY * moveY;
+		const M hasLength = L::Greater(lengthSq, V(0.f));
+		const V invLength = V(1.f) / L::Sqrt(L::Select(hasLength, lengthSq, V(1.f)));
+		const V directionX = L::Select(hasLength, moveX * invLength, moveX);
+		const V directionY = L::Select(hasLength, moveY * invLength, moveY);
+
+		// Forward (0, 1) turns into (-sin, cos), as with CPlayerMovementSimulation::GetBodyRotation
+		V sine = 0.f, cosine = 0.f;
+		SinCosLanes<L>(L::Load(pYaw + i), sine, cosine);
+		const V speed = L::Load(pSpeed + i);
+		L::Store(pVelocityX + i, (directionX * cosine - directionY * sine) * speed);
+		L::Store(pVelocityY + i, (directionX * sine + directionY * cosine) * speed);
+	}
+
+	template<typename L>
+	inline void AddWrappedLanes(float* pAngle, const float* pDelta, uint32 i)
+	{
+		typedef typename L::TValue V;
+
+		const V angle = L::Load(pAngle + i) + L::Load(pDelta + i);
+		L::Store(pAngle + i, L::Select(L::Greater(angle, V(gf_PI)), angle - V(gf_PI2), L::Select(L::Less(angle, V(-gf_PI)), angle + V(gf_PI2), angle)));
+	}
+
+	template<typename L>
+	inline void AddClampedLanes(float* pValue, const float* pDelta, const float* pMin, const float* pMax, uint32 i)
+	{
+		L::Store(pValue + i, L::Min(L::Max(L::Load(pValue + i) + L::Load(pDelta + i), L::Load(pMin + i)), L::Load(pMax + i)));
+	}
+
+	template<typename L>
+	inline void LerpLanes(float* pValue, const float* pTarget, const float* pT, uint32 i)
+	{
+		const typename L::TValue value = L::Load(pValue + i);
+		L::Store(pValue + i, value + (L::Load(pTarget + i) - value) * L::Load(pT + i));
+	}
+
+	template<typename L>
+	inline void ApproachRollLanes(float* pRoll, const float* pWallrunRoll, const float* pChange, const uint32* pIsWallrunning, uint32 i)
+	{
+		typedef typename L::TValue V;
+		typedef typename L::TMask M;
+
+		const V roll = L::Load(pRoll + i);
+		const V wallrunRoll = L::Load(pWallrunRoll + i);
+		const V change = L::Load(pChange + i);
+		const M isWallrunning = L::LoadMask(pIsWallrunning + i);
+
+		// Towards the roll of the wall while on it, back to level once off it, never past the target
+		const V target = L::Select(isWallrunning, wallrunRoll, V(0.f));
+		const M isPositive = L::Greater(wallrunRoll, V(0.f));
+		const M isNegative = L::Less(wallrunRoll, V(0.f));
+		const M rollsUp = L::SelectMask(isWallrunning, L::And(L::Less(roll, wallrunRoll), isPositive), isNegative);
+		const M rollsDown = L::SelectMask(isWallrunning, L::And(L::Greater(roll, wallrunRoll), isNegative), isPositive);
+		L::Store(pRoll + i, L::Select(rollsUp, L::Min(roll + change, target), L::Select(rollsDown, L::Max(roll - change, target), roll)));
+	}
+
+	// Full SIMD widths first, the rest one player at a time
+	template<typename L, typename TFunc>
+	inline void ForEachLane(uint32 count, const TFunc& func)
+	{
+		uint32 i = 0;
+		for (; i + L::Width <= count; i += L::Width)
+		{
+			func(L(), i);
+		}
+		for (; i < count; ++i)
+		{
+			func(SScalarLanes(), i);
+		}
+	}
+
+	template<typename TFunc>
+	inline void Dispatch(EMovementKernelPath path, uint32 count, const TFunc& func)
+	{
+		switch (path)
+		{
+#if CRY_PLATFORM_AVX
+		case EMovementKernelPath::Avx:
+			ForEachLane<SAvxLanes>(count, func);
+			return;
+#endif
+#if CRY_PLATFORM_SSE2
+		case EMovementKernelPath::Sse:
+			ForEachLane<SSseLanes>(count, func);
+			return;
+#endif
+		default:
+			ForEachLane<SScalarLanes>(count, func);
+			return;
+		}
+	}
+
+	// Inputs and outputs of every kernel for the benchmark
+	struct SBenchmarkData
+	{
+		explicit SBenchmarkData(uint32 numPlayers)
+			: moveX(numPlayers), moveY(numPlayers), yaw(numPlayers), speed(numPlayers), velocityX(numPlayers), velocityY(numPlayers)
+			, yawDelta(numPlayers), pitch(numPlayers), pitchDelta(numPlayers), pitchMin(numPlayers), pitchMax(numPlayers)
+			, cameraOffset(numPlayers * 3), cameraEndOffset(numPlayers * 3), cameraT(numPlayers * 3)
+			, roll(numPlayers), wallrunRoll(numPlayers), rollChange(numPlayers), isWallrunning(numPlayers)
+		{
+		}
+
+		bool IsSameOutput(const SBenchmarkData& other) const
+		{
+			auto isSame = [](const std::vector<float>& a, const std::vector<float>& b) { return memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0; };
+			return isSame(velocityX, other.velocityX) && isSame(velocityY, other.velocityY) && isSame(yaw, other.yaw)
+				&& isSame(pitch, other.pitch) && isSame(cameraOffset, other.cameraOffset) && isSame(roll, other.roll);
+		}
+
+		std::vector<float> moveX, moveY, yaw, speed, velocityX, velocityY;
+		std::vector<float> yawDelta, pitch, pitchDelta, pitchMin, pitchMax;
+		std::vector<float> cameraOffset, cameraEndOffset, cameraT;
+		std::vector<float> roll, wallrunRoll, rollChange;
+		std::vector<uint32> isWallrunning;
+	};
+}
+
+#if CRY_PLATFORM_AVX
+EMovementKernelPath CMovementKernels::s_path = EMovementKernelPath::Avx;
+#elif CRY_PLATFORM_SSE2
+EMovementKernelPath CMovementKernels::s_path = EMovementKernelPath::Sse;
+#else
+EMovementKernelPath CMovementKernels::s_path = EMovementKernelPath::Scalar;
+#endif
+
+bool CMovementKernels::IsSupported(EMovementKernelPath path)
+{
+	switch (path)
+	{
+	case EMovementKernelPath::Scalar:
+		return true;
+#if CRY_PLATFORM_SSE2
+	case EMovementKernelPath::Sse:
+		return true;
+#endif
+#if CRY_PLATFORM_AVX
+	case EMovementKernelPath::Avx:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+EMovementKernelPath CMovementKernels::GetBestPath()
+{
+	if (IsSupported(EMovementKernelPath::Avx))
+		return EMovementKernelPath::Avx;
+	if (IsSupported(EMovementKernelPath::Sse))
+		return EMovementKernelPath::Sse;
+	return EMovementKernelPath::Scalar;
+}
+
+void CMovementKernels::SetPath(EMovementKernelPath path)
+{
+	s_path = IsSupported(path) ? path : GetBestPath();
+}
+
+void CMovementKernels::ComputeMoveVelocity(const float* pMoveX, const float* pMoveY, const float* pYaw, const float* pSpeed, float* pVelocityX, float* pVelocityY, uint32 count)
+{
+	Dispatch(s_path, count, [=](auto lanes, uint32 i)
+	{
+		ComputeMoveVelocityLanes<decltype(lanes)>(pMoveX, pMoveY, pYaw, pSpeed, pVelocityX, pVelocityY, i);
+	});
+}
+
+void CMovementKernels::AddWrapped(float* pAngle, const float* pDelta, uint32 count)
+{
+	Dispatch(s_path, count, [=](auto lanes, uint32 i) { AddWrappedLanes<decltype(lanes)>(pAngle, pDelta, i); });
+}
+
+void CMovementKernels::AddClamped(float* pValue, const float* pDelta, const float* pMin, const float* pMax, uint32 count)
+{
+	Dispatch(s_path, count, [=](auto lanes, uint32 i) { AddClampedLanes<decltype(lanes)>(pValue, pDelta, pMin, pMax, i); });
+}
+
+void CMovementKernels::Lerp(float* pValue, const float* pTarget, const float* pT, uint32 count)
+{
+	Dispatch(s_path, count, [=](auto lanes, uint32 i) { LerpLanes<decltype(lanes)>(pValue, pTarget, pT, i); });
+}
+
+void CMovementKernels::ApproachRoll(float* pRoll, const float* pWallrunRoll, const float* pChange, const uint32* pIsWallrunning, uint32 count)
+{
+	Dispatch(s_path, count, [=](auto lanes, uint32 i) { ApproachRollLanes<decltype(lanes)>(pRoll, pWallrunRoll, pChange, pIsWallrunning, i); });
+}
+
+void CMovementKernels::SinCos(float angle, float& sine, float& cosine)
+{
+	SinCosLanes<SScalarLanes>(angle, sine, cosine);
+}
+
+CMovementKernels::SBenchmarkResult CMovementKernels::RunBenchmark(uint32 numPlayers, uint32 numIterations)
+{
+	using TClock = std::chrono::high_resolution_clock;
+
+	SBenchmarkResult result;
+	result.numPlayers = numPlayers;
+	if (numPlayers == 0 || numIterations == 0)
+		return result;
+
+	// Deterministic noise, so runs are comparable
+	uint32 random = 0x9E3779B9;
+	auto nextRandom = [&random](float minValue, float maxValue)
+	{
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		return minValue + static_cast<float>(random & 0xFFFF) / 65535.f * (maxValue - minValue);
+	};
+
+	SBenchmarkData initial(numPlayers);
+	for (uint32 i = 0; i < numPlayers; ++i)
+	{
+		// Mostly keyboard directions, some analog ones and some standing still
+		const float kind = nextRandom(0.f, 1.f);
+		initial.moveX[i] = kind < 0.1f ? 0.f : (kind < 0.4f ? nextRandom(-1.f, 1.f) : static_cast<float>(static_cast<int>(nextRandom(-1.f, 2.f))));
+		initial.moveY[i] = kind < 0.1f ? 0.f : (kind < 0.4f ? nextRandom(-1.f, 1.f) : 1.f);
+		initial.yaw[i] = nextRandom(-gf_PI, gf_PI);
+		initial.speed[i] = nextRandom(0.f, 1.f) < 0.5f ? 10.5f : 20.5f;
+		initial.yawDelta[i] = nextRandom(-0.2f, 0.2f);
+		initial.pitchDelta[i] = nextRandom(-0.05f, 0.05f);
+		initial.pitchMin[i] = -1.5f;
+		initial.pitchMax[i] = 1.5f;
+		for (uint32 axis = 0; axis < 3; ++axis)
+		{
+			initial.cameraOffset[i * 3 + axis] = nextRandom(0.f, 2.f);
+			initial.cameraEndOffset[i * 3 + axis] = nextRandom(0.f, 2.f);
+			initial.cameraT[i * 3 + axis] = 0.2f;
+		}
+		initial.roll[i] = nextRandom(-0.3f, 0.3f);
+		initial.wallrunRoll[i] = nextRandom(0.f, 1.f) < 0.5f ? -0.25f : 0.25f;
+		initial.rollChange[i] = 0.02f;
+		initial.isWallrunning[i] = nextRandom(0.f, 1.f) < 0.3f ? ~0u : 0u;
+
+		float sine, cosine;
+		SinCos(initial.yaw[i] * 16.f, sine, cosine);
+		result.maxSinCosError = std::max(result.maxSinCosError, std::max(std::abs(sine - sinf(initial.yaw[i] * 16.f)), std::abs(cosine - cosf(initial.yaw[i] * 16.f))));
+	}
+
+	const EMovementKernelPath previousPath = s_path;
+	std::unique_ptr<SBenchmarkData> pScalarData;
+	for (uint32 path = 0; path < static_cast<uint32>(EMovementKernelPath::Count); ++path)
+	{
+		if (!IsSupported(static_cast<EMovementKernelPath>(path)))
+			continue;
+
+		s_path = static_cast<EMovementKernelPath>(path);
+		std::unique_ptr<SBenchmarkData> pData(new SBenchmarkData(initial));
+		SBenchmarkData& data = *pData;
+
+		// The state carries over between iterations like it does between ticks
+		const TClock::time_point start = TClock::now();
+		for (uint32 iteration = 0; iteration < numIterations; ++iteration)
+		{
+			ComputeMoveVelocity(data.moveX.data(), data.moveY.data(), data.yaw.data(), data.speed.data(), data.velocityX.data(), data.velocityY.data(), numPlayers);
+			AddWrapped(data.yaw.data(), data.yawDelta.data(), numPlayers);
+			AddClamped(data.pitch.data(), data.pitchDelta.data(), data.pitchMin.data(), data.pitchMax.data(), numPlayers);
+			Lerp(data.cameraOffset.data(), data.cameraEndOffset.data(), data.cameraT.data(), numPlayers * 3);
+			ApproachRoll(data.roll.data(), data.wallrunRoll.data(), data.rollChange.data(), data.isWallrunning.data(), numPlayers);
+		}
+		const TClock::duration time = TClock::now() - start;
+
+		result.nanosecondsPerPlayer[path] = static_cast<float>(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count())
+			/ (static_cast<float>(numPlayers) * static_cast<float>(numIterations));
+		if (pScalarData)
+		{
+			result.isIdentical[path] = data.IsSameOutput(*pScalarData);
+		}
+		else
+		{
+			result.isIdentical[path] = true;
+			pScalarData = std::move(pData);
+		}
+	}
+	s_path = previousPath;
+
+	return result;
+}
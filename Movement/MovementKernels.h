@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+
+// Instruction sets the batched movement math runs on
+enum class EMovementKernelPath : uint8
+{
+	Scalar,
+	// 4 players per instruction
+	Sse,
+	// 8 players per instruction
+	Avx,
+
+	Count
+};
+
+inline const char* GetMovementKernelPathName(EMovementKernelPath path)
+{
+	static const char* const s_names[] =
+	{
+		"Scalar",
+		"SSE",
+		"AVX",
+	};
+	static_assert(CRY_ARRAY_COUNT(s_names) == static_cast<size_t>(EMovementKernelPath::Count), "Kernel path names out of date");
+	return s_names[static_cast<size_t>(path)];
+}
+
+////////////////////////////////////////////////////////
+// Batched math of the movement tick, over packed arrays holding one value per player
+// Every kernel is written once against a lane type, and the scalar, SSE and AVX lanes run the same IEEE operations in the
+// same order, so all paths produce the same bits and input trace checksums do not depend on the instruction set. Sine and
+// cosine use a polynomial of their own for the same reason. That only holds as long as the compiler does not fuse
+// multiplies and adds or reorder float math, so CMakeLists.txt builds this file outside the uber file with the float mode
+// pinned: /fp:precise on MSVC, -ffp-contract=off -fno-fast-math on GCC and Clang.
+// Which SIMD paths exist is decided at compile time (CRY_PLATFORM_SSE2, CRY_PLATFORM_AVX).
+////////////////////////////////////////////////////////
+class CMovementKernels
+{
+public:
+	// Players the simulation gathers into packed arrays at a time, keeps its scratch on the stack
+	static constexpr uint32 BatchSize = 64;
+
+	static bool IsSupported(EMovementKernelPath path);
+	// Widest path compiled in, used unless SetPath picks another
+	static EMovementKernelPath GetBestPath();
+	// Paths this build does not have fall back to the best one that it has
+	static void SetPath(EMovementKernelPath path);
+	static EMovementKernelPath GetPath() { return s_path; }
+
+	// velocity = normalized move direction rotated about z by yaw, times speed. A zero direction gives a zero velocity.
+	static void ComputeMoveVelocity(const float* pMoveX, const float* pMoveY, const float* pYaw, const float* pSpeed, float* pVelocityX, float* pVelocityY, uint32 count);
+	// angle += delta, brought back into [-pi, pi] if it left it
+	static void AddWrapped(float* pAngle, const float* pDelta, uint32 count);
+	// value = clamp(value + delta, min, max)
+	static void AddClamped(float* pValue, const float* pDelta, const float* pMin, const float* pMax, uint32 count);
+	// value += (target - value) * t
+	static void Lerp(float* pValue, const float* pTarget, const float* pT, uint32 count);
+	// Turns the camera roll towards the wallrun roll while wallrunning and back to level afterwards, by at most change
+	// pIsWallrunning holds ~0u for players that are wallrunning and 0 for the others.
+	static void ApproachRoll(float* pRoll, const float* pWallrunRoll, const float* pChange, const uint32* pIsWallrunning, uint32 count);
+
+	// Sine and cosine the way the kernels compute them, within a few ulp of the C library for angles up to a few thousand radians
+	static void SinCos(float angle, float& sine, float& cosine);
+
+	struct SBenchmarkResult
+	{
+		uint32 numPlayers = 0;
+		// One run of every kernel, per player, for each path. Zero for paths this build does not have.
+		std::array<float, static_cast<size_t>(EMovementKernelPath::Count)> nanosecondsPerPlayer = {};
+		// Whether the path produced the same bits as the scalar one
+		std::array<bool, static_cast<size_t>(EMovementKernelPath::Count)> isIdentical = {};
+		// Largest difference of SinCos to sinf / cosf over the benchmark angles
+		float maxSinCosError = 0.f;
+	};
+
+	// Runs every kernel numIterations times over numPlayers synthetic players on each path this build has
+	static SBenchmarkResult RunBenchmark(uint32 numPlayers, uint32 numIterations);
+
+private:
+	static EMovementKernelPath s_path;
+};
@@ -0,0 +1,136 @@
+#include "StdAfx.h"
+#include "MovementStageProfiler.h"
+
+#include <cstdio>
+
+namespace
+{
+	// Below this every nanosecond value has its own bucket
+	const uint64 LinearBuckets = 8;
+
+	uint32 GetHighestBit(uint64 value)
+	{
+		uint32 bit = 0;
+		while (value >>= 1)
+		{
+			++bit;
+		}
+		return bit;
+	}
+}
+
+uint32 CDurationHistogram::GetBucket(uint64 nanoseconds)
+{
+	if (nanoseconds < LinearBuckets)
+		return static_cast<uint32>(nanoseconds);
+
+	// The two bits below the highest one pick the quarter within the power of two
+	const uint32 highestBit = GetHighestBit(nanoseconds);
+	const uint32 quarter = static_cast<uint32>(nanoseconds >> (highestBit - 2)) & 3;
+	return std::min(static_cast<uint32>(LinearBuckets) + (highestBit - 3) * 4 + quarter, NumBuckets - 1);
+}
+
+uint64 CDurationHistogram::GetBucketUpperBound(uint32 bucket)
+{
+	if (bucket < LinearBuckets)
+		return bucket;
+
+	const uint32 highestBit = 3 + (bucket - static_cast<uint32>(LinearBuckets)) / 4;
+	const uint64 quarter = (bucket - LinearBuckets) % 4;
+	return ((4 + quarter + 1) << (highestBit - 2)) - 1;
+}
+
+void CDurationHistogram::Add(uint64 nanoseconds)
+{
+	++m_buckets[GetBucket(nanoseconds)];
+	++m_count;
+	m_total += nanoseconds;
+	m_max = std::max(m_max, nanoseconds);
+}
+
+uint64 CDurationHistogram::GetPercentile(float fraction) const
+{
+	if (m_count == 0)
+		return 0;
+
+	const uint64 rank = std::max<uint64>(static_cast<uint64>(ceilf(crymath::clamp(fraction, 0.f, 1.f) * static_cast<float>(m_count))), 1);
+	uint64 seen = 0;
+	for (uint32 bucket = 0; bucket < NumBuckets; ++bucket)
+	{
+		seen += m_buckets[bucket];
+		if (seen >= rank)
+			return std::min(GetBucketUpperBound(bucket), m_max);
+	}
+	return m_max;
+}
+
+void CMovementStageProfiler::Reset()
+{
+	*this = CMovementStageProfiler();
+}
+
+void CMovementStageProfiler::AddTick(const SMovementStageTimings& tick)
+{
+	for (size_t stage = 0; stage < SMovementStageTimings::NumStages; ++stage)
+	{
+		m_stages[stage].Add(tick.nanoseconds[stage]);
+		m_calls[stage] += tick.calls[stage];
+	}
+	m_total.Add(tick.GetTotalNanoseconds());
+}
+
+float CMovementStageProfiler::GetCallsPerTick(EMovementStage stage) const
+{
+	const size_t index = static_cast<size_t>(stage);
+	return m_stages[index].GetCount() != 0 ? static_cast<float>(m_calls[index]) / static_cast<float>(m_stages[index].GetCount()) : 0.f;
+}
+
+bool CMovementStageProfiler::WriteCsv(const char* szPath) const
+{
+	FILE* pFile = fopen(szPath, "w");
+	if (pFile == nullptr)
+		return false;
+
+	auto writeSummary = [pFile](const char* szName, const CDurationHistogram& histogram, float callsPerTick)
+	{
+		fprintf(pFile, "%s,%llu,%.3f,%.3f,%.3f,%.3f,%.2f\n", szName, static_cast<unsigned long long>(histogram.GetCount()),
+			histogram.GetPercentile(0.5f) * 1e-3, histogram.GetPercentile(0.99f) * 1e-3, histogram.GetMax() * 1e-3, histogram.GetMean() * 1e-3, callsPerTick);
+	};
+
+	fprintf(pFile, "stage,ticks,p50_us,p99_us,max_us,mean_us,calls_per_tick\n");
+	for (size_t stage = 0; stage < SMovementStageTimings::NumStages; ++stage)
+	{
+		writeSummary(GetMovementStageName(static_cast<EMovementStage>(stage)), m_stages[stage], GetCallsPerTick(static_cast<EMovementStage>(stage)));
+	}
+	writeSummary("Total", m_total, 1.f);
+
+	// Only the bucket range that was hit, enough to plot the distributions
+	uint32 lastBucket = 0;
+	for (uint32 bucket = 0; bucket < CDurationHistogram::NumBuckets; ++bucket)
+	{
+		for (const CDurationHistogram& histogram : m_stages)
+		{
+			lastBucket = histogram.GetBucketCount(bucket) != 0 ? bucket : lastBucket;
+		}
+		lastBucket = m_total.GetBucketCount(bucket) != 0 ? bucket : lastBucket;
+	}
+
+	fprintf(pFile, "\nbucket_upper_us");
+	for (size_t stage = 0; stage < SMovementStageTimings::NumStages; ++stage)
+	{
+		fprintf(pFile, ",%s", GetMovementStageName(static_cast<EMovementStage>(stage)));
+	}
+	fprintf(pFile, ",Total\n");
+
+	for (uint32 bucket = 0; bucket <= lastBucket; ++bucket)
+	{
+		fprintf(pFile, "%.3f", CDurationHistogram::GetBucketUpperBound(bucket) * 1e-3);
+		for (const CDurationHistogram& histogram : m_stages)
+		{
+			fprintf(pFile, ",%u", histogram.GetBucketCount(bucket));
+		}
+		fprintf(pFile, ",%u\n", m_total.GetBucketCount(bucket));
+	}
+
+	return fclose(pFile) == 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "MovementStageTimings.h"
+
+#include <array>
+
+// Counts durations in logarithmic buckets, four per power of two, so percentiles are within 25% at any scale
+class CDurationHistogram
+{
+public:
+	static constexpr uint32 NumBuckets = 160;
+
+	void Reset() { *this = CDurationHistogram(); }
+	void Add(uint64 nanoseconds);
+
+	// Upper bound of the bucket holding the given fraction of the samples, never above the largest sample
+	uint64 GetPercentile(float fraction) const;
+	uint64 GetMax() const { return m_max; }
+	uint64 GetMean() const { return m_count != 0 ? m_total / m_count : 0; }
+	uint64 GetCount() const { return m_count; }
+
+	uint32 GetBucketCount(uint32 bucket) const { return m_buckets[bucket]; }
+	static uint64 GetBucketUpperBound(uint32 bucket);
+
+private:
+	static uint32 GetBucket(uint64 nanoseconds);
+
+	std::array<uint32, NumBuckets> m_buckets = {};
+	uint64 m_count = 0;
+	uint64 m_total = 0;
+	uint64 m_max = 0;
+};
+
+////////////////////////////////////////////////////////
+// Per-tick time of every movement stage, collected into histograms
+// Fed with the SMovementStageTimings of single ticks, so a percentile is the cost of a stage in one tick.
+////////////////////////////////////////////////////////
+class CMovementStageProfiler
+{
+public:
+	void Reset();
+	void AddTick(const SMovementStageTimings& tick);
+
+	const CDurationHistogram& GetStage(EMovementStage stage) const { return m_stages[static_cast<size_t>(stage)]; }
+	const CDurationHistogram& GetTotal() const { return m_total; }
+	// Average number of times a stage ran per tick, the physics queries run once per player
+	float GetCallsPerTick(EMovementStage stage) const;
+
+	// One summary row per stage, followed by the bucket counts of every histogram
+	bool WriteCsv(const char* szPath) const;
+
+private:
+	std::array<CDurationHistogram, SMovementStageTimings::NumStages> m_stages;
+	std::array<uint64, SMovementStageTimings::NumStages> m_calls = {};
+	CDurationHistogram m_total;
+};
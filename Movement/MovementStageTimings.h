@@ -0,0 +1,104 @@
+#pragma once
+
+#include <chrono>
+
+// The phases of one CPlayerMovementSimulation tick in the order they run, followed by the physics queries inside them
+enum class EMovementStage : uint8
+{
+	GatherBodies,
+	SimulateActions,
+	QueryStance,
+	SimulateMotion,
+	QueryWalls,
+	SimulateWallrun,
+	CommitPhysics,
+
+	// Each MeasureHeadroom call, part of QueryStance
+	HeadroomQuery,
+	// Each ProbeWalls call, part of QueryWalls
+	WallProbeQuery,
+
+	Count
+};
+
+inline const char* GetMovementStageName(EMovementStage stage)
+{
+	static const char* const s_names[] =
+	{
+		"GatherBodies",
+		"SimulateActions",
+		"QueryStance",
+		"SimulateMotion",
+		"QueryWalls",
+		"SimulateWallrun",
+		"CommitPhysics",
+		"HeadroomQuery",
+		"WallProbeQuery",
+	};
+	static_assert(CRY_ARRAY_COUNT(s_names) == static_cast<size_t>(EMovementStage::Count), "Stage names out of date");
+	return s_names[static_cast<size_t>(stage)];
+}
+
+// Wall clock time spent in each stage, summed over however many ticks it was passed to
+struct SMovementStageTimings
+{
+	static constexpr size_t NumStages = static_cast<size_t>(EMovementStage::Count);
+	// Stages before this one run one after the other and add up to the whole tick
+	static constexpr size_t NumPhases = static_cast<size_t>(EMovementStage::CommitPhysics) + 1;
+
+	void Reset() { *this = SMovementStageTimings(); }
+
+	void Add(const SMovementStageTimings& other)
+	{
+		for (size_t stage = 0; stage < NumStages; ++stage)
+		{
+			nanoseconds[stage] += other.nanoseconds[stage];
+			calls[stage] += other.calls[stage];
+		}
+	}
+
+	uint64 GetTotalNanoseconds() const
+	{
+		uint64 total = 0;
+		for (size_t stage = 0; stage < NumPhases; ++stage)
+		{
+			total += nanoseconds[stage];
+		}
+		return total;
+	}
+
+	uint64 nanoseconds[NumStages] = {};
+	uint32 calls[NumStages] = {};
+};
+
+// Adds the time until it goes out of scope to one stage, does nothing without timings to write to
+class CMovementStageScope
+{
+public:
+	using TClock = std::chrono::steady_clock;
+
+	CMovementStageScope(SMovementStageTimings* pTimings, EMovementStage stage)
+		: m_pTimings(pTimings)
+		, m_stage(stage)
+	{
+		if (m_pTimings != nullptr)
+		{
+			m_start = TClock::now();
+		}
+	}
+
+	~CMovementStageScope()
+	{
+		if (m_pTimings != nullptr)
+		{
+			const TClock::duration elapsed = TClock::now() - m_start;
+			m_pTimings->nanoseconds[static_cast<size_t>(m_stage)] += static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+			++m_pTimings->calls[static_cast<size_t>(m_stage)];
+		}
+	}
+
+private:
+	SMovementStageTimings* m_pTimings;
+	EMovementStage m_stage;
+	TClock::time_point m_start;
+};
@@ -0,0 +1,394 @@
+#include "StdAfx.h"
+#include "MovementTelemetry.h"
+
+#include <algorithm>
+
+namespace
+{
+	enum EBlockTag : uint8
+	{
+		eBT_End = 0,
+		eBT_Events = 1,
+		eBT_Dropped = 2
+	};
+
+	// How often the writer drains the rings, well below the time a busy thread takes to fill one
+	const std::chrono::milliseconds WriterInterval(5);
+
+	// Sessions tell rings of an earlier recording apart from the current one, also across telemetry instances
+	std::atomic<uint32> s_nextSession { 1 };
+
+	void AppendVarint(std::vector<uint8>& data, uint64 value)
+	{
+		while (value >= 0x80)
+		{
+			data.push_back(static_cast<uint8>(value) | 0x80);
+			value >>= 7;
+		}
+		data.push_back(static_cast<uint8>(value));
+	}
+
+	void AppendSigned(std::vector<uint8>& data, int64 value)
+	{
+		AppendVarint(data, (static_cast<uint64>(value) << 1) ^ static_cast<uint64>(value >> 63));
+	}
+
+	bool ExtractVarint(const std::vector<uint8>& data, size_t& position, uint64& value)
+	{
+		value = 0;
+		for (uint32 shift = 0; shift < 64 && position < data.size(); shift += 7)
+		{
+			const uint8 byte = data[position++];
+			value |= static_cast<uint64>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	bool ExtractSigned(const std::vector<uint8>& data, size_t& position, int64& value)
+	{
+		uint64 encoded;
+		if (!ExtractVarint(data, position, encoded))
+			return false;
+
+		value = static_cast<int64>(encoded >> 1) ^ -static_cast<int64>(encoded & 1);
+		return true;
+	}
+
+	int64 ToCentimeters(float meters)
+	{
+		return static_cast<int64>(std::floor(meters * 100.f + 0.5f));
+	}
+}
+
+const char* GetMovementTelemetryEventName(EMovementTelemetryEvent type)
+{
+	switch (type)
+	{
+	case EMovementTelemetryEvent::TickSample:
+		return "TickSample";
+	case EMovementTelemetryEvent::SprintStart:
+		return "SprintStart";
+	case EMovementTelemetryEvent::SprintEnd:
+		return "SprintEnd";
+	case EMovementTelemetryEvent::Jump:
+		return "Jump";
+	case EMovementTelemetryEvent::DoubleJump:
+		return "DoubleJump";
+	case EMovementTelemetryEvent::WallJump:
+		return "WallJump";
+	case EMovementTelemetryEvent::StanceChange:
+		return "StanceChange";
+	case EMovementTelemetryEvent::WallrunStart:
+		return "WallrunStart";
+	case EMovementTelemetryEvent::WallrunEnd:
+		return "WallrunEnd";
+	case EMovementTelemetryEvent::WallrunReady:
+		return "WallrunReady";
+	case EMovementTelemetryEvent::Count:
+		break;
+	}
+	return "Unknown";
+}
+
+bool CMovementTelemetryRing::Push(const SMovementTelemetryEvent& event)
+{
+	const uint32 head = m_head.load(std::memory_order_relaxed);
+	if (head - m_tail.load(std::memory_order_acquire) == Capacity)
+	{
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	m_pEvents[head & (Capacity - 1)] = event;
+	// Publishes the event, the consumer does not read it before it sees the new head
+	m_head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+uint32 CMovementTelemetryRing::Pop(SMovementTelemetryEvent* pEvents, uint32 maxEvents)
+{
+	const uint32 tail = m_tail.load(std::memory_order_relaxed);
+	const uint32 count = std::min(m_head.load(std::memory_order_acquire) - tail, maxEvents);
+	for (uint32 i = 0; i < count; ++i)
+	{
+		pEvents[i] = m_pEvents[(tail + i) & (Capacity - 1)];
+	}
+
+	// Hands the slots back to the producer only after they were copied
+	m_tail.store(tail + count, std::memory_order_release);
+	return count;
+}
+
+bool CMovementTelemetry::Start(const char* szPath, uint32 sampleInterval)
+{
+	Stop();
+
+	m_pFile = fopen(szPath, "wb");
+	if (m_pFile == nullptr)
+		return false;
+
+	m_sampleInterval = sampleInterval;
+	m_session = s_nextSession.fetch_add(1);
+	m_start = std::chrono::steady_clock::now();
+	m_numEvents = 0;
+	m_numBytes = 0;
+
+	const uint32 header[] = { Magic, Version };
+	fwrite(header, sizeof(header), 1, m_pFile);
+	m_numBytes = sizeof(header);
+
+	m_drainEvents.resize(CMovementTelemetryRing::Capacity);
+	m_encoded.reserve(CMovementTelemetryRing::Capacity * sizeof(SMovementTelemetryEvent));
+
+	m_stopWriter = false;
+	m_writer = std::thread(&CMovementTelemetry::RunWriter, this);
+	return true;
+}
+
+void CMovementTelemetry::Stop()
+{
+	if (m_pFile == nullptr)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_writerMutex);
+		m_stopWriter = true;
+	}
+	m_writerWake.notify_one();
+	m_writer.join();
+
+	// The writer is gone and nobody records, whatever is left goes out from here
+	Drain();
+
+	m_encoded.clear();
+	for (const std::unique_ptr<CMovementTelemetryRing>& pRing : m_rings)
+	{
+		m_encoded.push_back(eBT_Dropped);
+		AppendVarint(m_encoded, pRing->GetIndex());
+		AppendVarint(m_encoded, pRing->GetDropped());
+	}
+	m_encoded.push_back(eBT_End);
+	fwrite(m_encoded.data(), m_encoded.size(), 1, m_pFile);
+	m_numBytes += m_encoded.size();
+	m_lastStats = GetStats();
+
+	fclose(m_pFile);
+	m_pFile = nullptr;
+
+	std::lock_guard<std::mutex> lock(m_ringMutex);
+	m_rings.clear();
+	m_drainEvents = std::vector<SMovementTelemetryEvent>();
+	m_encoded = std::vector<uint8>();
+}
+
+void CMovementTelemetry::Record(const SMovementTelemetryEvent& event)
+{
+	GetThreadRing()->Push(event);
+}
+
+uint64 CMovementTelemetry::GetNanoseconds() const
+{
+	return static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count());
+}
+
+CMovementTelemetry::SStats CMovementTelemetry::GetStats() const
+{
+	if (m_pFile == nullptr)
+		return m_lastStats;
+
+	SStats stats;
+	stats.events = m_numEvents.load(std::memory_order_relaxed);
+	stats.bytes = m_numBytes.load(std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> lock(m_ringMutex);
+	stats.rings = static_cast<uint32>(m_rings.size());
+	for (const std::unique_ptr<CMovementTelemetryRing>& pRing : m_rings)
+	{
+		stats.dropped += pRing->GetDropped();
+	}
+	return stats;
+}
+
+CMovementTelemetryRing* CMovementTelemetry::GetThreadRing()
+{
+	struct SThreadRing
+	{
+		uint32 session;
+		CMovementTelemetryRing* pRing;
+	};
+	static thread_local SThreadRing threadRing = { 0, nullptr };
+
+	// Only the first event of a thread in a recording takes the lock
+	if (threadRing.session != m_session)
+	{
+		std::lock_guard<std::mutex> lock(m_ringMutex);
+		m_rings.push_back(stl::make_unique<CMovementTelemetryRing>(static_cast<uint32>(m_rings.size())));
+		threadRing.session = m_session;
+		threadRing.pRing = m_rings.back().get();
+	}
+
+	return threadRing.pRing;
+}
+
+void CMovementTelemetry::RunWriter()
+{
+	std::unique_lock<std::mutex> lock(m_writerMutex);
+	while (!m_stopWriter)
+	{
+		m_writerWake.wait_for(lock, WriterInterval);
+		if (m_stopWriter)
+			break;
+
+		lock.unlock();
+		Drain();
+		lock.lock();
+	}
+}
+
+void CMovementTelemetry::Drain()
+{
+	// Rings can be added while this runs, the new ones are drained the next time
+	std::vector<CMovementTelemetryRing*> rings;
+	{
+		std::lock_guard<std::mutex> lock(m_ringMutex);
+		rings.reserve(m_rings.size());
+		for (const std::unique_ptr<CMovementTelemetryRing>& pRing : m_rings)
+		{
+			rings.push_back(pRing.get());
+		}
+	}
+
+	for (CMovementTelemetryRing* pRing : rings)
+	{
+		const uint32 count = pRing->Pop(m_drainEvents.data(), static_cast<uint32>(m_drainEvents.size()));
+		if (count == 0)
+			continue;
+
+		// Events of one ring come from one thread, so their time stamps only go up
+		m_encoded.clear();
+		m_encoded.push_back(eBT_Events);
+		AppendVarint(m_encoded, pRing->GetIndex());
+		AppendVarint(m_encoded, count);
+
+		uint64 previousNanoseconds = 0;
+		uint32 previousTick = 0;
+		for (uint32 i = 0; i < count; ++i)
+		{
+			const SMovementTelemetryEvent& event = m_drainEvents[i];
+			AppendVarint(m_encoded, event.nanoseconds - previousNanoseconds);
+			AppendSigned(m_encoded, static_cast<int64>(event.tick) - static_cast<int64>(previousTick));
+			AppendVarint(m_encoded, event.playerId);
+			m_encoded.push_back(static_cast<uint8>(event.type));
+			m_encoded.push_back(event.flags);
+			m_encoded.push_back(static_cast<uint8>(static_cast<uint8>(event.stance) | (static_cast<uint8>(event.playerState) << 4)));
+			AppendSigned(m_encoded, ToCentimeters(event.position.x));
+			AppendSigned(m_encoded, ToCentimeters(event.position.y));
+			AppendSigned(m_encoded, ToCentimeters(event.position.z));
+
+			previousNanoseconds = event.nanoseconds;
+			previousTick = event.tick;
+		}
+
+		fwrite(m_encoded.data(), m_encoded.size(), 1, m_pFile);
+		m_numEvents.fetch_add(count, std::memory_order_relaxed);
+		m_numBytes.fetch_add(m_encoded.size(), std::memory_order_relaxed);
+	}
+}
+
+bool CMovementTelemetry::Read(const char* szPath, std::vector<SMovementTelemetryEvent>& events, std::vector<uint32>& droppedPerRing, bool* pIsComplete)
+{
+	events.clear();
+	droppedPerRing.clear();
+	if (pIsComplete != nullptr)
+	{
+		*pIsComplete = false;
+	}
+
+	FILE* pFile = fopen(szPath, "rb");
+	if (pFile == nullptr)
+		return false;
+
+	std::vector<uint8> data;
+	uint8 buffer[64 * 1024];
+	for (size_t numRead; (numRead = fread(buffer, 1, sizeof(buffer), pFile)) != 0;)
+	{
+		data.insert(data.end(), buffer, buffer + numRead);
+	}
+	fclose(pFile);
+
+	uint32 header[2];
+	if (data.size() < sizeof(header))
+		return false;
+
+	memcpy(header, data.data(), sizeof(header));
+	if (header[0] != Magic || header[1] != Version)
+		return false;
+
+	size_t position = sizeof(header);
+	while (position < data.size())
+	{
+		const uint8 tag = data[position++];
+		if (tag == eBT_End)
+		{
+			if (pIsComplete != nullptr)
+			{
+				*pIsComplete = true;
+			}
+			break;
+		}
+
+		uint64 ringIndex, value;
+		if (!ExtractVarint(data, position, ringIndex) || !ExtractVarint(data, position, value))
+			break;
+
+		if (tag == eBT_Dropped)
+		{
+			droppedPerRing.resize(std::max<size_t>(droppedPerRing.size(), ringIndex + 1));
+			droppedPerRing[ringIndex] = static_cast<uint32>(value);
+			continue;
+		}
+		if (tag != eBT_Events)
+			break;
+
+		// A block is only taken whole, the end of a cut off trace is dropped
+		const size_t blockBegin = events.size();
+		bool isBlockComplete = true;
+		uint64 nanoseconds = 0;
+		int64 tick = 0;
+		for (uint64 i = 0; i < value && isBlockComplete; ++i)
+		{
+			uint64 nanosecondsDelta, playerId;
+			int64 tickDelta, x, y, z;
+			isBlockComplete = ExtractVarint(data, position, nanosecondsDelta) && ExtractSigned(data, position, tickDelta) && ExtractVarint(data, position, playerId)
+				&& position + 3 <= data.size();
+			if (!isBlockComplete)
+				break;
+
+			SMovementTelemetryEvent event;
+			nanoseconds += nanosecondsDelta;
+			tick += tickDelta;
+			event.nanoseconds = nanoseconds;
+			event.tick = static_cast<uint32>(tick);
+			event.playerId = static_cast<uint32>(playerId);
+			event.type = static_cast<EMovementTelemetryEvent>(data[position++]);
+			event.flags = data[position++];
+			event.stance = static_cast<EPlayerStance>(data[position] & 0x0F);
+			event.playerState = static_cast<EPlayerState>(data[position++] >> 4);
+
+			isBlockComplete = ExtractSigned(data, position, x) && ExtractSigned(data, position, y) && ExtractSigned(data, position, z);
+			event.position = Vec3(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z)) * 0.01f;
+			events.push_back(event);
+		}
+
+		if (!isBlockComplete)
+		{
+			events.resize(blockBegin);
+			break;
+		}
+	}
+
+	std::stable_sort(events.begin(), events.end(), [](const SMovementTelemetryEvent& a, const SMovementTelemetryEvent& b) { return a.nanoseconds < b.nanoseconds; });
+	return true;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "PlayerMovement.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class EMovementTelemetryEvent : uint8
+{
+	// State of a player at the end of a tick, every CMovementTelemetry::GetSampleInterval ticks
+	TickSample,
+	SprintStart,
+	SprintEnd,
+	Jump,
+	DoubleJump,
+	WallJump,
+	// The stance in the event is the new one
+	StanceChange,
+	WallrunStart,
+	WallrunEnd,
+	// The cooldown after a wallrun is over, eMF_CanWallrun is set again
+	WallrunReady,
+
+	Count
+};
+
+const char* GetMovementTelemetryEventName(EMovementTelemetryEvent type);
+
+// A state transition or tick sample of one player, with the player's state right after it
+// The position is where the body was at the start of the tick, physics only moves it after the simulation.
+struct SMovementTelemetryEvent
+{
+	// Since the recording started
+	uint64 nanoseconds = 0;
+	uint32 tick = 0;
+	uint32 playerId = 0;
+	EMovementTelemetryEvent type = EMovementTelemetryEvent::TickSample;
+	// EMovementFlags
+	uint8 flags = 0;
+	EPlayerStance stance = EPlayerStance::Standing;
+	EPlayerState playerState = EPlayerState::Walking;
+	// Traces store it to the centimeter
+	Vec3 position = ZERO;
+};
+
+// Single producer, single consumer queue of events, one per recording thread
+// The producer only writes m_head and the consumer only m_tail, neither ever waits for the other. A full ring drops the event.
+class CMovementTelemetryRing
+{
+public:
+	static constexpr uint32 Capacity = 8192;
+
+	explicit CMovementTelemetryRing(uint32 index) : m_index(index), m_pEvents(new SMovementTelemetryEvent[Capacity]) {}
+
+	// Producer thread only
+	bool Push(const SMovementTelemetryEvent& event);
+	// Consumer thread only, returns the number of events copied to pEvents
+	uint32 Pop(SMovementTelemetryEvent* pEvents, uint32 maxEvents);
+
+	uint32 GetIndex() const { return m_index; }
+	uint32 GetDropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+	const uint32 m_index;
+	std::unique_ptr<SMovementTelemetryEvent[]> m_pEvents;
+
+	// On separate cache lines, so the two threads don't keep taking the line from each other
+	alignas(64) std::atomic<uint32> m_head { 0 };
+	alignas(64) std::atomic<uint32> m_tail { 0 };
+	std::atomic<uint32> m_dropped { 0 };
+};
+
+////////////////////////////////////////////////////////
+// Records movement state transitions and tick samples to a binary trace file while a match runs
+// The simulation records through CPlayerMovementStore::pTelemetry, which is only set while recording. Every thread that
+// records gets its own CMovementTelemetryRing the first time, after that recording is a copy into the ring without locks.
+// A writer thread drains the rings every few milliseconds, encodes the events and appends them to the file, so the
+// simulation never waits on the disk.
+// Trace layout: the header, then blocks of the events one ring held at a time, with varint deltas for the timestamps and
+// ticks and the position in centimeters. The trace ends with the number of events every ring dropped.
+////////////////////////////////////////////////////////
+class CMovementTelemetry
+{
+public:
+	static constexpr uint32 Magic = 0x4C54564D; // "MVTL"
+	static constexpr uint32 Version = 1;
+
+	struct SStats
+	{
+		uint64 events = 0;
+		uint64 dropped = 0;
+		uint64 bytes = 0;
+		uint32 rings = 0;
+	};
+
+	CMovementTelemetry() = default;
+	CMovementTelemetry(const CMovementTelemetry&) = delete;
+	CMovementTelemetry& operator=(const CMovementTelemetry&) = delete;
+	~CMovementTelemetry() { Stop(); }
+
+	// Opens the trace and starts the writer, tick samples are taken every sampleInterval ticks, 0 for transitions only
+	bool Start(const char* szPath, uint32 sampleInterval);
+	// Writes what the rings still hold and closes the trace. Nothing may be recording while this runs.
+	void Stop();
+	bool IsRecording() const { return m_pFile != nullptr; }
+
+	void Record(const SMovementTelemetryEvent& event);
+	// Time stamp for an event recorded now
+	uint64 GetNanoseconds() const;
+	uint32 GetSampleInterval() const { return m_sampleInterval; }
+
+	// Of the recording in progress, or the last one once it stopped
+	SStats GetStats() const;
+
+	// Reads a whole trace, with the events of all rings merged in time order
+	// A trace cut off by a crash reads up to its last complete block, pIsComplete tells whether it had its end.
+	static bool Read(const char* szPath, std::vector<SMovementTelemetryEvent>& events, std::vector<uint32>& droppedPerRing, bool* pIsComplete = nullptr);
+
+private:
+	CMovementTelemetryRing* GetThreadRing();
+	void RunWriter();
+	// Moves everything the rings hold into the file, writer thread only
+	void Drain();
+
+	FILE* m_pFile = nullptr;
+	uint32 m_sampleInterval = 1;
+	uint32 m_session = 0;
+	std::chrono::steady_clock::time_point m_start;
+
+	// Rings are added by the recording threads and only removed by Stop
+	mutable std::mutex m_ringMutex;
+	std::vector<std::unique_ptr<CMovementTelemetryRing>> m_rings;
+
+	std::thread m_writer;
+	std::mutex m_writerMutex;
+	std::condition_variable m_writerWake;
+	bool m_stopWriter = false;
+
+	// Writer thread only, reused between drains
+	std::vector<SMovementTelemetryEvent> m_drainEvents;
+	std::vector<uint8> m_encoded;
+
+	std::atomic<uint64> m_numEvents { 0 };
+	std::atomic<uint64> m_numBytes { 0 };
+	SStats m_lastStats;
+};
@@ -0,0 +1,99 @@
+#include "StdAfx.h"
+#include "MovementUpdateScheduler.h"
+
+void CMovementUpdateScheduler::AssignTiers(CPlayerMovementStore& store, const float* pViewerDistancesSq)
+{
+	for (uint32 i = 0, n = store.GetCount(); i < n; ++i)
+	{
+		SMovementUpdateLod& lod = store.updateLod[i];
+		const EMovementUpdateTier desiredTier = GetDesiredTier(store, i, pViewerDistancesSq[i]);
+		lod.lastHeld = store.input[i].held;
+
+		if (desiredTier < lod.tier)
+		{
+			lod.tier = desiredTier;
+			lod.holdTicks = m_settings.holdTicks;
+		}
+		else if (desiredTier > lod.tier)
+		{
+			// Step down one tier at a time, so a player leaving the view is not dropped straight to the slowest one
+			if (lod.holdTicks == 0)
+			{
+				lod.tier = static_cast<EMovementUpdateTier>(static_cast<uint32>(lod.tier) + 1);
+				lod.holdTicks = m_settings.holdTicks;
+			}
+			else
+			{
+				--lod.holdTicks;
+			}
+		}
+		else
+		{
+			lod.holdTicks = m_settings.holdTicks;
+		}
+	}
+}
+
+EMovementUpdateTier CMovementUpdateScheduler::GetDesiredTier(const CPlayerMovementStore& store, uint32 index, float closestDistanceSq) const
+{
+	const SMovementUpdateLod& lod = store.updateLod[index];
+	if (!m_settings.isEnabled || lod.isPinned || store.HasFlag(index, eMF_Wallrunning))
+		return EMovementUpdateTier::Full;
+
+	// Edges and mouse movement stay in the input until the player is simulated, so any of them means it has to be now
+	const SPlayerInput& input = store.input[index];
+	if (input.held != lod.lastHeld || input.pressed != 0 || input.released != 0 || !input.mouseDeltaRotation.IsZero())
+		return EMovementUpdateTier::Full;
+
+	// Nothing to see of a player standing still, it is promoted again as soon as its input changes
+	const SMovementBody& body = store.body[index];
+	if (body.isOnGround && input.held == 0 && body.velocity.GetLengthSquared() < m_settings.idleSpeed * m_settings.idleSpeed)
+		return EMovementUpdateTier::Eighth;
+
+	if (closestDistanceSq < m_settings.fullDistance * m_settings.fullDistance)
+		return EMovementUpdateTier::Full;
+	if (!body.isOnGround)
+		return m_settings.airborneTier;
+	if (closestDistanceSq < m_settings.halfDistance * m_settings.halfDistance)
+		return EMovementUpdateTier::Half;
+	if (closestDistanceSq < m_settings.quarterDistance * m_settings.quarterDistance)
+		return EMovementUpdateTier::Quarter;
+	return EMovementUpdateTier::Eighth;
+}
+
+uint32 CMovementUpdateScheduler::GetDueRanges(CPlayerMovementStore& store, std::array<SMovementUpdateRange, NumTiers>& ranges)
+{
+	uint32 numRanges = 0;
+	for (uint32 tier = 0; tier < NumTiers; ++tier)
+	{
+		// One block of the tier per tick, in turn
+		const uint32 period = GetPeriod(static_cast<EMovementUpdateTier>(tier));
+		const uint32 block = store.tick % period;
+		const uint32 count = m_tierBegin[tier + 1] - m_tierBegin[tier];
+		const uint32 begin = m_tierBegin[tier] + count * block / period;
+		const uint32 end = m_tierBegin[tier] + count * (block + 1) / period;
+		if (begin == end)
+			continue;
+
+		for (uint32 i = begin; i < end; ++i)
+		{
+			// Players moved between blocks by the grouping may come up early or late, the catch-up covers exactly the time since their last update
+			SMovementUpdateLod& lod = store.updateLod[i];
+			store.catchUpTicks[i] = static_cast<uint8>(crymath::clamp(store.tick - lod.lastUpdateTick, 1u, MaxCatchUpTicks));
+			lod.lastUpdateTick = store.tick;
+		}
+
+		ranges[numRanges++] = SMovementUpdateRange { begin, end };
+		m_stats.updates[tier] += end - begin;
+	}
+
+	++m_stats.ticks;
+	return numRanges;
+}
+
+void CMovementUpdateScheduler::ResetStats()
+{
+	const std::array<uint32, NumTiers> players = m_stats.players;
+	m_stats = SStats();
+	m_stats.players = players;
+}
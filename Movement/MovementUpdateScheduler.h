@@ -0,0 +1,124 @@
+#pragma once
+
+#include "PlayerMovementStore.h"
+
+#include <array>
+
+// Players [begin, end) of the store, simulated together in one tick
+struct SMovementUpdateRange
+{
+	uint32 begin;
+	uint32 end;
+};
+
+////////////////////////////////////////////////////////
+// Update-rate LOD: decides per tick which players are simulated and keeps the store grouped by how often
+// Every player gets a tier from its distance to the nearest viewer, raised while it is airborne, wallrunning or
+// its input changes, and dropped to the slowest tier while it stands idle. The store is kept sorted by tier, and a
+// tier with period N runs one Nth of its players per tick, so each of them is simulated every N ticks over N times
+// the tick length (see SMovementUpdateLod::lastUpdateTick and CPlayerMovementStore::catchUpTicks).
+// Faster tiers take effect immediately, slower ones only after the player qualified for them for holdTicks.
+////////////////////////////////////////////////////////
+class CMovementUpdateScheduler
+{
+public:
+	static constexpr uint32 NumTiers = static_cast<uint32>(EMovementUpdateTier::Count);
+	// Longest span a single update catches up on, a player that had to wait longer loses the rest
+	static constexpr uint32 MaxCatchUpTicks = 16;
+
+	struct SSettings
+	{
+		// Nearest viewer closer than this keeps the tier, further away the player drops to the next one
+		float fullDistance = 20.f;
+		float halfDistance = 50.f;
+		float quarterDistance = 100.f;
+		// Slowest tier for players in the air, landing and double jumps need it
+		EMovementUpdateTier airborneTier = EMovementUpdateTier::Half;
+		// Body speed below which a player without held actions counts as idle
+		float idleSpeed = 0.1f;
+		uint16 holdTicks = 30;
+		bool isEnabled = true;
+	};
+
+	struct SStats
+	{
+		// Players in each tier as of the last tick
+		std::array<uint32, NumTiers> players = {};
+		// Player updates run per tier since the last reset
+		std::array<uint64, NumTiers> updates = {};
+		uint64 ticks = 0;
+		// Store rows exchanged to keep the tiers grouped
+		uint64 swaps = 0;
+	};
+
+	static uint32 GetPeriod(EMovementUpdateTier tier) { return 1u << static_cast<uint32>(tier); }
+
+	// Assigns every player its tier for the upcoming tick
+	// pViewerDistancesSq has the squared distance of each player to the nearest position players are seen from, in store order.
+	void AssignTiers(CPlayerMovementStore& store, const float* pViewerDistancesSq);
+
+	// Sorts the store by tier, calling onSwap(a, b) after each exchange so data kept alongside the store can follow
+	template<typename TOnSwap>
+	void GroupByTier(CPlayerMovementStore& store, TOnSwap&& onSwap);
+
+	// Writes the ranges due on the upcoming tick, sets their catch-up ticks and returns how many there are
+	uint32 GetDueRanges(CPlayerMovementStore& store, std::array<SMovementUpdateRange, NumTiers>& ranges);
+
+	SSettings& GetSettings() { return m_settings; }
+	const SStats& GetStats() const { return m_stats; }
+	void ResetStats();
+
+private:
+	EMovementUpdateTier GetDesiredTier(const CPlayerMovementStore& store, uint32 index, float closestDistanceSq) const;
+
+	SSettings m_settings;
+	SStats m_stats;
+	// First store row of each tier after grouping, followed by the end of the last one
+	std::array<uint32, NumTiers + 1> m_tierBegin = {};
+};
+
+template<typename TOnSwap>
+inline void CMovementUpdateScheduler::GroupByTier(CPlayerMovementStore& store, TOnSwap&& onSwap)
+{
+	std::array<uint32, NumTiers> counts = {};
+	for (uint32 i = 0, n = store.GetCount(); i < n; ++i)
+	{
+		++counts[static_cast<uint32>(store.updateLod[i].tier)];
+	}
+
+	m_tierBegin[0] = 0;
+	for (uint32 tier = 0; tier < NumTiers; ++tier)
+	{
+		m_tierBegin[tier + 1] = m_tierBegin[tier] + counts[tier];
+		m_stats.players[tier] = counts[tier];
+	}
+
+	// In-place bucket sort, players already inside the range of their tier stay where they are
+	std::array<uint32, NumTiers> next;
+	std::copy(m_tierBegin.begin(), m_tierBegin.begin() + NumTiers, next.begin());
+	for (uint32 tier = 0; tier < NumTiers; ++tier)
+	{
+		while (next[tier] < m_tierBegin[tier + 1])
+		{
+			const uint32 index = next[tier];
+			const uint32 actualTier = static_cast<uint32>(store.updateLod[index].tier);
+			if (actualTier == tier)
+			{
+				++next[tier];
+				continue;
+			}
+
+			// The player belongs further on, take the first row there that does not belong to that tier yet
+			uint32 target = next[actualTier];
+			while (store.updateLod[target].tier == store.updateLod[index].tier)
+			{
+				++target;
+			}
+			next[actualTier] = target + 1;
+
+			store.Swap(index, target);
+			onSwap(index, target);
+			++m_stats.swaps;
+		}
+	}
+}
@@ -0,0 +1,218 @@
+#include "StdAfx.h"
+#include "PlayerCapsuleHistory.h"
+
+#include <chrono>
+#include <vector>
+
+CPlayerCapsuleHistory::CPlayerCapsuleHistory()
+	: m_pFrames(new SFrame[MaxTicks]())
+{
+}
+
+void CPlayerCapsuleHistory::Clear()
+{
+	for (uint32 i = 0; i < MaxTicks; ++i)
+	{
+		m_pFrames[i].isValid = false;
+	}
+	m_newestTick = 0;
+	m_numRecorded = 0;
+}
+
+void CPlayerCapsuleHistory::BeginTick(uint32 tick)
+{
+	SFrame& frame = m_pFrames[tick & (MaxTicks - 1)];
+	frame.tick = tick;
+	frame.isValid = true;
+	// Rows of the previous use of the frame would still be found by the broad phase
+	std::fill(frame.radius, frame.radius + frame.count, 0.f);
+	frame.count = 0;
+
+	m_newestTick = tick;
+	++m_numRecorded;
+}
+
+bool CPlayerCapsuleHistory::Add(uint32 id, const Vec3& bottom, float height, float radius)
+{
+	SFrame& frame = m_pFrames[m_newestTick & (MaxTicks - 1)];
+	if (m_numRecorded == 0 || frame.count == MaxPlayers)
+		return false;
+
+	const uint32 index = frame.count++;
+	frame.x[index] = bottom.x;
+	frame.y[index] = bottom.y;
+	frame.bottom[index] = bottom.z;
+	frame.top[index] = bottom.z + height;
+	frame.radius[index] = radius;
+	frame.ids[index] = id;
+	return true;
+}
+
+bool CPlayerCapsuleHistory::FindTick(uint32 tick, uint32& recordedTick) const
+{
+	if (m_numRecorded == 0)
+		return false;
+
+	// Ticks after the newest one are served by the newest, anything older than the history is gone
+	const uint32 newestAge = static_cast<int32>(m_newestTick - tick) < 0 ? 0 : m_newestTick - tick;
+	for (uint32 age = newestAge; age < MaxTicks; ++age)
+	{
+		const uint32 candidate = m_newestTick - age;
+		const SFrame& frame = m_pFrames[candidate & (MaxTicks - 1)];
+		if (frame.isValid && frame.tick == candidate)
+		{
+			recordedTick = candidate;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool CPlayerCapsuleHistory::Raycast(uint32 tick, const SCapsuleRay* pRays, uint32 numRays, SCapsuleRayHit* pHits) const
+{
+	const SFrame& frame = m_pFrames[tick & (MaxTicks - 1)];
+	if (m_numRecorded == 0 || !frame.isValid || frame.tick != tick)
+		return false;
+
+	for (uint32 i = 0; i < numRays; ++i)
+	{
+		Raycast(frame, pRays[i], pHits[i]);
+	}
+	return true;
+}
+
+void CPlayerCapsuleHistory::Raycast(const SFrame& frame, const SCapsuleRay& ray, SCapsuleRayHit& hit)
+{
+	const float ox = ray.origin.x, oy = ray.origin.y, oz = ray.origin.z;
+	const float dx = ray.direction.x, dy = ray.direction.y, dz = ray.direction.z;
+
+	// Broad phase, the ray has to pass through the sphere around the capsule. Runs over the whole fixed-size frame without
+	// branches so the compiler turns it into SIMD code, the rows past the count are zeroed and never candidates.
+	uint32 isCandidate[MaxPlayers];
+	for (uint32 j = 0; j < MaxPlayers; ++j)
+	{
+		const float halfHeight = (frame.top[j] - frame.bottom[j]) * 0.5f;
+		const float mx = ox - frame.x[j];
+		const float my = oy - frame.y[j];
+		const float mz = oz - frame.bottom[j] - halfHeight;
+		const float boundRadius = frame.radius[j] + halfHeight;
+
+		const float b = mx * dx + my * dy + mz * dz;
+		const float c = mx * mx + my * my + mz * mz - boundRadius * boundRadius;
+		// In front of the origin and not beyond the end of the ray, & instead of && so there is nothing to branch on
+		isCandidate[j] = static_cast<uint32>(b * b >= c) & static_cast<uint32>(b <= boundRadius) & static_cast<uint32>(-b - boundRadius <= ray.length)
+			& static_cast<uint32>(frame.ids[j] != ray.ignoreId) & static_cast<uint32>(frame.radius[j] > 0.f);
+	}
+
+	uint32 candidates[MaxPlayers];
+	uint32 numCandidates = 0;
+	for (uint32 j = 0; j < frame.count; ++j)
+	{
+		candidates[numCandidates] = j;
+		numCandidates += isCandidate[j];
+	}
+
+	// Rays going straight up or down cannot enter through the side
+	const float horizontal = dx * dx + dy * dy;
+	const float invHorizontal = horizontal > 1e-8f ? 1.f / horizontal : 0.f;
+	const float noHit = std::numeric_limits<float>::max();
+
+	float nearest = ray.length;
+	uint32 nearestIndex = MaxPlayers;
+	for (uint32 candidate = 0; candidate < numCandidates; ++candidate)
+	{
+		const uint32 j = candidates[candidate];
+		const float mx = ox - frame.x[j];
+		const float my = oy - frame.y[j];
+		const float radiusSq = frame.radius[j] * frame.radius[j];
+
+		// Side: where the ray enters the infinite vertical cylinder, if that is between the sphere centers
+		const float b = mx * dx + my * dy;
+		const float c = mx * mx + my * my - radiusSq;
+		const float sideDisc = b * b - horizontal * c;
+		const float sideT = (-b - sqrtf(std::max(sideDisc, 0.f))) * invHorizontal;
+		const float sideZ = oz + dz * sideT;
+		const bool isSideHit = sideDisc >= 0.f && invHorizontal > 0.f && sideT >= 0.f && sideZ >= frame.bottom[j] && sideZ <= frame.top[j];
+
+		// Ends: the two spheres, the cylinder's flat caps lie inside them
+		const float bottomZ = oz - frame.bottom[j];
+		const float bottomB = b + bottomZ * dz;
+		const float bottomDisc = bottomB * bottomB - (c + bottomZ * bottomZ);
+		const float bottomT = -bottomB - sqrtf(std::max(bottomDisc, 0.f));
+
+		const float topZ = oz - frame.top[j];
+		const float topB = b + topZ * dz;
+		const float topDisc = topB * topB - (c + topZ * topZ);
+		const float topT = -topB - sqrtf(std::max(topDisc, 0.f));
+
+		const float t = std::min(isSideHit ? sideT : noHit, std::min(bottomDisc >= 0.f && bottomT >= 0.f ? bottomT : noHit, topDisc >= 0.f && topT >= 0.f ? topT : noHit));
+		if (t < nearest)
+		{
+			nearest = t;
+			nearestIndex = j;
+		}
+	}
+
+	hit.id = nearestIndex < frame.count ? frame.ids[nearestIndex] : 0;
+	hit.distance = nearestIndex < frame.count ? nearest : 0.f;
+}
+
+CPlayerCapsuleHistory::SBenchmarkResult CPlayerCapsuleHistory::RunBenchmark(uint32 numPlayers, uint32 numRays, uint32 numIterations)
+{
+	using TClock = std::chrono::high_resolution_clock;
+
+	SBenchmarkResult result;
+	result.numPlayers = std::min(numPlayers, MaxPlayers);
+	result.numRays = numRays;
+	if (result.numPlayers == 0 || numRays == 0 || numIterations == 0)
+		return result;
+
+	// Deterministic noise, so runs are comparable
+	uint32 random = 0x9E3779B9;
+	auto nextRandom = [&random](float minValue, float maxValue)
+	{
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		return minValue + static_cast<float>(random & 0xFFFF) / 65535.f * (maxValue - minValue);
+	};
+
+	// Standing and crouching players spread over an arena
+	CPlayerCapsuleHistory history;
+	history.BeginTick(1);
+	std::vector<Vec3> targets(result.numPlayers);
+	for (uint32 i = 0; i < result.numPlayers; ++i)
+	{
+		const Vec3 bottom(nextRandom(-50.f, 50.f), nextRandom(-50.f, 50.f), nextRandom(0.f, 5.f) + 0.6f);
+		const float height = nextRandom(0.f, 1.f) < 0.8f ? 1.7f : 0.75f;
+		history.Add(i + 1, bottom, height, 0.4f);
+		targets[i] = bottom + Vec3(0.f, 0.f, height * 0.5f);
+	}
+
+	// Every ray is fired by one player at another, aimed with some spread so that not all of them hit
+	std::vector<SCapsuleRay> rays(numRays);
+	std::vector<SCapsuleRayHit> hits(numRays);
+	for (SCapsuleRay& ray : rays)
+	{
+		const uint32 shooter = static_cast<uint32>(nextRandom(0.f, static_cast<float>(result.numPlayers) - 0.01f));
+		const uint32 target = static_cast<uint32>(nextRandom(0.f, static_cast<float>(result.numPlayers) - 0.01f));
+		ray.origin = targets[shooter] + Vec3(0.f, 0.f, 0.8f);
+		const Vec3 aim = targets[target] + Vec3(nextRandom(-1.f, 1.f), nextRandom(-1.f, 1.f), nextRandom(-1.f, 1.f)) - ray.origin;
+		ray.direction = aim.GetNormalizedSafe(Vec3(0.f, 1.f, 0.f));
+		ray.length = 200.f;
+		ray.ignoreId = shooter + 1;
+	}
+
+	const TClock::time_point start = TClock::now();
+	for (uint32 iteration = 0; iteration < numIterations; ++iteration)
+	{
+		history.Raycast(1, rays.data(), numRays, hits.data());
+	}
+	const TClock::duration time = TClock::now() - start;
+
+	result.nanosecondsPerRay = static_cast<float>(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count())
+		/ (static_cast<float>(numRays) * static_cast<float>(numIterations));
+	result.numHits = static_cast<uint32>(std::count_if(hits.begin(), hits.end(), [](const SCapsuleRayHit& hit) { return hit.IsHit(); }));
+	return result;
+}
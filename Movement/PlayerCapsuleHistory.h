@@ -0,0 +1,95 @@
+#pragma once
+
+#include <memory>
+
+// Shot, or any other ray, tested against the recorded capsules
+struct SCapsuleRay
+{
+	Vec3 origin = ZERO;
+	// Normalized
+	Vec3 direction = Vec3(0.f, 1.f, 0.f);
+	float length = 0.f;
+	// Player the ray cannot hit, usually the one firing it
+	uint32 ignoreId = 0;
+};
+
+struct SCapsuleRayHit
+{
+	bool IsHit() const { return id != 0; }
+
+	// Id of the player hit, 0 for a miss
+	uint32 id = 0;
+	// Along the ray, up to its length
+	float distance = 0.f;
+};
+
+////////////////////////////////////////////////////////
+// Server-side record of where every player's collision capsule was, for the last MaxTicks ticks
+// Answers what a ray hit at a past tick, i.e. what a client shooting at the players it saw hit, by testing the ray against
+// the recorded capsules instead of moving physics entities back and forth. Every tick is a fixed-size frame of
+// MaxPlayers capsules kept as separate float arrays, the whole history is allocated once.
+// Players are vertical capsules: the segment between the centers of their bottom and top spheres, and the sphere radius.
+// Ids are whatever the caller identifies players by and must not be 0, CPlayerMovementSystem uses entity ids.
+////////////////////////////////////////////////////////
+class CPlayerCapsuleHistory
+{
+public:
+	static constexpr uint32 MaxTicks = 128;
+	static constexpr uint32 MaxPlayers = 64;
+
+	struct SBenchmarkResult
+	{
+		uint32 numPlayers = 0;
+		uint32 numRays = 0;
+		float nanosecondsPerRay = 0.f;
+		// Rays that hit somebody, the same on every iteration
+		uint32 numHits = 0;
+	};
+
+	CPlayerCapsuleHistory();
+
+	void Clear();
+
+	// Starts recording the frame of a tick, overwriting the one MaxTicks before it
+	void BeginTick(uint32 tick);
+	// Adds a player to the frame begun last, returns false once it holds MaxPlayers
+	bool Add(uint32 id, const Vec3& bottom, float height, float radius);
+
+	// Newest recorded tick that is not after the given one, false if there is none in the history
+	// Ticks are not necessarily recorded back to back, e.g. when several ran in one frame.
+	bool FindTick(uint32 tick, uint32& recordedTick) const;
+	bool IsEmpty() const { return m_numRecorded == 0; }
+	uint32 GetNewestTick() const { return m_newestTick; }
+
+	// Finds the nearest capsule every ray hits among those recorded for the tick, which has to be in the history
+	// (see FindTick). Returns false if it is not.
+	bool Raycast(uint32 tick, const SCapsuleRay* pRays, uint32 numRays, SCapsuleRayHit* pHits) const;
+
+	// Memory a frame of MaxPlayers capsules takes
+	static constexpr size_t GetFrameBytes() { return sizeof(SFrame); }
+
+	// Casts numRays random rays at numPlayers random capsules numIterations times
+	static SBenchmarkResult RunBenchmark(uint32 numPlayers, uint32 numRays, uint32 numIterations);
+
+private:
+	struct SFrame
+	{
+		uint32 tick = 0;
+		uint32 count = 0;
+		bool isValid = false;
+
+		float x[MaxPlayers];
+		float y[MaxPlayers];
+		// Center of the bottom sphere, the top one is height above it
+		float bottom[MaxPlayers];
+		float top[MaxPlayers];
+		float radius[MaxPlayers];
+		uint32 ids[MaxPlayers];
+	};
+
+	static void Raycast(const SFrame& frame, const SCapsuleRay& ray, SCapsuleRayHit& hit);
+
+	std::unique_ptr<SFrame[]> m_pFrames;
+	uint32 m_newestTick = 0;
+	uint32 m_numRecorded = 0;
+};
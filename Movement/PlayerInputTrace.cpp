@@ -0,0 +1,282 @@
+#include "StdAfx.h"
+#include "PlayerInputTrace.h"
+#include "HeadlessMovementPhysics.h"
+#include "PlayerMovementSimulation.h"
+
+#if CRY_PLATFORM_WINDOWS
+	#include <CryCore/Platform/CryWindows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include <cstdio>
+
+namespace
+{
+	enum ETraceRecordFlags : uint8
+	{
+		eTRF_Edges         = 1 << 0,
+		eTRF_MovementDelta = 1 << 1,
+		eTRF_MouseDelta    = 1 << 2,
+	};
+
+	static_assert(ePIA_Crouch <= 0xFF, "Input actions no longer fit the one byte trace fields");
+
+	template<typename T>
+	void AppendValue(std::vector<uint8>& buffer, const T& value)
+	{
+		const uint8* pBytes = reinterpret_cast<const uint8*>(&value);
+		buffer.insert(buffer.end(), pBytes, pBytes + sizeof(T));
+	}
+
+	template<typename T>
+	bool Extract(const uint8* pData, size_t size, size_t& position, T& value)
+	{
+		if (position + sizeof(T) > size)
+			return false;
+
+		memcpy(&value, pData + position, sizeof(T));
+		position += sizeof(T);
+		return true;
+	}
+
+	// FNV-1a over the bit patterns, a difference in the last float bit changes the result
+	template<typename T>
+	uint32 Hash(uint32 checksum, const T& value)
+	{
+		const uint8* pBytes = reinterpret_cast<const uint8*>(&value);
+		for (size_t i = 0; i < sizeof(T); ++i)
+		{
+			checksum = (checksum ^ pBytes[i]) * 16777619u;
+		}
+		return checksum;
+	}
+}
+
+uint32 CPlayerInputTrace::HashTick(uint32 checksum, const SPlayerMovementState& state, const Vec3& position)
+{
+	// Field by field, the struct has padding
+	checksum = Hash(checksum, state.yaw);
+	checksum = Hash(checksum, state.pitch);
+	checksum = Hash(checksum, state.playerState);
+	checksum = Hash(checksum, state.stance);
+	checksum = Hash(checksum, state.desiredStance);
+	checksum = Hash(checksum, state.flags);
+	checksum = Hash(checksum, state.wallNormal);
+	checksum = Hash(checksum, state.wallrunTimer);
+	checksum = Hash(checksum, state.wallrunRoll);
+	checksum = Hash(checksum, state.cameraOffset);
+	checksum = Hash(checksum, state.cameraRoll);
+	checksum = Hash(checksum, state.fov);
+	checksum = Hash(checksum, position);
+	return checksum;
+}
+
+void CPlayerInputTraceWriter::Begin(const SPlayerInputTraceHeader& header)
+{
+	m_header = header;
+	m_header.numTicks = 0;
+	m_header.checksum = 2166136261u;
+	m_records.clear();
+}
+
+void CPlayerInputTraceWriter::Append(const SPlayerInput& input, const SPlayerMovementState& stateAfter, const Vec3& positionAfter)
+{
+	uint8 flags = 0;
+	flags |= (input.pressed | input.released) != 0 ? eTRF_Edges : 0;
+	flags |= !input.movementDelta.IsZero() ? eTRF_MovementDelta : 0;
+	flags |= !input.mouseDeltaRotation.IsZero() ? eTRF_MouseDelta : 0;
+
+	m_records.push_back(flags);
+	m_records.push_back(static_cast<uint8>(input.held));
+	if (flags & eTRF_Edges)
+	{
+		m_records.push_back(static_cast<uint8>(input.pressed));
+		m_records.push_back(static_cast<uint8>(input.released));
+	}
+	if (flags & eTRF_MovementDelta)
+	{
+		AppendValue(m_records, input.movementDelta.x);
+		AppendValue(m_records, input.movementDelta.y);
+	}
+	if (flags & eTRF_MouseDelta)
+	{
+		AppendValue(m_records, input.mouseDeltaRotation.x);
+		AppendValue(m_records, input.mouseDeltaRotation.y);
+	}
+
+	m_header.checksum = CPlayerInputTrace::HashTick(m_header.checksum, stateAfter, positionAfter);
+	++m_header.numTicks;
+}
+
+bool CPlayerInputTraceWriter::Save(const char* szPath) const
+{
+	FILE* pFile = fopen(szPath, "wb");
+	if (pFile == nullptr)
+		return false;
+
+	bool isWritten = fwrite(&m_header, sizeof(m_header), 1, pFile) == 1;
+	isWritten &= m_records.empty() || fwrite(m_records.data(), m_records.size(), 1, pFile) == 1;
+	isWritten &= fclose(pFile) == 0;
+	return isWritten;
+}
+
+bool CPlayerInputTraceReader::Open(const uint8* pData, size_t size)
+{
+	size_t position = 0;
+	if (pData == nullptr || !Extract(pData, size, position, m_header))
+		return false;
+
+	if (m_header.magic != SPlayerInputTraceHeader::Magic || m_header.version != SPlayerInputTraceHeader::Version || m_header.headerSize != sizeof(SPlayerInputTraceHeader))
+		return false;
+
+	m_pRecords = pData + position;
+	m_size = size - position;
+	m_position = 0;
+	return true;
+}
+
+bool CPlayerInputTraceReader::Read(SPlayerInput& input)
+{
+	uint8 flags = 0, held = 0;
+	if (!Extract(m_pRecords, m_size, m_position, flags) || !Extract(m_pRecords, m_size, m_position, held))
+		return false;
+
+	input = SPlayerInput();
+	input.held = held;
+
+	bool isComplete = true;
+	if (flags & eTRF_Edges)
+	{
+		uint8 pressed = 0, released = 0;
+		isComplete &= Extract(m_pRecords, m_size, m_position, pressed) && Extract(m_pRecords, m_size, m_position, released);
+		input.pressed = pressed;
+		input.released = released;
+	}
+	if (flags & eTRF_MovementDelta)
+	{
+		isComplete &= Extract(m_pRecords, m_size, m_position, input.movementDelta.x) && Extract(m_pRecords, m_size, m_position, input.movementDelta.y);
+	}
+	if (flags & eTRF_MouseDelta)
+	{
+		isComplete &= Extract(m_pRecords, m_size, m_position, input.mouseDeltaRotation.x) && Extract(m_pRecords, m_size, m_position, input.mouseDeltaRotation.y);
+	}
+	return isComplete;
+}
+
+bool CMappedFile::Open(const char* szPath)
+{
+	Close();
+
+#if CRY_PLATFORM_WINDOWS
+	HANDLE hFile = CreateFileA(szPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	HANDLE hMapping = GetFileSizeEx(hFile, &size) && size.QuadPart > 0 ? CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	const void* pView = hMapping != nullptr ? MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (pView == nullptr)
+	{
+		if (hMapping != nullptr)
+		{
+			CloseHandle(hMapping);
+		}
+		CloseHandle(hFile);
+		return false;
+	}
+
+	m_hFile = hFile;
+	m_hMapping = hMapping;
+	m_pData = static_cast<const uint8*>(pView);
+	m_size = static_cast<size_t>(size.QuadPart);
+#else
+	const int file = open(szPath, O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat status;
+	void* pView = fstat(file, &status) == 0 && status.st_size > 0 ? mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+	// The mapping stays valid after the descriptor is gone
+	close(file);
+	if (pView == MAP_FAILED)
+		return false;
+
+	m_pData = static_cast<const uint8*>(pView);
+	m_size = static_cast<size_t>(status.st_size);
+#endif
+	return true;
+}
+
+void CMappedFile::Close()
+{
+	if (m_pData == nullptr)
+		return;
+
+#if CRY_PLATFORM_WINDOWS
+	UnmapViewOfFile(m_pData);
+	CloseHandle(m_hMapping);
+	CloseHandle(m_hFile);
+	m_hFile = m_hMapping = nullptr;
+#else
+	munmap(const_cast<uint8*>(m_pData), m_size);
+#endif
+	m_pData = nullptr;
+	m_size = 0;
+}
+
+CPlayerInputTraceReplay::SResult CPlayerInputTraceReplay::RunHeadless(CPlayerInputTraceReader& trace, uint32 numPlayers)
+{
+	using TClock = std::chrono::steady_clock;
+
+	const SPlayerInputTraceHeader& header = trace.GetHeader();
+	const float tickLength = 1.f / std::max(header.tickRate, 1.f);
+
+	CHeadlessMovementPhysics::SWorld world;
+	world.groundHeight = header.initialPosition.z;
+
+	std::vector<std::unique_ptr<CHeadlessMovementPhysics>> bodies;
+	CPlayerMovementStore store;
+	for (uint32 i = 0; i < numPlayers; ++i)
+	{
+		bodies.emplace_back(stl::make_unique<CHeadlessMovementPhysics>(world, header.initialPosition));
+		bodies.back()->SetBodyState(header.initialPosition, header.initialVelocity);
+
+		const PlayerMovementId id = store.Add(header.params, *bodies.back());
+		store.SetState(store.GetIndex(id), header.initialState);
+	}
+
+	SResult result;
+	result.numPlayers = numPlayers;
+	result.checksum = 2166136261u;
+
+	trace.Rewind();
+	const TClock::time_point start = TClock::now();
+
+	SPlayerInput input;
+	while (result.numTicks < header.numTicks && trace.Read(input))
+	{
+		for (uint32 i = 0; i < numPlayers; ++i)
+		{
+			store.input[i] = input;
+		}
+
+		CPlayerMovementSimulation::Step(store, tickLength, &result.timings);
+		for (const std::unique_ptr<CHeadlessMovementPhysics>& pBody : bodies)
+		{
+			pBody->Integrate(tickLength);
+		}
+
+		if (numPlayers > 0)
+		{
+			result.checksum = CPlayerInputTrace::HashTick(result.checksum, store.GetState(0), store.body[0].position);
+		}
+		++result.numTicks;
+	}
+
+	result.totalNanoseconds = static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(TClock::now() - start).count());
+	return result;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "MovementStageTimings.h"
+#include "PlayerMovement.h"
+
+#include <vector>
+
+// Fixed part at the start of every input trace
+// Written as raw memory, so a trace only replays with the build layout it was recorded with (checked through headerSize).
+struct SPlayerInputTraceHeader
+{
+	static constexpr uint32 Magic = 0x52544950; // "PITR"
+	static constexpr uint32 Version = 1;
+
+	uint32 magic = Magic;
+	uint32 version = Version;
+	uint32 headerSize = sizeof(SPlayerInputTraceHeader);
+	float tickRate = CFixedTickAccumulator::DefaultTickRate;
+	uint32 numTicks = 0;
+	// Running checksum of the recorded player after every tick, see CPlayerInputTrace::HashTick
+	uint32 checksum = 0;
+
+	SMovementParams params;
+	SPlayerMovementState initialState;
+	Vec3 initialPosition = ZERO;
+	Vec3 initialVelocity = ZERO;
+};
+
+////////////////////////////////////////////////////////
+// Compact binary recording of the input a player simulated with, one record per tick
+// A record is a byte of present-field bits and the held actions, followed by press / release edges,
+// movement delta and mouse delta only when they are non-zero. Replaying it from the recorded start
+// state reproduces the movement exactly, as far as the physics world behaves the same.
+////////////////////////////////////////////////////////
+class CPlayerInputTrace
+{
+public:
+	// Folds the state after one tick into a running checksum
+	static uint32 HashTick(uint32 checksum, const SPlayerMovementState& state, const Vec3& position);
+};
+
+class CPlayerInputTraceWriter
+{
+public:
+	void Begin(const SPlayerInputTraceHeader& header);
+	void Append(const SPlayerInput& input, const SPlayerMovementState& stateAfter, const Vec3& positionAfter);
+	// Writes the trace to disk, returns false if the file could not be written
+	bool Save(const char* szPath) const;
+
+	uint32 GetNumTicks() const { return m_header.numTicks; }
+
+private:
+	SPlayerInputTraceHeader m_header;
+	std::vector<uint8> m_records;
+};
+
+// Reads a trace straight from memory, e.g. a CMappedFile
+class CPlayerInputTraceReader
+{
+public:
+	// Returns false if the data is not a trace of this build
+	bool Open(const uint8* pData, size_t size);
+	void Rewind() { m_position = 0; }
+	// Returns false once all ticks were read or the data is cut off
+	bool Read(SPlayerInput& input);
+
+	const SPlayerInputTraceHeader& GetHeader() const { return m_header; }
+
+private:
+	SPlayerInputTraceHeader m_header;
+	const uint8* m_pRecords = nullptr;
+	size_t m_size = 0;
+	size_t m_position = 0;
+};
+
+// Read-only memory mapping of a whole file
+class CMappedFile
+{
+public:
+	CMappedFile() = default;
+	CMappedFile(const CMappedFile&) = delete;
+	CMappedFile& operator=(const CMappedFile&) = delete;
+	~CMappedFile() { Close(); }
+
+	bool Open(const char* szPath);
+	void Close();
+
+	const uint8* GetData() const { return m_pData; }
+	size_t GetSize() const { return m_size; }
+
+private:
+	const uint8* m_pData = nullptr;
+	size_t m_size = 0;
+#if CRY_PLATFORM_WINDOWS
+	void* m_hFile = nullptr;
+	void* m_hMapping = nullptr;
+#endif
+};
+
+////////////////////////////////////////////////////////
+// Runs a trace through the movement simulation without the engine
+// Every player gets the same input, on a flat CHeadlessMovementPhysics ground plane, so traces that
+// rely on level geometry (wallruns) do not match their recorded checksum here. The replay checksum is
+// still stable between runs, which is what catches behavior changes in the movement code.
+////////////////////////////////////////////////////////
+class CPlayerInputTraceReplay
+{
+public:
+	struct SResult
+	{
+		uint32 numTicks = 0;
+		uint32 numPlayers = 0;
+		// Checksum of the first player, comparable with SPlayerInputTraceHeader::checksum
+		uint32 checksum = 0;
+		SMovementStageTimings timings;
+		uint64 totalNanoseconds = 0;
+	};
+
+	static SResult RunHeadless(CPlayerInputTraceReader& trace, uint32 numPlayers);
+};
@@ -0,0 +1,128 @@
+#include "StdAfx.h"
+#include "PlayerInterestGrid.h"
+
+void CPlayerInterestGrid::Update(CPlayerMovementStore& store)
+{
+	const float cellSize = std::max(m_settings.cellSize, 1.f);
+	if (cellSize != m_cellSize)
+	{
+		m_cellSize = cellSize;
+		m_invCellSize = 1.f / cellSize;
+		Rebuild(store);
+	}
+
+	for (uint32 i = 0, n = store.GetCount(); i < n; ++i)
+	{
+		const Vec3& position = store.body[i].position;
+		SPlayerInterestCell& cell = store.interestCell[i];
+		const int32 x = GetCellCoordinate(position.x);
+		const int32 y = GetCellCoordinate(position.y);
+		if (cell.isTracked && cell.x == x && cell.y == y)
+			continue;
+
+		if (cell.isTracked)
+		{
+			RemoveFromCell(cell, store.ids[i]);
+		}
+		cell.x = x;
+		cell.y = y;
+		cell.isTracked = true;
+		AddToCell(cell, store.ids[i]);
+		++m_stats.cellChanges;
+	}
+
+	m_stats.numPlayers = store.GetCount();
+	++m_stats.updates;
+}
+
+void CPlayerInterestGrid::Remove(CPlayerMovementStore& store, uint32 index)
+{
+	SPlayerInterestCell& cell = store.interestCell[index];
+	if (!cell.isTracked)
+		return;
+
+	RemoveFromCell(cell, store.ids[index]);
+	cell.isTracked = false;
+}
+
+void CPlayerInterestGrid::GatherRelevant(const CPlayerMovementStore& store, const Vec3& viewer, std::vector<SRelevantPlayer>& relevant)
+{
+	relevant.clear();
+	ForEachInRadius(store, viewer, m_settings.cullDistance, [this, &relevant](uint32 index, float distanceSq)
+	{
+		relevant.push_back(SRelevantPlayer { index, distanceSq, GetTier(distanceSq) });
+	});
+}
+
+EMovementUpdateTier CPlayerInterestGrid::GetTier(float distanceSq) const
+{
+	if (distanceSq < m_settings.fullDistance * m_settings.fullDistance)
+		return EMovementUpdateTier::Full;
+	if (distanceSq < m_settings.halfDistance * m_settings.halfDistance)
+		return EMovementUpdateTier::Half;
+	if (distanceSq < m_settings.quarterDistance * m_settings.quarterDistance)
+		return EMovementUpdateTier::Quarter;
+	return EMovementUpdateTier::Eighth;
+}
+
+void CPlayerInterestGrid::ResetStats()
+{
+	const SStats stats = m_stats;
+	m_stats = SStats();
+	m_stats.numPlayers = stats.numPlayers;
+	m_stats.numCells = stats.numCells;
+	m_stats.numOccupiedCells = stats.numOccupiedCells;
+}
+
+void CPlayerInterestGrid::Rebuild(CPlayerMovementStore& store)
+{
+	m_cellLookup.clear();
+	m_cellCoordinates.clear();
+	m_cellPlayers.clear();
+	m_stats.numCells = 0;
+	m_stats.numOccupiedCells = 0;
+
+	for (SPlayerInterestCell& cell : store.interestCell)
+	{
+		cell.isTracked = false;
+	}
+}
+
+void CPlayerInterestGrid::AddToCell(const SPlayerInterestCell& cell, PlayerMovementId id)
+{
+	const auto result = m_cellLookup.emplace(GetCellKey(cell.x, cell.y), static_cast<uint32>(m_cellPlayers.size()));
+	if (result.second)
+	{
+		m_cellCoordinates.push_back(cell);
+		m_cellPlayers.emplace_back();
+		m_stats.numCells = static_cast<uint32>(m_cellPlayers.size());
+	}
+
+	std::vector<PlayerMovementId>& players = m_cellPlayers[result.first->second];
+	if (players.empty())
+	{
+		++m_stats.numOccupiedCells;
+	}
+	players.push_back(id);
+}
+
+void CPlayerInterestGrid::RemoveFromCell(const SPlayerInterestCell& cell, PlayerMovementId id)
+{
+	const auto it = m_cellLookup.find(GetCellKey(cell.x, cell.y));
+	CRY_ASSERT(it != m_cellLookup.end());
+	if (it == m_cellLookup.end())
+		return;
+
+	// The order within a cell does not matter
+	std::vector<PlayerMovementId>& players = m_cellPlayers[it->second];
+	const auto playerIt = std::find(players.begin(), players.end(), id);
+	if (playerIt == players.end())
+		return;
+
+	*playerIt = players.back();
+	players.pop_back();
+	if (players.empty())
+	{
+		--m_stats.numOccupiedCells;
+	}
+}
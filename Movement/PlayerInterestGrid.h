@@ -0,0 +1,149 @@
+#pragma once
+
+#include "PlayerMovementStore.h"
+
+#include <unordered_map>
+#include <vector>
+
+// A player somebody should hear about, and how often
+struct SRelevantPlayer
+{
+	// Dense store index, only valid until the store is reordered
+	uint32 index;
+	float distanceSq;
+	// Every tick down to every eighth, by distance
+	EMovementUpdateTier tier;
+};
+
+////////////////////////////////////////////////////////
+// Spatial hash of the player positions over the ground plane, for finding the players around a point without looking at all of them
+// Every player is filed under the cell its body is in, by PlayerMovementId so reordering the store does not disturb it.
+// Update only moves the players whose cell changed since the last tick, cells are kept once created, so a running match
+// does not allocate. Queries see the bodies as of the last update, up to a tick of movement off.
+////////////////////////////////////////////////////////
+class CPlayerInterestGrid
+{
+public:
+	struct SSettings
+	{
+		// Changing it refiles every player on the next update
+		float cellSize = 32.f;
+		// Players closer than this to the viewer are relevant every tick, further out every 2nd, 4th and 8th tick
+		float fullDistance = 30.f;
+		float halfDistance = 80.f;
+		float quarterDistance = 150.f;
+		// Players further away than this are not relevant at all
+		float cullDistance = 300.f;
+	};
+
+	struct SStats
+	{
+		uint32 numPlayers = 0;
+		uint32 numCells = 0;
+		uint32 numOccupiedCells = 0;
+		uint64 updates = 0;
+		// Players moved to another cell since the last reset
+		uint64 cellChanges = 0;
+		uint64 queries = 0;
+		uint64 cellsVisited = 0;
+		// Players whose distance was measured, and those of them inside the radius
+		uint64 playersTested = 0;
+		uint64 playersFound = 0;
+	};
+
+	// Files new players and those that changed cell since the last call, the others are not touched
+	void Update(CPlayerMovementStore& store);
+	// Takes the player out of its cell, call before the store removes it
+	void Remove(CPlayerMovementStore& store, uint32 index);
+
+	// Calls func(index, distanceSq) for every player closer than radius to position, in no particular order
+	template<typename TFunc>
+	void ForEachInRadius(const CPlayerMovementStore& store, const Vec3& position, float radius, TFunc&& func);
+	// Replaces relevant with the players within the cull distance of the viewer, the viewer's own included
+	void GatherRelevant(const CPlayerMovementStore& store, const Vec3& viewer, std::vector<SRelevantPlayer>& relevant);
+	EMovementUpdateTier GetTier(float distanceSq) const;
+
+	SSettings& GetSettings() { return m_settings; }
+	const SStats& GetStats() const { return m_stats; }
+	void ResetStats();
+
+private:
+	int32 GetCellCoordinate(float value) const { return static_cast<int32>(floorf(value * m_invCellSize)); }
+	static uint64 GetCellKey(int32 x, int32 y) { return (static_cast<uint64>(static_cast<uint32>(x)) << 32) | static_cast<uint32>(y); }
+
+	// Forgets every cell, the next update files all players again
+	void Rebuild(CPlayerMovementStore& store);
+	void AddToCell(const SPlayerInterestCell& cell, PlayerMovementId id);
+	void RemoveFromCell(const SPlayerInterestCell& cell, PlayerMovementId id);
+
+	template<typename TFunc>
+	void VisitCell(const CPlayerMovementStore& store, uint32 cell, const Vec3& position, float radiusSq, TFunc& func);
+
+	// Cell index by key, and per cell its coordinates and the players in it
+	std::unordered_map<uint64, uint32> m_cellLookup;
+	std::vector<SPlayerInterestCell> m_cellCoordinates;
+	std::vector<std::vector<PlayerMovementId>> m_cellPlayers;
+
+	float m_cellSize = 0.f;
+	float m_invCellSize = 1.f;
+	SSettings m_settings;
+	SStats m_stats;
+};
+
+template<typename TFunc>
+inline void CPlayerInterestGrid::VisitCell(const CPlayerMovementStore& store, uint32 cell, const Vec3& position, float radiusSq, TFunc& func)
+{
+	++m_stats.cellsVisited;
+	for (const PlayerMovementId id : m_cellPlayers[cell])
+	{
+		const uint32 index = store.GetIndex(id);
+		const float distanceSq = store.body[index].position.GetSquaredDistance(position);
+		++m_stats.playersTested;
+		if (distanceSq < radiusSq)
+		{
+			++m_stats.playersFound;
+			func(index, distanceSq);
+		}
+	}
+}
+
+template<typename TFunc>
+inline void CPlayerInterestGrid::ForEachInRadius(const CPlayerMovementStore& store, const Vec3& position, float radius, TFunc&& func)
+{
+	++m_stats.queries;
+	if (m_cellPlayers.empty())
+		return;
+
+	const int32 minX = GetCellCoordinate(position.x - radius);
+	const int32 maxX = GetCellCoordinate(position.x + radius);
+	const int32 minY = GetCellCoordinate(position.y - radius);
+	const int32 maxY = GetCellCoordinate(position.y + radius);
+	const float radiusSq = radius * radius;
+
+	// A radius wider than the populated part of the level is cheaper to answer from the list of cells than by looking up every key
+	const uint64 numCoveredCells = static_cast<uint64>(maxX - minX + 1) * static_cast<uint64>(maxY - minY + 1);
+	if (numCoveredCells > m_cellPlayers.size())
+	{
+		for (uint32 cell = 0, n = static_cast<uint32>(m_cellPlayers.size()); cell < n; ++cell)
+		{
+			const SPlayerInterestCell& coordinates = m_cellCoordinates[cell];
+			if (!m_cellPlayers[cell].empty() && coordinates.x >= minX && coordinates.x <= maxX && coordinates.y >= minY && coordinates.y <= maxY)
+			{
+				VisitCell(store, cell, position, radiusSq, func);
+			}
+		}
+		return;
+	}
+
+	for (int32 x = minX; x <= maxX; ++x)
+	{
+		for (int32 y = minY; y <= maxY; ++y)
+		{
+			const auto it = m_cellLookup.find(GetCellKey(x, y));
+			if (it != m_cellLookup.end())
+			{
+				VisitCell(store, it->second, position, radiusSq, func);
+			}
+		}
+	}
+}
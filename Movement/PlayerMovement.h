@@ -0,0 +1,269 @@
+#pragma once
+
+#include <CryMath/Cry_Math.h>
+
+////////////////////////////////////////////////////////
+// Data types of the engine-independent player movement simulation
+// The rules are in CPlayerMovementSimulation, the per-player state in CPlayerMovementStore.
+////////////////////////////////////////////////////////
+
+enum class EPlayerState : uint8
+{
+	Walking,
+	Sprinting
+};
+
+enum class EPlayerStance : uint8
+{
+	Standing,
+	Crouching
+};
+
+// Digital player actions, stored as bits in SPlayerInput
+enum EPlayerInputAction : uint16
+{
+	ePIA_None        = 0,
+	ePIA_MoveForward = 1 << 0,
+	ePIA_MoveBack    = 1 << 1,
+	ePIA_MoveLeft    = 1 << 2,
+	ePIA_MoveRight   = 1 << 3,
+	ePIA_Sprint      = 1 << 4,
+	ePIA_Jump        = 1 << 5,
+	ePIA_Crouch      = 1 << 6,
+};
+
+// Input consumed by one simulation tick
+struct SPlayerInput
+{
+	void ClearEdges() { pressed = released = 0; }
+	bool IsPressed(EPlayerInputAction action) const { return (pressed & action) != 0; }
+	bool IsReleased(EPlayerInputAction action) const { return (released & action) != 0; }
+	bool IsHeld(EPlayerInputAction action) const { return (held & action) != 0; }
+
+	// Updates the held state of an action, recording a press or release edge when it changes
+	void SetHeld(EPlayerInputAction action, bool isHeld)
+	{
+		if (isHeld == IsHeld(action))
+			return;
+
+		if (isHeld)
+		{
+			held |= action;
+			pressed |= action;
+		}
+		else
+		{
+			held &= ~action;
+			released |= action;
+		}
+	}
+
+	// Keyboard movement direction from the held move actions, opposite keys cancel out
+	void UpdateMovementDelta()
+	{
+		movementDelta.x = static_cast<float>(IsHeld(ePIA_MoveRight)) - static_cast<float>(IsHeld(ePIA_MoveLeft));
+		movementDelta.y = static_cast<float>(IsHeld(ePIA_MoveForward)) - static_cast<float>(IsHeld(ePIA_MoveBack));
+	}
+
+	// Local movement direction, x = right, y = forward
+	Vec2 movementDelta = ZERO;
+	// Mouse movement since the previous tick, x = yaw, y = pitch
+	Vec2 mouseDeltaRotation = ZERO;
+
+	uint16 held = 0;
+	uint16 pressed = 0;
+	uint16 released = 0;
+};
+
+// Tuning values of a movement profile, shared read-only by every player using it (see CMovementProfileLibrary)
+struct SMovementParams
+{
+	float walkSpeed = 3.f;
+	float runSpeed = 6.f;
+	float jumpEnergy = 4.f;
+	float doubleJumpEnergy = 6.f;
+	float walljumpSideEnergy = 5.f;
+	float walljumpHeightEnergy = 4.f;
+
+	float rotationSpeed = 0.002f;
+	float pitchMin = -1.5f;
+	float pitchMax = 1.5f;
+
+	Vec3 cameraOffsetStanding = Vec3(0.f, 0.f, 1.7f);
+	Vec3 cameraOffsetCrouching = Vec3(0.f, 0.f, 1.0f);
+	float capsuleHeightStanding = 1.7f;
+	float capsuleHeightCrouching = 0.75f;
+	float capsuleGroundOffset = 0.2f;
+	// Limits on reusing a measured ceiling clearance, see CHeadroomCache. 1 tick measures every tick.
+	uint32 headroomMaxTicks = 30;
+	float headroomMaxTravel = 0.05f;
+
+	// Field of view in degrees
+	float fov = 65.f;
+	float wallrunFov = 75.f;
+	float fovChangeRate = 35.f;
+
+	float wallSearchRange = 0.5f;
+	float wallrunCooldown = 0.2f;
+	float wallrunCameraRoll = 0.3f;
+	float wallrunCameraRollSpeed = 2.f;
+	float wallStickForce = 2.f;
+	// Limits on following a wall without probing it, see CWallContactTracker. 1 tick probes every tick.
+	uint32 wallContactMaxTicks = 8;
+	float wallContactMaxTravel = 0.4f;
+	float wallContactDistanceTolerance = 0.1f;
+	// Rate of the exponential approach of the camera offset to its stance height, per second
+	float cameraOffsetLerpSpeed = 10.f;
+};
+
+// Boolean movement state, packed so the hot per-player data stays small
+enum EMovementFlags : uint8
+{
+	eMF_CanJump        = 1 << 0,
+	eMF_CanDoubleJump  = 1 << 1,
+	eMF_Wallrunning    = 1 << 2,
+	eMF_CanWallrun     = 1 << 3,
+	eMF_MovingForward  = 1 << 4,
+
+	eMF_Default = eMF_CanJump | eMF_CanDoubleJump
+};
+
+// Complete movement state of one player
+// The simulation itself works on CPlayerMovementStore, this is the form used to copy a player in and out of it.
+struct SPlayerMovementState
+{
+	bool HasFlag(EMovementFlags flag) const { return (flags & flag) != 0; }
+
+	uint32 tick = 0;
+
+	// Look direction, in radians
+	float yaw = 0.f;
+	float pitch = 0.f;
+
+	EPlayerState playerState = EPlayerState::Walking;
+	EPlayerStance stance = EPlayerStance::Standing;
+	EPlayerStance desiredStance = EPlayerStance::Standing;
+	uint8 flags = eMF_Default;
+
+	Vec3 wallNormal = ZERO;
+	float wallrunTimer = 0.f;
+	// Camera roll we are blending towards while wallrunning, sign depends on the wall side
+	float wallrunRoll = 0.f;
+
+	// Presentation, local to the entity
+	Vec3 cameraOffset = Vec3(0.f, 0.f, 1.7f);
+	Vec3 cameraEndOffset = Vec3(0.f, 0.f, 1.7f);
+	float cameraRoll = 0.f;
+	float fov = 65.f;
+	float desiredFov = 65.f;
+};
+
+// What the entity and camera show of a player, rendered between two ticks by interpolating the state after each
+struct SMovementPresentation
+{
+	static SMovementPresentation Interpolate(const SMovementPresentation& from, const SMovementPresentation& to, float alpha)
+	{
+		// Yaw wraps at +-pi, go the short way around
+		float yawDelta = to.yaw - from.yaw;
+		yawDelta -= gf_PI2 * floorf((yawDelta + gf_PI) / gf_PI2);
+
+		SMovementPresentation presentation;
+		presentation.yaw = from.yaw + yawDelta * alpha;
+		presentation.pitch = LERP(from.pitch, to.pitch, alpha);
+		presentation.cameraOffset = Vec3::CreateLerp(from.cameraOffset, to.cameraOffset, alpha);
+		presentation.cameraRoll = LERP(from.cameraRoll, to.cameraRoll, alpha);
+		presentation.fov = LERP(from.fov, to.fov, alpha);
+		return presentation;
+	}
+
+	float yaw = 0.f;
+	float pitch = 0.f;
+	Vec3 cameraOffset = Vec3(0.f, 0.f, 1.7f);
+	float cameraRoll = 0.f;
+	float fov = 65.f;
+};
+
+// How often a player is simulated, every tick down to every eighth
+enum class EMovementUpdateTier : uint8
+{
+	Full,
+	Half,
+	Quarter,
+	Eighth,
+
+	Count
+};
+
+inline const char* GetMovementUpdateTierName(EMovementUpdateTier tier)
+{
+	static const char* const s_names[] =
+	{
+		"Full",
+		"Half",
+		"Quarter",
+		"Eighth",
+	};
+	static_assert(CRY_ARRAY_COUNT(s_names) == static_cast<size_t>(EMovementUpdateTier::Count), "Tier names out of date");
+	return s_names[static_cast<size_t>(tier)];
+}
+
+// Update-rate LOD state of one player, see CMovementUpdateScheduler
+struct SMovementUpdateLod
+{
+	EMovementUpdateTier tier = EMovementUpdateTier::Full;
+	// Simulated every tick no matter what, e.g. players driven by a client or the local player
+	bool isPinned = false;
+	// Held actions seen at the last evaluation, a change means somebody is steering the player
+	uint8 lastHeld = 0;
+	// Ticks left before the player may drop to a slower tier
+	uint16 holdTicks = 0;
+	// Store tick the player was last simulated on
+	uint32 lastUpdateTick = 0;
+};
+
+// Cell of CPlayerInterestGrid the player is filed under
+struct SPlayerInterestCell
+{
+	int32 x = 0;
+	int32 y = 0;
+	// New players are not in the grid until its next update
+	bool isTracked = false;
+};
+
+// Splits variable frame times into fixed simulation ticks
+class CFixedTickAccumulator
+{
+public:
+	static constexpr float DefaultTickRate = 60.f;
+	static constexpr int MaxTicksPerUpdate = 8;
+
+	explicit CFixedTickAccumulator(float tickRate = DefaultTickRate) { SetTickRate(tickRate); }
+
+	void SetTickRate(float tickRate) { m_tickLength = 1.f / std::max(tickRate, 1.f); }
+	float GetTickLength() const { return m_tickLength; }
+	// Fraction of a tick left over after the last Advance, in [0, 1)
+	float GetAlpha() const { return m_accumulated / m_tickLength; }
+	void Reset() { m_accumulated = 0.f; }
+
+	// Returns how many ticks should be simulated for this frame
+	int Advance(float frameTime)
+	{
+		m_accumulated += frameTime;
+		int ticks = static_cast<int>(m_accumulated / m_tickLength);
+		if (ticks > MaxTicksPerUpdate)
+		{
+			// Drop the backlog instead of spiralling after a long hitch
+			ticks = MaxTicksPerUpdate;
+			m_accumulated = 0.f;
+		}
+		else
+		{
+			m_accumulated -= static_cast<float>(ticks) * m_tickLength;
+		}
+		return ticks;
+	}
+
+private:
+	float m_tickLength;
+	float m_accumulated = 0.f;
+};
@@ -0,0 +1,530 @@
+#include "StdAfx.h"
+#include "PlayerMovementSimulation.h"
+#include "MovementKernels.h"
+
+void CPlayerMovementSimulation::ResetState(SPlayerMovementState& state, const SMovementParams& params, float yaw)
+{
+	state.playerState = EPlayerState::Walking;
+	state.stance = EPlayerStance::Standing;
+	state.desiredStance = state.stance;
+
+	state.yaw = yaw;
+	state.pitch = 0.f;
+
+	state.cameraEndOffset = params.cameraOffsetStanding;
+	state.cameraOffset = params.cameraOffsetStanding;
+	state.desiredFov = params.fov;
+}
+
+void CPlayerMovementSimulation::ApplyParams(CPlayerMovementStore& store, uint32 index)
+{
+	const SMovementParams& params = *store.params[index];
+	const EPlayerStance stance = store.stance[index];
+
+	store.cameraEndOffset[index] = stance == EPlayerStance::Crouching ? params.cameraOffsetCrouching : params.cameraOffsetStanding;
+	store.desiredFov[index] = store.HasFlag(index, eMF_Wallrunning) ? params.wallrunFov : params.fov;
+	store.wallContact[index] = SWallContact();
+	CHeadroomCache::Invalidate(store.headroom[index]);
+
+	IMovementPhysics& physics = *store.physics[index];
+	const SMovementBody body = physics.GetBody();
+	if (body.isPhysicalized)
+	{
+		const float radius = body.colliderRadius;
+		const float height = GetStanceHeight(params, stance);
+		SMovementPhysicsApplied& applied = store.appliedPhysics[index];
+		applied.colliderHeight = GetColliderHeight(params, radius, height);
+		applied.colliderSize = Vec3(radius, radius, height * 0.5f);
+		applied.known |= SMovementPhysicsCommands::ePending_ColliderDimensions;
+		physics.SetColliderDimensions(applied.colliderHeight, applied.colliderSize);
+	}
+}
+
+void CPlayerMovementSimulation::Step(CPlayerMovementStore& store, float dt, SMovementStageTimings* pTimings)
+{
+	Step(store, dt, [](uint32 count, const auto& func) { func(0, count); }, pTimings);
+}
+
+void CPlayerMovementSimulation::Resimulate(CPlayerMovementStore& store, uint32 index, float dt)
+{
+	auto runSerial = [](uint32 count, const auto& func) { func(0, count); };
+
+	// Replayed ticks already went into the telemetry when they first ran
+	CMovementTelemetry* pTelemetry = store.pTelemetry;
+	store.pTelemetry = nullptr;
+	RunPhases(store, index, index + 1, dt, runSerial, nullptr);
+	store.pTelemetry = pTelemetry;
+}
+
+void CPlayerMovementSimulation::GatherBodies(CPlayerMovementStore& store, uint32 begin, uint32 end)
+{
+	for (uint32 i = begin; i < end; ++i)
+	{
+		store.body[i] = store.physics[i]->GetBody();
+		store.commands[i].pending = 0;
+	}
+}
+
+void CPlayerMovementSimulation::QueryStance(CPlayerMovementStore& store, uint32 begin, uint32 end, SMovementStageTimings* pTimings)
+{
+	for (uint32 i = begin; i < end; ++i)
+	{
+		// Only standing up can be blocked, crouching always fits
+		store.isStandingBlocked[i] = false;
+		if (store.desiredStance[i] == store.stance[i] || store.desiredStance[i] != EPlayerStance::Standing || !store.body[i].isPhysicalized)
+			continue;
+
+		const SMovementParams& params = *store.params[i];
+		const SMovementBody& body = store.body[i];
+		const float radius = body.colliderRadius;
+		const float height = GetStanceHeight(params, store.stance[i]);
+		const float rise = GetStanceHeight(params, EPlayerStance::Standing) - height;
+
+		// Both stances share the bottom of the capsule, standing up only moves its top sphere
+		const Vec3 capsuleTop = body.position + Vec3(0.f, 0.f, params.capsuleGroundOffset + radius + height);
+		store.isStandingBlocked[i] = CHeadroomCache::IsRiseBlocked(store.headroom[i], *store.physics[i], params, capsuleTop, radius, rise, pTimings);
+	}
+}
+
+void CPlayerMovementSimulation::QueryWalls(CPlayerMovementStore& store, uint32 begin, uint32 end, SMovementStageTimings* pTimings)
+{
+	for (uint32 i = begin; i < end; ++i)
+	{
+		const Vec3 playerRightDir = GetBodyRotation(store.yaw[i]).GetColumn0();
+		const Vec3 probeOrigin = GetEyePosition(store.yaw[i], store.cameraOffset[i], store.body[i].position);
+
+		// Along a known wall the hits follow from the wall plane
+		const bool isWallrunning = store.HasFlag(i, eMF_Wallrunning);
+		if (isWallrunning && CWallContactTracker::Predict(store.wallContact[i], *store.params[i], probeOrigin, playerRightDir, store.leftWallHit[i], store.rightWallHit[i]))
+			continue;
+
+		CMovementStageScope scope(pTimings, EMovementStage::WallProbeQuery);
+		store.physics[i]->ProbeWalls(probeOrigin, playerRightDir, store.params[i]->wallSearchRange, store.leftWallHit[i], store.rightWallHit[i]);
+		CWallContactTracker::OnProbed(store.wallContact[i], isWallrunning, probeOrigin, store.leftWallHit[i], store.rightWallHit[i]);
+	}
+}
+
+void CPlayerMovementSimulation::CommitPhysics(CPlayerMovementStore& store, uint32 begin, uint32 end)
+{
+	for (uint32 i = begin; i < end; ++i)
+	{
+		const SMovementPhysicsCommands& commands = store.commands[i];
+		SMovementPhysicsApplied& applied = store.appliedPhysics[i];
+		IMovementPhysics& physics = *store.physics[i];
+
+		// Nothing sticks to a body that isn't there, start over once it is physicalized
+		if (!store.body[i].isPhysicalized)
+		{
+			applied = SMovementPhysicsApplied();
+			continue;
+		}
+
+		// An impulse is overwritten by the velocity override, so only one of them goes out.
+		// The body velocity changes on its own, overrides are compared against what physics reported at the start of the tick.
+		const bool addsVelocity = (commands.pending & SMovementPhysicsCommands::ePending_AddVelocity) != 0;
+		const bool setsVelocity = (commands.pending & SMovementPhysicsCommands::ePending_SetVelocity) != 0
+			&& (addsVelocity || !store.body[i].velocity.IsEquivalent(commands.setVelocity, VelocityEpsilon));
+
+		if (addsVelocity && (commands.pending & SMovementPhysicsCommands::ePending_SetVelocity) == 0)
+		{
+			physics.AddVelocity(commands.addVelocity);
+		}
+
+		if ((commands.pending & SMovementPhysicsCommands::ePending_ColliderDimensions)
+			&& !((applied.known & SMovementPhysicsCommands::ePending_ColliderDimensions) && applied.colliderHeight == commands.colliderHeight && applied.colliderSize == commands.colliderSize))
+		{
+			physics.SetColliderDimensions(commands.colliderHeight, commands.colliderSize);
+			applied.colliderHeight = commands.colliderHeight;
+			applied.colliderSize = commands.colliderSize;
+			applied.known |= SMovementPhysicsCommands::ePending_ColliderDimensions;
+		}
+
+		if ((commands.pending & SMovementPhysicsCommands::ePending_MoveVelocity)
+			&& !((applied.known & SMovementPhysicsCommands::ePending_MoveVelocity) && applied.moveVelocity == commands.moveVelocity))
+		{
+			physics.RequestMoveVelocity(commands.moveVelocity);
+			applied.moveVelocity = commands.moveVelocity;
+			applied.known |= SMovementPhysicsCommands::ePending_MoveVelocity;
+		}
+
+		if (setsVelocity)
+		{
+			physics.SetVelocity(commands.setVelocity);
+		}
+
+		if ((commands.pending & SMovementPhysicsCommands::ePending_Gravity)
+			&& !((applied.known & SMovementPhysicsCommands::ePending_Gravity) && applied.gravityEnabled == commands.gravityEnabled))
+		{
+			physics.SetGravityEnabled(commands.gravityEnabled);
+			applied.gravityEnabled = commands.gravityEnabled;
+			applied.known |= SMovementPhysicsCommands::ePending_Gravity;
+		}
+	}
+}
+
+void CPlayerMovementSimulation::SimulateActions(CPlayerMovementStore& store, uint32 begin, uint32 end)
+{
+	ProcessActions(store, begin, end);
+}
+
+void CPlayerMovementSimulation::SimulateMotion(CPlayerMovementStore& store, uint32 begin, uint32 end, float dt)
+{
+	UpdateStance(store, begin, end);
+	UpdateMovement(store, begin, end);
+	UpdateRotation(store, begin, end);
+	UpdateCamera(store, begin, end, dt);
+	UpdateGroundState(store, begin, end);
+}
+
+void CPlayerMovementSimulation::SimulateWallrun(CPlayerMovementStore& store, uint32 begin, uint32 end, float dt)
+{
+	UpdateWallrun(store, begin, end, dt);
+	UpdateFOV(store, begin, end, dt);
+	ConsumeInput(store, begin, end);
+
+	if (store.pTelemetry != nullptr && store.pTelemetry->GetSampleInterval() != 0 && store.tick % store.pTelemetry->GetSampleInterval() == 0)
+	{
+		RecordTickSamples(store, begin, end);
+	}
+}
+
+void CPlayerMovementSimulation::ProcessActions(CPlayerMovementStore& store, uint32 begin, uint32 end)
+{
+	for (uint32 i = begin; i < end; ++i)
+	{
+		const SPlayerInput& input = store.input[i];
+		const SMovementBody& body = store.body[i];
+		const SMovementParams& params = *store.params[i];
+		const EPlayerState previousState = store.playerState[i];
+
+		store.SetFlag(i, eMF_MovingForward, input.IsHeld(ePIA_MoveForward));
+
+		if (input.IsPressed(ePIA_Sprint) && store.stance[i] == EPlayerStance::Standing)
+		{
+			store.playerState[i] = EPlayerState::Sprinting;
+		}
+		else if (input.IsReleased(ePIA_Sprint))
+		{
+			store.playerState[i] = EPlayerState::Walking;
+		}
+
+		if (input.IsPressed(ePIA_Jump))
+		{
+			SMovementPhysicsCommands& commands = store.commands[i];
+			const bool isWallrunning = store.HasFlag(i, eMF_Wallrunning);
+
+			if (store.HasFlag(i, eMF_CanJump))
+			{
+				if (isWallrunning)
+				{
+					store.SetFlag(i, eMF_CanWallrun, false);
+					store.wallrunTimer[i] = 0.f;
+					commands.AddVelocity(Vec3(0.f, 0.f, params.walljumpHeightEnergy) + store.wallNormal[i] * params.walljumpSideEnergy);
+				}
+				else
+				{
+					commands.AddVelocity(Vec3(0.f, 0.f, params.jumpEnergy));
+				}
+
+				if (store.pTelemetry != nullptr)
+				{
+					RecordEvent(store, i, isWallrunning ? EMovementTelemetryEvent::WallJump : EMovementTelemetryEvent::Jump, store.pTelemetry->GetNanoseconds());
+				}
+			}
+			// One press is one jump: right after leaving the ground eMF_CanJump is still set, that press must not double jump as well
+			else if (!body.isOnGround && !isWallrunning && store.HasFlag(i, eMF_CanDoubleJump))
+			{
+				commands.AddVelocity(Vec3(0.f, 0.f, std::abs(body.velocity.z) + params.doubleJumpEnergy));
+				store.SetFlag(i, eMF_CanDoubleJump, false);
+
+				if (store.pTelemetry != nullptr)
+				{
+					RecordEvent(store, i, EMovementTelemetryEvent::DoubleJump, store.pTelemetry->GetNanoseconds());
+				}
+			}
+		}
+
+		if (body.isOnGround && input.IsPressed(ePIA_Crouch))
+		{
+			store.desiredStance[i] = EPlayerStance::Crouching;
+			store.playerState[i] = EPlayerState::Walking;
+		}
+		else if (input.IsReleased(ePIA_Crouch))
+		{
+			store.desiredStance[i] = EPlayerStance::Standing;
+		}
+
+		if (store.pTelemetry != nullptr && store.playerState[i] != previousState)
+		{
+			RecordEvent(store, i, store.playerState[i] == EPlayerState::Sprinting ? EMovementTelemetryEvent::SprintStart : EMovementTelemetryEvent::SprintEnd, store.pTelemetry->GetNanoseconds());
+		}
+	}
+}
+
+void CPlayerMovementSimulation::UpdateStance(CPlayerMovementStore& store, uint32 begin, uint32 end)
+{
+	for (uint32 i = begin; i < end; ++i)
+	{
+		if (store.desiredStance[i] == store.stance[i])
+			continue;
+
+		const SMovementBody& body = store.body[i];
+		if (!body.isPhysicalized || store.isStandingBlocked[i])
+			continue;
+
+		const SMovementParams& params = *store.params[i];
+		const EPlayerStance desiredStance = store.desiredStance[i];
+		const float radius = body.colliderRadius;
+		const float height = GetStanceHeight(params, desiredStance);
+
+		store.commands[i].SetColliderDimensions(GetColliderHeight(params, radius, height), Vec3(radius, radius, height * 0.5f));
+		store.cameraEndOffset[i] = desiredStance == EPlayerStance::Crouching ? params.cameraOffsetCrouching : params.cameraOffsetStanding;
+		store.stance[i] = desiredStance;
+
+		if (store.pTelemetry != nullptr)
+		{
+			RecordEvent(store, i, EMovementTelemetryEvent::StanceChange, store.pTelemetry->GetNanoseconds());
+		}
+	}
+}
+
+float CPlayerMovementSimulation::GetStanceHeight(const SMovementParams& params, EPlayerStance stance)
+{
+	switch (stance)
+	{
+	case EPlayerStance::Crouching:
+		return params.capsuleHeightCrouching;
+	case EPlayerStance::Standing:
+		return params.capsuleHeightStanding;
+	}
+	return params.capsuleHeightStanding;
+}
+
+void CPlayerMovementSimulation::UpdateMovement(CPlayerMovementStore& store, uint32 begin, uint32 end)
+{
+	alignas(32) float moveX[CMovementKernels::BatchSize];
+	alignas(32) float moveY[CMovementKernels::BatchSize];
+	alignas(32) float speed[CMovementKernels::BatchSize];
+	alignas(32) float velocityX[CMovementKernels::BatchSize];
+	alignas(32) float velocityY[CMovementKernels::BatchSize];
+
+	for (uint32 batchBegin = begin; batchBegin < end; batchBegin += CMovementKernels::BatchSize)
+	{
+		const uint32 count = std::min(end - batchBegin, CMovementKernels::BatchSize);
+		for (uint32 j = 0; j < count; ++j)
+		{
+			const uint32 i = batchBegin + j;
+			const SMovementParams& params = *store.params[i];
+			moveX[j] = store.input[i].movementDelta.x;
+			moveY[j] = store.input[i].movementDelta.y;
+			speed[j] = store.playerState[i] == EPlayerState::Sprinting ? params.runSpeed : params.walkSpeed;
+		}
+
+		CMovementKernels::ComputeMoveVelocity(moveX, moveY, &store.yaw[batchBegin], speed, velocityX, velocityY, count);
+
+		for (uint32 j = 0; j < count; ++j)
+		{
+			store.commands[batchBegin + j].RequestMoveVelocity(Vec3(velocityX[j], velocityY[j], 0.f));
+		}
+	}
+}
+
+void CPlayerMovementSimulation::UpdateRotation(CPlayerMovementStore& store, uint32 begin, uint32 end)
+{
+	alignas(32) float yawDelta[CMovementKernels::BatchSize];
+
+	for (uint32 batchBegin = begin; batchBegin < end; batchBegin += CMovementKernels::BatchSize)
+	{
+		const uint32 count = std::min(end - batchBegin, CMovementKernels::BatchSize);
+		for (uint32 j = 0; j < count; ++j)
+		{
+			const uint32 i = batchBegin + j;
+			yawDelta[j] = store.input[i].mouseDeltaRotation.x * store.params[i]->rotationSpeed;
+		}
+
+		// Keep the angle bounded so long sessions don't lose precision
+		CMovementKernels::AddWrapped(&store.yaw[batchBegin], yawDelta, count);
+	}
+}
+
+void CPlayerMovementSimulation::UpdateCamera(CPlayerMovementStore& store, uint32 begin, uint32 end, float dt)
+{
+	static_assert(sizeof(Vec3) == 3 * sizeof(float), "Camera offsets are lerped as packed floats");
+
+	alignas(32) float pitchDelta[CMovementKernels::BatchSize];
+	alignas(32) float pitchMin[CMovementKernels::BatchSize];
+	alignas(32) float pitchMax[CMovementKernels::BatchSize];
+	alignas(32) float offsetT[CMovementKernels::BatchSize * 3];
+	alignas(32) float rollChange[CMovementKernels::BatchSize];
+	alignas(32) uint32 isWallrunning[CMovementKernels::BatchSize];
+
+	for (uint32 batchBegin = begin; batchBegin < end; batchBegin += CMovementKernels::BatchSize)
+	{
+		const uint32 count = std::min(end - batchBegin, CMovementKernels::BatchSize);
+		for (uint32 j = 0; j < count; ++j)
+		{
+			const uint32 i = batchBegin + j;
+			const SMovementParams& params = *store.params[i];
+			const float playerDt = dt * store.catchUpTicks[i];
+
+			pitchDelta[j] = store.input[i].mouseDeltaRotation.y * params.rotationSpeed;
+			pitchMin[j] = params.pitchMin;
+			pitchMax[j] = params.pitchMax;
+
+			// Exponential approach, closes the same share of the gap per second at any tick rate
+			const float t = 1.f - expf(-params.cameraOffsetLerpSpeed * playerDt);
+			offsetT[j * 3] = t;
+			offsetT[j * 3 + 1] = t;
+			offsetT[j * 3 + 2] = t;
+
+			rollChange[j] = params.wallrunCameraRollSpeed * playerDt;
+			isWallrunning[j] = store.HasFlag(i, eMF_Wallrunning) ? ~0u : 0u;
+		}
+
+		CMovementKernels::AddClamped(&store.pitch[batchBegin], pitchDelta, pitchMin, pitchMax, count);
+		CMovementKernels::Lerp(&store.cameraOffset[batchBegin].x, &store.cameraEndOffset[batchBegin].x, offsetT, count * 3);
+		CMovementKernels::ApproachRoll(&store.cameraRoll[batchBegin], &store.wallrunRoll[batchBegin], rollChange, isWallrunning, count);
+	}
+}
+
+void CPlayerMovementSimulation::UpdateGroundState(CPlayerMovementStore& store, uint32 begin, uint32 end)
+{
+	for (uint32 i = begin; i < end; ++i)
+	{
+		if (store.body[i].isOnGround || store.HasFlag(i, eMF_Wallrunning))
+		{
+			store.flags[i] |= eMF_CanJump | eMF_CanDoubleJump;
+		}
+		else
+		{
+			store.SetFlag(i, eMF_CanJump, false);
+		}
+	}
+}
+
+void CPlayerMovementSimulation::UpdateWallrun(CPlayerMovementStore& store, uint32 begin, uint32 end, float dt)
+{
+	for (uint32 i = begin; i < end; ++i)
+	{
+		const SMovementParams& params = *store.params[i];
+		const SWallProbeHit& leftHit = store.leftWallHit[i];
+		const SWallProbeHit& rightHit = store.rightWallHit[i];
+
+		if (leftHit.hit)
+		{
+			if (leftHit.isWallrunnable)
+			{
+				StartWallrun(store, i, leftHit, 1.f);
+			}
+		}
+		else if (rightHit.hit)
+		{
+			if (rightHit.isWallrunnable)
+			{
+				StartWallrun(store, i, rightHit, -1.f);
+			}
+		}
+		else
+		{
+			const uint8 previousFlags = store.flags[i];
+			store.SetFlag(i, eMF_Wallrunning, false);
+			store.desiredFov[i] = params.fov;
+			store.wallrunTimer[i] += dt * store.catchUpTicks[i];
+			if (store.wallrunTimer[i] >= params.wallrunCooldown)
+			{
+				store.SetFlag(i, eMF_CanWallrun, true);
+			}
+
+			if (store.pTelemetry != nullptr && store.flags[i] != previousFlags)
+			{
+				const uint64 nanoseconds = store.pTelemetry->GetNanoseconds();
+				if (previousFlags & eMF_Wallrunning)
+				{
+					RecordEvent(store, i, EMovementTelemetryEvent::WallrunEnd, nanoseconds);
+				}
+				if (store.HasFlag(i, eMF_CanWallrun) && (previousFlags & eMF_CanWallrun) == 0)
+				{
+					RecordEvent(store, i, EMovementTelemetryEvent::WallrunReady, nanoseconds);
+				}
+			}
+		}
+
+		// Gravity is off for exactly as long as we are wallrunning, the commit drops this while it doesn't change
+		store.commands[i].SetGravityEnabled(!store.HasFlag(i, eMF_Wallrunning));
+	}
+}
+
+void CPlayerMovementSimulation::StartWallrun(CPlayerMovementStore& store, uint32 index, const SWallProbeHit& hit, float side)
+{
+	if (store.body[index].isOnGround || !store.HasFlag(index, eMF_MovingForward) || !store.HasFlag(index, eMF_CanWallrun))
+		return;
+
+	const SMovementParams& params = *store.params[index];
+
+	// Called every tick of a wallrun, only the first one starts it
+	const bool isStarting = !store.HasFlag(index, eMF_Wallrunning);
+	store.SetFlag(index, eMF_Wallrunning, true);
+	store.wallNormal[index] = hit.normal;
+	store.desiredFov[index] = params.wallrunFov;
+	// Roll the camera towards the side the wall is on
+	store.wallrunRoll[index] = params.wallrunCameraRoll * side;
+
+	// The wall is on our left when side is positive, so we run along -surfaceForward
+	const Vec3 surfaceForward = hit.normal.Cross(Vec3(0.f, 0.f, 1.f)).GetNormalized();
+	const Vec3 wallForce = -hit.normal * params.wallStickForce;
+
+	SMovementPhysicsCommands& commands = store.commands[index];
+	commands.SetVelocity(-surfaceForward * side * params.runSpeed + wallForce);
+
+	if (isStarting && store.pTelemetry != nullptr)
+	{
+		RecordEvent(store, index, EMovementTelemetryEvent::WallrunStart, store.pTelemetry->GetNanoseconds());
+	}
+}
+
+void CPlayerMovementSimulation::UpdateFOV(CPlayerMovementStore& store, uint32 begin, uint32 end, float dt)
+{
+	for (uint32 i = begin; i < end; ++i)
+	{
+		const float fov = store.fov[i];
+		const float desiredFov = store.desiredFov[i];
+		if (fov == desiredFov)
+			continue;
+
+		const float fovChange = std::min(store.params[i]->fovChangeRate * dt * store.catchUpTicks[i], std::abs(desiredFov - fov));
+		store.fov[i] = desiredFov > fov ? fov + fovChange : fov - fovChange;
+	}
+}
+
+void CPlayerMovementSimulation::RecordEvent(const CPlayerMovementStore& store, uint32 index, EMovementTelemetryEvent type, uint64 nanoseconds)
+{
+	SMovementTelemetryEvent event;
+	event.nanoseconds = nanoseconds;
+	event.tick = store.tick;
+	event.playerId = store.ids[index];
+	event.type = type;
+	event.flags = store.flags[index];
+	event.stance = store.stance[index];
+	event.playerState = store.playerState[index];
+	event.position = store.body[index].position;
+	store.pTelemetry->Record(event);
+}
+
+void CPlayerMovementSimulation::RecordTickSamples(const CPlayerMovementStore& store, uint32 begin, uint32 end)
+{
+	// One clock read for the whole range, the samples are of the same tick anyway
+	const uint64 nanoseconds = store.pTelemetry->GetNanoseconds();
+	for (uint32 i = begin; i < end; ++i)
+	{
+		RecordEvent(store, i, EMovementTelemetryEvent::TickSample, nanoseconds);
+	}
+}
+
+void CPlayerMovementSimulation::ConsumeInput(CPlayerMovementStore& store, uint32 begin, uint32 end)
+{
+	for (uint32 i = begin; i < end; ++i)
+	{
+		store.input[i].ClearEdges();
+		store.input[i].mouseDeltaRotation = ZERO;
+	}
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "PlayerMovementStore.h"
+#include "MovementStageTimings.h"
+#include "MovementUpdateScheduler.h"
+#include "MovementTelemetry.h"
+
+////////////////////////////////////////////////////////
+// Engine-independent player movement simulation
+// Holds the walk / sprint / jump / double jump / wallrun / crouch rules that used to live in CPlayerComponent.
+// Everything here is plain data and math: the physics world is only reached through IMovementPhysics,
+// so the same code runs inside the game and headless (see CHeadlessMovementPhysics).
+////////////////////////////////////////////////////////
+class CPlayerMovementSimulation
+{
+public:
+	// Puts the state back to standing / walking, looking along the given yaw
+	static void ResetState(SPlayerMovementState& state, const SMovementParams& params, float yaw);
+	// Brings what the player derived from its SMovementParams in line after they changed, without resetting it:
+	// collider and camera offset of its stance, its FOV target and the cached ceiling and wall probes
+	static void ApplyParams(CPlayerMovementStore& store, uint32 index);
+
+	// Advances every player in the store by one tick of length dt, or its catchUpTicks of them if a scheduler set those
+	// With pTimings set, the time spent in each stage is added to it.
+	static void Step(CPlayerMovementStore& store, float dt, SMovementStageTimings* pTimings = nullptr);
+
+	// Same as Step, but hands the phases that only touch the store to parallelFor(count, func).
+	// parallelFor has to call func(begin, end) for disjoint ranges covering [0, count) and only return once all calls are done.
+	// Physics world queries and the commit of the recorded physics writes always run on the calling thread.
+	template<typename TParallelFor>
+	static void Step(CPlayerMovementStore& store, float dt, TParallelFor&& parallelFor, SMovementStageTimings* pTimings = nullptr);
+
+	// Advances only the players in the given ranges, each by its CPlayerMovementStore::catchUpTicks ticks of length dt
+	// The ranges must not overlap. Phases run per range, see CMovementUpdateScheduler for how the ranges are picked.
+	template<typename TParallelFor>
+	static void StepRanges(CPlayerMovementStore& store, const SMovementUpdateRange* pRanges, uint32 numRanges, float dt, TParallelFor&& parallelFor, SMovementStageTimings* pTimings = nullptr);
+
+	// Runs one tick for a single player, without advancing the store tick
+	// Used to replay the inputs the server has not acknowledged yet after a correction.
+	static void Resimulate(CPlayerMovementStore& store, uint32 index, float dt);
+
+	// Camera position in world space, derived from the body transform so it works without a renderer
+	static Vec3 GetEyePosition(float yaw, const Vec3& cameraOffset, const Vec3& bodyPosition) { return bodyPosition + GetBodyRotation(yaw) * cameraOffset; }
+	static Quat GetBodyRotation(float yaw) { return Quat::CreateRotationZ(yaw); }
+	static Quat GetCameraRotation(float cameraRoll, float pitch) { return Quat::CreateRotationY(cameraRoll) * Quat::CreateRotationX(pitch); }
+
+	// Capsule dimensions for a stance: distance between the sphere centers, and height of the capsule center above the entity
+	static float GetStanceHeight(const SMovementParams& params, EPlayerStance stance);
+	static float GetColliderHeight(const SMovementParams& params, float radius, float height) { return params.capsuleGroundOffset + radius + height * 0.5f; }
+
+protected:
+	template<typename TParallelFor>
+	static void RunPhases(CPlayerMovementStore& store, uint32 begin, uint32 end, float dt, TParallelFor& parallelFor, SMovementStageTimings* pTimings);
+
+	// Velocity overrides closer than this to the current body velocity are not sent
+	static constexpr float VelocityEpsilon = 0.001f;
+
+	// Serial phases, these talk to IMovementPhysics
+	static void GatherBodies(CPlayerMovementStore& store, uint32 begin, uint32 end);
+	static void QueryStance(CPlayerMovementStore& store, uint32 begin, uint32 end, SMovementStageTimings* pTimings);
+	static void QueryWalls(CPlayerMovementStore& store, uint32 begin, uint32 end, SMovementStageTimings* pTimings);
+	static void CommitPhysics(CPlayerMovementStore& store, uint32 begin, uint32 end);
+
+	// Parallel phases, these only read and write the store rows in [begin, end)
+	static void SimulateActions(CPlayerMovementStore& store, uint32 begin, uint32 end);
+	static void SimulateMotion(CPlayerMovementStore& store, uint32 begin, uint32 end, float dt);
+	static void SimulateWallrun(CPlayerMovementStore& store, uint32 begin, uint32 end, float dt);
+
+	static void ProcessActions(CPlayerMovementStore& store, uint32 begin, uint32 end);
+	static void UpdateStance(CPlayerMovementStore& store, uint32 begin, uint32 end);
+	static void UpdateMovement(CPlayerMovementStore& store, uint32 begin, uint32 end);
+	static void UpdateRotation(CPlayerMovementStore& store, uint32 begin, uint32 end);
+	static void UpdateCamera(CPlayerMovementStore& store, uint32 begin, uint32 end, float dt);
+	static void UpdateGroundState(CPlayerMovementStore& store, uint32 begin, uint32 end);
+	static void UpdateWallrun(CPlayerMovementStore& store, uint32 begin, uint32 end, float dt);
+	static void UpdateFOV(CPlayerMovementStore& store, uint32 begin, uint32 end, float dt);
+	static void ConsumeInput(CPlayerMovementStore& store, uint32 begin, uint32 end);
+
+	static void StartWallrun(CPlayerMovementStore& store, uint32 index, const SWallProbeHit& hit, float side);
+
+	// Only called while store.pTelemetry is set
+	static void RecordEvent(const CPlayerMovementStore& store, uint32 index, EMovementTelemetryEvent type, uint64 nanoseconds);
+	static void RecordTickSamples(const CPlayerMovementStore& store, uint32 begin, uint32 end);
+
+};
+
+template<typename TParallelFor>
+inline void CPlayerMovementSimulation::Step(CPlayerMovementStore& store, float dt, TParallelFor&& parallelFor, SMovementStageTimings* pTimings)
+{
+	RunPhases(store, 0, store.GetCount(), dt, parallelFor, pTimings);
+	++store.tick;
+}
+
+template<typename TParallelFor>
+inline void CPlayerMovementSimulation::StepRanges(CPlayerMovementStore& store, const SMovementUpdateRange* pRanges, uint32 numRanges, float dt, TParallelFor&& parallelFor, SMovementStageTimings* pTimings)
+{
+	for (uint32 range = 0; range < numRanges; ++range)
+	{
+		RunPhases(store, pRanges[range].begin, pRanges[range].end, dt, parallelFor, pTimings);
+	}
+	++store.tick;
+}
+
+template<typename TParallelFor>
+inline void CPlayerMovementSimulation::RunPhases(CPlayerMovementStore& store, uint32 begin, uint32 end, float dt, TParallelFor& parallelFor, SMovementStageTimings* pTimings)
+{
+	const uint32 count = end - begin;
+
+	{
+		CMovementStageScope scope(pTimings, EMovementStage::GatherBodies);
+		GatherBodies(store, begin, end);
+	}
+	{
+		CMovementStageScope scope(pTimings, EMovementStage::SimulateActions);
+		parallelFor(count, [&store, begin](uint32 first, uint32 last) { SimulateActions(store, begin + first, begin + last); });
+	}
+	{
+		CMovementStageScope scope(pTimings, EMovementStage::QueryStance);
+		QueryStance(store, begin, end, pTimings);
+	}
+	{
+		CMovementStageScope scope(pTimings, EMovementStage::SimulateMotion);
+		parallelFor(count, [&store, begin, dt](uint32 first, uint32 last) { SimulateMotion(store, begin + first, begin + last, dt); });
+	}
+	{
+		CMovementStageScope scope(pTimings, EMovementStage::QueryWalls);
+		QueryWalls(store, begin, end, pTimings);
+	}
+	{
+		CMovementStageScope scope(pTimings, EMovementStage::SimulateWallrun);
+		parallelFor(count, [&store, begin, dt](uint32 first, uint32 last) { SimulateWallrun(store, begin + first, begin + last, dt); });
+	}
+	{
+		CMovementStageScope scope(pTimings, EMovementStage::CommitPhysics);
+		CommitPhysics(store, begin, end);
+	}
+}
@@ -0,0 +1,189 @@
+#include "StdAfx.h"
+#include "PlayerMovementStore.h"
+#include "PlayerMovementSimulation.h"
+
+template<typename TStore, typename TFunc>
+void CPlayerMovementStore::ForEachColumn(TStore& store, TFunc func)
+{
+	func(store.input);
+	func(store.yaw);
+	func(store.pitch);
+	func(store.flags);
+	func(store.playerState);
+	func(store.stance);
+	func(store.desiredStance);
+	func(store.wallrunTimer);
+	func(store.wallrunRoll);
+	func(store.wallNormal);
+	func(store.cameraOffset);
+	func(store.cameraEndOffset);
+	func(store.cameraRoll);
+	func(store.fov);
+	func(store.desiredFov);
+	func(store.previousPresentation);
+	func(store.body);
+	func(store.isStandingBlocked);
+	func(store.leftWallHit);
+	func(store.rightWallHit);
+	func(store.commands);
+	func(store.appliedPhysics);
+	func(store.wallContact);
+	func(store.headroom);
+	func(store.catchUpTicks);
+	func(store.updateLod);
+	func(store.interestCell);
+	func(store.params);
+	func(store.physics);
+	func(store.ids);
+}
+
+PlayerMovementId CPlayerMovementStore::Add(const SMovementParams& movementParams, IMovementPhysics& movementPhysics)
+{
+	uint32 slot;
+	if (!m_freeSlots.empty())
+	{
+		slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else
+	{
+		slot = static_cast<uint32>(m_slotToIndex.size());
+		CRY_ASSERT(slot <= SlotMask);
+		m_slotToIndex.push_back(0);
+		m_slotGeneration.push_back(0);
+	}
+
+	const PlayerMovementId id = (static_cast<uint32>(m_slotGeneration[slot]) << SlotBits) | slot;
+	const uint32 index = GetCount();
+	m_slotToIndex[slot] = index;
+
+	ForEachColumn(*this, [](auto& column) { column.emplace_back(); });
+	params[index] = &movementParams;
+	physics[index] = &movementPhysics;
+	ids[index] = id;
+	catchUpTicks[index] = 1;
+	updateLod[index].lastUpdateTick = tick;
+
+	SPlayerMovementState state;
+	CPlayerMovementSimulation::ResetState(state, movementParams, 0.f);
+	SetState(index, state);
+	previousPresentation[index] = GetPresentation(index);
+
+	return id;
+}
+
+void CPlayerMovementStore::Remove(PlayerMovementId id)
+{
+	if (!IsValid(id))
+		return;
+
+	const uint32 slot = id & SlotMask;
+	const uint32 index = m_slotToIndex[slot];
+	const uint32 last = GetCount() - 1;
+
+	if (index != last)
+	{
+		ForEachColumn(*this, [index, last](auto& column) { column[index] = column[last]; });
+		m_slotToIndex[ids[index] & SlotMask] = index;
+	}
+	ForEachColumn(*this, [](auto& column) { column.pop_back(); });
+
+	// Bump the generation so stale ids to this slot stop validating
+	++m_slotGeneration[slot];
+	m_freeSlots.push_back(slot);
+}
+
+void CPlayerMovementStore::Clear()
+{
+	while (!ids.empty())
+	{
+		Remove(ids.back());
+	}
+}
+
+void CPlayerMovementStore::Reserve(uint32 capacity)
+{
+	ForEachColumn(*this, [capacity](auto& column) { column.reserve(capacity); });
+}
+
+void CPlayerMovementStore::Swap(uint32 a, uint32 b)
+{
+	if (a == b)
+		return;
+
+	ForEachColumn(*this, [a, b](auto& column) { std::swap(column[a], column[b]); });
+	m_slotToIndex[ids[a] & SlotMask] = a;
+	m_slotToIndex[ids[b] & SlotMask] = b;
+}
+
+size_t CPlayerMovementStore::GetMemoryUsage() const
+{
+	size_t bytes = 0;
+	ForEachColumn(*this, [&bytes](const auto& column) { bytes += column.capacity() * sizeof(column[0]); });
+	bytes += m_slotToIndex.capacity() * sizeof(uint32) + m_slotGeneration.capacity() * sizeof(uint16) + m_freeSlots.capacity() * sizeof(uint32);
+	return bytes;
+}
+
+bool CPlayerMovementStore::IsValid(PlayerMovementId id) const
+{
+	const uint32 slot = id & SlotMask;
+	if (id == InvalidPlayerMovementId || slot >= m_slotToIndex.size())
+		return false;
+
+	const uint32 index = m_slotToIndex[slot];
+	return index < GetCount() && ids[index] == id;
+}
+
+SPlayerMovementState CPlayerMovementStore::GetState(uint32 index) const
+{
+	SPlayerMovementState state;
+	state.tick = tick;
+	state.yaw = yaw[index];
+	state.pitch = pitch[index];
+	state.playerState = playerState[index];
+	state.stance = stance[index];
+	state.desiredStance = desiredStance[index];
+	state.flags = flags[index];
+	state.wallNormal = wallNormal[index];
+	state.wallrunTimer = wallrunTimer[index];
+	state.wallrunRoll = wallrunRoll[index];
+	state.cameraOffset = cameraOffset[index];
+	state.cameraEndOffset = cameraEndOffset[index];
+	state.cameraRoll = cameraRoll[index];
+	state.fov = fov[index];
+	state.desiredFov = desiredFov[index];
+	return state;
+}
+
+void CPlayerMovementStore::SetState(uint32 index, const SPlayerMovementState& state)
+{
+	yaw[index] = state.yaw;
+	pitch[index] = state.pitch;
+	playerState[index] = state.playerState;
+	stance[index] = state.stance;
+	desiredStance[index] = state.desiredStance;
+	flags[index] = state.flags;
+	wallNormal[index] = state.wallNormal;
+	wallrunTimer[index] = state.wallrunTimer;
+	wallrunRoll[index] = state.wallrunRoll;
+	cameraOffset[index] = state.cameraOffset;
+	cameraEndOffset[index] = state.cameraEndOffset;
+	cameraRoll[index] = state.cameraRoll;
+	fov[index] = state.fov;
+	desiredFov[index] = state.desiredFov;
+
+	// The player may have been moved anywhere, e.g. rewound for a resimulation
+	wallContact[index] = SWallContact();
+	CHeadroomCache::Invalidate(headroom[index]);
+}
+
+SMovementPresentation CPlayerMovementStore::GetPresentation(uint32 index) const
+{
+	SMovementPresentation presentation;
+	presentation.yaw = yaw[index];
+	presentation.pitch = pitch[index];
+	presentation.cameraOffset = cameraOffset[index];
+	presentation.cameraRoll = cameraRoll[index];
+	presentation.fov = fov[index];
+	return presentation;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "PlayerMovement.h"
+#include "IMovementPhysics.h"
+#include "HeadroomCache.h"
+#include "WallContactTracker.h"
+
+class CMovementTelemetry;
+
+// Stable reference to a player in a CPlayerMovementStore, the low bits are the slot and the high bits a generation
+typedef uint32 PlayerMovementId;
+static constexpr PlayerMovementId InvalidPlayerMovementId = ~0u;
+
+////////////////////////////////////////////////////////
+// Movement state of all players, stored as one array per field
+// Players are kept densely packed in [0, GetCount()), removing a player moves the last one into its place,
+// so dense indices are only valid until the next Add / Remove. Hold on to the PlayerMovementId instead.
+////////////////////////////////////////////////////////
+class CPlayerMovementStore
+{
+public:
+	PlayerMovementId Add(const SMovementParams& params, IMovementPhysics& physics);
+	void Remove(PlayerMovementId id);
+	void Clear();
+	void Reserve(uint32 capacity);
+	// Exchanges two players in every column, their ids stay valid
+	void Swap(uint32 a, uint32 b);
+
+	bool IsValid(PlayerMovementId id) const;
+	uint32 GetIndex(PlayerMovementId id) const { CRY_ASSERT(IsValid(id)); return m_slotToIndex[id & SlotMask]; }
+	uint32 GetCount() const { return static_cast<uint32>(ids.size()); }
+	// Bytes allocated by the columns and slot tables, including reserved capacity
+	size_t GetMemoryUsage() const;
+
+	// Copies a single player in or out of the columns
+	SPlayerMovementState GetState(uint32 index) const;
+	void SetState(uint32 index, const SPlayerMovementState& state);
+	SMovementPresentation GetPresentation(uint32 index) const;
+
+	bool HasFlag(uint32 index, EMovementFlags flag) const { return (flags[index] & flag) != 0; }
+	void SetFlag(uint32 index, EMovementFlags flag, bool set) { flags[index] = set ? (flags[index] | flag) : (flags[index] & ~flag); }
+
+	// Ticks simulated since the store was created
+	uint32 tick = 0;
+	// Receives the state transitions of the simulation while a recording runs, null otherwise
+	CMovementTelemetry* pTelemetry = nullptr;
+
+	// Input for the next tick, edges and mouse movement are consumed by the tick
+	std::vector<SPlayerInput> input;
+
+	// Simulation state
+	std::vector<float> yaw;
+	std::vector<float> pitch;
+	std::vector<uint8> flags;
+	std::vector<EPlayerState> playerState;
+	std::vector<EPlayerStance> stance;
+	std::vector<EPlayerStance> desiredStance;
+	std::vector<float> wallrunTimer;
+	std::vector<float> wallrunRoll;
+	std::vector<Vec3> wallNormal;
+
+	// Presentation state
+	std::vector<Vec3> cameraOffset;
+	std::vector<Vec3> cameraEndOffset;
+	std::vector<float> cameraRoll;
+	std::vector<float> fov;
+	std::vector<float> desiredFov;
+	// Presentation after the tick before the current one, rendering interpolates from it
+	std::vector<SMovementPresentation> previousPresentation;
+
+	// Physics body as seen at the start of the current tick
+	std::vector<SMovementBody> body;
+
+	// Scratch for the current tick: physics world queries made on the main thread, and the writes to commit back
+	std::vector<uint8> isStandingBlocked;
+	std::vector<SWallProbeHit> leftWallHit;
+	std::vector<SWallProbeHit> rightWallHit;
+	std::vector<SMovementPhysicsCommands> commands;
+	// What the commits so far left the body with, reset when the body is physicalized again
+	std::vector<SMovementPhysicsApplied> appliedPhysics;
+	// Wall followed between probes and ceiling clearance reused between checks, not part of the state, SetState drops them
+	std::vector<SWallContact> wallContact;
+	std::vector<SHeadroom> headroom;
+
+	// Ticks the next simulation of the player covers, more than one when CMovementUpdateScheduler skipped it
+	std::vector<uint8> catchUpTicks;
+	std::vector<SMovementUpdateLod> updateLod;
+	// Where CPlayerInterestGrid has the player, only it writes this
+	std::vector<SPlayerInterestCell> interestCell;
+
+	// Cold data, only dereferenced by the stages that need it
+	std::vector<const SMovementParams*> params;
+	std::vector<IMovementPhysics*> physics;
+	std::vector<PlayerMovementId> ids;
+
+private:
+	static constexpr uint32 SlotBits = 16;
+	static constexpr uint32 SlotMask = (1u << SlotBits) - 1;
+
+	// Calls func on every column, const or not depending on the store passed
+	template<typename TStore, typename TFunc>
+	static void ForEachColumn(TStore& store, TFunc func);
+
+	// Per slot: dense index of the player and the generation handed out with its id
+	std::vector<uint32> m_slotToIndex;
+	std::vector<uint16> m_slotGeneration;
+	std::vector<uint32> m_freeSlots;
+};
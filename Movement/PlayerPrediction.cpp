@@ -0,0 +1,205 @@
+#include "StdAfx.h"
+#include "PlayerPrediction.h"
+#include "PlayerMovementSimulation.h"
+
+namespace
+{
+	// Sequences wrap around, compare them by distance instead of value
+	bool IsNewer(uint32 sequence, uint32 than)
+	{
+		return static_cast<int32>(sequence - than) > 0;
+	}
+
+	// Folds the one-off parts of a skipped input into the next one, so presses and mouse movement are not lost
+	void MergeEdges(SPlayerInput& into, const SPlayerInput& from)
+	{
+		into.pressed |= from.pressed;
+		into.released |= from.released;
+		into.mouseDeltaRotation += from.mouseDeltaRotation;
+	}
+}
+
+void CPlayerInputQueue::Receive(const SPlayerInputCommand* pCommands, uint32 count)
+{
+	for (uint32 i = 0; i < count; ++i)
+	{
+		const SPlayerInputCommand& command = pCommands[i];
+
+		// Already simulated, or a repeat of a command we are holding on to
+		if ((m_hasStarted && !IsNewer(command.sequence, m_ackSequence)) || m_commands.Find(command.sequence) != nullptr)
+			continue;
+
+		m_commands.Insert(command.sequence) = command.input;
+
+		if (!m_hasReceived || IsNewer(command.sequence, m_newestSequence))
+		{
+			m_newestSequence = command.sequence;
+		}
+		m_hasReceived = true;
+	}
+}
+
+SPlayerInput CPlayerInputQueue::Consume()
+{
+	if (!m_hasReceived)
+		return SPlayerInput();
+
+	if (!m_hasStarted)
+	{
+		// Start with the oldest command we have, anything before it is gone
+		uint32 oldest = m_newestSequence;
+		while (m_newestSequence - (oldest - 1) < MaxQueuedCommands && m_commands.Find(oldest - 1) != nullptr)
+		{
+			--oldest;
+		}
+		m_ackSequence = oldest - 1;
+		m_hasStarted = true;
+	}
+
+	SPlayerInput skipped;
+	while (IsNewer(m_newestSequence, m_ackSequence))
+	{
+		const uint32 next = m_ackSequence + 1;
+		SPlayerInput* pInput = m_commands.Find(next);
+
+		// Catch up when the client got too far ahead, and step over commands that never arrived
+		if (pInput != nullptr && m_newestSequence - m_ackSequence <= MaxQueuedCommands)
+		{
+			SPlayerInput input = *pInput;
+			MergeEdges(input, skipped);
+			m_commands.Erase(next);
+
+			m_ackSequence = next;
+			m_lastInput = input;
+			return input;
+		}
+
+		if (pInput != nullptr)
+		{
+			MergeEdges(skipped, *pInput);
+			m_commands.Erase(next);
+		}
+		m_ackSequence = next;
+	}
+
+	SPlayerInput input = m_lastInput;
+	input.ClearEdges();
+	input.mouseDeltaRotation = ZERO;
+	return input;
+}
+
+void CPlayerPrediction::RecordInput(uint32 sequence, const SPlayerInput& input)
+{
+	m_history.Insert(sequence).input = input;
+	m_newestSequence = sequence;
+	m_hasRecorded = true;
+}
+
+void CPlayerPrediction::RecordState(uint32 sequence, const SPlayerMovementState& state)
+{
+	if (STick* pTick = m_history.Find(sequence))
+	{
+		pTick->state = state;
+		pTick->hasState = true;
+	}
+}
+
+void CPlayerPrediction::RecordBody(uint32 sequence, const Vec3& position, const Vec3& velocity)
+{
+	if (STick* pTick = m_history.Find(sequence))
+	{
+		pTick->position = position;
+		pTick->velocity = velocity;
+		pTick->hasBody = true;
+	}
+}
+
+uint32 CPlayerPrediction::GetUnacknowledged(SPlayerInputCommand* pCommands, uint32 maxCount) const
+{
+	if (!m_hasRecorded || maxCount == 0 || (m_hasAck && !IsNewer(m_newestSequence, m_ackSequence)))
+		return 0;
+
+	uint32 first = m_newestSequence + 1 - maxCount;
+	if (m_hasAck && IsNewer(m_ackSequence + 1, first))
+	{
+		first = m_ackSequence + 1;
+	}
+
+	uint32 count = 0;
+	for (uint32 sequence = first; sequence != m_newestSequence + 1; ++sequence)
+	{
+		if (const STick* pTick = m_history.Find(sequence))
+		{
+			pCommands[count].sequence = sequence;
+			pCommands[count].input = pTick->input;
+			++count;
+		}
+	}
+	return count;
+}
+
+bool CPlayerPrediction::Reconcile(CPlayerMovementStore& store, uint32 index, const SPlayerMovementSnapshot& snapshot, float tickLength, float positionTolerance)
+{
+	// Snapshots arrive unordered, only ever move forward
+	if (m_hasAck && !IsNewer(snapshot.ackSequence, m_ackSequence))
+		return false;
+
+	m_hasAck = true;
+	m_ackSequence = snapshot.ackSequence;
+
+	const STick* pPredicted = m_history.Find(snapshot.ackSequence);
+	if (pPredicted != nullptr && Matches(*pPredicted, snapshot, positionTolerance))
+		return false;
+
+	// Rewind to the server state, then run every input it has not seen yet on top of it again
+	IMovementPhysics& physics = *store.physics[index];
+	const SPlayerInput pendingInput = store.input[index];
+
+	store.SetState(index, snapshot.state);
+	physics.SetBodyState(snapshot.position, snapshot.velocity);
+
+	if (STick* pAcknowledged = m_history.Find(snapshot.ackSequence))
+	{
+		pAcknowledged->state = snapshot.state;
+		pAcknowledged->position = snapshot.position;
+		pAcknowledged->velocity = snapshot.velocity;
+		pAcknowledged->hasState = pAcknowledged->hasBody = true;
+	}
+
+	physics.SetReplaying(true);
+	if (m_hasRecorded && IsNewer(m_newestSequence, snapshot.ackSequence) && m_newestSequence - snapshot.ackSequence < HistorySize)
+	{
+		for (uint32 sequence = snapshot.ackSequence + 1; sequence != m_newestSequence + 1; ++sequence)
+		{
+			STick* pTick = m_history.Find(sequence);
+			if (pTick == nullptr)
+				continue;
+
+			store.input[index] = pTick->input;
+			CPlayerMovementSimulation::Resimulate(store, index, tickLength);
+			physics.StepBody(tickLength);
+
+			const SMovementBody body = physics.GetBody();
+			pTick->state = store.GetState(index);
+			pTick->position = body.position;
+			pTick->velocity = body.velocity;
+			pTick->hasState = pTick->hasBody = true;
+		}
+	}
+	physics.SetReplaying(false);
+
+	store.input[index] = pendingInput;
+	return true;
+}
+
+bool CPlayerPrediction::Matches(const STick& predicted, const SPlayerMovementSnapshot& snapshot, float positionTolerance) const
+{
+	if (!predicted.hasState)
+		return false;
+
+	const SPlayerMovementState& state = predicted.state;
+	if (state.flags != snapshot.state.flags || state.stance != snapshot.state.stance || state.playerState != snapshot.state.playerState)
+		return false;
+
+	return !predicted.hasBody || predicted.position.GetSquaredDistance(snapshot.position) <= positionTolerance * positionTolerance;
+}
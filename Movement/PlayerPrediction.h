@@ -0,0 +1,158 @@
+#pragma once
+
+#include "PlayerMovement.h"
+
+#include <array>
+
+class CPlayerMovementStore;
+
+// Input of one tick, stamped with the client tick that produced it
+struct SPlayerInputCommand
+{
+	uint32 sequence = 0;
+	SPlayerInput input;
+};
+
+// Most input commands sent in one message, the unacknowledged ones are repeated in every message up to this many
+static constexpr uint32 MaxInputCommandsPerPacket = 8;
+
+// Authoritative movement state of a player, as sent by the server
+struct SPlayerMovementSnapshot
+{
+	// Last input command of the owning client the state includes
+	uint32 ackSequence = 0;
+	SPlayerMovementState state;
+	// Body after physics has integrated the acknowledged tick
+	Vec3 position = ZERO;
+	Vec3 velocity = ZERO;
+	// Held input the server is currently simulating with, lets other clients keep the player moving between snapshots
+	SPlayerInput input;
+};
+
+// Fixed size history of values keyed by a tick sequence, older entries are overwritten
+template<typename T, uint32 Capacity>
+class CSequenceRing
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+public:
+	void Clear()
+	{
+		for (SEntry& entry : m_entries)
+		{
+			entry.isValid = false;
+		}
+	}
+
+	T& Insert(uint32 sequence)
+	{
+		SEntry& entry = m_entries[sequence & (Capacity - 1)];
+		entry.sequence = sequence;
+		entry.isValid = true;
+		entry.value = T();
+		return entry.value;
+	}
+
+	T* Find(uint32 sequence)
+	{
+		SEntry& entry = m_entries[sequence & (Capacity - 1)];
+		return entry.isValid && entry.sequence == sequence ? &entry.value : nullptr;
+	}
+
+	const T* Find(uint32 sequence) const { return const_cast<CSequenceRing*>(this)->Find(sequence); }
+
+	void Erase(uint32 sequence)
+	{
+		SEntry& entry = m_entries[sequence & (Capacity - 1)];
+		if (entry.sequence == sequence)
+		{
+			entry.isValid = false;
+		}
+	}
+
+private:
+	struct SEntry
+	{
+		T value;
+		uint32 sequence = 0;
+		bool isValid = false;
+	};
+
+	std::array<SEntry, Capacity> m_entries;
+};
+
+////////////////////////////////////////////////////////
+// Server side: input commands received from the client owning a player
+// Commands arrive unreliably, out of order and repeated. They are consumed one per server tick in sequence order.
+////////////////////////////////////////////////////////
+class CPlayerInputQueue
+{
+public:
+	// Commands further ahead of the next one to simulate than this are skipped, the client is running ahead of us
+	static constexpr uint32 MaxQueuedCommands = 8;
+
+	void Receive(const SPlayerInputCommand* pCommands, uint32 count);
+
+	// Input for the next server tick
+	// Without a fresh command the last held input is repeated, without any press / release edges.
+	SPlayerInput Consume();
+
+	// Last command that was simulated
+	uint32 GetAckSequence() const { return m_ackSequence; }
+
+private:
+	CSequenceRing<SPlayerInput, 32> m_commands;
+	SPlayerInput m_lastInput;
+	uint32 m_ackSequence = 0;
+	uint32 m_newestSequence = 0;
+	bool m_hasReceived = false;
+	bool m_hasStarted = false;
+};
+
+////////////////////////////////////////////////////////
+// Client side prediction for the locally controlled player
+// Remembers the input and resulting state of every predicted tick, so a server snapshot can be compared
+// against what we predicted for that tick and the unacknowledged inputs replayed on top of it when they differ.
+////////////////////////////////////////////////////////
+class CPlayerPrediction
+{
+public:
+	static constexpr uint32 HistorySize = 128;
+
+	// Called right before the tick simulating the input
+	void RecordInput(uint32 sequence, const SPlayerInput& input);
+	// Called right after the tick
+	void RecordState(uint32 sequence, const SPlayerMovementState& state);
+	// Called once physics has integrated the tick
+	void RecordBody(uint32 sequence, const Vec3& position, const Vec3& velocity);
+
+	// Fills pCommands with the newest unacknowledged commands, oldest first, and returns how many were written
+	// Everything the server has not confirmed yet is sent again, so single lost packets cost nothing.
+	uint32 GetUnacknowledged(SPlayerInputCommand* pCommands, uint32 maxCount) const;
+
+	// Applies a server snapshot for the player at the given store index
+	// Returns true if the prediction was off and the player had to be rewound and replayed.
+	bool Reconcile(CPlayerMovementStore& store, uint32 index, const SPlayerMovementSnapshot& snapshot, float tickLength, float positionTolerance);
+
+	bool HasRecorded() const { return m_hasRecorded; }
+	uint32 GetNewestSequence() const { return m_newestSequence; }
+
+protected:
+	struct STick
+	{
+		SPlayerInput input;
+		SPlayerMovementState state;
+		Vec3 position = ZERO;
+		Vec3 velocity = ZERO;
+		bool hasState = false;
+		bool hasBody = false;
+	};
+
+	bool Matches(const STick& predicted, const SPlayerMovementSnapshot& snapshot, float positionTolerance) const;
+
+	CSequenceRing<STick, HistorySize> m_history;
+	uint32 m_ackSequence = 0;
+	uint32 m_newestSequence = 0;
+	bool m_hasAck = false;
+	bool m_hasRecorded = false;
+};
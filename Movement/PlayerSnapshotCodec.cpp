@@ -0,0 +1,488 @@
+#include "StdAfx.h"
+#include "PlayerSnapshotCodec.h"
+
+#include <chrono>
+
+namespace
+{
+	// Bit widths of the fixed size fields, the ranges are what the simulation can produce
+	constexpr uint32 AngleBits = 16;
+	constexpr uint32 DiscreteBits = 8;
+	constexpr uint32 NormalBits = 10;
+	constexpr uint32 WallrunTimerBits = 12;
+	constexpr float WallrunTimerMax = 4.f;
+	constexpr uint32 RollBits = 12;
+	constexpr float RollMax = 1.f;
+	constexpr uint32 CameraOffsetBits = 12;
+	constexpr float CameraOffsetMax = 4.f;
+	constexpr uint32 FovBits = 12;
+	constexpr float FovMax = 180.f;
+	constexpr uint32 HeldBits = 7;
+	constexpr uint32 MovementDeltaBits = 8;
+	constexpr uint32 VarLengthBits = 6;
+
+	uint32 QuantizeRange(float value, float minValue, float maxValue, uint32 numBits)
+	{
+		const float maxStep = static_cast<float>((1u << numBits) - 1);
+		const float normalized = (crymath::clamp(value, minValue, maxValue) - minValue) / (maxValue - minValue);
+		return static_cast<uint32>(normalized * maxStep + 0.5f);
+	}
+
+	float DequantizeRange(uint32 value, float minValue, float maxValue, uint32 numBits)
+	{
+		const float maxStep = static_cast<float>((1u << numBits) - 1);
+		return minValue + static_cast<float>(value) / maxStep * (maxValue - minValue);
+	}
+
+	int32 QuantizeFixed(float value, float scale)
+	{
+		return static_cast<int32>(std::lround(value * scale));
+	}
+
+	template<typename T>
+	void WriteField(CBitWriter& writer, T value, T baseline, uint32 numBits)
+	{
+		writer.WriteBool(value != baseline);
+		if (value != baseline)
+		{
+			writer.WriteBits(value, numBits);
+		}
+	}
+
+	template<typename T>
+	void ReadField(CBitReader& reader, T& value, T baseline, uint32 numBits)
+	{
+		value = reader.ReadBool() ? static_cast<T>(reader.ReadBits(numBits)) : baseline;
+	}
+
+	// Fields sent as a group share one changed bit
+	template<typename T, size_t Size>
+	bool Differs(const T (&value)[Size], const T (&baseline)[Size])
+	{
+		for (size_t i = 0; i < Size; ++i)
+		{
+			if (value[i] != baseline[i])
+				return true;
+		}
+		return false;
+	}
+
+	template<typename T, size_t Size>
+	void WriteGroup(CBitWriter& writer, const T (&value)[Size], const T (&baseline)[Size], uint32 numBits)
+	{
+		const bool hasChanged = Differs(value, baseline);
+		writer.WriteBool(hasChanged);
+		for (size_t i = 0; hasChanged && i < Size; ++i)
+		{
+			writer.WriteBits(value[i], numBits);
+		}
+	}
+
+	template<typename T, size_t Size>
+	void ReadGroup(CBitReader& reader, T (&value)[Size], const T (&baseline)[Size], uint32 numBits)
+	{
+		const bool hasChanged = reader.ReadBool();
+		for (size_t i = 0; i < Size; ++i)
+		{
+			value[i] = hasChanged ? static_cast<T>(reader.ReadBits(numBits)) : baseline[i];
+		}
+	}
+
+	template<size_t Size>
+	void WriteDeltaGroup(CBitWriter& writer, const int32 (&value)[Size], const int32 (&baseline)[Size])
+	{
+		const bool hasChanged = Differs(value, baseline);
+		writer.WriteBool(hasChanged);
+		for (size_t i = 0; hasChanged && i < Size; ++i)
+		{
+			writer.WriteVarSigned(static_cast<int32>(static_cast<uint32>(value[i]) - static_cast<uint32>(baseline[i])));
+		}
+	}
+
+	template<size_t Size>
+	void ReadDeltaGroup(CBitReader& reader, int32 (&value)[Size], const int32 (&baseline)[Size])
+	{
+		const bool hasChanged = reader.ReadBool();
+		for (size_t i = 0; i < Size; ++i)
+		{
+			value[i] = hasChanged ? static_cast<int32>(static_cast<uint32>(baseline[i]) + static_cast<uint32>(reader.ReadVarSigned())) : baseline[i];
+		}
+	}
+
+	bool IsSame(const SQuantizedSnapshot& a, const SQuantizedSnapshot& b)
+	{
+		return a.ackSequence == b.ackSequence && !Differs(a.position, b.position) && !Differs(a.velocity, b.velocity)
+			&& a.yaw == b.yaw && a.pitch == b.pitch && a.discrete == b.discrete && !Differs(a.wallNormal, b.wallNormal)
+			&& a.wallrunTimer == b.wallrunTimer && a.wallrunRoll == b.wallrunRoll && a.cameraRoll == b.cameraRoll
+			&& !Differs(a.cameraOffset, b.cameraOffset) && !Differs(a.cameraEndOffset, b.cameraEndOffset)
+			&& a.fov == b.fov && a.desiredFov == b.desiredFov && a.held == b.held && !Differs(a.movementDelta, b.movementDelta);
+	}
+
+	// Deterministic noise for the benchmark, so runs are comparable
+	struct SBenchmarkRandom
+	{
+		float Next(float minValue, float maxValue)
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return minValue + static_cast<float>(state & 0xFFFF) / 65535.f * (maxValue - minValue);
+		}
+
+		uint32 state = 0x9E3779B9;
+	};
+}
+
+void CBitWriter::WriteBits(uint32 value, uint32 numBits)
+{
+	if (m_hasOverflowed || m_numBits + numBits > m_capacityBits)
+	{
+		m_hasOverflowed = true;
+		return;
+	}
+
+	while (numBits > 0)
+	{
+		const uint32 bitInByte = m_numBits & 7;
+		const uint32 count = std::min(8 - bitInByte, numBits);
+		uint8& byte = m_pBuffer[m_numBits >> 3];
+		if (bitInByte == 0)
+		{
+			byte = 0;
+		}
+		byte |= static_cast<uint8>((value & ((1u << count) - 1)) << bitInByte);
+
+		value >>= count;
+		numBits -= count;
+		m_numBits += count;
+	}
+}
+
+void CBitWriter::WriteVarSigned(int32 value)
+{
+	const uint32 zigzag = (static_cast<uint32>(value) << 1) ^ static_cast<uint32>(value >> 31);
+
+	uint32 length = 0;
+	while (length < 32 && (zigzag >> length) != 0)
+	{
+		++length;
+	}
+
+	WriteBits(length, VarLengthBits);
+	WriteBits(zigzag, length);
+}
+
+void CBitWriter::WriteBitsFrom(const CBitWriter& other)
+{
+	CBitReader reader(other.GetData(), other.GetNumBits());
+	while (reader.GetNumBitsLeft() > 0)
+	{
+		const uint32 count = std::min(reader.GetNumBitsLeft(), 32u);
+		WriteBits(reader.ReadBits(count), count);
+	}
+}
+
+uint32 CBitReader::ReadBits(uint32 numBits)
+{
+	if (m_hasOverflowed || m_position + numBits > m_numBits)
+	{
+		m_hasOverflowed = true;
+		return 0;
+	}
+
+	uint32 value = 0;
+	uint32 shift = 0;
+	while (numBits > 0)
+	{
+		const uint32 bitInByte = m_position & 7;
+		const uint32 count = std::min(8 - bitInByte, numBits);
+		const uint32 bits = (m_pData[m_position >> 3] >> bitInByte) & ((1u << count) - 1);
+		value |= bits << shift;
+
+		shift += count;
+		numBits -= count;
+		m_position += count;
+	}
+	return value;
+}
+
+int32 CBitReader::ReadVarSigned()
+{
+	const uint32 length = ReadBits(VarLengthBits);
+	if (length > 32)
+	{
+		m_hasOverflowed = true;
+		return 0;
+	}
+
+	const uint32 zigzag = ReadBits(length);
+	return static_cast<int32>((zigzag >> 1) ^ (0u - (zigzag & 1)));
+}
+
+void CBitReader::SkipBits(uint32 numBits)
+{
+	if (m_position + numBits > m_numBits)
+	{
+		m_hasOverflowed = true;
+		m_position = m_numBits;
+		return;
+	}
+	m_position += numBits;
+}
+
+SQuantizedSnapshot CPlayerSnapshotCodec::Quantize(const SPlayerMovementSnapshot& snapshot)
+{
+	const SPlayerMovementState& state = snapshot.state;
+
+	SQuantizedSnapshot quantized;
+	quantized.ackSequence = snapshot.ackSequence;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		quantized.position[axis] = QuantizeFixed(snapshot.position[axis], PositionScale);
+		quantized.velocity[axis] = QuantizeFixed(snapshot.velocity[axis], VelocityScale);
+		quantized.wallNormal[axis] = static_cast<uint16>(QuantizeRange(state.wallNormal[axis], -1.f, 1.f, NormalBits));
+		quantized.cameraOffset[axis] = static_cast<uint16>(QuantizeRange(state.cameraOffset[axis], -CameraOffsetMax, CameraOffsetMax, CameraOffsetBits));
+		quantized.cameraEndOffset[axis] = static_cast<uint16>(QuantizeRange(state.cameraEndOffset[axis], -CameraOffsetMax, CameraOffsetMax, CameraOffsetBits));
+	}
+
+	quantized.yaw = static_cast<uint16>(QuantizeRange(state.yaw, -gf_PI, gf_PI, AngleBits));
+	quantized.pitch = static_cast<uint16>(QuantizeRange(state.pitch, -gf_PI, gf_PI, AngleBits));
+	quantized.discrete = static_cast<uint8>(static_cast<uint32>(state.playerState)
+		| (static_cast<uint32>(state.stance) << 1)
+		| (static_cast<uint32>(state.desiredStance) << 2)
+		| (static_cast<uint32>(state.flags) << 3));
+	quantized.wallrunTimer = static_cast<uint16>(QuantizeRange(state.wallrunTimer, 0.f, WallrunTimerMax, WallrunTimerBits));
+	quantized.wallrunRoll = static_cast<uint16>(QuantizeRange(state.wallrunRoll, -RollMax, RollMax, RollBits));
+	quantized.cameraRoll = static_cast<uint16>(QuantizeRange(state.cameraRoll, -RollMax, RollMax, RollBits));
+	quantized.fov = static_cast<uint16>(QuantizeRange(state.fov, 0.f, FovMax, FovBits));
+	quantized.desiredFov = static_cast<uint16>(QuantizeRange(state.desiredFov, 0.f, FovMax, FovBits));
+
+	// Press and release edges and mouse movement only matter to the tick that consumed them, nobody simulates them from a snapshot
+	quantized.held = static_cast<uint8>(snapshot.input.held & ((1u << HeldBits) - 1));
+	quantized.movementDelta[0] = static_cast<uint8>(QuantizeRange(snapshot.input.movementDelta.x, -1.f, 1.f, MovementDeltaBits));
+	quantized.movementDelta[1] = static_cast<uint8>(QuantizeRange(snapshot.input.movementDelta.y, -1.f, 1.f, MovementDeltaBits));
+	return quantized;
+}
+
+SPlayerMovementSnapshot CPlayerSnapshotCodec::Dequantize(const SQuantizedSnapshot& quantized, uint32 serverTick)
+{
+	SPlayerMovementSnapshot snapshot;
+	SPlayerMovementState& state = snapshot.state;
+
+	snapshot.ackSequence = quantized.ackSequence;
+	state.tick = serverTick;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		snapshot.position[axis] = static_cast<float>(quantized.position[axis]) / PositionScale;
+		snapshot.velocity[axis] = static_cast<float>(quantized.velocity[axis]) / VelocityScale;
+		state.wallNormal[axis] = DequantizeRange(quantized.wallNormal[axis], -1.f, 1.f, NormalBits);
+		state.cameraOffset[axis] = DequantizeRange(quantized.cameraOffset[axis], -CameraOffsetMax, CameraOffsetMax, CameraOffsetBits);
+		state.cameraEndOffset[axis] = DequantizeRange(quantized.cameraEndOffset[axis], -CameraOffsetMax, CameraOffsetMax, CameraOffsetBits);
+	}
+	// The all-zero normal does not survive the quantization on its own, it is what the simulation tests for
+	if (state.wallNormal.GetLengthSquared() < 0.25f)
+	{
+		state.wallNormal = ZERO;
+	}
+	else
+	{
+		state.wallNormal.Normalize();
+	}
+
+	state.yaw = DequantizeRange(quantized.yaw, -gf_PI, gf_PI, AngleBits);
+	state.pitch = DequantizeRange(quantized.pitch, -gf_PI, gf_PI, AngleBits);
+	state.playerState = static_cast<EPlayerState>(quantized.discrete & 1);
+	state.stance = static_cast<EPlayerStance>((quantized.discrete >> 1) & 1);
+	state.desiredStance = static_cast<EPlayerStance>((quantized.discrete >> 2) & 1);
+	state.flags = static_cast<uint8>(quantized.discrete >> 3);
+	state.wallrunTimer = DequantizeRange(quantized.wallrunTimer, 0.f, WallrunTimerMax, WallrunTimerBits);
+	state.wallrunRoll = DequantizeRange(quantized.wallrunRoll, -RollMax, RollMax, RollBits);
+	state.cameraRoll = DequantizeRange(quantized.cameraRoll, -RollMax, RollMax, RollBits);
+	state.fov = DequantizeRange(quantized.fov, 0.f, FovMax, FovBits);
+	state.desiredFov = DequantizeRange(quantized.desiredFov, 0.f, FovMax, FovBits);
+
+	snapshot.input.held = quantized.held;
+	snapshot.input.movementDelta.x = DequantizeRange(quantized.movementDelta[0], -1.f, 1.f, MovementDeltaBits);
+	snapshot.input.movementDelta.y = DequantizeRange(quantized.movementDelta[1], -1.f, 1.f, MovementDeltaBits);
+	return snapshot;
+}
+
+void CPlayerSnapshotCodec::Write(CBitWriter& writer, const SQuantizedSnapshot& snapshot, const SQuantizedSnapshot* pBaseline)
+{
+	const SQuantizedSnapshot zero;
+	const SQuantizedSnapshot& baseline = pBaseline != nullptr ? *pBaseline : zero;
+
+	writer.WriteBool(snapshot.ackSequence != baseline.ackSequence);
+	if (snapshot.ackSequence != baseline.ackSequence)
+	{
+		writer.WriteVarSigned(static_cast<int32>(snapshot.ackSequence - baseline.ackSequence));
+	}
+
+	WriteDeltaGroup(writer, snapshot.position, baseline.position);
+	WriteDeltaGroup(writer, snapshot.velocity, baseline.velocity);
+	WriteField(writer, snapshot.yaw, baseline.yaw, AngleBits);
+	WriteField(writer, snapshot.pitch, baseline.pitch, AngleBits);
+	WriteField(writer, snapshot.discrete, baseline.discrete, DiscreteBits);
+	WriteGroup(writer, snapshot.wallNormal, baseline.wallNormal, NormalBits);
+	WriteField(writer, snapshot.wallrunTimer, baseline.wallrunTimer, WallrunTimerBits);
+	WriteField(writer, snapshot.wallrunRoll, baseline.wallrunRoll, RollBits);
+	WriteField(writer, snapshot.cameraRoll, baseline.cameraRoll, RollBits);
+	WriteGroup(writer, snapshot.cameraOffset, baseline.cameraOffset, CameraOffsetBits);
+	WriteGroup(writer, snapshot.cameraEndOffset, baseline.cameraEndOffset, CameraOffsetBits);
+	WriteField(writer, snapshot.fov, baseline.fov, FovBits);
+	WriteField(writer, snapshot.desiredFov, baseline.desiredFov, FovBits);
+
+	const bool hasInputChanged = snapshot.held != baseline.held || Differs(snapshot.movementDelta, baseline.movementDelta);
+	writer.WriteBool(hasInputChanged);
+	if (hasInputChanged)
+	{
+		writer.WriteBits(snapshot.held, HeldBits);
+		writer.WriteBits(snapshot.movementDelta[0], MovementDeltaBits);
+		writer.WriteBits(snapshot.movementDelta[1], MovementDeltaBits);
+	}
+}
+
+bool CPlayerSnapshotCodec::Read(CBitReader& reader, SQuantizedSnapshot& snapshot, const SQuantizedSnapshot* pBaseline)
+{
+	const SQuantizedSnapshot zero;
+	const SQuantizedSnapshot& baseline = pBaseline != nullptr ? *pBaseline : zero;
+
+	snapshot.ackSequence = reader.ReadBool() ? baseline.ackSequence + static_cast<uint32>(reader.ReadVarSigned()) : baseline.ackSequence;
+
+	ReadDeltaGroup(reader, snapshot.position, baseline.position);
+	ReadDeltaGroup(reader, snapshot.velocity, baseline.velocity);
+	ReadField(reader, snapshot.yaw, baseline.yaw, AngleBits);
+	ReadField(reader, snapshot.pitch, baseline.pitch, AngleBits);
+	ReadField(reader, snapshot.discrete, baseline.discrete, DiscreteBits);
+	ReadGroup(reader, snapshot.wallNormal, baseline.wallNormal, NormalBits);
+	ReadField(reader, snapshot.wallrunTimer, baseline.wallrunTimer, WallrunTimerBits);
+	ReadField(reader, snapshot.wallrunRoll, baseline.wallrunRoll, RollBits);
+	ReadField(reader, snapshot.cameraRoll, baseline.cameraRoll, RollBits);
+	ReadGroup(reader, snapshot.cameraOffset, baseline.cameraOffset, CameraOffsetBits);
+	ReadGroup(reader, snapshot.cameraEndOffset, baseline.cameraEndOffset, CameraOffsetBits);
+	ReadField(reader, snapshot.fov, baseline.fov, FovBits);
+	ReadField(reader, snapshot.desiredFov, baseline.desiredFov, FovBits);
+
+	if (reader.ReadBool())
+	{
+		snapshot.held = static_cast<uint8>(reader.ReadBits(HeldBits));
+		snapshot.movementDelta[0] = static_cast<uint8>(reader.ReadBits(MovementDeltaBits));
+		snapshot.movementDelta[1] = static_cast<uint8>(reader.ReadBits(MovementDeltaBits));
+	}
+	else
+	{
+		snapshot.held = baseline.held;
+		snapshot.movementDelta[0] = baseline.movementDelta[0];
+		snapshot.movementDelta[1] = baseline.movementDelta[1];
+	}
+
+	return !reader.HasOverflowed();
+}
+
+CPlayerSnapshotCodec::SBenchmarkResult CPlayerSnapshotCodec::RunBenchmark(uint32 numPlayers, uint32 numTicks)
+{
+	using TClock = std::chrono::high_resolution_clock;
+
+	SBenchmarkResult result;
+	if (numPlayers == 0 || numTicks == 0)
+		return result;
+
+	SBenchmarkRandom random;
+	std::vector<SPlayerMovementSnapshot> players(numPlayers);
+	for (SPlayerMovementSnapshot& player : players)
+	{
+		player.position = Vec3(random.Next(-500.f, 500.f), random.Next(-500.f, 500.f), random.Next(0.f, 100.f));
+		player.state.yaw = random.Next(-gf_PI, gf_PI);
+		player.input.held = ePIA_MoveForward;
+		player.input.movementDelta = Vec2(0.f, 1.f);
+	}
+
+	std::vector<SQuantizedSnapshot> quantized(numPlayers);
+	std::vector<SQuantizedSnapshot> baselines(numPlayers);
+	std::vector<SQuantizedSnapshot> decoded(numPlayers);
+	std::vector<uint8> buffer(64 * numPlayers + 64);
+
+	uint64 fullBits = 0, deltaBits = 0;
+	TClock::duration encodeTime = TClock::duration::zero(), decodeTime = TClock::duration::zero();
+	const float tickLength = 1.f / CFixedTickAccumulator::DefaultTickRate;
+
+	for (uint32 tick = 0; tick < numTicks; ++tick)
+	{
+		// Roughly what players do: run, turn a little, sometimes jump or change speed
+		for (SPlayerMovementSnapshot& player : players)
+		{
+			player.ackSequence += 1;
+			player.state.yaw = player.state.yaw + random.Next(-0.05f, 0.05f);
+			player.state.yaw = player.state.yaw > gf_PI ? player.state.yaw - gf_PI2 : player.state.yaw;
+			player.state.yaw = player.state.yaw < -gf_PI ? player.state.yaw + gf_PI2 : player.state.yaw;
+			player.state.pitch = crymath::clamp(player.state.pitch + random.Next(-0.02f, 0.02f), -1.5f, 1.5f);
+			if (random.Next(0.f, 1.f) < 0.02f)
+			{
+				player.velocity.z = 4.f;
+				player.state.flags ^= eMF_CanJump;
+			}
+			player.velocity.x = 6.f * cosf(player.state.yaw);
+			player.velocity.y = 6.f * sinf(player.state.yaw);
+			player.velocity.z -= 9.81f * tickLength;
+			player.position += player.velocity * tickLength;
+			if (player.position.z < 0.f)
+			{
+				player.position.z = 0.f;
+				player.velocity.z = 0.f;
+			}
+		}
+
+		for (uint32 i = 0; i < numPlayers; ++i)
+		{
+			quantized[i] = Quantize(players[i]);
+		}
+
+		// Full records, as sent to a client without a baseline
+		{
+			CBitWriter writer(buffer.data(), static_cast<uint32>(buffer.size()));
+			for (uint32 i = 0; i < numPlayers; ++i)
+			{
+				Write(writer, quantized[i], nullptr);
+			}
+			fullBits += writer.GetNumBits();
+		}
+
+		// Delta records against the previous tick, the steady state of a client acknowledging everything
+		CBitWriter writer(buffer.data(), static_cast<uint32>(buffer.size()));
+		const TClock::time_point encodeStart = TClock::now();
+		for (uint32 i = 0; i < numPlayers; ++i)
+		{
+			Write(writer, quantized[i], tick > 0 ? &baselines[i] : nullptr);
+		}
+		encodeTime += TClock::now() - encodeStart;
+		if (tick > 0)
+		{
+			deltaBits += writer.GetNumBits();
+		}
+
+		CBitReader reader(writer.GetData(), writer.GetNumBits());
+		const TClock::time_point decodeStart = TClock::now();
+		for (uint32 i = 0; i < numPlayers; ++i)
+		{
+			Read(reader, decoded[i], tick > 0 ? &baselines[i] : nullptr);
+		}
+		decodeTime += TClock::now() - decodeStart;
+
+		for (uint32 i = 0; i < numPlayers; ++i)
+		{
+			result.isRoundTripExact &= !writer.HasOverflowed() && IsSame(decoded[i], quantized[i]);
+
+			const Vec3 position = Dequantize(decoded[i], tick).position;
+			result.maxPositionError = std::max(result.maxPositionError, position.GetDistance(players[i].position));
+			baselines[i] = decoded[i];
+		}
+	}
+
+	const float numRecords = static_cast<float>(numPlayers) * static_cast<float>(numTicks);
+	result.numRecords = numPlayers * numTicks;
+	result.fullBitsPerRecord = static_cast<float>(fullBits) / numRecords;
+	result.deltaBitsPerRecord = numTicks > 1 ? static_cast<float>(deltaBits) / (static_cast<float>(numPlayers) * static_cast<float>(numTicks - 1)) : 0.f;
+	result.encodeNanosecondsPerRecord = static_cast<float>(std::chrono::duration_cast<std::chrono::nanoseconds>(encodeTime).count()) / numRecords;
+	result.decodeNanosecondsPerRecord = static_cast<float>(std::chrono::duration_cast<std::chrono::nanoseconds>(decodeTime).count()) / numRecords;
+	return result;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "PlayerPrediction.h"
+
+// Appends values of arbitrary bit width to a fixed size buffer, least significant bit first
+class CBitWriter
+{
+public:
+	CBitWriter(uint8* pBuffer, uint32 capacityBytes) : m_pBuffer(pBuffer), m_capacityBits(capacityBytes * 8) {}
+
+	void WriteBits(uint32 value, uint32 numBits);
+	void WriteBool(bool value) { WriteBits(value ? 1 : 0, 1); }
+	// Small values take few bits: a 6 bit length followed by the zigzag encoded value
+	void WriteVarSigned(int32 value);
+	// Copies everything written to another writer
+	void WriteBitsFrom(const CBitWriter& other);
+
+	const uint8* GetData() const { return m_pBuffer; }
+	uint32 GetNumBits() const { return m_numBits; }
+	uint32 GetNumBytes() const { return (m_numBits + 7) / 8; }
+	// Set once a write did not fit, everything after it is dropped
+	bool HasOverflowed() const { return m_hasOverflowed; }
+
+private:
+	uint8* m_pBuffer;
+	uint32 m_capacityBits;
+	uint32 m_numBits = 0;
+	bool m_hasOverflowed = false;
+};
+
+// Reads back what a CBitWriter wrote
+class CBitReader
+{
+public:
+	CBitReader(const uint8* pData, uint32 numBits) : m_pData(pData), m_numBits(numBits) {}
+
+	uint32 ReadBits(uint32 numBits);
+	bool ReadBool() { return ReadBits(1) != 0; }
+	int32 ReadVarSigned();
+	void SkipBits(uint32 numBits);
+
+	uint32 GetPosition() const { return m_position; }
+	uint32 GetNumBitsLeft() const { return m_position < m_numBits ? m_numBits - m_position : 0; }
+	// Set once a read went past the end, all reads after it return zero
+	bool HasOverflowed() const { return m_hasOverflowed; }
+
+private:
+	const uint8* m_pData;
+	uint32 m_numBits;
+	uint32 m_position = 0;
+	bool m_hasOverflowed = false;
+};
+
+// A snapshot reduced to the precision it is sent with
+// Baselines are kept in this form on both ends, so a delta always refers to exactly what the receiver decoded.
+struct SQuantizedSnapshot
+{
+	uint32 ackSequence = 0;
+	int32 position[3] = {};
+	int32 velocity[3] = {};
+	uint16 yaw = 0;
+	uint16 pitch = 0;
+	// Player state, stance, desired stance and movement flags
+	uint8 discrete = 0;
+	uint16 wallNormal[3] = {};
+	uint16 wallrunTimer = 0;
+	uint16 wallrunRoll = 0;
+	uint16 cameraRoll = 0;
+	uint16 cameraOffset[3] = {};
+	uint16 cameraEndOffset[3] = {};
+	uint16 fov = 0;
+	uint16 desiredFov = 0;
+	uint8 held = 0;
+	uint8 movementDelta[2] = {};
+};
+
+////////////////////////////////////////////////////////
+// Bit-packed, delta-compressed encoding of player movement snapshots
+// Every field is quantized, then written only if it differs from the baseline the receiver has acknowledged.
+// Positions and velocities are sent as variable length differences, so a player standing still costs a few bits.
+// Without a baseline the record is encoded against an all-zero one, which is the same format.
+////////////////////////////////////////////////////////
+class CPlayerSnapshotCodec
+{
+public:
+	// Positions are sent in units of 1/512 m, velocities in 1/128 m/s
+	static constexpr float PositionScale = 512.f;
+	static constexpr float VelocityScale = 128.f;
+
+	static SQuantizedSnapshot Quantize(const SPlayerMovementSnapshot& snapshot);
+	// The server tick the snapshot was taken at is not part of the record, it comes with the packet
+	static SPlayerMovementSnapshot Dequantize(const SQuantizedSnapshot& quantized, uint32 serverTick);
+
+	static void Write(CBitWriter& writer, const SQuantizedSnapshot& snapshot, const SQuantizedSnapshot* pBaseline);
+	// Returns false if the data ran out before the record was complete
+	static bool Read(CBitReader& reader, SQuantizedSnapshot& snapshot, const SQuantizedSnapshot* pBaseline);
+
+	struct SBenchmarkResult
+	{
+		uint32 numRecords = 0;
+		float fullBitsPerRecord = 0.f;
+		float deltaBitsPerRecord = 0.f;
+		float encodeNanosecondsPerRecord = 0.f;
+		float decodeNanosecondsPerRecord = 0.f;
+		float maxPositionError = 0.f;
+		bool isRoundTripExact = true;
+	};
+
+	// Encodes and decodes the snapshots of numPlayers synthetic players moving around for numTicks ticks
+	static SBenchmarkResult RunBenchmark(uint32 numPlayers, uint32 numTicks);
+};
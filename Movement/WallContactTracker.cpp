@@ -0,0 +1,60 @@
+#include "StdAfx.h"
+#include "WallContactTracker.h"
+
+bool CWallContactTracker::Predict(SWallContact& contact, const SMovementParams& params, const Vec3& origin, const Vec3& rightDir, SWallProbeHit& leftHit, SWallProbeHit& rightHit)
+{
+	if (!contact.IsTracking() || static_cast<uint32>(contact.ticksSinceProbe) + 1 >= params.wallContactMaxTicks)
+		return false;
+
+	if (origin.GetSquaredDistance(contact.probeOrigin) > params.wallContactMaxTravel * params.wallContactMaxTravel)
+		return false;
+
+	// The probe on the wall side, left probes go along -rightDir
+	const Vec3 direction = rightDir * (-contact.side * params.wallSearchRange);
+	const float approach = direction.Dot(contact.normal);
+	if (approach >= -1e-6f)
+		return false;
+
+	const float fraction = (contact.point - origin).Dot(contact.normal) / approach;
+	if (fraction < 0.f || fraction > 1.f)
+		return false;
+
+	const float distance = fraction * params.wallSearchRange;
+	if (std::abs(distance - contact.probeDistance) > params.wallContactDistanceTolerance)
+		return false;
+
+	SWallProbeHit& wallHit = contact.side > 0.f ? leftHit : rightHit;
+	wallHit.hit = true;
+	wallHit.isWallrunnable = true;
+	wallHit.point = origin + direction * fraction;
+	wallHit.normal = contact.normal;
+	wallHit.distance = distance;
+
+	// The other side is only looked at when the wall side misses, which it doesn't here
+	(contact.side > 0.f ? rightHit : leftHit) = SWallProbeHit();
+
+	++contact.ticksSinceProbe;
+	contact.state = EWallContactState::Predicted;
+	return true;
+}
+
+void CWallContactTracker::OnProbed(SWallContact& contact, bool isWallrunning, const Vec3& origin, const SWallProbeHit& leftHit, const SWallProbeHit& rightHit)
+{
+	// Same preference as CPlayerMovementSimulation::UpdateWallrun, the left wall wins
+	const SWallProbeHit& wallHit = leftHit.hit ? leftHit : rightHit;
+	if (!isWallrunning || !wallHit.hit || !wallHit.isWallrunnable)
+	{
+		const bool wasTracking = contact.IsTracking();
+		contact = SWallContact();
+		contact.state = wasTracking && isWallrunning ? EWallContactState::Lost : EWallContactState::None;
+		return;
+	}
+
+	contact.point = wallHit.point;
+	contact.normal = wallHit.normal;
+	contact.probeOrigin = origin;
+	contact.probeDistance = wallHit.distance;
+	contact.side = leftHit.hit ? 1.f : -1.f;
+	contact.ticksSinceProbe = 0;
+	contact.state = EWallContactState::Probed;
+}
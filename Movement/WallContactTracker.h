@@ -0,0 +1,51 @@
+#pragma once
+
+#include "PlayerMovement.h"
+#include "IMovementPhysics.h"
+
+enum class EWallContactState : uint8
+{
+	// Not wallrunning, every tick probes
+	None,
+	// The hits of this tick came from a real probe that found the wall again
+	Probed,
+	// The hits of this tick were derived from the wall plane, no probe was made
+	Predicted,
+	// A real probe no longer found the wall we were running along
+	Lost,
+};
+
+// The wall a player is running along, as last seen by a real probe
+struct SWallContact
+{
+	Vec3 point = ZERO;
+	// Faces the player
+	Vec3 normal = ZERO;
+	// Probe origin and hit distance when the wall was last probed
+	Vec3 probeOrigin = ZERO;
+	float probeDistance = 0.f;
+	// Positive when the wall is on the left, as in CPlayerMovementSimulation::StartWallrun
+	float side = 0.f;
+	uint16 ticksSinceProbe = 0;
+	EWallContactState state = EWallContactState::None;
+
+	bool IsTracking() const { return state == EWallContactState::Probed || state == EWallContactState::Predicted; }
+};
+
+////////////////////////////////////////////////////////
+// Skips the wall probes of players that are running along a known wall
+// While wallrunning the wall is a plane, so where the probe would hit it follows from the probe origin alone.
+// A real probe is still made when the player moved further than SMovementParams::wallContactMaxTravel,
+// the distance to the plane drifted by more than wallContactDistanceTolerance, wallContactMaxTicks passed,
+// or the plane is no longer in probe range. The plane has no edges, so how soon the end of a wall is
+// noticed depends on the travel and tick limits.
+////////////////////////////////////////////////////////
+class CWallContactTracker
+{
+public:
+	// Fills both hits from the tracked wall, returns false if the walls have to be probed this tick
+	static bool Predict(SWallContact& contact, const SMovementParams& params, const Vec3& origin, const Vec3& rightDir, SWallProbeHit& leftHit, SWallProbeHit& rightHit);
+
+	// Takes the result of a real probe, isWallrunning is whether the player was wallrunning before this tick
+	static void OnProbed(SWallContact& contact, bool isWallrunning, const Vec3& origin, const SWallProbeHit& leftHit, const SWallProbeHit& rightHit);
+};
@@ -0,0 +1,226 @@
+#include "StdAfx.h"
+#include "WallSurfaceIndex.h"
+
+#include <algorithm>
+#include <chrono>
+
+void CWallSurfaceIndex::Clear()
+{
+	// A fresh index gives the memory back, clear() would keep the capacity around
+	*this = CWallSurfaceIndex();
+}
+
+bool CWallSurfaceIndex::AddTriangle(const Vec3& v0, const Vec3& v1, const Vec3& v2, bool canWallrun)
+{
+	STriangle triangle;
+	triangle.v0 = v0;
+	triangle.edge1 = v1 - v0;
+	triangle.edge2 = v2 - v0;
+	triangle.normal = triangle.edge1.Cross(triangle.edge2);
+
+	const float length = triangle.normal.GetLength();
+	if (length < 1e-6f || std::abs(triangle.normal.z) > MaxBlockingNormalZ * length)
+	{
+		++m_stats.numRejected;
+		return false;
+	}
+
+	triangle.normal /= length;
+	triangle.isWallrunnable = canWallrun && std::abs(triangle.normal.z) <= MaxNormalZ;
+	m_stats.numBlockers += triangle.isWallrunnable ? 0 : 1;
+	m_triangles.push_back(triangle);
+	return true;
+}
+
+void CWallSurfaceIndex::AddBox(const Matrix34& boxToWorld, const Vec3& halfExtents, bool canWallrun)
+{
+	Vec3 corners[8];
+	for (int i = 0; i < 8; ++i)
+	{
+		const Vec3 local((i & 1) ? halfExtents.x : -halfExtents.x, (i & 2) ? halfExtents.y : -halfExtents.y, (i & 4) ? halfExtents.z : -halfExtents.z);
+		corners[i] = boxToWorld * local;
+	}
+
+	// Two triangles per face, the faces that end up horizontal are dropped
+	static const int s_faces[6][4] =
+	{
+		{ 0, 2, 6, 4 }, { 1, 5, 7, 3 },
+		{ 0, 4, 5, 1 }, { 2, 3, 7, 6 },
+		{ 0, 1, 3, 2 }, { 4, 6, 7, 5 },
+	};
+	for (const int* face : s_faces)
+	{
+		AddTriangle(corners[face[0]], corners[face[1]], corners[face[2]], canWallrun);
+		AddTriangle(corners[face[0]], corners[face[2]], corners[face[3]], canWallrun);
+	}
+}
+
+void CWallSurfaceIndex::AddRayOnlyBounds(const AABB& bounds)
+{
+	m_rayOnlyBounds.push_back(bounds);
+	++m_stats.numRayOnly;
+}
+
+void CWallSurfaceIndex::Build(float cellSize)
+{
+	using TClock = std::chrono::steady_clock;
+	const TClock::time_point start = TClock::now();
+
+	m_invCellSize = 1.f / std::max(cellSize, 0.1f);
+	m_cellKeys.clear();
+	m_cellStarts.clear();
+	m_cellTriangles.clear();
+
+	// One entry per cell a triangle's footprint overlaps, sorted so every cell's triangles are adjacent
+	std::vector<std::pair<uint64, uint32>> references;
+	references.reserve(m_triangles.size() * 2);
+	for (uint32 index = 0; index < m_triangles.size(); ++index)
+	{
+		const STriangle& triangle = m_triangles[index];
+		const Vec3 v1 = triangle.v0 + triangle.edge1;
+		const Vec3 v2 = triangle.v0 + triangle.edge2;
+
+		const int32 minX = GetCellCoordinate(std::min({ triangle.v0.x, v1.x, v2.x }));
+		const int32 maxX = GetCellCoordinate(std::max({ triangle.v0.x, v1.x, v2.x }));
+		const int32 minY = GetCellCoordinate(std::min({ triangle.v0.y, v1.y, v2.y }));
+		const int32 maxY = GetCellCoordinate(std::max({ triangle.v0.y, v1.y, v2.y }));
+
+		for (int32 x = minX; x <= maxX; ++x)
+		{
+			for (int32 y = minY; y <= maxY; ++y)
+			{
+				references.emplace_back(GetCellKey(x, y), index);
+			}
+		}
+	}
+	std::sort(references.begin(), references.end());
+
+	m_cellTriangles.reserve(references.size());
+	for (const std::pair<uint64, uint32>& reference : references)
+	{
+		if (m_cellKeys.empty() || m_cellKeys.back() != reference.first)
+		{
+			m_cellKeys.push_back(reference.first);
+			m_cellStarts.push_back(static_cast<uint32>(m_cellTriangles.size()));
+		}
+		m_cellTriangles.push_back(reference.second);
+	}
+	m_cellStarts.push_back(static_cast<uint32>(m_cellTriangles.size()));
+
+	m_rayOnlyCells.clear();
+	for (uint32 index = 0; index < m_rayOnlyBounds.size(); ++index)
+	{
+		const AABB& bounds = m_rayOnlyBounds[index];
+		for (int32 x = GetCellCoordinate(bounds.min.x), maxX = GetCellCoordinate(bounds.max.x); x <= maxX; ++x)
+		{
+			for (int32 y = GetCellCoordinate(bounds.min.y), maxY = GetCellCoordinate(bounds.max.y); y <= maxY; ++y)
+			{
+				m_rayOnlyCells.emplace_back(GetCellKey(x, y), index);
+			}
+		}
+	}
+	std::sort(m_rayOnlyCells.begin(), m_rayOnlyCells.end());
+
+	m_triangles.shrink_to_fit();
+	m_cellKeys.shrink_to_fit();
+	m_cellStarts.shrink_to_fit();
+
+	m_stats.numTriangles = static_cast<uint32>(m_triangles.size());
+	m_stats.numCells = static_cast<uint32>(m_cellKeys.size());
+	m_stats.numReferences = static_cast<uint32>(m_cellTriangles.size());
+	m_stats.memoryBytes = m_triangles.capacity() * sizeof(STriangle) + m_cellKeys.capacity() * sizeof(uint64)
+		+ m_cellStarts.capacity() * sizeof(uint32) + m_cellTriangles.capacity() * sizeof(uint32)
+		+ m_rayOnlyBounds.capacity() * sizeof(AABB) + m_rayOnlyCells.capacity() * sizeof(std::pair<uint64, uint32>);
+	m_stats.buildNanoseconds = static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(TClock::now() - start).count());
+}
+
+SWallProbeHit CWallSurfaceIndex::RayCast(const Vec3& origin, const Vec3& direction) const
+{
+	SWallProbeHit result;
+	if (!IsBuilt())
+		return result;
+
+	const Vec3 end = origin + direction;
+	const int32 minX = GetCellCoordinate(std::min(origin.x, end.x));
+	const int32 maxX = GetCellCoordinate(std::max(origin.x, end.x));
+	const int32 minY = GetCellCoordinate(std::min(origin.y, end.y));
+	const int32 maxY = GetCellCoordinate(std::max(origin.y, end.y));
+
+	// Fraction of the segment to the closest hit so far
+	float closest = 1.f;
+	const STriangle* pClosest = nullptr;
+
+	for (int32 x = minX; x <= maxX; ++x)
+	{
+		for (int32 y = minY; y <= maxY; ++y)
+		{
+			const uint64 key = GetCellKey(x, y);
+			const auto cell = std::lower_bound(m_cellKeys.begin(), m_cellKeys.end(), key);
+			if (cell == m_cellKeys.end() || *cell != key)
+				continue;
+
+			const size_t cellIndex = static_cast<size_t>(cell - m_cellKeys.begin());
+			for (uint32 reference = m_cellStarts[cellIndex]; reference < m_cellStarts[cellIndex + 1]; ++reference)
+			{
+				// Moller-Trumbore, both sides of the triangle count
+				const STriangle& triangle = m_triangles[m_cellTriangles[reference]];
+				const Vec3 p = direction.Cross(triangle.edge2);
+				const float determinant = triangle.edge1.Dot(p);
+				if (std::abs(determinant) < 1e-9f)
+					continue;
+
+				const float invDeterminant = 1.f / determinant;
+				const Vec3 s = origin - triangle.v0;
+				const float u = s.Dot(p) * invDeterminant;
+				if (u < 0.f || u > 1.f)
+					continue;
+
+				const Vec3 q = s.Cross(triangle.edge1);
+				const float v = direction.Dot(q) * invDeterminant;
+				if (v < 0.f || u + v > 1.f)
+					continue;
+
+				const float t = triangle.edge2.Dot(q) * invDeterminant;
+				if (t >= 0.f && t < closest)
+				{
+					closest = t;
+					pClosest = &triangle;
+				}
+			}
+		}
+	}
+
+	if (pClosest != nullptr)
+	{
+		result.hit = true;
+		result.isWallrunnable = pClosest->isWallrunnable;
+		result.point = origin + direction * closest;
+		result.normal = pClosest->normal.Dot(direction) > 0.f ? -pClosest->normal : pClosest->normal;
+		result.distance = closest * direction.GetLength();
+	}
+
+	return result;
+}
+
+bool CWallSurfaceIndex::IsRayOnly(const Vec3& origin, const Vec3& direction) const
+{
+	if (m_rayOnlyCells.empty())
+		return false;
+
+	const Vec3 end = origin + direction;
+	const AABB segmentBounds(Vec3(std::min(origin.x, end.x), std::min(origin.y, end.y), std::min(origin.z, end.z)),
+		Vec3(std::max(origin.x, end.x), std::max(origin.y, end.y), std::max(origin.z, end.z)));
+	for (int32 x = GetCellCoordinate(segmentBounds.min.x), maxX = GetCellCoordinate(segmentBounds.max.x); x <= maxX; ++x)
+	{
+		for (int32 y = GetCellCoordinate(segmentBounds.min.y), maxY = GetCellCoordinate(segmentBounds.max.y); y <= maxY; ++y)
+		{
+			const uint64 key = GetCellKey(x, y);
+			for (auto cell = std::lower_bound(m_rayOnlyCells.begin(), m_rayOnlyCells.end(), std::make_pair(key, 0u)); cell != m_rayOnlyCells.end() && cell->first == key; ++cell)
+			{
+				if (m_rayOnlyBounds[cell->second].IsIntersectBox(segmentBounds))
+					return true;
+			}
+		}
+	}
+	return false;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "IMovementPhysics.h"
+
+#include <vector>
+
+////////////////////////////////////////////////////////
+// Static triangles that horizontal wall probes can hit, bucketed into a uniform grid over the ground plane
+// Near-vertical triangles of entities can be wallrun on, everything else is kept as well so it blocks a probe like it would
+// block a ray. Only flat triangles are left out, a horizontal probe never hits them.
+// Walls are tall and thin, so cells are columns and a wall probe only ever touches one to four of them.
+// Only occupied cells are stored, as a sorted key list with one run of triangle indices each.
+// Colliders that can't be turned into triangles are added as bounds instead, probes near them have to be cast as rays.
+// Fill with AddTriangle / AddBox / AddRayOnlyBounds, then call Build once; the index is read-only and thread-safe after that.
+////////////////////////////////////////////////////////
+class CWallSurfaceIndex
+{
+public:
+	static constexpr float DefaultCellSize = 2.f;
+	// Triangles whose normal points further up or down than this are floors, ramps or ceilings (about 20 degrees from vertical)
+	static constexpr float MaxNormalZ = 0.35f;
+	// Triangles whose normal points further up or down than this are flat, a horizontal probe can't hit them
+	static constexpr float MaxBlockingNormalZ = 0.9999f;
+
+	struct SStats
+	{
+		uint32 numTriangles = 0;
+		// Of those, the ones that only block probes
+		uint32 numBlockers = 0;
+		// Triangles passed in that are degenerate or flat
+		uint32 numRejected = 0;
+		// Colliders added as bounds only
+		uint32 numRayOnly = 0;
+		uint32 numCells = 0;
+		// Triangle indices over all cells, a triangle spanning several cells is listed in each
+		uint32 numReferences = 0;
+		size_t memoryBytes = 0;
+		uint64 buildNanoseconds = 0;
+	};
+
+	// Forgets all triangles and frees the memory
+	void Clear();
+
+	// Returns false if the triangle is degenerate or flat. With canWallrun, near-vertical triangles are walls, the rest only blocks.
+	bool AddTriangle(const Vec3& v0, const Vec3& v1, const Vec3& v2, bool canWallrun = true);
+	// Adds the faces of a box given by its transform and half extents
+	void AddBox(const Matrix34& boxToWorld, const Vec3& halfExtents, bool canWallrun = true);
+	// Marks a collider the index has no triangles for, see IsRayOnly
+	void AddRayOnlyBounds(const AABB& bounds);
+
+	void Build(float cellSize = DefaultCellSize);
+	bool IsBuilt() const { return !m_cellKeys.empty(); }
+
+	// Closest triangle along the segment from origin to origin + direction, the normal faces the origin
+	SWallProbeHit RayCast(const Vec3& origin, const Vec3& direction) const;
+	// Whether the segment passes near a collider added with AddRayOnlyBounds, RayCast can't tell what it hits then
+	bool IsRayOnly(const Vec3& origin, const Vec3& direction) const;
+
+	const SStats& GetStats() const { return m_stats; }
+
+	// The triangles one by one, the normal has the winding of the source geometry and may face into a solid
+	uint32 GetNumTriangles() const { return static_cast<uint32>(m_triangles.size()); }
+	bool IsTriangleWallrunnable(uint32 index) const { return m_triangles[index].isWallrunnable; }
+	Vec3 GetTriangleCenter(uint32 index) const { const STriangle& triangle = m_triangles[index]; return triangle.v0 + (triangle.edge1 + triangle.edge2) * (1.f / 3.f); }
+	const Vec3& GetTriangleNormal(uint32 index) const { return m_triangles[index].normal; }
+
+private:
+	struct STriangle
+	{
+		Vec3 v0;
+		Vec3 edge1;
+		Vec3 edge2;
+		Vec3 normal;
+		bool isWallrunnable;
+	};
+
+	int32 GetCellCoordinate(float value) const { return static_cast<int32>(floorf(value * m_invCellSize)); }
+	static uint64 GetCellKey(int32 x, int32 y) { return (static_cast<uint64>(static_cast<uint32>(x)) << 32) | static_cast<uint32>(y); }
+
+	std::vector<STriangle> m_triangles;
+	// Sorted keys of the occupied cells, the triangles of cell i are m_cellTriangles[m_cellStarts[i], m_cellStarts[i + 1])
+	std::vector<uint64> m_cellKeys;
+	std::vector<uint32> m_cellStarts;
+	std::vector<uint32> m_cellTriangles;
+	// Sorted pairs of cell key and index into m_rayOnlyBounds, one for each cell the bounds overlap
+	std::vector<AABB> m_rayOnlyBounds;
+	std::vector<std::pair<uint64, uint32>> m_rayOnlyCells;
+
+	float m_invCellSize = 1.f / DefaultCellSize;
+	SStats m_stats;
+};
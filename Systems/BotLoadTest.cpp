@@ -0,0 +1,399 @@
+#include "StdAfx.h"
+#include "BotLoadTest.h"
+#include "GamePlugin.h"
+#include "WallProbeService.h"
+#include "PlayerMovementSystem.h"
+#include "PlayerPool.h"
+#include "ProjectileSystem.h"
+#include "Components/Player.h"
+
+#include <CryEntitySystem/IEntitySystem.h>
+#include <CryMemory/IMemory.h>
+#include <CryPhysics/physinterface.h>
+
+namespace
+{
+	// Wall targets are spread over the index instead of taking every triangle, bots only need a choice
+	const uint32 MaxWallTargets = 512;
+	// Walls further above or below the spawn than this are out of reach
+	const float MaxWallTargetHeight = 3.f;
+	// Bots line up about this far from a wall, the open side is the one with room for them there
+	const float WallClearanceDistance = 1.2f;
+	const float WallClearanceRadius = 0.4f;
+	// Muzzle velocity of bot shots, about that of a rifle
+	const float BotProjectileSpeed = 400.f;
+
+	void BotLoadTestCommand(IConsoleCmdArgs* pArgs)
+	{
+		if (pArgs->GetArgCount() < 2)
+		{
+			CryLogAlways("Usage: pl_botLoadTest <maxBots> [step=16] [seconds=5] [csv file]");
+			return;
+		}
+
+		const uint32 maxBots = static_cast<uint32>(std::max(atoi(pArgs->GetArg(1)), 1));
+		const uint32 stepSize = pArgs->GetArgCount() > 2 ? static_cast<uint32>(std::max(atoi(pArgs->GetArg(2)), 1)) : 16;
+		const float measureSeconds = pArgs->GetArgCount() > 3 ? std::max(static_cast<float>(atof(pArgs->GetArg(3))), 0.5f) : 5.f;
+		const char* szCsvPath = pArgs->GetArgCount() > 4 ? pArgs->GetArg(4) : nullptr;
+
+		CGamePlugin::GetInstance()->GetBotLoadTest()->Start(maxBots, stepSize, measureSeconds, szCsvPath);
+	}
+
+	void BotLoadTestStopCommand(IConsoleCmdArgs* pArgs)
+	{
+		CGamePlugin::GetInstance()->GetBotLoadTest()->Stop();
+	}
+
+	// Overlap test of a sphere against everything static, used to tell the open side of a wall
+	bool IsSpaceFree(const Vec3& center, float radius)
+	{
+		primitives::sphere sphere;
+		sphere.center = center;
+		sphere.r = radius;
+
+		IPhysicalWorld::SPWIParams pwiParams;
+		pwiParams.itype = sphere.type;
+		pwiParams.pprim = &sphere;
+		pwiParams.entTypes = ent_static | ent_terrain;
+
+		return gEnv->pPhysicalWorld->PrimitiveWorldIntersection(pwiParams) == 0.f;
+	}
+}
+
+CBotLoadTest::CBotLoadTest()
+{
+	REGISTER_COMMAND("pl_botLoadTest", &BotLoadTestCommand, VF_NULL,
+		"Spawns bot players step by step up to maxBots and logs the movement tick time, per-stage cost and memory per bot at every count\n"
+		"Bots walk, sprint, jump and wallrun along the walls of the wall surface index. Server only.\n"
+		"Usage: pl_botLoadTest <maxBots> [step=16] [seconds=5] [csv file]");
+	REGISTER_COMMAND("pl_botLoadTestStop", &BotLoadTestStopCommand, VF_NULL,
+		"Ends the bot load test in progress and removes the bots");
+	REGISTER_CVAR2("pl_botLoadTestWarmUp", &m_warmUpSeconds, 1.f, VF_NULL,
+		"Seconds bots run after every step before measuring starts, so the spawn and first physicalization are not counted");
+	REGISTER_CVAR2("pl_botLoadTestSpacing", &m_botSpacing, 2.f, VF_NULL,
+		"Distance in meters between bots on the spawn grid");
+	REGISTER_CVAR2("pl_botLoadTestFireRate", &m_fireRate, 0.f, VF_NULL,
+		"Projectiles every bot fires per second along its view, 0 for bots that only move");
+}
+
+CBotLoadTest::~CBotLoadTest()
+{
+	Stop();
+
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->RemoveCommand("pl_botLoadTest");
+		gEnv->pConsole->RemoveCommand("pl_botLoadTestStop");
+		gEnv->pConsole->UnregisterVariable("pl_botLoadTestWarmUp", true);
+		gEnv->pConsole->UnregisterVariable("pl_botLoadTestSpacing", true);
+		gEnv->pConsole->UnregisterVariable("pl_botLoadTestFireRate", true);
+	}
+}
+
+bool CBotLoadTest::Start(uint32 maxBots, uint32 stepSize, float measureSeconds, const char* szCsvPath)
+{
+	if (!gEnv->bServer || gEnv->pPhysicalWorld == nullptr)
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "The bot load test needs a running server");
+		return false;
+	}
+
+	Stop();
+
+	m_maxBots = maxBots;
+	m_stepSize = std::min(stepSize, maxBots);
+	m_measureSeconds = measureSeconds;
+
+	// Bots start around the players already in the level, or the origin on an empty server
+	const CPlayerMovementStore& store = CGamePlugin::GetInstance()->GetPlayerMovementSystem()->GetStore();
+	m_spawnCenter = store.GetCount() != 0 ? store.body[0].position : Vec3(ZERO);
+
+	if (szCsvPath != nullptr && szCsvPath[0] != '\0')
+	{
+		m_pCsvFile = fopen(szCsvPath, "w");
+		if (m_pCsvFile == nullptr)
+		{
+			CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "Failed to open %s for the bot load test results", szCsvPath);
+		}
+		else
+		{
+			fprintf(m_pCsvFile, "bots,ticks,tick_p50_us,tick_p99_us,tick_mean_us,us_per_bot,frame_p50_ms,frame_p99_ms");
+			for (size_t stage = 0; stage < SMovementStageTimings::NumStages; ++stage)
+			{
+				fprintf(m_pCsvFile, ",%s_mean_us", GetMovementStageName(static_cast<EMovementStage>(stage)));
+			}
+			fprintf(m_pCsvFile, ",store_bytes_per_bot,process_bytes_per_bot\n");
+		}
+	}
+
+	CollectWallTargets();
+
+	m_baseProcessMemory = GetProcessMemory();
+	m_baseStoreMemory = store.GetMemoryUsage();
+
+	// Stage timings are what the test is about, turn them on for its duration
+	if (ICVar* pProfileVar = gEnv->pConsole->GetCVar("pl_profileMovement"))
+	{
+		m_previousProfileStages = pProfileVar->GetIVal();
+		pProfileVar->Set(1);
+	}
+
+	CryLogAlways("[BotLoadTest] Up to %u bots, %u per step, %.1f s per step, %u wall targets", m_maxBots, m_stepSize, m_measureSeconds, static_cast<uint32>(m_walls.size()));
+	CryLogAlways("  %6s %10s %10s %10s %10s %10s %10s %12s %12s", "bots", "tick p50", "tick p99", "tick mean", "us/bot", "frame p50", "frame p99", "store B/bot", "proc B/bot");
+
+	SpawnBots(m_stepSize);
+	m_phase = EPhase::WarmUp;
+	m_phaseTimeLeft = m_warmUpSeconds;
+	return true;
+}
+
+void CBotLoadTest::Stop()
+{
+	if (m_phase == EPhase::Idle)
+		return;
+
+	RemoveBots();
+	m_walls.clear();
+	m_phase = EPhase::Idle;
+
+	if (m_pCsvFile != nullptr)
+	{
+		fclose(m_pCsvFile);
+		m_pCsvFile = nullptr;
+	}
+
+	if (ICVar* pProfileVar = gEnv->pConsole->GetCVar("pl_profileMovement"))
+	{
+		pProfileVar->Set(m_previousProfileStages);
+	}
+
+	CryLogAlways("[BotLoadTest] Finished");
+}
+
+void CBotLoadTest::Update(float frameTime)
+{
+	if (m_phase == EPhase::Idle)
+		return;
+
+	UpdateInput(frameTime);
+	UpdateFire(frameTime);
+
+	if (m_phase == EPhase::Measure)
+	{
+		m_frameTimes.Add(static_cast<uint64>(frameTime * 1e9f));
+	}
+
+	m_phaseTimeLeft -= frameTime;
+	if (m_phaseTimeLeft > 0.f)
+		return;
+
+	if (m_phase == EPhase::WarmUp)
+	{
+		BeginMeasure();
+		return;
+	}
+
+	EndMeasure();
+
+	if (m_bots.size() >= m_maxBots)
+	{
+		Stop();
+		return;
+	}
+
+	SpawnBots(std::min<uint32>(m_stepSize, m_maxBots - static_cast<uint32>(m_bots.size())));
+	m_phase = EPhase::WarmUp;
+	m_phaseTimeLeft = m_warmUpSeconds;
+}
+
+void CBotLoadTest::CollectWallTargets()
+{
+	m_walls.clear();
+
+	const CWallProbeService* pWallProbeService = CGamePlugin::GetInstance()->GetWallProbeService();
+	const uint32 numTriangles = pWallProbeService != nullptr ? pWallProbeService->GetSurfaceIndex().GetNumTriangles() : 0;
+	if (numTriangles == 0)
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "No wall surface index, bots will not attempt wallruns");
+		return;
+	}
+
+	const CWallSurfaceIndex& surfaceIndex = pWallProbeService->GetSurfaceIndex();
+	const uint32 stride = std::max(numTriangles / MaxWallTargets, 1u);
+	for (uint32 triangle = 0; triangle < numTriangles; triangle += stride)
+	{
+		if (!surfaceIndex.IsTriangleWallrunnable(triangle))
+			continue;
+
+		SBotWallTarget wall;
+		wall.point = surfaceIndex.GetTriangleCenter(triangle);
+		if (std::abs(wall.point.z - m_spawnCenter.z) > MaxWallTargetHeight)
+			continue;
+
+		// Probes only care about the horizontal part, and the winding says nothing about which side is solid
+		Vec3 normal = surfaceIndex.GetTriangleNormal(triangle);
+		normal.z = 0.f;
+		normal.NormalizeSafe(Vec3(1.f, 0.f, 0.f));
+
+		const Vec3 lineUpHeight(0.f, 0.f, WallClearanceRadius + 0.1f);
+		if (IsSpaceFree(wall.point + normal * WallClearanceDistance + lineUpHeight, WallClearanceRadius))
+		{
+			wall.normal = normal;
+		}
+		else if (IsSpaceFree(wall.point - normal * WallClearanceDistance + lineUpHeight, WallClearanceRadius))
+		{
+			wall.normal = -normal;
+		}
+		else
+		{
+			continue;
+		}
+
+		m_walls.push_back(wall);
+	}
+}
+
+void CBotLoadTest::SpawnBots(uint32 count)
+{
+	CPlayerPool* pPlayerPool = CGamePlugin::GetInstance()->GetPlayerPool();
+
+	// Square grid big enough for all bots of the test, filled in order
+	const uint32 gridSize = static_cast<uint32>(ceilf(sqrtf(static_cast<float>(m_maxBots))));
+	const Vec3 gridOrigin = m_spawnCenter - Vec3(static_cast<float>(gridSize) * 0.5f * m_botSpacing, static_cast<float>(gridSize) * 0.5f * m_botSpacing, -0.5f);
+
+	// Spawns whatever the pool is short of in one go, so the step below only unparks players
+	pPlayerPool->Reserve(count);
+
+	for (uint32 i = 0; i < count; ++i)
+	{
+		const uint32 botIndex = static_cast<uint32>(m_bots.size());
+		const Vec3 position = gridOrigin + Vec3(static_cast<float>(botIndex % gridSize), static_cast<float>(botIndex / gridSize), 0.f) * m_botSpacing;
+		const Quat rotation = Quat::CreateRotationZ(static_cast<float>(botIndex) * 2.39996f);
+
+		// Bots have no client, the server drives them
+		CPlayerComponent* pPlayer = pPlayerPool->Acquire(position, rotation, 0);
+		if (pPlayer == nullptr)
+		{
+			CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "Failed to spawn bot %u", botIndex);
+			break;
+		}
+
+		m_bots.push_back(SBot { pPlayer->GetEntity()->GetId(), pPlayer->GetMovementId(), CBotInputGenerator(botIndex + 1), 0.f });
+	}
+}
+
+void CBotLoadTest::RemoveBots()
+{
+	CPlayerPool* pPlayerPool = CGamePlugin::GetInstance()->GetPlayerPool();
+	for (const SBot& bot : m_bots)
+	{
+		pPlayerPool->Release(bot.entityId);
+	}
+	m_bots.clear();
+}
+
+void CBotLoadTest::UpdateInput(float frameTime)
+{
+	CPlayerMovementSystem* pMovementSystem = CGamePlugin::GetInstance()->GetPlayerMovementSystem();
+	const CPlayerMovementStore& store = pMovementSystem->GetStore();
+
+	for (SBot& bot : m_bots)
+	{
+		if (!store.IsValid(bot.movementId))
+			continue;
+
+		const uint32 index = store.GetIndex(bot.movementId);
+		CBotInputGenerator::SView view;
+		view.position = store.body[index].position;
+		view.yaw = store.yaw[index];
+		view.isOnGround = store.body[index].isOnGround;
+		view.isWallrunning = store.HasFlag(index, eMF_Wallrunning);
+
+		bot.generator.Update(view, *store.params[index], m_walls, frameTime, pMovementSystem->GetInput(bot.movementId));
+	}
+}
+
+void CBotLoadTest::UpdateFire(float frameTime)
+{
+	if (m_fireRate <= 0.f)
+		return;
+
+	CProjectileSystem* pProjectiles = CGamePlugin::GetInstance()->GetProjectileSystem();
+	const CPlayerMovementStore& store = CGamePlugin::GetInstance()->GetPlayerMovementSystem()->GetStore();
+
+	for (SBot& bot : m_bots)
+	{
+		if (!store.IsValid(bot.movementId))
+			continue;
+
+		bot.fireBudget += m_fireRate * frameTime;
+		if (bot.fireBudget < 1.f)
+			continue;
+
+		const uint32 index = store.GetIndex(bot.movementId);
+		const Vec3 eyePosition = CPlayerMovementSimulation::GetEyePosition(store.yaw[index], store.cameraOffset[index], store.body[index].position);
+		const Vec3 viewDirection = (CPlayerMovementSimulation::GetBodyRotation(store.yaw[index]) * Quat::CreateRotationX(store.pitch[index])).GetColumn1();
+
+		for (; bot.fireBudget >= 1.f; bot.fireBudget -= 1.f)
+		{
+			pProjectiles->Fire(eyePosition, viewDirection * BotProjectileSpeed, bot.entityId);
+		}
+	}
+}
+
+void CBotLoadTest::BeginMeasure()
+{
+	CGamePlugin::GetInstance()->GetPlayerMovementSystem()->ResetStageProfiler();
+	CGamePlugin::GetInstance()->GetProjectileSystem()->ResetStats();
+	m_frameTimes.Reset();
+	m_phase = EPhase::Measure;
+	m_phaseTimeLeft = m_measureSeconds;
+}
+
+void CBotLoadTest::EndMeasure()
+{
+	const CPlayerMovementSystem* pMovementSystem = CGamePlugin::GetInstance()->GetPlayerMovementSystem();
+	const CMovementStageProfiler& profiler = pMovementSystem->GetStageProfiler();
+	const CDurationHistogram& tick = profiler.GetTotal();
+
+	const uint32 numBots = static_cast<uint32>(m_bots.size());
+	const float botCount = static_cast<float>(std::max(numBots, 1u));
+	// Memory is the growth since before the first bot, so it includes the entities, components and physics of a bot
+	const float storeBytesPerBot = static_cast<float>(pMovementSystem->GetStore().GetMemoryUsage() - m_baseStoreMemory) / botCount;
+	const uint64 processMemory = GetProcessMemory();
+	const float processBytesPerBot = processMemory > m_baseProcessMemory ? static_cast<float>(processMemory - m_baseProcessMemory) / botCount : 0.f;
+
+	CryLogAlways("  %6u %10.2f %10.2f %10.2f %10.3f %10.2f %10.2f %12.0f %12.0f", numBots,
+		tick.GetPercentile(0.5f) * 1e-3f, tick.GetPercentile(0.99f) * 1e-3f, tick.GetMean() * 1e-3f, tick.GetMean() * 1e-3f / botCount,
+		m_frameTimes.GetPercentile(0.5f) * 1e-6f, m_frameTimes.GetPercentile(0.99f) * 1e-6f, storeBytesPerBot, processBytesPerBot);
+
+	if (m_fireRate > 0.f)
+	{
+		const CProjectileSystem::SStats& projectiles = CGamePlugin::GetInstance()->GetProjectileSystem()->GetStats();
+		CryLogAlways("  %6s projectiles: update p50 %.1f us, p99 %.1f us, peak %u live, %llu hit, %llu dropped", "",
+			projectiles.update.GetPercentile(0.5f) * 1e-3f, projectiles.update.GetPercentile(0.99f) * 1e-3f, projectiles.peakLive,
+			static_cast<unsigned long long>(projectiles.impacts), static_cast<unsigned long long>(projectiles.dropped));
+	}
+
+	if (m_pCsvFile != nullptr)
+	{
+		fprintf(m_pCsvFile, "%u,%llu,%.3f,%.3f,%.3f,%.4f,%.3f,%.3f", numBots, static_cast<unsigned long long>(tick.GetCount()),
+			tick.GetPercentile(0.5f) * 1e-3, tick.GetPercentile(0.99f) * 1e-3, tick.GetMean() * 1e-3, tick.GetMean() * 1e-3 / botCount,
+			m_frameTimes.GetPercentile(0.5f) * 1e-6, m_frameTimes.GetPercentile(0.99f) * 1e-6);
+		for (size_t stage = 0; stage < SMovementStageTimings::NumStages; ++stage)
+		{
+			fprintf(m_pCsvFile, ",%.3f", profiler.GetStage(static_cast<EMovementStage>(stage)).GetMean() * 1e-3);
+		}
+		fprintf(m_pCsvFile, ",%.0f,%.0f\n", storeBytesPerBot, processBytesPerBot);
+		fflush(m_pCsvFile);
+	}
+}
+
+uint64 CBotLoadTest::GetProcessMemory()
+{
+	IMemoryManager::SProcessMemInfo memoryInfo;
+	if (gEnv->pSystem->GetIMemoryManager() == nullptr || !gEnv->pSystem->GetIMemoryManager()->GetProcessMemInfo(memoryInfo))
+		return 0;
+
+	return memoryInfo.WorkingSetSize;
+}
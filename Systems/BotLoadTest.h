@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Movement/BotInputGenerator.h"
+#include "Movement/MovementStageProfiler.h"
+#include "Movement/PlayerMovementStore.h"
+
+#include <vector>
+
+////////////////////////////////////////////////////////
+// Server load test: spawns bot players in steps and measures the movement update at every bot count
+// Bots are regular CPlayerComponent entities without a client, their input comes from a CBotInputGenerator each.
+// Every step warms up, then collects the per-stage tick times of CPlayerMovementSystem, the frame times and the memory
+// added per bot, and logs one row (pl_botLoadTest). Runs in the dedicated server as well as in a listen server.
+// With pl_botLoadTestFireRate the bots also shoot along their view through CProjectileSystem.
+////////////////////////////////////////////////////////
+class CBotLoadTest
+{
+public:
+	CBotLoadTest();
+	~CBotLoadTest();
+
+	// Adds bots stepSize at a time until there are maxBots, measuring for measureSeconds after every step
+	// Rows are also written to szCsvPath unless it is null or empty.
+	bool Start(uint32 maxBots, uint32 stepSize, float measureSeconds, const char* szCsvPath);
+	// Removes the bots and restores the profiling setting, the rows so far stay in the log
+	void Stop();
+	bool IsRunning() const { return m_phase != EPhase::Idle; }
+
+	// Drives the bots, call once per frame before the player movement update
+	void Update(float frameTime);
+
+protected:
+	enum class EPhase
+	{
+		Idle,
+		WarmUp,
+		Measure
+	};
+
+	struct SBot
+	{
+		EntityId entityId;
+		PlayerMovementId movementId;
+		CBotInputGenerator generator;
+		// Shots due but not fired yet
+		float fireBudget;
+	};
+
+	// Points on the level's walls from the wall surface index, with the normal turned to the open side
+	void CollectWallTargets();
+	void SpawnBots(uint32 count);
+	void RemoveBots();
+	void UpdateInput(float frameTime);
+	void UpdateFire(float frameTime);
+
+	void BeginMeasure();
+	void EndMeasure();
+
+	static uint64 GetProcessMemory();
+
+	std::vector<SBot> m_bots;
+	std::vector<SBotWallTarget> m_walls;
+	CDurationHistogram m_frameTimes;
+
+	EPhase m_phase = EPhase::Idle;
+	float m_phaseTimeLeft = 0.f;
+	uint32 m_maxBots = 0;
+	uint32 m_stepSize = 0;
+	float m_measureSeconds = 0.f;
+	Vec3 m_spawnCenter = ZERO;
+	FILE* m_pCsvFile = nullptr;
+
+	// Before the first bot was spawned
+	uint64 m_baseProcessMemory = 0;
+	size_t m_baseStoreMemory = 0;
+	int m_previousProfileStages = 0;
+
+	float m_warmUpSeconds = 1.f;
+	float m_botSpacing = 2.f;
+	float m_fireRate = 0.f;
+};
@@ -0,0 +1,216 @@
+#include "StdAfx.h"
+#include "MovementProfileLibrary.h"
+#include "PlayerMovementSystem.h"
+#include "GamePlugin.h"
+
+#include <CrySerialization/IArchiveHost.h>
+#include <CrySerialization/STL.h>
+#include <CrySerialization/CryStrings.h>
+#include <CrySerialization/Math.h>
+
+namespace
+{
+	void SerializeMovementParams(Serialization::IArchive& ar, SMovementParams& params)
+	{
+		ar(params.walkSpeed, "walkSpeed", "Walk Speed");
+		ar(params.runSpeed, "runSpeed", "Run Speed");
+		ar(params.jumpEnergy, "jumpEnergy", "Jump Energy");
+		ar(params.doubleJumpEnergy, "doubleJumpEnergy", "Double Jump Energy");
+		ar(params.walljumpSideEnergy, "walljumpSideEnergy", "Wall Jump Side Energy");
+		ar(params.walljumpHeightEnergy, "walljumpHeightEnergy", "Wall Jump Height Energy");
+
+		ar(params.rotationSpeed, "rotationSpeed", "Rotation Speed");
+		ar(params.pitchMin, "pitchMin", "Camera Pitch Min");
+		ar(params.pitchMax, "pitchMax", "Camera Pitch Max");
+
+		ar(params.cameraOffsetStanding, "cameraOffsetStanding", "Camera Standing Offset");
+		ar(params.cameraOffsetCrouching, "cameraOffsetCrouching", "Camera Crouching Offset");
+		ar(params.capsuleHeightStanding, "capsuleHeightStanding", "Capsule Standing Height");
+		ar(params.capsuleHeightCrouching, "capsuleHeightCrouching", "Capsule Crouching Height");
+		ar(params.capsuleGroundOffset, "capsuleGroundOffset", "Capsule Ground Offset");
+		ar(params.headroomMaxTicks, "headroomMaxTicks", "Headroom Reuse Ticks");
+		ar(params.headroomMaxTravel, "headroomMaxTravel", "Headroom Reuse Travel");
+
+		ar(params.fov, "fov", "FOV");
+		ar(params.wallrunFov, "wallrunFov", "Wall Run FOV");
+		ar(params.fovChangeRate, "fovChangeRate", "FOV Change Rate");
+
+		ar(params.wallSearchRange, "wallSearchRange", "Wall Search Range");
+		ar(params.wallrunCooldown, "wallrunCooldown", "Wall Run Cooldown");
+		ar(params.wallrunCameraRoll, "wallrunCameraRoll", "Wall Run Camera Roll");
+		ar(params.wallrunCameraRollSpeed, "wallrunCameraRollSpeed", "Wall Run Camera Roll Speed");
+		ar(params.wallStickForce, "wallStickForce", "Wall Stick Force");
+		ar(params.wallContactMaxTicks, "wallContactMaxTicks", "Wall Contact Reuse Ticks");
+		ar(params.wallContactMaxTravel, "wallContactMaxTravel", "Wall Contact Reuse Travel");
+		ar(params.wallContactDistanceTolerance, "wallContactDistanceTolerance", "Wall Contact Distance Tolerance");
+		ar(params.cameraOffsetLerpSpeed, "cameraOffsetLerpSpeed", "Camera Offset Lerp Speed");
+	}
+
+	// One profile as it appears in the asset, values it leaves out keep the SMovementParams defaults
+	struct SProfileEntry
+	{
+		void Serialize(Serialization::IArchive& ar)
+		{
+			ar(name, "name", "Name");
+			SerializeMovementParams(ar, params);
+		}
+
+		string name;
+		SMovementParams params;
+	};
+
+	struct SProfileFile
+	{
+		void Serialize(Serialization::IArchive& ar)
+		{
+			ar(version, "version", "Version");
+			ar(profiles, "profiles", "Profiles");
+		}
+
+		uint32 version = CMovementProfileLibrary::FormatVersion;
+		std::vector<SProfileEntry> profiles;
+	};
+
+	void ReloadMovementProfilesCommand(IConsoleCmdArgs* pArgs)
+	{
+		CMovementProfileLibrary* pLibrary = CGamePlugin::GetInstance()->GetMovementProfiles();
+		if (pLibrary->Load())
+		{
+			pLibrary->LogProfiles();
+		}
+	}
+
+	void SaveMovementProfilesCommand(IConsoleCmdArgs* pArgs)
+	{
+		CGamePlugin::GetInstance()->GetMovementProfiles()->Save();
+	}
+
+	void ListMovementProfilesCommand(IConsoleCmdArgs* pArgs)
+	{
+		CGamePlugin::GetInstance()->GetMovementProfiles()->LogProfiles();
+	}
+}
+
+CMovementProfileLibrary::CMovementProfileLibrary()
+{
+	// Built in, so players always have a profile even without the asset
+	FindOrAdd(DefaultProfileName);
+
+	m_pPathCVar = REGISTER_STRING("pl_movementProfiles", "Libs/MovementProfiles.json", VF_NULL,
+		"Asset holding the named player movement profiles, read at startup and by pl_movementProfilesReload");
+	REGISTER_COMMAND("pl_movementProfilesReload", &ReloadMovementProfilesCommand, VF_NULL,
+		"Reads the movement profiles again, players using a changed profile move with the new values from the next tick on");
+	REGISTER_COMMAND("pl_movementProfilesSave", &SaveMovementProfilesCommand, VF_NULL,
+		"Writes the loaded movement profiles to pl_movementProfiles");
+	REGISTER_COMMAND("pl_movementProfilesList", &ListMovementProfilesCommand, VF_NULL,
+		"Logs the loaded movement profiles and their revisions");
+}
+
+CMovementProfileLibrary::~CMovementProfileLibrary()
+{
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->UnregisterVariable("pl_movementProfiles", true);
+		gEnv->pConsole->RemoveCommand("pl_movementProfilesReload");
+		gEnv->pConsole->RemoveCommand("pl_movementProfilesSave");
+		gEnv->pConsole->RemoveCommand("pl_movementProfilesList");
+	}
+}
+
+bool CMovementProfileLibrary::Load()
+{
+	const char* szPath = m_pPathCVar->GetString();
+
+	SProfileFile file;
+	if (!Serialization::LoadJsonFile(file, szPath))
+	{
+		CryLog("No movement profiles read from %s, using the built-in defaults", szPath);
+		return false;
+	}
+
+	if (file.version > FormatVersion)
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_ERROR, "Movement profiles %s have format version %u, this build reads up to %u", szPath, file.version, FormatVersion);
+		return false;
+	}
+
+	for (const SProfileEntry& entry : file.profiles)
+	{
+		if (entry.name.empty())
+		{
+			CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "Movement profile without a name in %s skipped", szPath);
+			continue;
+		}
+
+		SMovementProfile& profile = FindOrAdd(entry.name.c_str());
+		if (memcmp(&profile.params, &entry.params, sizeof(SMovementParams)) == 0)
+			continue;
+
+		profile.params = entry.params;
+		++profile.revision;
+
+		// Values the players derived from the old ones, e.g. their collider size, follow now
+		CGamePlugin::GetInstance()->GetPlayerMovementSystem()->OnMovementParamsChanged(profile.params);
+	}
+
+	return true;
+}
+
+bool CMovementProfileLibrary::Save() const
+{
+	SProfileFile file;
+	file.profiles.reserve(m_profiles.size());
+	for (const std::unique_ptr<SMovementProfile>& pProfile : m_profiles)
+	{
+		file.profiles.push_back(SProfileEntry{ pProfile->name, pProfile->params });
+	}
+
+	const char* szPath = m_pPathCVar->GetString();
+	if (!Serialization::SaveJsonFile(szPath, file))
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_ERROR, "Could not write movement profiles to %s", szPath);
+		return false;
+	}
+
+	CryLogAlways("Wrote %u movement profiles to %s", static_cast<uint32>(file.profiles.size()), szPath);
+	return true;
+}
+
+const SMovementProfile* CMovementProfileLibrary::Find(const char* szName) const
+{
+	for (const std::unique_ptr<SMovementProfile>& pProfile : m_profiles)
+	{
+		if (pProfile->name.compareNoCase(szName) == 0)
+			return pProfile.get();
+	}
+
+	return nullptr;
+}
+
+const SMovementProfile& CMovementProfileLibrary::Get(const char* szName) const
+{
+	if (const SMovementProfile* pProfile = Find(szName))
+		return *pProfile;
+
+	CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "Unknown movement profile %s, using %s", szName, DefaultProfileName);
+	return *m_profiles.front();
+}
+
+void CMovementProfileLibrary::LogProfiles() const
+{
+	CryLogAlways("%u movement profiles from %s", static_cast<uint32>(m_profiles.size()), m_pPathCVar->GetString());
+	for (const std::unique_ptr<SMovementProfile>& pProfile : m_profiles)
+	{
+		CryLogAlways("  %-24s revision %u", pProfile->name.c_str(), pProfile->revision);
+	}
+}
+
+SMovementProfile& CMovementProfileLibrary::FindOrAdd(const char* szName)
+{
+	if (const SMovementProfile* pProfile = Find(szName))
+		return const_cast<SMovementProfile&>(*pProfile);
+
+	m_profiles.push_back(stl::make_unique<SMovementProfile>());
+	m_profiles.back()->name = szName;
+	return *m_profiles.back();
+}
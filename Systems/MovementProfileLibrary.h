@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Movement/PlayerMovement.h"
+
+#include <vector>
+
+// Named set of tuning values, shared read-only by every player using it
+struct SMovementProfile
+{
+	string name;
+	// Bumped whenever a reload changed the values
+	uint32 revision = 0;
+	SMovementParams params;
+};
+
+////////////////////////////////////////////////////////
+// Movement profiles loaded from a JSON asset (pl_movementProfiles), referenced by players through CPlayerComponent's profile name
+// The store points straight at a profile's parameters, so a reload that changes them is picked up on the next tick without
+// resetting anyone. Profiles are never removed or moved once loaded, players may still point at them.
+// The "default" profile always exists and is what players with an unknown profile name fall back to.
+// Clients and servers reload on their own, until both did, predicted players using a changed profile get corrected.
+////////////////////////////////////////////////////////
+class CMovementProfileLibrary
+{
+public:
+	// Asset layout this build reads and writes, files of a newer one are refused
+	static constexpr uint32 FormatVersion = 1;
+	static constexpr const char* DefaultProfileName = "default";
+
+	CMovementProfileLibrary();
+	~CMovementProfileLibrary();
+
+	// Reads the asset, values of profiles it no longer lists stay as they were
+	// Returns false if the file could not be read, the loaded profiles are left alone then.
+	bool Load();
+	// Writes every profile to the asset, e.g. to get a file to start tuning from
+	bool Save() const;
+
+	// Null if there is no profile of that name
+	const SMovementProfile* Find(const char* szName) const;
+	// The profile of that name, or the default one
+	const SMovementProfile& Get(const char* szName) const;
+
+	void LogProfiles() const;
+
+private:
+	SMovementProfile& FindOrAdd(const char* szName);
+
+	std::vector<std::unique_ptr<SMovementProfile>> m_profiles;
+
+	ICVar* m_pPathCVar = nullptr;
+};
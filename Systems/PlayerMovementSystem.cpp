@@ -0,0 +1,1428 @@
+#include "StdAfx.h"
+#include "PlayerMovementSystem.h"
+#include "GamePlugin.h"
+
+#include <DefaultComponents/Cameras/CameraComponent.h>
+#include <CryThreading/IJobManager.h>
+
+#include <atomic>
+#include <numeric>
+
+namespace
+{
+	// Upper bound on the helper jobs a single ParallelFor spawns, the calling thread always works as well
+	const uint32 MaxParallelJobs = 31;
+
+	// Snapshot packet layout: the server tick, then records each preceded by a continue bit and their length,
+	// so records of players the client does not know yet can be skipped.
+	// Once the client acknowledged a packet the tick is sent as its low bits, the client takes the one nearest its newest.
+	const uint32 ServerTickBits = 32;
+	const uint32 ShortServerTickBits = 16;
+	// Full records carry the entity id along with the slot, delta records are only sent after the client got one
+	const uint32 NetworkIdBits = 32;
+	// Ticks between a record and its baseline, 0 for none
+	const uint32 BaselineAgeBits = 6;
+	const uint32 MaxSnapshotRecordBytes = 128;
+	const uint32 RecordLengthBits = 11;
+	static_assert(MaxSnapshotRecordBytes * 8 < (1u << RecordLengthBits), "Record length does not fit its field");
+
+	void SnapshotBenchmarkCommand(IConsoleCmdArgs* pArgs)
+	{
+		const uint32 numPlayers = pArgs->GetArgCount() > 1 ? static_cast<uint32>(std::max(atoi(pArgs->GetArg(1)), 1)) : 64;
+		const uint32 numTicks = pArgs->GetArgCount() > 2 ? static_cast<uint32>(std::max(atoi(pArgs->GetArg(2)), 1)) : 600;
+
+		const CPlayerSnapshotCodec::SBenchmarkResult result = CPlayerSnapshotCodec::RunBenchmark(numPlayers, numTicks);
+		CryLogAlways("Snapshot codec: %u players, %u ticks, %u records", numPlayers, numTicks, result.numRecords);
+		CryLogAlways("  full %.1f bits/record, delta %.1f bits/record, %.0f bytes/tick for all players",
+			result.fullBitsPerRecord, result.deltaBitsPerRecord, result.deltaBitsPerRecord * static_cast<float>(numPlayers) / 8.f);
+		CryLogAlways("  encode %.1f ns/record, decode %.1f ns/record", result.encodeNanosecondsPerRecord, result.decodeNanosecondsPerRecord);
+		CryLogAlways("  max position error %.4f m, round trip %s", result.maxPositionError, result.isRoundTripExact ? "exact" : "MISMATCH");
+	}
+
+	void KernelBenchmarkCommand(IConsoleCmdArgs* pArgs)
+	{
+		const uint32 numPlayers = pArgs->GetArgCount() > 1 ? static_cast<uint32>(std::max(atoi(pArgs->GetArg(1)), 1)) : 1024;
+		const uint32 numIterations = pArgs->GetArgCount() > 2 ? static_cast<uint32>(std::max(atoi(pArgs->GetArg(2)), 1)) : 1000;
+
+		const CMovementKernels::SBenchmarkResult result = CMovementKernels::RunBenchmark(numPlayers, numIterations);
+		const float scalarNanoseconds = result.nanosecondsPerPlayer[static_cast<size_t>(EMovementKernelPath::Scalar)];
+		CryLogAlways("Movement kernels: %u players, %u iterations, active path %s", numPlayers, numIterations, GetMovementKernelPathName(CMovementKernels::GetPath()));
+		for (uint32 path = 0; path < static_cast<uint32>(EMovementKernelPath::Count); ++path)
+		{
+			if (!CMovementKernels::IsSupported(static_cast<EMovementKernelPath>(path)))
+			{
+				CryLogAlways("  %-6s not in this build", GetMovementKernelPathName(static_cast<EMovementKernelPath>(path)));
+				continue;
+			}
+
+			const float nanoseconds = result.nanosecondsPerPlayer[path];
+			CryLogAlways("  %-6s %6.2f ns/player, %4.2fx scalar, %s", GetMovementKernelPathName(static_cast<EMovementKernelPath>(path)),
+				nanoseconds, nanoseconds > 0.f ? scalarNanoseconds / nanoseconds : 0.f, result.isIdentical[path] ? "bit-identical" : "MISMATCH");
+		}
+		CryLogAlways("  sin / cos max error %.2e", result.maxSinCosError);
+	}
+
+	void HitHistoryBenchmarkCommand(IConsoleCmdArgs* pArgs)
+	{
+		const uint32 numPlayers = pArgs->GetArgCount() > 1 ? static_cast<uint32>(std::max(atoi(pArgs->GetArg(1)), 1)) : CPlayerCapsuleHistory::MaxPlayers;
+		const uint32 numRays = pArgs->GetArgCount() > 2 ? static_cast<uint32>(std::max(atoi(pArgs->GetArg(2)), 1)) : 1000;
+		const uint32 numIterations = pArgs->GetArgCount() > 3 ? static_cast<uint32>(std::max(atoi(pArgs->GetArg(3)), 1)) : 100;
+
+		const CPlayerCapsuleHistory::SBenchmarkResult result = CPlayerCapsuleHistory::RunBenchmark(numPlayers, numRays, numIterations);
+		CryLogAlways("Capsule history: %u rays against %u players, %u iterations", result.numRays, result.numPlayers, numIterations);
+		CryLogAlways("  %7.1f ns/ray, %u of the rays hit", result.nanosecondsPerRay, result.numHits);
+		CryLogAlways("  %7.1f KB for %u ticks of %u players", static_cast<float>(sizeof(CPlayerCapsuleHistory) + CPlayerCapsuleHistory::GetFrameBytes() * CPlayerCapsuleHistory::MaxTicks) / 1024.f,
+			CPlayerCapsuleHistory::MaxTicks, CPlayerCapsuleHistory::MaxPlayers);
+	}
+
+	void LogInputTraceResult(const char* szPath, uint32 numTicks, uint32 numPlayers, uint32 checksum, uint32 recordedChecksum, const SMovementStageTimings& timings)
+	{
+		const float tickCount = static_cast<float>(std::max(numTicks, 1u));
+		CryLogAlways("Input trace %s: %u ticks, %u players, checksum %08x (recorded %08x, %s)",
+			szPath, numTicks, numPlayers, checksum, recordedChecksum, checksum == recordedChecksum ? "match" : "DIVERGED");
+		for (size_t stage = 0; stage < SMovementStageTimings::NumStages; ++stage)
+		{
+			CryLogAlways("  %-16s %9.3f ms %8.2f us/tick", GetMovementStageName(static_cast<EMovementStage>(stage)),
+				static_cast<float>(timings.nanoseconds[stage]) * 1e-6f, static_cast<float>(timings.nanoseconds[stage]) * 1e-3f / tickCount);
+		}
+		CryLogAlways("  %-16s %9.3f ms %8.2f us/tick", "Total",
+			static_cast<float>(timings.GetTotalNanoseconds()) * 1e-6f, static_cast<float>(timings.GetTotalNanoseconds()) * 1e-3f / tickCount);
+	}
+
+	void ProfileReportCommand(IConsoleCmdArgs* pArgs)
+	{
+		CPlayerMovementSystem* pSystem = CGamePlugin::GetInstance()->GetPlayerMovementSystem();
+		if (pArgs->GetArgCount() > 1 && strcmp(pArgs->GetArg(1), "reset") == 0)
+		{
+			pSystem->ResetStageProfiler();
+			CryLogAlways("Player movement profile reset");
+		}
+		else if (pArgs->GetArgCount() > 2 && strcmp(pArgs->GetArg(1), "csv") == 0)
+		{
+			if (pSystem->GetStageProfiler().WriteCsv(pArgs->GetArg(2)))
+			{
+				CryLogAlways("Wrote player movement profile to %s", pArgs->GetArg(2));
+			}
+			else
+			{
+				CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_ERROR, "Could not write player movement profile to %s", pArgs->GetArg(2));
+			}
+		}
+		else
+		{
+			pSystem->LogStageProfile();
+		}
+	}
+
+	void LodStatsCommand(IConsoleCmdArgs* pArgs)
+	{
+		CPlayerMovementSystem* pSystem = CGamePlugin::GetInstance()->GetPlayerMovementSystem();
+		if (pArgs->GetArgCount() > 1 && strcmp(pArgs->GetArg(1), "reset") == 0)
+		{
+			pSystem->ResetUpdateSchedulerStats();
+			CryLogAlways("Player update LOD counters reset");
+		}
+		else
+		{
+			pSystem->LogUpdateSchedulerStats();
+		}
+	}
+
+	void InterestStatsCommand(IConsoleCmdArgs* pArgs)
+	{
+		CPlayerMovementSystem* pSystem = CGamePlugin::GetInstance()->GetPlayerMovementSystem();
+		if (pArgs->GetArgCount() > 1 && strcmp(pArgs->GetArg(1), "reset") == 0)
+		{
+			pSystem->ResetInterestStats();
+			CryLogAlways("Player interest grid counters reset");
+		}
+		else
+		{
+			pSystem->LogInterestStats();
+		}
+	}
+
+	void TraceRecordCommand(IConsoleCmdArgs* pArgs)
+	{
+		if (pArgs->GetArgCount() < 2)
+		{
+			CryLogAlways("Usage: pl_traceRecord <file>");
+			return;
+		}
+		CGamePlugin::GetInstance()->GetPlayerMovementSystem()->StartInputTraceRecording(pArgs->GetArg(1));
+	}
+
+	void TraceReplayCommand(IConsoleCmdArgs* pArgs)
+	{
+		if (pArgs->GetArgCount() < 2)
+		{
+			CryLogAlways("Usage: pl_traceReplay <file>");
+			return;
+		}
+		CGamePlugin::GetInstance()->GetPlayerMovementSystem()->StartInputTraceReplay(pArgs->GetArg(1));
+	}
+
+	void TraceStopCommand(IConsoleCmdArgs* pArgs)
+	{
+		CGamePlugin::GetInstance()->GetPlayerMovementSystem()->StopInputTrace();
+	}
+
+	void TraceBenchmarkCommand(IConsoleCmdArgs* pArgs)
+	{
+		if (pArgs->GetArgCount() < 2)
+		{
+			CryLogAlways("Usage: pl_traceBenchmark <file> [players=1]");
+			return;
+		}
+
+		CMappedFile file;
+		CPlayerInputTraceReader trace;
+		if (!file.Open(pArgs->GetArg(1)) || !trace.Open(file.GetData(), file.GetSize()))
+		{
+			CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_ERROR, "Could not open input trace %s", pArgs->GetArg(1));
+			return;
+		}
+
+		const uint32 numPlayers = pArgs->GetArgCount() > 2 ? static_cast<uint32>(std::max(atoi(pArgs->GetArg(2)), 1)) : 1;
+		const CPlayerInputTraceReplay::SResult result = CPlayerInputTraceReplay::RunHeadless(trace, numPlayers);
+		LogInputTraceResult(pArgs->GetArg(1), result.numTicks, result.numPlayers, result.checksum, trace.GetHeader().checksum, result.timings);
+		CryLogAlways("  %-16s %9.3f ms wall clock", "Run", static_cast<float>(result.totalNanoseconds) * 1e-6f);
+	}
+
+	void TelemetryStartCommand(IConsoleCmdArgs* pArgs)
+	{
+		CGamePlugin::GetInstance()->GetPlayerMovementSystem()->StartTelemetry(pArgs->GetArgCount() > 1 ? pArgs->GetArg(1) : "movement.mvtl");
+	}
+
+	void TelemetryStopCommand(IConsoleCmdArgs* pArgs)
+	{
+		CGamePlugin::GetInstance()->GetPlayerMovementSystem()->StopTelemetry();
+	}
+
+	void TelemetryDecodeCommand(IConsoleCmdArgs* pArgs)
+	{
+		if (pArgs->GetArgCount() < 2)
+		{
+			CryLogAlways("Usage: pl_telemetryDecode <trace> [csv file]");
+			return;
+		}
+
+		std::vector<SMovementTelemetryEvent> events;
+		std::vector<uint32> droppedPerRing;
+		bool isComplete = false;
+		if (!CMovementTelemetry::Read(pArgs->GetArg(1), events, droppedPerRing, &isComplete))
+		{
+			CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_ERROR, "Could not read movement telemetry %s", pArgs->GetArg(1));
+			return;
+		}
+
+		std::array<uint32, static_cast<size_t>(EMovementTelemetryEvent::Count)> counts = {};
+		for (const SMovementTelemetryEvent& event : events)
+		{
+			if (event.type < EMovementTelemetryEvent::Count)
+			{
+				++counts[static_cast<size_t>(event.type)];
+			}
+		}
+
+		const float seconds = events.empty() ? 0.f : static_cast<float>(events.back().nanoseconds - events.front().nanoseconds) * 1e-9f;
+		CryLogAlways("Movement telemetry %s: %u events over %.1f s from %u threads, %u dropped%s", pArgs->GetArg(1), static_cast<uint32>(events.size()), seconds,
+			static_cast<uint32>(droppedPerRing.size()), std::accumulate(droppedPerRing.begin(), droppedPerRing.end(), 0u), isComplete ? "" : ", cut off");
+		for (size_t type = 0; type < counts.size(); ++type)
+		{
+			CryLogAlways("  %-16s %9u", GetMovementTelemetryEventName(static_cast<EMovementTelemetryEvent>(type)), counts[type]);
+		}
+
+		if (pArgs->GetArgCount() < 3)
+			return;
+
+		FILE* pFile = fopen(pArgs->GetArg(2), "w");
+		if (pFile == nullptr)
+		{
+			CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_ERROR, "Could not write %s", pArgs->GetArg(2));
+			return;
+		}
+
+		fprintf(pFile, "time_us,tick,player,event,flags,stance,state,x,y,z\n");
+		for (const SMovementTelemetryEvent& event : events)
+		{
+			fprintf(pFile, "%.3f,%u,%08x,%s,%02x,%u,%u,%.2f,%.2f,%.2f\n", static_cast<double>(event.nanoseconds) * 1e-3, event.tick, event.playerId,
+				GetMovementTelemetryEventName(event.type), event.flags, static_cast<uint32>(event.stance), static_cast<uint32>(event.playerState),
+				event.position.x, event.position.y, event.position.z);
+		}
+		fclose(pFile);
+		CryLogAlways("Wrote %u events to %s", static_cast<uint32>(events.size()), pArgs->GetArg(2));
+	}
+}
+
+CPlayerMovementSystem::CPlayerMovementSystem()
+	: m_tickAccumulator(CFixedTickAccumulator::DefaultTickRate)
+{
+	m_freeSnapshotSlots.resize(MaxSnapshotSlots);
+	std::iota(m_freeSnapshotSlots.rbegin(), m_freeSnapshotSlots.rend(), 0u);
+	m_snapshotSlotIds.fill(INVALID_ENTITYID);
+
+	REGISTER_CVAR2("pl_movementParallel", &m_parallelUpdate, 1, VF_NULL,
+		"Player movement update threading\n"
+		"0: Update all players on the main thread\n"
+		"1: Split the player update into chunks and run them on the job system worker threads");
+	REGISTER_CVAR2("pl_movementChunkSize", &m_parallelChunkSize, 32, VF_NULL,
+		"Number of players updated by a single job when pl_movementParallel is enabled");
+	REGISTER_CVAR2("pl_movementSimd", &m_kernelPath, static_cast<int>(EMovementKernelPath::Avx), VF_NULL,
+		"Instruction set of the batched movement math, all of them give the same results\n"
+		"0: Scalar\n"
+		"1: SSE, 4 players at a time\n"
+		"2: AVX, 8 players at a time\n"
+		"Sets the build does not have fall back to the widest one it has");
+	REGISTER_COMMAND("pl_movementSimdBenchmark", &KernelBenchmarkCommand, VF_NULL,
+		"Times the batched movement math on every instruction set in this build and checks that they agree\n"
+		"Usage: pl_movementSimdBenchmark [players=1024] [iterations=1000]");
+	REGISTER_CVAR2("pl_movementLod", &m_updateLod, 1, VF_NULL,
+		"Update-rate LOD for players nobody controls from this machine or a client, e.g. bots and other clients' players\n"
+		"0: Simulate every player every tick\n"
+		"1: Simulate distant, idle or steady players every 2nd, 4th or 8th tick, catching up on the time in between");
+	REGISTER_CVAR2("pl_movementLodFullDistance", &m_updateScheduler.GetSettings().fullDistance, 20.f, VF_NULL,
+		"Players closer than this to a viewer are simulated every tick");
+	REGISTER_CVAR2("pl_movementLodHalfDistance", &m_updateScheduler.GetSettings().halfDistance, 50.f, VF_NULL,
+		"Players closer than this to a viewer are simulated at least every 2nd tick");
+	REGISTER_CVAR2("pl_movementLodQuarterDistance", &m_updateScheduler.GetSettings().quarterDistance, 100.f, VF_NULL,
+		"Players closer than this to a viewer are simulated at least every 4th tick, all others every 8th");
+	REGISTER_COMMAND("pl_movementLodStats", &LodStatsCommand, VF_NULL,
+		"Logs how many players are in each update-rate tier and how many updates each tier ran per tick\n"
+		"Usage: pl_movementLodStats [reset]");
+	REGISTER_CVAR2("pl_interestCellSize", &m_interestGrid.GetSettings().cellSize, 32.f, VF_NULL,
+		"Edge length in meters of the grid cells players are bucketed into to find who is near whom, changing it refiles every player");
+	REGISTER_CVAR2("pl_interestFullDistance", &m_interestGrid.GetSettings().fullDistance, 30.f, VF_NULL,
+		"Players closer than this to a client's player are sent to it every tick");
+	REGISTER_CVAR2("pl_interestHalfDistance", &m_interestGrid.GetSettings().halfDistance, 80.f, VF_NULL,
+		"Players closer than this to a client's player are sent to it at least every 2nd tick");
+	REGISTER_CVAR2("pl_interestQuarterDistance", &m_interestGrid.GetSettings().quarterDistance, 150.f, VF_NULL,
+		"Players closer than this to a client's player are sent to it at least every 4th tick, all others within pl_interestCullDistance every 8th");
+	REGISTER_CVAR2("pl_interestCullDistance", &m_interestGrid.GetSettings().cullDistance, 300.f, VF_NULL,
+		"Players further than this from a client's player are not sent to it, and not turned on the local player's screen");
+	REGISTER_COMMAND("pl_interestStats", &InterestStatsCommand, VF_NULL,
+		"Logs how the players are spread over the interest grid and what its queries cost\n"
+		"Usage: pl_interestStats [reset]");
+	REGISTER_CVAR2("pl_movementTickRate", &m_tickRate, CFixedTickAccumulator::DefaultTickRate, VF_NET_SYNCED,
+		"Player movement ticks per second, independent of the frame rate. The server's value is used by all clients.\n"
+		"Camera offset, roll, field of view and yaw are interpolated between ticks, so lower rates only cost responsiveness");
+	REGISTER_CVAR2("pl_profileMovement", &m_profileStages, 0, VF_NULL,
+		"Times every stage of the player movement tick and each physics query it makes, see pl_profileMovementReport");
+	REGISTER_COMMAND("pl_profileMovementReport", &ProfileReportCommand, VF_NULL,
+		"Logs p50 / p99 / max per-tick time of each player movement stage collected while pl_profileMovement is on\n"
+		"Usage: pl_profileMovementReport [reset | csv <file>]");
+	REGISTER_CVAR2("pl_netCorrectionTolerance", &m_correctionTolerance, 0.05f, VF_NULL,
+		"Distance in meters the predicted player position may be off from the server before the client rewinds and replays its input");
+	REGISTER_CVAR2("pl_netSnapshotBudget", &m_snapshotBudget, 1024, VF_NULL,
+		"Bytes of player snapshots sent to each client per tick, 0 for no limit\n"
+		"The client's own player is always sent, other players that are due but do not fit are sent first on the next tick");
+	REGISTER_COMMAND("pl_netSnapshotBenchmark", &SnapshotBenchmarkCommand, VF_NULL,
+		"Measures the player snapshot encoder and decoder\n"
+		"Usage: pl_netSnapshotBenchmark [players=64] [ticks=600]");
+	REGISTER_CVAR2("pl_hitRewindMaxTicks", &m_hitRewindMaxTicks, 32, VF_NULL,
+		"Movement ticks a shot is tested back in time at most, to where its client saw the other players\n"
+		"Clients further behind hit the players where they were this many ticks ago");
+	REGISTER_COMMAND("pl_hitHistoryBenchmark", &HitHistoryBenchmarkCommand, VF_NULL,
+		"Times the batched ray test against the recorded player capsules\n"
+		"Usage: pl_hitHistoryBenchmark [players=64] [rays=1000] [iterations=100]");
+	REGISTER_COMMAND("pl_traceRecord", &TraceRecordCommand, VF_NULL,
+		"Records the local player's input every tick until pl_traceStop, then saves it\n"
+		"Usage: pl_traceRecord <file>");
+	REGISTER_COMMAND("pl_traceReplay", &TraceReplayCommand, VF_NULL,
+		"Drives the local player from a recorded input trace, then logs per-stage timings and the state checksum\n"
+		"Usage: pl_traceReplay <file>");
+	REGISTER_COMMAND("pl_traceStop", &TraceStopCommand, VF_NULL,
+		"Ends the input trace recording or replay in progress");
+	REGISTER_COMMAND("pl_traceBenchmark", &TraceBenchmarkCommand, VF_NULL,
+		"Replays an input trace through the movement simulation without the engine and logs per-stage timings and the checksum\n"
+		"Usage: pl_traceBenchmark <file> [players=1]");
+	REGISTER_CVAR2("pl_telemetrySampleInterval", &m_telemetrySampleInterval, 1, VF_NULL,
+		"Ticks between the state samples of every player in the movement telemetry, 0 to record only state transitions");
+	REGISTER_COMMAND("pl_telemetryStart", &TelemetryStartCommand, VF_NULL,
+		"Streams jumps, wallruns, stance and sprint changes and per-tick samples of all players to a binary trace until pl_telemetryStop\n"
+		"Usage: pl_telemetryStart [file=movement.mvtl]");
+	REGISTER_COMMAND("pl_telemetryStop", &TelemetryStopCommand, VF_NULL,
+		"Ends the movement telemetry recording and closes the trace");
+	REGISTER_COMMAND("pl_telemetryDecode", &TelemetryDecodeCommand, VF_NULL,
+		"Logs the event counts of a movement telemetry trace and optionally writes its events as CSV, needs no level\n"
+		"Usage: pl_telemetryDecode <trace> [csv file]");
+}
+
+CPlayerMovementSystem::~CPlayerMovementSystem()
+{
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->UnregisterVariable("pl_movementParallel", true);
+		gEnv->pConsole->UnregisterVariable("pl_movementChunkSize", true);
+		gEnv->pConsole->UnregisterVariable("pl_movementSimd", true);
+		gEnv->pConsole->RemoveCommand("pl_movementSimdBenchmark");
+		gEnv->pConsole->UnregisterVariable("pl_movementLod", true);
+		gEnv->pConsole->UnregisterVariable("pl_movementLodFullDistance", true);
+		gEnv->pConsole->UnregisterVariable("pl_movementLodHalfDistance", true);
+		gEnv->pConsole->UnregisterVariable("pl_movementLodQuarterDistance", true);
+		gEnv->pConsole->RemoveCommand("pl_movementLodStats");
+		gEnv->pConsole->UnregisterVariable("pl_interestCellSize", true);
+		gEnv->pConsole->UnregisterVariable("pl_interestFullDistance", true);
+		gEnv->pConsole->UnregisterVariable("pl_interestHalfDistance", true);
+		gEnv->pConsole->UnregisterVariable("pl_interestQuarterDistance", true);
+		gEnv->pConsole->UnregisterVariable("pl_interestCullDistance", true);
+		gEnv->pConsole->RemoveCommand("pl_interestStats");
+		gEnv->pConsole->UnregisterVariable("pl_movementTickRate", true);
+		gEnv->pConsole->UnregisterVariable("pl_profileMovement", true);
+		gEnv->pConsole->RemoveCommand("pl_profileMovementReport");
+		gEnv->pConsole->UnregisterVariable("pl_netCorrectionTolerance", true);
+		gEnv->pConsole->UnregisterVariable("pl_netSnapshotBudget", true);
+		gEnv->pConsole->RemoveCommand("pl_netSnapshotBenchmark");
+		gEnv->pConsole->UnregisterVariable("pl_hitRewindMaxTicks", true);
+		gEnv->pConsole->RemoveCommand("pl_hitHistoryBenchmark");
+		gEnv->pConsole->RemoveCommand("pl_traceRecord");
+		gEnv->pConsole->RemoveCommand("pl_traceReplay");
+		gEnv->pConsole->RemoveCommand("pl_traceStop");
+		gEnv->pConsole->RemoveCommand("pl_traceBenchmark");
+		gEnv->pConsole->UnregisterVariable("pl_telemetrySampleInterval", true);
+		gEnv->pConsole->RemoveCommand("pl_telemetryStart");
+		gEnv->pConsole->RemoveCommand("pl_telemetryStop");
+		gEnv->pConsole->RemoveCommand("pl_telemetryDecode");
+	}
+
+	StopTelemetry();
+}
+
+PlayerMovementId CPlayerMovementSystem::AddPlayer(IEntity& entity, const SMovementParams& params, IMovementPhysics& physics)
+{
+	const PlayerMovementId id = m_store.Add(params, physics);
+	m_targets.push_back(SPresentationTarget{ &entity });
+	m_network.emplace_back();
+	if (!m_freeSnapshotSlots.empty())
+	{
+		m_network.back().snapshotSlot = m_freeSnapshotSlots.back();
+		m_freeSnapshotSlots.pop_back();
+	}
+	else
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "More than %u players, the rest are not sent to clients", MaxSnapshotSlots);
+	}
+	return id;
+}
+
+void CPlayerMovementSystem::RemovePlayer(PlayerMovementId id)
+{
+	if (!m_store.IsValid(id))
+		return;
+
+	// Mirror the swap with the last player the store is about to do
+	const uint32 index = m_store.GetIndex(id);
+	const EntityId networkId = m_targets[index].pEntity->GetId();
+	m_snapshotHistory.erase(networkId);
+	for (SPlayerNetwork& network : m_network)
+	{
+		if (network.pReceiver)
+		{
+			network.pReceiver->baselineTicks.erase(networkId);
+			network.pReceiver->sentTicks.erase(networkId);
+		}
+	}
+	m_interestGrid.Remove(m_store, index);
+	if (m_network[index].snapshotSlot != MaxSnapshotSlots)
+	{
+		m_freeSnapshotSlots.push_back(m_network[index].snapshotSlot);
+	}
+
+	m_targets[index] = m_targets.back();
+	m_targets.pop_back();
+	m_network[index] = std::move(m_network.back());
+	m_network.pop_back();
+
+	m_store.Remove(id);
+}
+
+void CPlayerMovementSystem::ResetPlayer(PlayerMovementId id, float yaw)
+{
+	const uint32 index = m_store.GetIndex(id);
+
+	SPlayerMovementState state = m_store.GetState(index);
+	CPlayerMovementSimulation::ResetState(state, *m_store.params[index], yaw);
+	m_store.SetState(index, state);
+	m_store.input[index] = SPlayerInput();
+	m_store.appliedPhysics[index] = SMovementPhysicsApplied();
+	// Snap instead of blending in from wherever the player was before
+	m_store.previousPresentation[index] = m_store.GetPresentation(index);
+}
+
+void CPlayerMovementSystem::SetMovementParams(PlayerMovementId id, const SMovementParams& params)
+{
+	const uint32 index = m_store.GetIndex(id);
+	if (m_store.params[index] == &params)
+		return;
+
+	m_store.params[index] = &params;
+	CPlayerMovementSimulation::ApplyParams(m_store, index);
+}
+
+void CPlayerMovementSystem::OnMovementParamsChanged(const SMovementParams& params)
+{
+	for (uint32 i = 0, n = m_store.GetCount(); i < n; ++i)
+	{
+		if (m_store.params[i] == &params)
+		{
+			CPlayerMovementSimulation::ApplyParams(m_store, i);
+		}
+	}
+}
+
+void CPlayerMovementSystem::SetNetworkRole(PlayerMovementId id, EPlayerNetRole role, IPlayerMovementTransport* pTransport)
+{
+	const uint32 index = m_store.GetIndex(id);
+	// Players somebody controls right now are simulated every tick, their input arrives every tick and prediction relies on it.
+	// That includes the one played on this machine whatever its role, e.g. the Authority player of a listen server host.
+	m_store.updateLod[index].isPinned = IsLocalPlayer(index) || role == EPlayerNetRole::RemoteAuthority || role == EPlayerNetRole::Predicted;
+
+	SPlayerNetwork& network = m_network[index];
+	network.pTransport = pTransport;
+	if (network.role == role)
+		return;
+
+	// The slot stays with the player, clients keep naming it the same whatever its role
+	const uint32 snapshotSlot = network.snapshotSlot;
+	network = SPlayerNetwork();
+	network.role = role;
+	network.pTransport = pTransport;
+	network.snapshotSlot = snapshotSlot;
+	if (role == EPlayerNetRole::RemoteAuthority)
+	{
+		network.pInputQueue = stl::make_unique<CPlayerInputQueue>();
+		network.pReceiver = stl::make_unique<SSnapshotReceiver>();
+	}
+	else if (role == EPlayerNetRole::Predicted)
+	{
+		network.pPrediction = stl::make_unique<CPlayerPrediction>();
+	}
+}
+
+void CPlayerMovementSystem::ReceiveInput(PlayerMovementId id, const SPlayerInputCommand* pCommands, uint32 count, uint32 snapshotAck)
+{
+	if (!m_store.IsValid(id))
+		return;
+
+	SPlayerNetwork& network = m_network[m_store.GetIndex(id)];
+	if (network.pInputQueue)
+	{
+		network.pInputQueue->Receive(pCommands, count);
+	}
+
+	// Every player in the acknowledged packet can be delta encoded against it from now on
+	SSnapshotReceiver* pReceiver = network.pReceiver.get();
+	if (pReceiver != nullptr && snapshotAck != 0 && (!pReceiver->hasAck || static_cast<int32>(snapshotAck - pReceiver->ackTick) > 0))
+	{
+		pReceiver->ackTick = snapshotAck;
+		pReceiver->hasAck = true;
+
+		if (const std::vector<EntityId>* pIncluded = pReceiver->sentPackets.Find(snapshotAck))
+		{
+			for (const EntityId networkId : *pIncluded)
+			{
+				pReceiver->baselineTicks[networkId] = snapshotAck;
+			}
+		}
+	}
+}
+
+void CPlayerMovementSystem::ReceiveSnapshots(const uint8* pData, uint32 numBits)
+{
+	CBitReader packet(pData, numBits);
+	uint32 serverTick = 0;
+	if (packet.ReadBool())
+	{
+		serverTick = packet.ReadBits(ServerTickBits);
+	}
+	else
+	{
+		// The server only shortens the tick after we acknowledged one
+		const uint32 shortTick = packet.ReadBits(ShortServerTickBits);
+		if (m_newestSnapshotTick == 0)
+			return;
+
+		const uint32 tickMask = (1u << ShortServerTickBits) - 1;
+		const uint32 delta = (shortTick - m_newestSnapshotTick) & tickMask;
+		serverTick = m_newestSnapshotTick + delta - (delta > (tickMask >> 1) ? tickMask + 1 : 0);
+	}
+
+	bool isComplete = true;
+	while (packet.ReadBool())
+	{
+		const uint32 numRecordBits = packet.ReadBits(RecordLengthBits);
+		if (packet.GetNumBitsLeft() < numRecordBits)
+		{
+			isComplete = false;
+			break;
+		}
+
+		CBitReader record(pData, packet.GetPosition() + numRecordBits);
+		record.SkipBits(packet.GetPosition());
+		packet.SkipBits(numRecordBits);
+
+		const uint32 slot = record.ReadBits(SnapshotSlotBits);
+		const uint32 baselineAge = record.ReadBits(BaselineAgeBits);
+		if (baselineAge == 0)
+		{
+			m_snapshotSlotIds[slot] = static_cast<EntityId>(record.ReadBits(NetworkIdBits));
+		}
+		const EntityId networkId = m_snapshotSlotIds[slot];
+		if (networkId == INVALID_ENTITYID)
+		{
+			isComplete = false;
+			continue;
+		}
+
+		// Records of players that have not spawned here yet are kept as well, the server may use them as baselines
+		TSnapshotHistory& history = GetSnapshotHistory(networkId);
+		const SQuantizedSnapshot* pBaseline = baselineAge != 0 ? history.Find(serverTick - baselineAge) : nullptr;
+
+		SQuantizedSnapshot quantized;
+		if ((baselineAge != 0 && pBaseline == nullptr) || !CPlayerSnapshotCodec::Read(record, quantized, pBaseline))
+		{
+			isComplete = false;
+			continue;
+		}
+		history.Insert(serverTick) = quantized;
+
+		const PlayerMovementId id = FindPlayer(networkId);
+		if (id != InvalidPlayerMovementId)
+		{
+			QueueSnapshot(m_store.GetIndex(id), CPlayerSnapshotCodec::Dequantize(quantized, serverTick));
+		}
+	}
+
+	// Only acknowledge what we can serve as a baseline in full
+	if (isComplete && !packet.HasOverflowed() && (m_newestSnapshotTick == 0 || static_cast<int32>(serverTick - m_newestSnapshotTick) > 0))
+	{
+		m_newestSnapshotTick = serverTick;
+	}
+}
+
+void CPlayerMovementSystem::QueueSnapshot(uint32 index, const SPlayerMovementSnapshot& snapshot)
+{
+	SPlayerNetwork& network = m_network[index];
+	if (network.role != EPlayerNetRole::Predicted && network.role != EPlayerNetRole::Proxy)
+		return;
+
+	// Unreliable messages can overtake each other, keep the newest
+	if (!network.hasPendingSnapshot || static_cast<int32>(snapshot.state.tick - network.pendingSnapshot.state.tick) > 0)
+	{
+		network.pendingSnapshot = snapshot;
+		network.hasPendingSnapshot = true;
+	}
+}
+
+void CPlayerMovementSystem::InvalidatePhysics(PlayerMovementId id)
+{
+	// The entity can be physicalized before it was added
+	if (m_store.IsValid(id))
+	{
+		m_store.appliedPhysics[m_store.GetIndex(id)] = SMovementPhysicsApplied();
+	}
+}
+
+void CPlayerMovementSystem::SetCamera(PlayerMovementId id, Cry::DefaultComponents::CCameraComponent* pCamera)
+{
+	if (m_store.IsValid(id))
+	{
+		m_targets[m_store.GetIndex(id)].pCamera = pCamera;
+	}
+}
+
+void CPlayerMovementSystem::InvalidateEnvironment()
+{
+	for (uint32 i = 0, n = m_store.GetCount(); i < n; ++i)
+	{
+		m_store.wallContact[i] = SWallContact();
+		CHeadroomCache::Invalidate(m_store.headroom[i]);
+	}
+}
+
+void CPlayerMovementSystem::Update(float frameTime)
+{
+	if (gEnv->IsEditing() || m_store.GetCount() == 0)
+		return;
+
+	m_simulatedLink.Update(frameTime);
+	ExchangeSnapshots();
+
+	// Both ends have to agree on the tick rate, pl_movementTickRate is synced to clients
+	if (1.f / std::max(m_tickRate, 1.f) != m_tickAccumulator.GetTickLength())
+	{
+		m_tickAccumulator.SetTickRate(m_tickRate);
+	}
+	// All kernel paths give the same results, so switching between ticks does not disturb prediction
+	CMovementKernels::SetPath(static_cast<EMovementKernelPath>(crymath::clamp(m_kernelPath, 0, static_cast<int>(EMovementKernelPath::Count) - 1)));
+
+	const int numTicks = m_tickAccumulator.Advance(frameTime);
+	for (int i = 0; i < numTicks; ++i)
+	{
+		BeginInputTraceTick();
+		PrepareTickInput();
+		ScheduleTick();
+		SavePresentation();
+
+		// Timing costs two clock reads per stage and physics query, only pay for it when somebody looks
+		SMovementStageTimings tickTimings;
+		const bool isTimed = m_profileStages != 0 || m_pInputTrace != nullptr;
+		CPlayerMovementSimulation::StepRanges(m_store, m_dueRanges.data(), m_numDueRanges, m_tickAccumulator.GetTickLength(),
+			[this](uint32 count, const auto& func) { ParallelFor(count, func); }, isTimed ? &tickTimings : nullptr);
+
+		if (m_profileStages != 0)
+		{
+			m_stageProfiler.AddTick(tickTimings);
+		}
+		if (m_pInputTrace != nullptr)
+		{
+			m_pInputTrace->timings.Add(tickTimings);
+		}
+
+		RecordPredictions();
+		EndInputTraceTick();
+	}
+
+	if (numTicks > 0)
+	{
+		SendInputCommands();
+	}
+
+	// Rendering runs between ticks, a dedicated server only needs the entity rotation to follow each tick
+	if (numTicks > 0 || !gEnv->IsDedicated())
+	{
+		ApplyPresentation(m_tickAccumulator.GetAlpha());
+	}
+}
+
+void CPlayerMovementSystem::ExchangeSnapshots()
+{
+	if (m_store.tick != m_lastSnapshotTick)
+	{
+		m_lastSnapshotTick = m_store.tick;
+		SendSnapshots();
+		if (gEnv->bServer)
+		{
+			RecordCapsules();
+		}
+	}
+
+	for (uint32 i = 0, n = m_store.GetCount(); i < n; ++i)
+	{
+		SPlayerNetwork& network = m_network[i];
+		IMovementPhysics& physics = *m_store.physics[i];
+
+		switch (network.role)
+		{
+		case EPlayerNetRole::Predicted:
+		{
+			CPlayerPrediction& prediction = *network.pPrediction;
+
+			// Physics has integrated the newest tick by now
+			if (prediction.HasRecorded())
+			{
+				const SMovementBody body = physics.GetBody();
+				prediction.RecordBody(prediction.GetNewestSequence(), body.position, body.velocity);
+			}
+
+			if (network.hasPendingSnapshot)
+			{
+				network.hasPendingSnapshot = false;
+				if (prediction.Reconcile(m_store, i, network.pendingSnapshot, m_tickAccumulator.GetTickLength(), m_correctionTolerance))
+				{
+					++m_numCorrections;
+				}
+			}
+		} break;
+
+		case EPlayerNetRole::Proxy:
+		{
+			if (network.hasPendingSnapshot)
+			{
+				network.hasPendingSnapshot = false;
+				m_store.SetState(i, network.pendingSnapshot.state);
+				physics.SetBodyState(network.pendingSnapshot.position, network.pendingSnapshot.velocity);
+				network.proxyInput = network.pendingSnapshot.input;
+			}
+		} break;
+
+		default:
+			break;
+		}
+	}
+}
+
+void CPlayerMovementSystem::SendSnapshots()
+{
+	const bool hasReceivers = std::any_of(m_network.begin(), m_network.end(), [](const SPlayerNetwork& network)
+	{
+		return network.pReceiver != nullptr && network.pTransport != nullptr;
+	});
+	if (!hasReceivers)
+		return;
+
+	const uint32 serverTick = m_store.tick;
+	for (uint32 i = 0, n = m_store.GetCount(); i < n; ++i)
+	{
+		const SPlayerNetwork& network = m_network[i];
+		if (network.role != EPlayerNetRole::Authority && network.role != EPlayerNetRole::RemoteAuthority)
+			continue;
+
+		const SMovementBody body = m_store.physics[i]->GetBody();
+
+		// While the client's input is late the state runs ahead of the acknowledged command,
+		// its prediction only compares once the acknowledgement moves on.
+		SPlayerMovementSnapshot snapshot;
+		snapshot.ackSequence = network.pInputQueue != nullptr ? network.pInputQueue->GetAckSequence() : 0;
+		snapshot.state = m_store.GetState(i);
+		snapshot.position = body.position;
+		snapshot.velocity = body.velocity;
+		snapshot.input = m_store.input[i];
+
+		GetSnapshotHistory(m_targets[i].pEntity->GetId()).Insert(serverTick) = CPlayerSnapshotCodec::Quantize(snapshot);
+	}
+
+	for (uint32 i = 0, n = m_store.GetCount(); i < n; ++i)
+	{
+		if (m_network[i].pReceiver == nullptr || m_network[i].pTransport == nullptr)
+			continue;
+
+		const uint32 numBits = WriteSnapshotPacket(i, serverTick);
+		if (!m_simulatedLink.IsEnabled())
+		{
+			m_network[i].pTransport->SendSnapshots(m_packetBuffer.data(), numBits);
+			continue;
+		}
+
+		// The packet buffer is rewritten for the next receiver, a held back packet needs a copy of its own
+		if (m_freeDelayedPackets.empty())
+		{
+			m_freeDelayedPackets.push_back(static_cast<uint32>(m_delayedPackets.size()));
+			m_delayedPackets.emplace_back();
+		}
+		const uint32 slot = m_freeDelayedPackets.back();
+		m_freeDelayedPackets.pop_back();
+		m_delayedPackets[slot].assign(m_packetBuffer.begin(), m_packetBuffer.begin() + (numBits + 7) / 8);
+
+		const PlayerMovementId id = m_store.ids[i];
+		const bool isQueued = m_simulatedLink.Send([this, id, slot, numBits]()
+		{
+			if (m_store.IsValid(id) && m_network[m_store.GetIndex(id)].pTransport != nullptr)
+			{
+				m_network[m_store.GetIndex(id)].pTransport->SendSnapshots(m_delayedPackets[slot].data(), numBits);
+			}
+			m_freeDelayedPackets.push_back(slot);
+		});
+		if (!isQueued)
+		{
+			m_freeDelayedPackets.push_back(slot);
+		}
+	}
+}
+
+void CPlayerMovementSystem::RecordCapsules()
+{
+	m_capsuleHistory.BeginTick(m_store.tick);
+	for (uint32 i = 0, n = m_store.GetCount(); i < n; ++i)
+	{
+		const SMovementParams& params = *m_store.params[i];
+		const SMovementBody body = m_store.physics[i]->GetBody();
+		if (!body.isPhysicalized)
+			continue;
+
+		// The stance is committed to the collider in the same tick it changes
+		const float radius = body.colliderRadius;
+		const Vec3 bottom = body.position + Vec3(0.f, 0.f, params.capsuleGroundOffset + radius);
+		if (!m_capsuleHistory.Add(m_targets[i].pEntity->GetId(), bottom, CPlayerMovementSimulation::GetStanceHeight(params, m_store.stance[i]), radius))
+		{
+			CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "More than %u players, the rest cannot be hit by lag-compensated shots", CPlayerCapsuleHistory::MaxPlayers);
+			break;
+		}
+	}
+}
+
+bool CPlayerMovementSystem::TraceShots(PlayerMovementId shooter, SCapsuleRay* pRays, uint32 numRays, SCapsuleRayHit* pHits, uint32* pTick) const
+{
+	if (!m_store.IsValid(shooter) || m_capsuleHistory.IsEmpty())
+		return false;
+
+	const uint32 index = m_store.GetIndex(shooter);
+	const SSnapshotReceiver* pReceiver = m_network[index].pReceiver.get();
+	const uint32 newestTick = m_capsuleHistory.GetNewestTick();
+	const uint32 maxRewind = static_cast<uint32>(crymath::clamp(m_hitRewindMaxTicks, 0, static_cast<int>(CPlayerCapsuleHistory::MaxTicks) - 1));
+
+	uint32 viewTick = newestTick;
+	if (pReceiver != nullptr && pReceiver->hasAck)
+	{
+		// Acknowledgements from the future are as bogus as those from too far back
+		const uint32 rewind = static_cast<int32>(newestTick - pReceiver->ackTick) < 0 ? 0 : newestTick - pReceiver->ackTick;
+		viewTick = newestTick - std::min(rewind, maxRewind);
+	}
+
+	uint32 recordedTick = 0;
+	if (!m_capsuleHistory.FindTick(viewTick, recordedTick))
+		return false;
+
+	const uint32 shooterId = m_targets[index].pEntity->GetId();
+	for (uint32 i = 0; i < numRays; ++i)
+	{
+		pRays[i].ignoreId = shooterId;
+	}
+
+	if (pTick != nullptr)
+	{
+		*pTick = recordedTick;
+	}
+	return m_capsuleHistory.Raycast(recordedTick, pRays, numRays, pHits);
+}
+
+uint32 CPlayerMovementSystem::WriteSnapshotPacket(uint32 receiverIndex, uint32 serverTick)
+{
+	SSnapshotReceiver& receiver = *m_network[receiverIndex].pReceiver;
+	std::vector<EntityId>& included = receiver.sentPackets.Insert(serverTick);
+
+	CBitWriter packet(m_packetBuffer.data(), MaxSnapshotPacketBytes);
+	packet.WriteBool(!receiver.hasAck);
+	packet.WriteBits(serverTick, receiver.hasAck ? ShortServerTickBits : ServerTickBits);
+
+	// The client's own player first, it is the one it predicts
+	WriteSnapshotRecord(packet, receiver, included, receiverIndex, serverTick, 0);
+
+	// Then the players around it that are due for their tier, those waiting the most periods first, so players that
+	// did not fit the budget go ahead of the rest next tick
+	m_interestGrid.GatherRelevant(m_store, m_store.body[receiverIndex].position, m_relevant);
+	m_snapshotCandidates.clear();
+	for (const SRelevantPlayer& player : m_relevant)
+	{
+		if (player.index == receiverIndex)
+			continue;
+
+		const uint32 period = CMovementUpdateScheduler::GetPeriod(player.tier);
+		const auto sentIt = receiver.sentTicks.find(m_targets[player.index].pEntity->GetId());
+		const uint32 ticksSinceSent = sentIt != receiver.sentTicks.end() ? serverTick - sentIt->second : std::numeric_limits<uint32>::max();
+		if (ticksSinceSent < period)
+			continue;
+
+		m_snapshotCandidates.push_back(SSnapshotCandidate { player.index, static_cast<float>(ticksSinceSent) / static_cast<float>(period), player.distanceSq });
+	}
+	std::sort(m_snapshotCandidates.begin(), m_snapshotCandidates.end(), [](const SSnapshotCandidate& a, const SSnapshotCandidate& b)
+	{
+		return a.overdue != b.overdue ? a.overdue > b.overdue : a.distanceSq < b.distanceSq;
+	});
+
+	const uint32 budgetBits = static_cast<uint32>(std::max(m_snapshotBudget, 0)) * 8;
+	for (const SSnapshotCandidate& candidate : m_snapshotCandidates)
+	{
+		if (!WriteSnapshotRecord(packet, receiver, included, candidate.index, serverTick, budgetBits))
+			break;
+
+		receiver.sentTicks[m_targets[candidate.index].pEntity->GetId()] = serverTick;
+	}
+
+	packet.WriteBool(false);
+	return packet.GetNumBits();
+}
+
+bool CPlayerMovementSystem::WriteSnapshotRecord(CBitWriter& packet, const SSnapshotReceiver& receiver, std::vector<EntityId>& included, uint32 index, uint32 serverTick, uint32 budgetBits)
+{
+	const uint32 slot = m_network[index].snapshotSlot;
+	const EntityId networkId = m_targets[index].pEntity->GetId();
+	const TSnapshotHistory& history = GetSnapshotHistory(networkId);
+	const SQuantizedSnapshot* pSnapshot = history.Find(serverTick);
+	if (pSnapshot == nullptr || slot == MaxSnapshotSlots)
+		return true;
+
+	// Fall back to a full record once the acknowledged baseline got too old to be referenced
+	const SQuantizedSnapshot* pBaseline = nullptr;
+	uint32 baselineAge = 0;
+	const auto baselineIt = receiver.baselineTicks.find(networkId);
+	if (baselineIt != receiver.baselineTicks.end() && serverTick - baselineIt->second < (1u << BaselineAgeBits))
+	{
+		pBaseline = history.Find(baselineIt->second);
+		baselineAge = pBaseline != nullptr ? serverTick - baselineIt->second : 0;
+	}
+
+	std::array<uint8, MaxSnapshotRecordBytes> recordBuffer;
+	CBitWriter record(recordBuffer.data(), MaxSnapshotRecordBytes);
+	record.WriteBits(slot, SnapshotSlotBits);
+	record.WriteBits(baselineAge, BaselineAgeBits);
+	if (baselineAge == 0)
+	{
+		record.WriteBits(networkId, NetworkIdBits);
+	}
+	CPlayerSnapshotCodec::Write(record, *pSnapshot, pBaseline);
+
+	// Room for the continue bit, the length and the terminating bit of the packet
+	const uint32 packetBits = packet.GetNumBits() + 1 + RecordLengthBits + record.GetNumBits() + 1;
+	if ((budgetBits != 0 && packetBits > budgetBits) || packetBits > MaxSnapshotPacketBytes * 8)
+		return false;
+
+	packet.WriteBool(true);
+	packet.WriteBits(record.GetNumBits(), RecordLengthBits);
+	packet.WriteBitsFrom(record);
+	included.push_back(networkId);
+	return true;
+}
+
+CPlayerMovementSystem::TSnapshotHistory& CPlayerMovementSystem::GetSnapshotHistory(EntityId networkId)
+{
+	std::unique_ptr<TSnapshotHistory>& pHistory = m_snapshotHistory[networkId];
+	if (!pHistory)
+	{
+		pHistory = stl::make_unique<TSnapshotHistory>();
+	}
+	return *pHistory;
+}
+
+PlayerMovementId CPlayerMovementSystem::FindPlayer(EntityId networkId) const
+{
+	for (uint32 i = 0, n = m_store.GetCount(); i < n; ++i)
+	{
+		if (m_targets[i].pEntity->GetId() == networkId)
+			return m_store.ids[i];
+	}
+	return InvalidPlayerMovementId;
+}
+
+void CPlayerMovementSystem::PrepareTickInput()
+{
+	for (uint32 i = 0, n = m_store.GetCount(); i < n; ++i)
+	{
+		SPlayerNetwork& network = m_network[i];
+		switch (network.role)
+		{
+		case EPlayerNetRole::RemoteAuthority:
+			m_store.input[i] = network.pInputQueue->Consume();
+			break;
+
+		case EPlayerNetRole::Predicted:
+			// Sequence numbers are our own ticks, the server only uses them to order and acknowledge
+			network.pPrediction->RecordInput(m_store.tick, m_store.input[i]);
+			break;
+
+		case EPlayerNetRole::Proxy:
+			// Keep moving the way the server last said, local input does not belong to this player
+			m_store.input[i] = network.proxyInput;
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+void CPlayerMovementSystem::RecordPredictions()
+{
+	// The tick counter was already advanced by the step
+	const uint32 sequence = m_store.tick - 1;
+
+	for (uint32 i = 0, n = m_store.GetCount(); i < n; ++i)
+	{
+		if (m_network[i].role == EPlayerNetRole::Predicted)
+		{
+			m_network[i].pPrediction->RecordState(sequence, m_store.GetState(i));
+		}
+	}
+}
+
+void CPlayerMovementSystem::SendInputCommands()
+{
+	for (uint32 i = 0, n = m_store.GetCount(); i < n; ++i)
+	{
+		const SPlayerNetwork& network = m_network[i];
+		if (network.role != EPlayerNetRole::Predicted || network.pTransport == nullptr)
+			continue;
+
+		std::array<SPlayerInputCommand, MaxInputCommandsPerPacket> commands;
+		const uint32 count = network.pPrediction->GetUnacknowledged(commands.data(), MaxInputCommandsPerPacket);
+		if (count == 0 && m_sentSnapshotAck == m_newestSnapshotTick)
+			continue;
+
+		const PlayerMovementId id = m_store.ids[i];
+		const uint32 snapshotAck = m_sentSnapshotAck = m_newestSnapshotTick;
+		m_simulatedLink.Send([this, id, commands, count, snapshotAck]()
+		{
+			if (m_store.IsValid(id) && m_network[m_store.GetIndex(id)].pTransport != nullptr)
+			{
+				m_network[m_store.GetIndex(id)].pTransport->SendInput(commands.data(), count, snapshotAck);
+			}
+		});
+	}
+}
+
+void CPlayerMovementSystem::LogStageProfile() const
+{
+	const CDurationHistogram& total = m_stageProfiler.GetTotal();
+	CryLogAlways("Player movement stages over %llu ticks, %u players (microseconds per tick)", static_cast<unsigned long long>(total.GetCount()), m_store.GetCount());
+	CryLogAlways("  %-16s %9s %9s %9s %9s %9s", "Stage", "p50", "p99", "max", "mean", "calls");
+
+	auto logRow = [](const char* szName, const CDurationHistogram& histogram, float callsPerTick)
+	{
+		CryLogAlways("  %-16s %9.2f %9.2f %9.2f %9.2f %9.1f", szName, histogram.GetPercentile(0.5f) * 1e-3f, histogram.GetPercentile(0.99f) * 1e-3f,
+			histogram.GetMax() * 1e-3f, histogram.GetMean() * 1e-3f, callsPerTick);
+	};
+
+	for (size_t stage = 0; stage < SMovementStageTimings::NumStages; ++stage)
+	{
+		const EMovementStage movementStage = static_cast<EMovementStage>(stage);
+		logRow(GetMovementStageName(movementStage), m_stageProfiler.GetStage(movementStage), m_stageProfiler.GetCallsPerTick(movementStage));
+	}
+	logRow("Total", total, 1.f);
+}
+
+bool CPlayerMovementSystem::StartInputTraceRecording(const char* szPath)
+{
+	const PlayerMovementId id = FindLocalPlayer();
+	if (id == InvalidPlayerMovementId)
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "No local player to record an input trace of");
+		return false;
+	}
+
+	StopInputTrace();
+
+	const uint32 index = m_store.GetIndex(id);
+	const SMovementBody body = m_store.physics[index]->GetBody();
+
+	SPlayerInputTraceHeader header;
+	header.tickRate = 1.f / m_tickAccumulator.GetTickLength();
+	header.params = *m_store.params[index];
+	header.initialState = m_store.GetState(index);
+	header.initialPosition = body.position;
+	header.initialVelocity = body.velocity;
+
+	m_pInputTrace = stl::make_unique<SInputTraceSession>();
+	m_pInputTrace->path = szPath;
+	m_pInputTrace->playerId = id;
+	m_pInputTrace->writer.Begin(header);
+	CryLogAlways("Recording input trace to %s", szPath);
+	return true;
+}
+
+bool CPlayerMovementSystem::StartInputTraceReplay(const char* szPath)
+{
+	const PlayerMovementId id = FindLocalPlayer();
+	if (id == InvalidPlayerMovementId)
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "No local player to replay an input trace on");
+		return false;
+	}
+
+	StopInputTrace();
+
+	std::unique_ptr<SInputTraceSession> pSession = stl::make_unique<SInputTraceSession>();
+	if (!pSession->file.Open(szPath) || !pSession->reader.Open(pSession->file.GetData(), pSession->file.GetSize()))
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_ERROR, "Could not open input trace %s", szPath);
+		return false;
+	}
+
+	// Start exactly where the recording started
+	const SPlayerInputTraceHeader& header = pSession->reader.GetHeader();
+	const uint32 index = m_store.GetIndex(id);
+	if (memcmp(&header.params, m_store.params[index], sizeof(SMovementParams)) != 0)
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "Input trace %s was recorded with different movement parameters, the replay will diverge", szPath);
+	}
+	if (fabsf(header.tickRate - 1.f / m_tickAccumulator.GetTickLength()) > 0.01f)
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "Input trace %s was recorded at %.1f ticks per second, the replay will diverge", szPath, header.tickRate);
+	}
+
+	m_store.SetState(index, header.initialState);
+	m_store.input[index] = SPlayerInput();
+	m_store.appliedPhysics[index] = SMovementPhysicsApplied();
+	m_store.physics[index]->SetBodyState(header.initialPosition, header.initialVelocity);
+
+	pSession->path = szPath;
+	pSession->playerId = id;
+	pSession->isReplay = true;
+	pSession->checksum = 2166136261u;
+	m_pInputTrace = std::move(pSession);
+	CryLogAlways("Replaying input trace %s, %u ticks", szPath, header.numTicks);
+	return true;
+}
+
+void CPlayerMovementSystem::StopInputTrace()
+{
+	if (m_pInputTrace == nullptr)
+		return;
+
+	const SInputTraceSession& session = *m_pInputTrace;
+	if (session.isReplay)
+	{
+		LogInputTraceResult(session.path.c_str(), session.numTicks, 1, session.checksum, session.reader.GetHeader().checksum, session.timings);
+	}
+	else if (session.writer.Save(session.path.c_str()))
+	{
+		CryLogAlways("Saved input trace %s, %u ticks", session.path.c_str(), session.writer.GetNumTicks());
+	}
+	else
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_ERROR, "Could not write input trace %s", session.path.c_str());
+	}
+
+	m_pInputTrace.reset();
+}
+
+bool CPlayerMovementSystem::StartTelemetry(const char* szPath)
+{
+	StopTelemetry();
+
+	if (!m_telemetry.Start(szPath, static_cast<uint32>(std::max(m_telemetrySampleInterval, 0))))
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_ERROR, "Could not open movement telemetry %s", szPath);
+		return false;
+	}
+
+	// Console commands run between frames, so no tick is in flight to see the pointer change
+	m_store.pTelemetry = &m_telemetry;
+	CryLogAlways("Recording movement telemetry to %s", szPath);
+	return true;
+}
+
+void CPlayerMovementSystem::StopTelemetry()
+{
+	if (!m_telemetry.IsRecording())
+		return;
+
+	m_store.pTelemetry = nullptr;
+	m_telemetry.Stop();
+	LogTelemetryStats();
+}
+
+void CPlayerMovementSystem::LogTelemetryStats() const
+{
+	const CMovementTelemetry::SStats stats = m_telemetry.GetStats();
+	CryLogAlways("Movement telemetry: %llu events, %llu dropped, %.1f KB, %.1f bytes/event, %u threads", static_cast<unsigned long long>(stats.events),
+		static_cast<unsigned long long>(stats.dropped), static_cast<float>(stats.bytes) / 1024.f,
+		stats.events != 0 ? static_cast<float>(stats.bytes) / static_cast<float>(stats.events) : 0.f, stats.rings);
+}
+
+void CPlayerMovementSystem::BeginInputTraceTick()
+{
+	if (m_pInputTrace == nullptr)
+		return;
+
+	SInputTraceSession& session = *m_pInputTrace;
+	if (!m_store.IsValid(session.playerId))
+	{
+		m_pInputTrace.reset();
+		return;
+	}
+
+	SPlayerInput& input = m_store.input[m_store.GetIndex(session.playerId)];
+	if (session.isReplay && (session.numTicks >= session.reader.GetHeader().numTicks || !session.reader.Read(input)))
+	{
+		StopInputTrace();
+		return;
+	}
+	session.tickInput = input;
+}
+
+void CPlayerMovementSystem::EndInputTraceTick()
+{
+	if (m_pInputTrace == nullptr)
+		return;
+
+	SInputTraceSession& session = *m_pInputTrace;
+	const uint32 index = m_store.GetIndex(session.playerId);
+	const SPlayerMovementState state = m_store.GetState(index);
+	const Vec3& position = m_store.body[index].position;
+
+	if (session.isReplay)
+	{
+		session.checksum = CPlayerInputTrace::HashTick(session.checksum, state, position);
+	}
+	else
+	{
+		session.writer.Append(session.tickInput, state, position);
+	}
+	++session.numTicks;
+}
+
+PlayerMovementId CPlayerMovementSystem::FindLocalPlayer() const
+{
+	for (uint32 i = 0, n = m_store.GetCount(); i < n; ++i)
+	{
+		const EPlayerNetRole role = m_network[i].role;
+		if (IsLocalPlayer(i) && (role == EPlayerNetRole::Authority || role == EPlayerNetRole::Predicted))
+			return m_store.ids[i];
+	}
+	return InvalidPlayerMovementId;
+}
+
+template<typename TFunc>
+void CPlayerMovementSystem::ParallelFor(uint32 count, const TFunc& func)
+{
+	const uint32 chunkSize = static_cast<uint32>(std::max(m_parallelChunkSize, 1));
+	const uint32 numChunks = (count + chunkSize - 1) / chunkSize;
+	if (m_parallelUpdate == 0 || numChunks <= 1 || gEnv->pJobManager == nullptr)
+	{
+		func(0, count);
+		return;
+	}
+
+	// Chunks are handed out dynamically, so a worker that got delayed or a chunk full of wallrunners doesn't hold up the rest
+	std::atomic<uint32> nextChunk(0);
+	auto runChunks = [&nextChunk, &func, numChunks, chunkSize, count]()
+	{
+		for (uint32 chunk = nextChunk++; chunk < numChunks; chunk = nextChunk++)
+		{
+			const uint32 begin = chunk * chunkSize;
+			func(begin, std::min(begin + chunkSize, count));
+		}
+	};
+
+	const uint32 numWorkers = static_cast<uint32>(std::max(gEnv->pJobManager->GetNumWorkerThreads(), 0));
+	const uint32 numJobs = std::min(std::min(numChunks - 1, numWorkers), MaxParallelJobs);
+
+	JobManager::SJobState jobStates[MaxParallelJobs];
+	for (uint32 i = 0; i < numJobs; ++i)
+	{
+		gEnv->pJobManager->AddLambdaJob("PlayerMovementUpdate", runChunks, JobManager::eRegularPriority, &jobStates[i]);
+	}
+
+	runChunks();
+
+	for (uint32 i = 0; i < numJobs; ++i)
+	{
+		gEnv->pJobManager->WaitForJob(jobStates[i]);
+	}
+}
+
+void CPlayerMovementSystem::ScheduleTick()
+{
+	m_interestGrid.Update(m_store);
+
+	// Players driven by a person are seen through: the one played on this machine, on a server also every client's
+	m_viewers.clear();
+	for (uint32 i = 0, n = m_store.GetCount(); i < n; ++i)
+	{
+		if (m_store.updateLod[i].isPinned)
+		{
+			m_viewers.push_back(m_store.body[i].position);
+		}
+	}
+
+	// Beyond the quarter distance every player is in the slowest tier anyway, so only the players the grid finds within it get measured
+	CMovementUpdateScheduler::SSettings& lodSettings = m_updateScheduler.GetSettings();
+	m_viewerDistancesSq.assign(m_store.GetCount(), std::numeric_limits<float>::max());
+	if (m_updateLod != 0)
+	{
+		const float radius = std::max(std::max(lodSettings.fullDistance, lodSettings.halfDistance), lodSettings.quarterDistance);
+		for (const Vec3& viewer : m_viewers)
+		{
+			m_interestGrid.ForEachInRadius(m_store, viewer, radius, [this](uint32 index, float distanceSq)
+			{
+				m_viewerDistancesSq[index] = std::min(m_viewerDistancesSq[index], distanceSq);
+			});
+		}
+	}
+
+	lodSettings.isEnabled = m_updateLod != 0;
+	m_updateScheduler.AssignTiers(m_store, m_viewerDistancesSq.data());
+	m_updateScheduler.GroupByTier(m_store, [this](uint32 a, uint32 b) { SwapPlayers(a, b); });
+	m_numDueRanges = m_updateScheduler.GetDueRanges(m_store, m_dueRanges);
+}
+
+void CPlayerMovementSystem::SwapPlayers(uint32 a, uint32 b)
+{
+	// The store has already swapped its own columns
+	std::swap(m_targets[a], m_targets[b]);
+	std::swap(m_network[a], m_network[b]);
+}
+
+void CPlayerMovementSystem::SavePresentation()
+{
+	for (uint32 range = 0; range < m_numDueRanges; ++range)
+	{
+		for (uint32 i = m_dueRanges[range].begin; i < m_dueRanges[range].end; ++i)
+		{
+			m_store.previousPresentation[i] = m_store.GetPresentation(i);
+		}
+	}
+}
+
+void CPlayerMovementSystem::LogUpdateSchedulerStats() const
+{
+	const CMovementUpdateScheduler::SStats& stats = m_updateScheduler.GetStats();
+	const float tickCount = static_cast<float>(std::max<uint64>(stats.ticks, 1));
+	CryLogAlways("Player update LOD over %llu ticks, %u viewers, %llu store swaps", static_cast<unsigned long long>(stats.ticks), static_cast<uint32>(m_viewers.size()), static_cast<unsigned long long>(stats.swaps));
+	CryLogAlways("  %-8s %7s %8s %14s", "Tier", "Period", "Players", "Updates/tick");
+
+	uint64 totalUpdates = 0;
+	for (uint32 tier = 0; tier < CMovementUpdateScheduler::NumTiers; ++tier)
+	{
+		const EMovementUpdateTier updateTier = static_cast<EMovementUpdateTier>(tier);
+		CryLogAlways("  %-8s %7u %8u %14.1f", GetMovementUpdateTierName(updateTier), CMovementUpdateScheduler::GetPeriod(updateTier), stats.players[tier], static_cast<float>(stats.updates[tier]) / tickCount);
+		totalUpdates += stats.updates[tier];
+	}
+	CryLogAlways("  %-8s %7s %8u %14.1f", "Total", "", m_store.GetCount(), static_cast<float>(totalUpdates) / tickCount);
+}
+
+void CPlayerMovementSystem::LogInterestStats() const
+{
+	const CPlayerInterestGrid::SStats& stats = m_interestGrid.GetStats();
+	const float updateCount = static_cast<float>(std::max<uint64>(stats.updates, 1));
+	const float queryCount = static_cast<float>(std::max<uint64>(stats.queries, 1));
+	CryLogAlways("Player interest grid over %llu ticks: %u players in %u of %u cells", static_cast<unsigned long long>(stats.updates), stats.numPlayers, stats.numOccupiedCells, stats.numCells);
+	CryLogAlways("  %8.2f cell changes/tick", static_cast<float>(stats.cellChanges) / updateCount);
+	CryLogAlways("  %8llu queries, per query %.1f cells visited, %.1f players tested, %.1f found", static_cast<unsigned long long>(stats.queries),
+		static_cast<float>(stats.cellsVisited) / queryCount, static_cast<float>(stats.playersTested) / queryCount, static_cast<float>(stats.playersFound) / queryCount);
+}
+
+void CPlayerMovementSystem::ApplyPresentation(float alpha)
+{
+	// Nobody looks through any camera but the local player's, and of the others only those it can see need to turn.
+	// A dedicated server has no local player and keeps every rotation up to date.
+	const PlayerMovementId localId = gEnv->IsDedicated() ? InvalidPlayerMovementId : FindLocalPlayer();
+	const bool isCulled = localId != InvalidPlayerMovementId;
+	if (isCulled)
+	{
+		m_isPresented.assign(m_store.GetCount(), 0);
+		m_interestGrid.GatherRelevant(m_store, m_store.body[m_store.GetIndex(localId)].position, m_relevant);
+		for (const SRelevantPlayer& player : m_relevant)
+		{
+			m_isPresented[player.index] = 1;
+		}
+	}
+
+	for (uint32 i = 0, n = m_store.GetCount(); i < n; ++i)
+	{
+		const SPresentationTarget& target = m_targets[i];
+		const bool isLocalPlayer = IsLocalPlayer(i);
+		if (isCulled && !isLocalPlayer && m_isPresented[i] == 0)
+			continue;
+
+		// A player simulated every few ticks covered all of them in its last update, so it is spread over as many rendered ticks.
+		// Those in the full tier were updated last tick by one tick and blend by alpha.
+		const int32 ticksSinceUpdate = std::max(static_cast<int32>(m_store.tick - m_store.updateLod[i].lastUpdateTick) - 1, 0);
+		const float playerAlpha = std::min((static_cast<float>(ticksSinceUpdate) + alpha) / static_cast<float>(std::max<uint8>(m_store.catchUpTicks[i], 1)), 1.f);
+		SMovementPresentation presentation = SMovementPresentation::Interpolate(m_store.previousPresentation[i], m_store.GetPresentation(i), playerAlpha);
+
+		// Looking around must not wait for the next tick: the local player sees the mouse movement it has not simulated yet on top of the newest tick
+		if (isLocalPlayer)
+		{
+			const SMovementParams& params = *m_store.params[i];
+			const Vec2& pendingRotation = m_store.input[i].mouseDeltaRotation;
+			presentation.yaw = m_store.yaw[i] + pendingRotation.x * params.rotationSpeed;
+			presentation.pitch = crymath::clamp(m_store.pitch[i] + pendingRotation.y * params.rotationSpeed, params.pitchMin, params.pitchMax);
+		}
+
+		target.pEntity->SetRotation(CPlayerMovementSimulation::GetBodyRotation(presentation.yaw));
+		if (!isLocalPlayer || target.pCamera == nullptr)
+			continue;
+
+		Matrix34 cameraMatrix(IDENTITY);
+		cameraMatrix.SetRotation33(Matrix33(CPlayerMovementSimulation::GetCameraRotation(presentation.cameraRoll, presentation.pitch)));
+		cameraMatrix.SetTranslation(presentation.cameraOffset);
+		target.pCamera->SetTransformMatrix(cameraMatrix);
+
+		const CryTransform::CAngle fov = CryTransform::CAngle::FromDegrees(presentation.fov);
+		if (target.pCamera->GetFieldOfView() != fov)
+		{
+			target.pCamera->SetFieldOfView(fov);
+		}
+	}
+}
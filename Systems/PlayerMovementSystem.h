@@ -0,0 +1,297 @@
+#pragma once
+
+#include "Movement/PlayerMovementSimulation.h"
+#include "Movement/MovementKernels.h"
+#include "Movement/PlayerPrediction.h"
+#include "Movement/PlayerSnapshotCodec.h"
+#include "Movement/PlayerInputTrace.h"
+#include "Movement/PlayerCapsuleHistory.h"
+#include "Movement/PlayerInterestGrid.h"
+#include "Movement/MovementTelemetry.h"
+#include "Movement/MovementStageProfiler.h"
+#include "SimulatedNetworkLink.h"
+
+#include <unordered_map>
+
+namespace Cry::DefaultComponents
+{
+	class CCameraComponent;
+}
+
+// Who decides where a player is, from the point of view of this machine
+enum class EPlayerNetRole : uint8
+{
+	// Simulated here from local input, nobody to answer to (single player, listen server host)
+	Authority,
+	// Simulated here from the input commands its client sends, snapshots are sent back
+	RemoteAuthority,
+	// Controlled on this client, simulated ahead of the server and corrected by its snapshots
+	Predicted,
+	// Controlled on another machine, follows the server snapshots
+	Proxy
+};
+
+// Largest snapshot packet sent to a client in one tick
+static constexpr uint32 MaxSnapshotPacketBytes = 4096;
+// Players in snapshot packets are named by a slot the server hands out, players beyond this many are not sent
+static constexpr uint32 SnapshotSlotBits = 8;
+static constexpr uint32 MaxSnapshotSlots = 1u << SnapshotSlotBits;
+
+// Carries player movement messages between client and server, implemented by CPlayerComponent on top of entity RMIs
+struct IPlayerMovementTransport
+{
+	virtual ~IPlayerMovementTransport() = default;
+
+	// Client to server, along with the newest server tick snapshots were received for (0 if none yet)
+	virtual void SendInput(const SPlayerInputCommand* pCommands, uint32 count, uint32 snapshotAck) = 0;
+	// Server to the client owning the player: the encoded snapshots of every player for one tick
+	virtual void SendSnapshots(const uint8* pData, uint32 numBits) = 0;
+};
+
+////////////////////////////////////////////////////////
+// Updates the movement of every player in one pass per frame
+// Replaces the per-entity Update event: CPlayerComponent only registers itself and feeds input,
+// the state lives in a CPlayerMovementStore owned by this system.
+////////////////////////////////////////////////////////
+class CPlayerMovementSystem
+{
+public:
+	CPlayerMovementSystem();
+	~CPlayerMovementSystem();
+
+	PlayerMovementId AddPlayer(IEntity& entity, const SMovementParams& params, IMovementPhysics& physics);
+	void RemovePlayer(PlayerMovementId id);
+	// Restores the default movement state and drops any pending input
+	void ResetPlayer(PlayerMovementId id, float yaw);
+	// Switches the player to other tuning values, which have to outlive it
+	void SetMovementParams(PlayerMovementId id, const SMovementParams& params);
+	// Call after params changed in place, every player using them follows without being reset
+	void OnMovementParamsChanged(const SMovementParams& params);
+	// Forgets the body settings committed so far, call when the player entity was physicalized again
+	void InvalidatePhysics(PlayerMovementId id);
+	// Camera the local player is seen through, its view follows the movement. Null for every other player.
+	void SetCamera(PlayerMovementId id, Cry::DefaultComponents::CCameraComponent* pCamera);
+	// Forgets the ceiling clearances and walls remembered for every player, call when the level geometry may have changed
+	void InvalidateEnvironment();
+
+	// Decides whether the player is simulated from local input, from network input or follows the server
+	void SetNetworkRole(PlayerMovementId id, EPlayerNetRole role, IPlayerMovementTransport* pTransport);
+	EPlayerNetRole GetNetworkRole(PlayerMovementId id) const { return m_network[m_store.GetIndex(id)].role; }
+	// Server: input commands from the client owning the player, and the snapshot tick that client acknowledged
+	void ReceiveInput(PlayerMovementId id, const SPlayerInputCommand* pCommands, uint32 count, uint32 snapshotAck);
+	// Client: a snapshot packet from the server, the states in it are applied at the start of the next update
+	void ReceiveSnapshots(const uint8* pData, uint32 numBits);
+
+	// Input that will be consumed by the next tick of the player
+	SPlayerInput& GetInput(PlayerMovementId id) { return m_store.input[m_store.GetIndex(id)]; }
+	SPlayerMovementState GetState(PlayerMovementId id) const { return m_store.GetState(m_store.GetIndex(id)); }
+
+	void Update(float frameTime);
+	// Movement ticks per second, the same on the server and all clients
+	float GetTickRate() const { return m_tickRate; }
+
+	// Records the input of the local player from the next tick on, StopInputTrace saves it to szPath
+	bool StartInputTraceRecording(const char* szPath);
+	// Drives the local player from a recorded trace instead of its input, stage timings and checksum are logged at the end
+	bool StartInputTraceReplay(const char* szPath);
+	void StopInputTrace();
+
+	// Streams the movement state transitions of all players, and every pl_telemetrySampleInterval ticks their state, to szPath
+	bool StartTelemetry(const char* szPath);
+	void StopTelemetry();
+	void LogTelemetryStats() const;
+
+	// Per-tick stage timings, collected while pl_profileMovement is enabled
+	const CMovementStageProfiler& GetStageProfiler() const { return m_stageProfiler; }
+	void ResetStageProfiler() { m_stageProfiler.Reset(); }
+	void LogStageProfile() const;
+
+	// Update-rate LOD of the players, its counters say how many ran at each tier
+	const CMovementUpdateScheduler& GetUpdateScheduler() const { return m_updateScheduler; }
+	void ResetUpdateSchedulerStats() { m_updateScheduler.ResetStats(); }
+	void LogUpdateSchedulerStats() const;
+
+	// Which players each client hears about and how often, and what the LOD distances are measured with
+	const CPlayerInterestGrid& GetInterestGrid() const { return m_interestGrid; }
+	void ResetInterestStats() { m_interestGrid.ResetStats(); }
+	void LogInterestStats() const;
+
+	// Server: tests rays the player fired against the other players where its client saw them, for lag-compensated hits
+	// That is the newest snapshot its client acknowledged, which proxies are only extrapolated from by the frame the client
+	// is in, but at most pl_hitRewindMaxTicks back. Players the server drives itself see the present.
+	// Sets the rays to ignore the shooter and returns the tick they were tested at, or false if the history does not reach it.
+	// CProjectileSystem tests the path of every shot a player fired through here.
+	bool TraceShots(PlayerMovementId shooter, SCapsuleRay* pRays, uint32 numRays, SCapsuleRayHit* pHits, uint32* pTick = nullptr) const;
+	const CPlayerCapsuleHistory& GetCapsuleHistory() const { return m_capsuleHistory; }
+
+	const CPlayerMovementStore& GetStore() const { return m_store; }
+	// Times a predicted player had to be rewound because the server disagreed
+	uint32 GetNumCorrections() const { return m_numCorrections; }
+
+protected:
+	// Quantized snapshots of one player by server tick, at least as long as a baseline may be old
+	static constexpr uint32 SnapshotHistorySize = 64;
+	using TSnapshotHistory = CSequenceRing<SQuantizedSnapshot, SnapshotHistorySize>;
+
+	// Server side view of what a client has received
+	// Each player is delta encoded against the newest snapshot of it that was in a packet the client acknowledged.
+	struct SSnapshotReceiver
+	{
+		// Players carried by each packet, by server tick
+		CSequenceRing<std::vector<EntityId>, SnapshotHistorySize> sentPackets;
+		// Newest acknowledged server tick that carried each player
+		std::unordered_map<EntityId, uint32> baselineTicks;
+		// Newest server tick each player was sent at, acknowledged or not, players are due again once their tier's period passed
+		std::unordered_map<EntityId, uint32> sentTicks;
+		uint32 ackTick = 0;
+		bool hasAck = false;
+	};
+
+	// A player due in the snapshot packet being written, the most overdue go first
+	struct SSnapshotCandidate
+	{
+		uint32 index;
+		// Periods of its tier since it was last sent
+		float overdue;
+		float distanceSq;
+	};
+
+	// Calls func(begin, end) over [0, count) in chunks, spread over the job system worker threads when enabled.
+	// Workers and the calling thread pull chunks from a shared counter until none are left, then the call returns.
+	template<typename TFunc>
+	void ParallelFor(uint32 count, const TFunc& func);
+
+	// Picks the players simulated in the upcoming tick into m_dueRanges, regrouping the store by update tier
+	void ScheduleTick();
+	// Exchanges two players in the store and everything kept in the same order
+	void SwapPlayers(uint32 a, uint32 b);
+	// Keeps what the due players look like before the upcoming tick, to interpolate from
+	void SavePresentation();
+	// Writes rotation back to the entities the local player can see and camera transform and field of view to its own,
+	// between each player's last two updates, by how far rendering is into the ticks the last one covered (alpha into the newest)
+	void ApplyPresentation(float alpha);
+
+	// Applies received snapshots on clients, and sends snapshots of the state the last frame ended with on the server
+	void ExchangeSnapshots();
+	// Server: records the snapshot of every player and sends each client a packet within the budget
+	void SendSnapshots();
+	// Server: remembers every player's capsule as of the newest tick, for TraceShots
+	void RecordCapsules();
+	// Writes the packet for the client owning the player at receiverIndex to m_packetBuffer, returns its size in bits
+	// It carries the players relevant to the client that are due for their tier, as many as the budget allows.
+	uint32 WriteSnapshotPacket(uint32 receiverIndex, uint32 serverTick);
+	// Appends the record of the player at index and notes it in included, unless it would push the packet over budgetBits (0 for no limit)
+	bool WriteSnapshotRecord(CBitWriter& packet, const SSnapshotReceiver& receiver, std::vector<EntityId>& included, uint32 index, uint32 serverTick, uint32 budgetBits);
+	// Client: keeps the newest snapshot of the player for the next update
+	void QueueSnapshot(uint32 index, const SPlayerMovementSnapshot& snapshot);
+	TSnapshotHistory& GetSnapshotHistory(EntityId networkId);
+	// Players are identified by their entity id, it is the same on the server and every client
+	PlayerMovementId FindPlayer(EntityId networkId) const;
+	// Picks the input each player simulates the upcoming tick with
+	void PrepareTickInput();
+	// Remembers what the tick predicted, for comparison with the server snapshot later on
+	void RecordPredictions();
+	// Sends every command the server has not acknowledged yet
+	void SendInputCommands();
+	// Replaces the local player's input with the next traced tick, or remembers it for recording
+	void BeginInputTraceTick();
+	// Records the tick, or folds its result into the replay checksum
+	void EndInputTraceTick();
+	// The player this machine plays, as marked by CPlayerComponent::UpdateLocalPlayer
+	bool IsLocalPlayer(uint32 index) const { return (m_targets[index].pEntity->GetFlags() & ENTITY_FLAG_LOCAL_PLAYER) != 0; }
+	PlayerMovementId FindLocalPlayer() const;
+
+	// Where the simulated state is presented, kept in the same dense order as the store
+	struct SPresentationTarget
+	{
+		IEntity* pEntity;
+		Cry::DefaultComponents::CCameraComponent* pCamera = nullptr;
+	};
+
+	// Network side of a player, kept in the same dense order as the store
+	struct SPlayerNetwork
+	{
+		EPlayerNetRole role = EPlayerNetRole::Authority;
+		IPlayerMovementTransport* pTransport = nullptr;
+		// Server: names the player in snapshot packets, MaxSnapshotSlots if all were taken
+		uint32 snapshotSlot = MaxSnapshotSlots;
+
+		// RemoteAuthority
+		std::unique_ptr<CPlayerInputQueue> pInputQueue;
+		std::unique_ptr<SSnapshotReceiver> pReceiver;
+		// Predicted
+		std::unique_ptr<CPlayerPrediction> pPrediction;
+		// Predicted and Proxy: newest snapshot received since the last update
+		SPlayerMovementSnapshot pendingSnapshot;
+		bool hasPendingSnapshot = false;
+		// Proxy: input the server is simulating the player with
+		SPlayerInput proxyInput;
+	};
+
+	// Local player input being recorded to or replayed from a trace
+	struct SInputTraceSession
+	{
+		string path;
+		PlayerMovementId playerId = InvalidPlayerMovementId;
+		bool isReplay = false;
+		CPlayerInputTraceWriter writer;
+		CMappedFile file;
+		CPlayerInputTraceReader reader;
+		// Input of the tick in flight, before the simulation consumes its edges
+		SPlayerInput tickInput;
+		uint32 numTicks = 0;
+		uint32 checksum = 0;
+		SMovementStageTimings timings;
+	};
+
+	CPlayerMovementStore m_store;
+	std::vector<SPresentationTarget> m_targets;
+	std::vector<SPlayerNetwork> m_network;
+	CFixedTickAccumulator m_tickAccumulator;
+	CSimulatedNetworkLink m_simulatedLink;
+	std::unique_ptr<SInputTraceSession> m_pInputTrace;
+	CMovementStageProfiler m_stageProfiler;
+	CMovementUpdateScheduler m_updateScheduler;
+	// Positions of the players somebody looks through, LOD distances are measured from them
+	std::vector<Vec3> m_viewers;
+	// Squared distance of each player to the nearest viewer, in store order
+	std::vector<float> m_viewerDistancesSq;
+	CPlayerInterestGrid m_interestGrid;
+	// Scratch for the snapshot packets and the presentation, reused so they do not allocate
+	std::vector<SRelevantPlayer> m_relevant;
+	std::vector<SSnapshotCandidate> m_snapshotCandidates;
+	std::vector<uint8> m_isPresented;
+	std::array<SMovementUpdateRange, CMovementUpdateScheduler::NumTiers> m_dueRanges;
+	uint32 m_numDueRanges = 0;
+	// Sent snapshots on the server, received ones on clients, by network id
+	std::unordered_map<EntityId, std::unique_ptr<TSnapshotHistory>> m_snapshotHistory;
+	std::array<uint8, MaxSnapshotPacketBytes> m_packetBuffer;
+	// Copies of the snapshot packets the simulated link holds back, slots are reused once sent or dropped
+	std::vector<std::vector<uint8>> m_delayedPackets;
+	std::vector<uint32> m_freeDelayedPackets;
+	CPlayerCapsuleHistory m_capsuleHistory;
+	CMovementTelemetry m_telemetry;
+
+	int m_parallelUpdate = 1;
+	int m_profileStages = 0;
+	int m_parallelChunkSize = 32;
+	int m_kernelPath = static_cast<int>(EMovementKernelPath::Avx);
+	float m_tickRate = CFixedTickAccumulator::DefaultTickRate;
+	int m_updateLod = 1;
+	// Distance between predicted and server position that is still accepted without a correction
+	float m_correctionTolerance = 0.05f;
+	uint32 m_numCorrections = 0;
+	// Bytes of snapshot data each client gets per tick, its own player is sent regardless
+	int m_snapshotBudget = 1024;
+	// Furthest back in ticks a shot is tested, bounds how much latency is made up for
+	int m_hitRewindMaxTicks = 32;
+	int m_telemetrySampleInterval = 1;
+	// Store tick the last snapshots were sent for, nothing new to send until it moves on
+	uint32 m_lastSnapshotTick = 0;
+	// Client: newest server tick a complete snapshot packet arrived for, and what was last acknowledged
+	uint32 m_newestSnapshotTick = 0;
+	uint32 m_sentSnapshotAck = 0;
+	// Server: slots no player holds, the lowest at the back. Client: the entity id last sent for each slot.
+	std::vector<uint32> m_freeSnapshotSlots;
+	std::array<EntityId, MaxSnapshotSlots> m_snapshotSlotIds;
+};
@@ -0,0 +1,172 @@
+#include "StdAfx.h"
+#include "PlayerPool.h"
+#include "GamePlugin.h"
+#include "Components/Player.h"
+
+#include <CryEntitySystem/IEntitySystem.h>
+
+namespace
+{
+	// Parked players wait below the level, hidden and without physics
+	const Vec3 ParkingPosition = Vec3(0.f, 0.f, -1000.f);
+
+	void PlayerPoolStatsCommand(IConsoleCmdArgs* pArgs)
+	{
+		CPlayerPool* pPool = CGamePlugin::GetInstance()->GetPlayerPool();
+		if (pArgs->GetArgCount() > 1 && strcmp(pArgs->GetArg(1), "reset") == 0)
+		{
+			pPool->ResetStats();
+			CryLogAlways("Player pool stats reset");
+			return;
+		}
+
+		pPool->LogStats();
+	}
+}
+
+CPlayerPool::CPlayerPool()
+{
+	REGISTER_CVAR2("pl_playerPoolSize", &m_poolSize, 32, VF_NULL,
+		"Player entities created and parked at level start on the server, and the most kept parked for reuse afterwards\n"
+		"Joining and respawning players take one of them instead of spawning and physicalizing a new entity");
+	REGISTER_COMMAND("pl_playerPoolStats", &PlayerPoolStatsCommand, VF_NULL,
+		"Logs how many player acquires the pool served from parked players and how many had to spawn one\n"
+		"Usage: pl_playerPoolStats [reset]");
+}
+
+CPlayerPool::~CPlayerPool()
+{
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->UnregisterVariable("pl_playerPoolSize", true);
+		gEnv->pConsole->RemoveCommand("pl_playerPoolStats");
+	}
+}
+
+void CPlayerPool::Prewarm()
+{
+	Reserve(static_cast<uint32>(std::max(m_poolSize, 0)));
+}
+
+void CPlayerPool::Reserve(uint32 count)
+{
+	m_parked.reserve(count);
+
+	while (m_parked.size() < count)
+	{
+		CPlayerComponent* pPlayer = Spawn();
+		if (pPlayer == nullptr)
+			break;
+
+		pPlayer->Park();
+		m_parked.push_back(pPlayer->GetEntity()->GetId());
+	}
+}
+
+void CPlayerPool::Clear()
+{
+	m_parked.clear();
+	m_stats.inUse = 0;
+}
+
+CPlayerComponent* CPlayerPool::Acquire(const Vec3& position, const Quat& rotation, uint16 channelId)
+{
+	CPlayerComponent* pPlayer = nullptr;
+	while (pPlayer == nullptr && !m_parked.empty())
+	{
+		// Entities removed behind the pool's back, e.g. by an editor reset, are skipped
+		IEntity* pEntity = gEnv->pEntitySystem->GetEntity(m_parked.back());
+		m_parked.pop_back();
+		pPlayer = pEntity != nullptr ? pEntity->GetComponent<CPlayerComponent>() : nullptr;
+	}
+
+	if (pPlayer != nullptr)
+	{
+		++m_stats.hits;
+	}
+	else
+	{
+		++m_stats.misses;
+		pPlayer = Spawn();
+		if (pPlayer == nullptr)
+			return nullptr;
+	}
+
+	// The owner has to be known before the respawn sets up the network role
+	pPlayer->GetEntity()->GetNetEntity()->SetChannelId(channelId);
+	pPlayer->Respawn(position, rotation);
+
+	++m_stats.inUse;
+	m_stats.peakInUse = std::max(m_stats.peakInUse, m_stats.inUse);
+	return pPlayer;
+}
+
+void CPlayerPool::Release(EntityId entityId)
+{
+	// Already gone when the engine shuts down
+	if (gEnv->pEntitySystem == nullptr)
+		return;
+
+	IEntity* pEntity = gEnv->pEntitySystem->GetEntity(entityId);
+	CPlayerComponent* pPlayer = pEntity != nullptr ? pEntity->GetComponent<CPlayerComponent>() : nullptr;
+	if (pPlayer == nullptr)
+		return;
+
+	++m_stats.releases;
+	m_stats.inUse -= std::min(m_stats.inUse, 1u);
+
+	if (m_parked.size() >= static_cast<size_t>(std::max(m_poolSize, 0)))
+	{
+		++m_stats.overflows;
+		gEnv->pEntitySystem->RemoveEntity(entityId);
+		return;
+	}
+
+	pPlayer->Park();
+	pEntity->GetNetEntity()->SetChannelId(0);
+	pEntity->SetPos(ParkingPosition);
+	m_parked.push_back(entityId);
+}
+
+void CPlayerPool::ResetStats()
+{
+	const uint32 inUse = m_stats.inUse;
+	m_stats = SStats();
+	m_stats.inUse = inUse;
+	m_stats.peakInUse = inUse;
+}
+
+void CPlayerPool::LogStats() const
+{
+	const uint32 numAcquires = m_stats.hits + m_stats.misses;
+	CryLogAlways("Player pool: %u parked of %d, %u in use (peak %u)", GetNumParked(), m_poolSize, m_stats.inUse, m_stats.peakInUse);
+	CryLogAlways("  %u acquires: %u hits, %u misses (%.1f%% hit rate)", numAcquires, m_stats.hits, m_stats.misses,
+		numAcquires > 0 ? 100.f * static_cast<float>(m_stats.hits) / static_cast<float>(numAcquires) : 0.f);
+	CryLogAlways("  %u releases, %u removed because the pool was full", m_stats.releases, m_stats.overflows);
+	CryLogAlways("  %u spawned, %u physicalizations, %u colliders recentered afterwards", m_stats.spawns, m_stats.physicalizations, m_stats.colliderRecenters);
+}
+
+CPlayerComponent* CPlayerPool::Spawn()
+{
+	string name;
+	name.Format("Player%u", m_numSpawned++);
+
+	SEntitySpawnParams spawnParams;
+	spawnParams.pClass = gEnv->pEntitySystem->GetClassRegistry()->GetDefaultClass();
+	spawnParams.sName = name.c_str();
+	spawnParams.vPosition = ParkingPosition;
+
+	IEntity* pEntity = gEnv->pEntitySystem->SpawnEntity(spawnParams);
+	if (pEntity == nullptr)
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "Failed to spawn player entity %s", name.c_str());
+		return nullptr;
+	}
+
+	// Creates the camera, input, character controller and animation components and physicalizes the player
+	++m_stats.spawns;
+	m_isSpawning = true;
+	CPlayerComponent* pPlayer = pEntity->GetOrCreateComponent<CPlayerComponent>();
+	m_isSpawning = false;
+	return pPlayer;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+
+class CPlayerComponent;
+
+////////////////////////////////////////////////////////
+// Player entities created ahead of time and reused, so joining and respawning players do not spawn and physicalize
+// Prewarm creates the entities with their CPlayerComponent at level start and parks them (see CPlayerComponent::Park).
+// Acquire hands out a parked player, or spawns a new one when there is none left, and Release parks it again.
+// Only used where player entities are created, i.e. on the server.
+////////////////////////////////////////////////////////
+class CPlayerPool
+{
+public:
+	struct SStats
+	{
+		// Acquires served by a parked player, and those that had to spawn one
+		uint32 hits = 0;
+		uint32 misses = 0;
+		uint32 releases = 0;
+		// Released players removed because the pool was already full
+		uint32 overflows = 0;
+		uint32 inUse = 0;
+		uint32 peakInUse = 0;
+		// Player entities spawned, times a player was physicalized, one per spawn when nothing else interferes,
+		// and colliders that had to be moved after physicalizing, also one per spawn as the controller physicalizes before it can be offset
+		uint32 spawns = 0;
+		uint32 physicalizations = 0;
+		uint32 colliderRecenters = 0;
+	};
+
+	CPlayerPool();
+	~CPlayerPool();
+
+	// Spawns and parks players until pl_playerPoolSize are waiting
+	void Prewarm();
+	// Spawns and parks players until count are waiting, call before a wave of acquires so none of them spawns in between
+	void Reserve(uint32 count);
+	// Forgets the parked players, the level unload removes their entities
+	void Clear();
+
+	// An active player at the given transform, owned by channelId (0 for players the server drives itself)
+	// Returns null if no entity could be spawned.
+	CPlayerComponent* Acquire(const Vec3& position, const Quat& rotation, uint16 channelId);
+	// Parks the player for the next Acquire, or removes it if the pool is full
+	void Release(EntityId entityId);
+
+	// Called by CPlayerComponent for every player, pooled or not
+	void OnPlayerPhysicalized() { ++m_stats.physicalizations; }
+	void OnColliderRecentered() { ++m_stats.colliderRecenters; }
+
+	// True while Spawn creates a player, which is parked right away and kept off the network until it is acquired
+	bool IsSpawning() const { return m_isSpawning; }
+
+	uint32 GetNumParked() const { return static_cast<uint32>(m_parked.size()); }
+	const SStats& GetStats() const { return m_stats; }
+	void ResetStats();
+	void LogStats() const;
+
+protected:
+	CPlayerComponent* Spawn();
+
+	std::vector<EntityId> m_parked;
+	SStats m_stats;
+	uint32 m_numSpawned = 0;
+	bool m_isSpawning = false;
+
+	int m_poolSize = 32;
+};
@@ -0,0 +1,449 @@
+#include "StdAfx.h"
+#include "ProjectileSystem.h"
+#include "PlayerMovementSystem.h"
+#include "GamePlugin.h"
+#include "Components/Player.h"
+
+#include <CryEntitySystem/IEntitySystem.h>
+#include <CryPhysics/physinterface.h>
+
+#include <chrono>
+
+namespace
+{
+	// Everything a bullet stops at, pierceable surfaces like foliage let it through
+	// Players' shots leave out ent_living where the players are tested on their recorded capsules instead.
+	const uint32 ProjectileQueryFlags = ent_static | ent_terrain | ent_rigid | ent_sleeping_rigid | ent_living;
+	const uint32 ProjectileRayFlags = rwi_stop_at_pierceable | rwi_colltype_any;
+	const float Gravity = -9.81f;
+
+	// Benchmark shots leave from about eye height around the origins, flat enough to mostly travel their whole life
+	const float BenchmarkProjectileSpeed = 400.f;
+	const float BenchmarkOriginSpread = 10.f;
+	const float BenchmarkOriginHeight = 1.6f;
+
+	void ProjectileStatsCommand(IConsoleCmdArgs* pArgs)
+	{
+		CProjectileSystem* pProjectiles = CGamePlugin::GetInstance()->GetProjectileSystem();
+		pProjectiles->LogStats();
+
+		if (pArgs->GetArgCount() > 1 && strcmp(pArgs->GetArg(1), "reset") == 0)
+		{
+			pProjectiles->ResetStats();
+		}
+	}
+
+	void ProjectileBenchmarkCommand(IConsoleCmdArgs* pArgs)
+	{
+		if (pArgs->GetArgCount() < 2)
+		{
+			CryLogAlways("Usage: pl_projectileBenchmark <perSecond> [seconds=5]");
+			return;
+		}
+
+		const float perSecond = std::max(static_cast<float>(atof(pArgs->GetArg(1))), 1.f);
+		const float seconds = pArgs->GetArgCount() > 2 ? std::max(static_cast<float>(atof(pArgs->GetArg(2))), 0.5f) : 5.f;
+		CGamePlugin::GetInstance()->GetProjectileSystem()->StartBenchmark(perSecond, seconds);
+	}
+}
+
+CProjectileSystem::CProjectileSystem()
+{
+	REGISTER_CVAR2("pl_projectileRayLatency", &m_latencyPolicy, static_cast<int>(ELatencyPolicy::OneFrame), VF_NULL,
+		"Projectile ray latency policy\n"
+		"0: Cast the rays of all projectiles immediately on the main thread\n"
+		"1: Batch the rays of all projectiles through the deferred raycast queue, impacts are reported one frame later");
+	REGISTER_CVAR2("pl_projectilePoolSize", &m_poolSize, 4096, VF_NULL,
+		"Projectiles that can be in flight at once, further shots are dropped. Changes apply on the next level load.");
+	REGISTER_CVAR2("pl_projectileLifetime", &m_lifetime, 3.f, VF_NULL,
+		"Seconds a projectile flies without hitting anything before it is removed");
+	REGISTER_CVAR2("pl_projectileGravity", &m_gravityScale, 1.f, VF_NULL,
+		"Scale of the gravity pulling projectiles down, 0 flies them straight");
+	REGISTER_COMMAND("pl_projectileStats", &ProjectileStatsCommand, VF_NULL,
+		"Logs the projectiles fired, hit, expired and dropped and the update time per frame\n"
+		"Usage: pl_projectileStats [reset]");
+	REGISTER_COMMAND("pl_projectileBenchmark", &ProjectileBenchmarkCommand, VF_NULL,
+		"Fires projectiles at a sustained rate from around the players in the level, then logs the update time per frame and per projectile\n"
+		"Usage: pl_projectileBenchmark <perSecond> [seconds=5]");
+
+	Allocate(static_cast<uint32>(std::max(m_poolSize, 1)));
+}
+
+CProjectileSystem::~CProjectileSystem()
+{
+	CancelQueuedRays();
+
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->UnregisterVariable("pl_projectileRayLatency", true);
+		gEnv->pConsole->UnregisterVariable("pl_projectilePoolSize", true);
+		gEnv->pConsole->UnregisterVariable("pl_projectileLifetime", true);
+		gEnv->pConsole->UnregisterVariable("pl_projectileGravity", true);
+		gEnv->pConsole->RemoveCommand("pl_projectileStats");
+		gEnv->pConsole->RemoveCommand("pl_projectileBenchmark");
+	}
+}
+
+ProjectileId CProjectileSystem::Fire(const Vec3& position, const Vec3& velocity, EntityId shooterId)
+{
+	++m_stats.fired;
+	if (m_count == m_ids.size())
+	{
+		++m_stats.dropped;
+		return InvalidProjectileId;
+	}
+
+	const uint32 index = m_count++;
+	m_position[index] = position;
+	m_castPosition[index] = position;
+	m_queuedRays[index] = 0;
+	m_velocity[index] = velocity;
+	m_timeLeft[index] = m_lifetime;
+	m_ids[index] = m_nextId++;
+	m_shooterIds[index] = shooterId;
+	m_playerHitIds[index] = 0;
+
+	m_stats.peakLive = std::max(m_stats.peakLive, m_count);
+	return m_ids[index];
+}
+
+void CProjectileSystem::Clear()
+{
+	CancelQueuedRays();
+	m_count = 0;
+	m_impacts.clear();
+	m_benchmarkTimeLeft = 0.f;
+
+	const uint32 capacity = static_cast<uint32>(std::max(m_poolSize, 1));
+	if (capacity != m_ids.size())
+	{
+		Allocate(capacity);
+	}
+}
+
+void CProjectileSystem::Update(float frameTime)
+{
+	if (m_benchmarkTimeLeft > 0.f)
+	{
+		UpdateBenchmark(frameTime);
+	}
+
+	const float tickRate = CGamePlugin::GetInstance()->GetPlayerMovementSystem()->GetTickRate();
+	if (1.f / std::max(tickRate, 1.f) != m_tickAccumulator.GetTickLength())
+	{
+		m_tickAccumulator.SetTickRate(tickRate);
+	}
+	const int numTicks = m_tickAccumulator.Advance(frameTime);
+
+	if (m_count == 0 || gEnv->pPhysicalWorld == nullptr)
+		return;
+
+	using TClock = std::chrono::high_resolution_clock;
+	const TClock::time_point start = TClock::now();
+
+	// Hands out the results of last frame's rays, which removes the projectiles that hit
+	m_rayCaster.Update(frameTime);
+	for (int i = 0; i < numTicks; ++i)
+	{
+		Integrate(m_tickAccumulator.GetTickLength());
+		Sweep();
+	}
+
+	m_stats.update.Add(static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(TClock::now() - start).count()));
+
+	// Delivered after the batch, so listeners see a consistent pool and can fire right away
+	for (const SProjectileImpact& impact : m_impacts)
+	{
+		for (IProjectileListener* pListener : m_listeners)
+		{
+			pListener->OnProjectileImpact(impact);
+		}
+	}
+	m_impacts.clear();
+}
+
+void CProjectileSystem::AddListener(IProjectileListener* pListener)
+{
+	stl::push_back_unique(m_listeners, pListener);
+}
+
+void CProjectileSystem::RemoveListener(IProjectileListener* pListener)
+{
+	stl::find_and_erase(m_listeners, pListener);
+}
+
+void CProjectileSystem::LogStats() const
+{
+	CryLogAlways("Projectiles: %u live of %u, peak %u", m_count, static_cast<uint32>(m_ids.size()), m_stats.peakLive);
+	CryLogAlways("  fired %llu, hit %llu, expired %llu, dropped %llu", static_cast<unsigned long long>(m_stats.fired), static_cast<unsigned long long>(m_stats.impacts),
+		static_cast<unsigned long long>(m_stats.expired), static_cast<unsigned long long>(m_stats.dropped));
+	CryLogAlways("  update p50 %.1f us, p99 %.1f us, max %.1f us over %llu frames", m_stats.update.GetPercentile(0.5f) * 1e-3f, m_stats.update.GetPercentile(0.99f) * 1e-3f,
+		m_stats.update.GetMax() * 1e-3f, static_cast<unsigned long long>(m_stats.update.GetCount()));
+}
+
+void CProjectileSystem::StartBenchmark(float perSecond, float seconds)
+{
+	if (gEnv->pPhysicalWorld == nullptr)
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "The projectile benchmark needs a level");
+		return;
+	}
+
+	// Shots come from where the players are, so they cross the same geometry as in a match
+	m_benchmarkOrigins.clear();
+	const CPlayerMovementStore& store = CGamePlugin::GetInstance()->GetPlayerMovementSystem()->GetStore();
+	for (uint32 i = 0; i < store.GetCount(); ++i)
+	{
+		m_benchmarkOrigins.push_back(store.body[i].position);
+	}
+	if (m_benchmarkOrigins.empty())
+	{
+		m_benchmarkOrigins.push_back(Vec3(ZERO));
+	}
+
+	ResetStats();
+	m_benchmarkRate = perSecond;
+	m_benchmarkSeconds = seconds;
+	m_benchmarkTimeLeft = seconds;
+	m_benchmarkBudget = 0.f;
+	m_benchmarkRandom = 0x9E3779B9;
+	m_benchmarkLiveTotal = 0;
+	m_benchmarkFrames = 0;
+
+	CryLogAlways("[ProjectileBenchmark] %.0f projectiles per second for %.1f s from %u origins, pool of %u", perSecond, seconds,
+		static_cast<uint32>(m_benchmarkOrigins.size()), static_cast<uint32>(m_ids.size()));
+}
+
+void CProjectileSystem::Allocate(uint32 capacity)
+{
+	m_position.resize(capacity);
+	m_castPosition.resize(capacity);
+	m_queuedRays.resize(capacity);
+	m_velocity.resize(capacity);
+	m_timeLeft.resize(capacity);
+	m_ids.resize(capacity);
+	m_shooterIds.resize(capacity);
+	m_playerHitIds.resize(capacity);
+	m_playerHitDistances.resize(capacity);
+	m_playerHitPoints.resize(capacity);
+	// Every projectile can hit in the same frame
+	m_impacts.reserve(capacity);
+	m_count = std::min(m_count, capacity);
+}
+
+void CProjectileSystem::Integrate(float dt)
+{
+	const float fall = Gravity * m_gravityScale * dt;
+	for (uint32 i = 0; i < m_count; ++i)
+	{
+		// Expired ones stay where they are until the rest of their path has been cast
+		if (m_timeLeft[i] <= 0.f)
+			continue;
+
+		m_velocity[i].z += fall;
+		m_position[i] += m_velocity[i] * dt;
+		m_timeLeft[i] -= dt;
+	}
+}
+
+void CProjectileSystem::Sweep()
+{
+	const bool isImmediate = static_cast<ELatencyPolicy>(m_latencyPolicy) == ELatencyPolicy::Immediate;
+
+	// Shots of one weapon follow each other in the pool, so the shooter's physics is mostly looked up once for several
+	const CPlayerMovementSystem* pPlayerMovement = CGamePlugin::GetInstance()->GetPlayerMovementSystem();
+	EntityId skipEntityId = 0;
+	IPhysicalEntity* pSkipEntity = nullptr;
+	PlayerMovementId shooterMovementId = InvalidPlayerMovementId;
+
+	// Back to front, the projectile moved into a removed row was already looked at
+	for (uint32 i = m_count; i-- > 0;)
+	{
+		if (m_queuedRays[i] != 0)
+			continue;
+
+		const Vec3 segment = m_position[i] - m_castPosition[i];
+		if (segment.IsZero())
+		{
+			if (m_timeLeft[i] <= 0.f)
+			{
+				++m_stats.expired;
+				RemoveAt(i);
+			}
+			continue;
+		}
+
+		if (m_shooterIds[i] != skipEntityId)
+		{
+			skipEntityId = m_shooterIds[i];
+			const IEntity* pShooter = skipEntityId != 0 ? gEnv->pEntitySystem->GetEntity(skipEntityId) : nullptr;
+			pSkipEntity = pShooter != nullptr ? pShooter->GetPhysicalEntity() : nullptr;
+			const CPlayerComponent* pPlayer = pShooter != nullptr ? pShooter->GetComponent<CPlayerComponent>() : nullptr;
+			shooterMovementId = pPlayer != nullptr ? pPlayer->GetMovementId() : InvalidPlayerMovementId;
+		}
+
+		const Vec3 origin = m_castPosition[i];
+		m_castPosition[i] = m_position[i];
+
+		uint32 queryFlags = ProjectileQueryFlags;
+		m_playerHitIds[i] = 0;
+		if (shooterMovementId != InvalidPlayerMovementId)
+		{
+			SCapsuleRay ray;
+			ray.origin = origin;
+			ray.length = segment.GetLength();
+			ray.direction = segment / ray.length;
+			SCapsuleRayHit playerHit;
+			// Without a history, e.g. on a client, the players' physics is hit where it is now
+			if (pPlayerMovement->TraceShots(shooterMovementId, &ray, 1, &playerHit))
+			{
+				queryFlags &= ~ent_living;
+				if (playerHit.IsHit())
+				{
+					m_playerHitIds[i] = playerHit.id;
+					m_playerHitDistances[i] = playerHit.distance;
+					m_playerHitPoints[i] = origin + ray.direction * playerHit.distance;
+				}
+			}
+		}
+
+		if (isImmediate)
+		{
+			ray_hit hit;
+			const bool isWorldHit = gEnv->pPhysicalWorld->RayWorldIntersection(origin, segment, queryFlags, ProjectileRayFlags, &hit, 1, pSkipEntity) > 0;
+			if (!ResolveHit(i, isWorldHit ? &hit : nullptr) && m_timeLeft[i] <= 0.f)
+			{
+				++m_stats.expired;
+				RemoveAt(i);
+			}
+			continue;
+		}
+
+		IPhysicalEntity* skipList[] = { pSkipEntity };
+		const RayCastRequest request(origin, segment, queryFlags, ProjectileRayFlags, skipList, pSkipEntity != nullptr ? 1 : 0);
+		const QueuedRayID rayID = m_rayCaster.Queue(RayCastRequest::HighPriority, request, functor(*this, &CProjectileSystem::OnRayCastResult));
+		m_queuedRays[i] = rayID;
+		m_rayOwners[rayID] = i;
+	}
+}
+
+void CProjectileSystem::OnRayCastResult(const QueuedRayID& rayID, const RayCastResult& result)
+{
+	const auto owner = m_rayOwners.find(rayID);
+	if (owner == m_rayOwners.end())
+		return;
+
+	const uint32 index = owner->second;
+	m_rayOwners.erase(owner);
+	m_queuedRays[index] = 0;
+
+	// A projectile that missed flies on, its next ray picks up where this one ended
+	ResolveHit(index, result.hitCount > 0 ? &result[0] : nullptr);
+}
+
+bool CProjectileSystem::ResolveHit(uint32 index, const ray_hit* pWorldHit)
+{
+	const bool isPlayerHit = m_playerHitIds[index] != 0;
+	if (pWorldHit != nullptr && (!isPlayerHit || pWorldHit->dist <= m_playerHitDistances[index]))
+	{
+		const IEntity* pHitEntity = gEnv->pEntitySystem->GetEntityFromPhysics(pWorldHit->pCollider);
+		Impact(index, pHitEntity != nullptr ? pHitEntity->GetId() : 0, pWorldHit->pt, pWorldHit->n);
+		return true;
+	}
+
+	if (isPlayerHit)
+	{
+		// The capsules have no surface to take a normal from, the shot counts as hitting head-on
+		Impact(index, m_playerHitIds[index], m_playerHitPoints[index], -m_velocity[index].GetNormalizedSafe(Vec3(0.f, 1.f, 0.f)));
+		return true;
+	}
+	return false;
+}
+
+void CProjectileSystem::Impact(uint32 index, EntityId hitEntityId, const Vec3& point, const Vec3& normal)
+{
+	SProjectileImpact impact;
+	impact.id = m_ids[index];
+	impact.shooterId = m_shooterIds[index];
+	impact.hitEntityId = hitEntityId;
+	impact.point = point;
+	impact.normal = normal;
+	impact.velocity = m_velocity[index];
+	m_impacts.push_back(impact);
+
+	++m_stats.impacts;
+	RemoveAt(index);
+}
+
+void CProjectileSystem::RemoveAt(uint32 index)
+{
+	if (m_queuedRays[index] != 0)
+	{
+		m_rayCaster.Cancel(m_queuedRays[index]);
+		m_rayOwners.erase(m_queuedRays[index]);
+	}
+
+	const uint32 last = --m_count;
+	m_position[index] = m_position[last];
+	m_castPosition[index] = m_castPosition[last];
+	m_queuedRays[index] = m_queuedRays[last];
+	m_velocity[index] = m_velocity[last];
+	m_timeLeft[index] = m_timeLeft[last];
+	m_ids[index] = m_ids[last];
+	m_shooterIds[index] = m_shooterIds[last];
+	m_playerHitIds[index] = m_playerHitIds[last];
+	m_playerHitDistances[index] = m_playerHitDistances[last];
+	m_playerHitPoints[index] = m_playerHitPoints[last];
+
+	if (index != last && m_queuedRays[index] != 0)
+	{
+		m_rayOwners[m_queuedRays[index]] = index;
+	}
+}
+
+void CProjectileSystem::CancelQueuedRays()
+{
+	for (uint32 i = 0; i < m_count; ++i)
+	{
+		if (m_queuedRays[i] != 0)
+		{
+			m_rayCaster.Cancel(m_queuedRays[i]);
+			m_queuedRays[i] = 0;
+		}
+	}
+	m_rayOwners.clear();
+}
+
+void CProjectileSystem::UpdateBenchmark(float frameTime)
+{
+	// Deterministic noise, so runs are comparable
+	auto nextRandom = [this](float minValue, float maxValue)
+	{
+		m_benchmarkRandom ^= m_benchmarkRandom << 13;
+		m_benchmarkRandom ^= m_benchmarkRandom >> 17;
+		m_benchmarkRandom ^= m_benchmarkRandom << 5;
+		return minValue + static_cast<float>(m_benchmarkRandom & 0xFFFF) / 65535.f * (maxValue - minValue);
+	};
+
+	m_benchmarkBudget += m_benchmarkRate * frameTime;
+	for (; m_benchmarkBudget >= 1.f; m_benchmarkBudget -= 1.f)
+	{
+		const Vec3& origin = m_benchmarkOrigins[m_benchmarkRandom % m_benchmarkOrigins.size()];
+		const Vec3 position = origin + Vec3(nextRandom(-BenchmarkOriginSpread, BenchmarkOriginSpread), nextRandom(-BenchmarkOriginSpread, BenchmarkOriginSpread), BenchmarkOriginHeight);
+		const Vec3 direction = Vec3(nextRandom(-1.f, 1.f), nextRandom(-1.f, 1.f), nextRandom(-0.05f, 0.1f)).GetNormalizedSafe(Vec3(0.f, 1.f, 0.f));
+		Fire(position, direction * BenchmarkProjectileSpeed, 0);
+	}
+
+	m_benchmarkLiveTotal += m_count;
+	++m_benchmarkFrames;
+	m_benchmarkTimeLeft -= frameTime;
+	if (m_benchmarkTimeLeft > 0.f)
+		return;
+
+	const float averageLive = static_cast<float>(m_benchmarkLiveTotal) / static_cast<float>(std::max(m_benchmarkFrames, 1u));
+	CryLogAlways("[ProjectileBenchmark] %.0f per second for %.1f s: %.0f live on average, peak %u", m_benchmarkRate, m_benchmarkSeconds, averageLive, m_stats.peakLive);
+	CryLogAlways("  update p50 %.1f us, p99 %.1f us, %.3f us per live projectile", m_stats.update.GetPercentile(0.5f) * 1e-3f, m_stats.update.GetPercentile(0.99f) * 1e-3f,
+		m_stats.update.GetMean() * 1e-3f / std::max(averageLive, 1.f));
+	CryLogAlways("  fired %llu, hit %llu, expired %llu, dropped %llu", static_cast<unsigned long long>(m_stats.fired), static_cast<unsigned long long>(m_stats.impacts),
+		static_cast<unsigned long long>(m_stats.expired), static_cast<unsigned long long>(m_stats.dropped));
+}
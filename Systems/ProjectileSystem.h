@@ -0,0 +1,146 @@
+#pragma once
+
+#include "Movement/PlayerMovement.h"
+#include "Movement/MovementStageProfiler.h"
+
+#include <CryPhysics/RayCastQueue.h>
+
+#include <unordered_map>
+#include <vector>
+
+// Identifies a projectile in impact events, never reused within a session
+typedef uint32 ProjectileId;
+static constexpr ProjectileId InvalidProjectileId = 0;
+
+struct SProjectileImpact
+{
+	ProjectileId id = InvalidProjectileId;
+	EntityId shooterId = 0;
+	// 0 for the terrain and physics without an entity
+	EntityId hitEntityId = 0;
+	Vec3 point = ZERO;
+	Vec3 normal = ZERO;
+	// Of the projectile as it hit
+	Vec3 velocity = ZERO;
+};
+
+struct IProjectileListener
+{
+	virtual ~IProjectileListener() = default;
+
+	// Called once the update of all projectiles is done, firing new ones from here is fine
+	virtual void OnProjectileImpact(const SProjectileImpact& impact) = 0;
+};
+
+////////////////////////////////////////////////////////
+// Simulates every projectile in one pass per movement tick, without entities
+// Projectiles live in a pool of pl_projectilePoolSize rows of plain arrays, allocated up front, so firing does not allocate.
+// Every tick they all move ballistically in one loop, then the segments they moved along are submitted to the deferred
+// raycast queue as one batch. Each projectile has at most one ray in flight, its next one covers all the path since.
+// The ones that hit something are reported to the listeners and removed, normally a frame after they got there.
+// Projectiles are simulated on the machine that fires them, for gameplay that is the server. There the segments of shots
+// fired by players are tested against the other players where the shooter saw them (CPlayerMovementSystem::TraceShots)
+// rather than against their living physics, and the nearer of that and the world hit counts.
+////////////////////////////////////////////////////////
+class CProjectileSystem
+{
+public:
+	struct SStats
+	{
+		uint64 fired = 0;
+		uint64 impacts = 0;
+		uint64 expired = 0;
+		// Fire calls turned down because the pool was full
+		uint64 dropped = 0;
+		uint32 peakLive = 0;
+		// Time of the whole update, per frame
+		CDurationHistogram update;
+	};
+
+	CProjectileSystem();
+	~CProjectileSystem();
+
+	// Starts a projectile, which passes through the shooter. Returns InvalidProjectileId if the pool is full.
+	ProjectileId Fire(const Vec3& position, const Vec3& velocity, EntityId shooterId);
+	// Removes all projectiles and applies a changed pool size, called when the level unloads
+	void Clear();
+
+	void Update(float frameTime);
+
+	void AddListener(IProjectileListener* pListener);
+	void RemoveListener(IProjectileListener* pListener);
+
+	uint32 GetNumLive() const { return m_count; }
+	const SStats& GetStats() const { return m_stats; }
+	void ResetStats() { m_stats = SStats(); }
+	void LogStats() const;
+
+	// Keeps perSecond projectiles in flight from around the level's players for the given time, then logs the stats
+	void StartBenchmark(float perSecond, float seconds);
+
+protected:
+	enum class ELatencyPolicy
+	{
+		Immediate = 0,
+		OneFrame = 1
+	};
+
+	void Allocate(uint32 capacity);
+	void Integrate(float dt);
+	// Casts the path every projectile moved along since its last ray, and removes the ones that expired with all of it cast
+	void Sweep();
+	void OnRayCastResult(const QueuedRayID& rayID, const RayCastResult& result);
+	// Stops the projectile at index at the nearer of the world hit and the player its segment hit, false if there is neither
+	bool ResolveHit(uint32 index, const ray_hit* pWorldHit);
+	// Reports the projectile at index as stopped and removes it
+	void Impact(uint32 index, EntityId hitEntityId, const Vec3& point, const Vec3& normal);
+	// Moves the last projectile into the row, the order does not matter
+	void RemoveAt(uint32 index);
+	void CancelQueuedRays();
+	void UpdateBenchmark(float frameTime);
+
+	// Live projectiles are the first m_count rows
+	std::vector<Vec3> m_position;
+	// Where the path not cast yet starts, and the ray casting the path up to there, 0 if none is in flight
+	std::vector<Vec3> m_castPosition;
+	std::vector<QueuedRayID> m_queuedRays;
+	std::vector<Vec3> m_velocity;
+	std::vector<float> m_timeLeft;
+	std::vector<ProjectileId> m_ids;
+	std::vector<EntityId> m_shooterIds;
+	// Player the segment of the ray in flight hit on the server, 0 if none, and where along it
+	std::vector<EntityId> m_playerHitIds;
+	std::vector<float> m_playerHitDistances;
+	std::vector<Vec3> m_playerHitPoints;
+	uint32 m_count = 0;
+	ProjectileId m_nextId = 1;
+
+	// Steps at the rate of the player movement, so projectiles and the players they are fired at move in the same ticks
+	CFixedTickAccumulator m_tickAccumulator;
+	static constexpr int RayCasterId = 42;
+	RayCastQueue<RayCasterId> m_rayCaster;
+	// Maps rays in flight back to the row of their projectile
+	std::unordered_map<QueuedRayID, uint32> m_rayOwners;
+
+	// Filled during the update and delivered once it is done, reserved to the pool size
+	std::vector<SProjectileImpact> m_impacts;
+	std::vector<IProjectileListener*> m_listeners;
+	SStats m_stats;
+
+	// Benchmark in progress while there is time left, fires from around m_benchmarkOrigins
+	float m_benchmarkRate = 0.f;
+	float m_benchmarkSeconds = 0.f;
+	float m_benchmarkTimeLeft = 0.f;
+	// Projectiles due but not fired yet, frames rarely line up with the rate
+	float m_benchmarkBudget = 0.f;
+	uint32 m_benchmarkRandom = 1;
+	// Projectiles live summed over the benchmark frames
+	uint64 m_benchmarkLiveTotal = 0;
+	uint32 m_benchmarkFrames = 0;
+	std::vector<Vec3> m_benchmarkOrigins;
+
+	int m_latencyPolicy = static_cast<int>(ELatencyPolicy::OneFrame);
+	int m_poolSize = 4096;
+	float m_lifetime = 3.f;
+	float m_gravityScale = 1.f;
+};
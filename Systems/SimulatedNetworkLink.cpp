@@ -0,0 +1,71 @@
+#include "StdAfx.h"
+#include "SimulatedNetworkLink.h"
+
+#include <CryCore/Random.h>
+
+CSimulatedNetworkLink::CSimulatedNetworkLink()
+{
+	REGISTER_CVAR2("pl_netSimLatency", &m_latency, 0.f, VF_CHEAT,
+		"Simulated one-way latency of outgoing player movement messages, in milliseconds");
+	REGISTER_CVAR2("pl_netSimJitter", &m_jitter, 0.f, VF_CHEAT,
+		"Random extra latency of up to this many milliseconds per player movement message, messages can arrive out of order");
+	REGISTER_CVAR2("pl_netSimPacketLoss", &m_packetLoss, 0.f, VF_CHEAT,
+		"Chance of an outgoing player movement message being dropped, from 0 to 1");
+}
+
+CSimulatedNetworkLink::~CSimulatedNetworkLink()
+{
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->UnregisterVariable("pl_netSimLatency", true);
+		gEnv->pConsole->UnregisterVariable("pl_netSimJitter", true);
+		gEnv->pConsole->UnregisterVariable("pl_netSimPacketLoss", true);
+	}
+}
+
+bool CSimulatedNetworkLink::Send(std::function<void()>&& send)
+{
+	if (!IsEnabled())
+	{
+		send();
+		return true;
+	}
+
+	if (m_packetLoss > 0.f && cry_random(0.f, 1.f) < m_packetLoss)
+		return false;
+
+	const float delay = (std::max(m_latency, 0.f) + (m_jitter > 0.f ? cry_random(0.f, m_jitter) : 0.f)) * 0.001f;
+	m_messages.push_back(SMessage{ m_time + delay, std::move(send) });
+	return true;
+}
+
+void CSimulatedNetworkLink::Update(float frameTime)
+{
+	m_time += frameTime;
+
+	if (m_messages.empty())
+		return;
+
+	// Messages can be held back for different times, send in the order they are due
+	std::stable_sort(m_messages.begin(), m_messages.end(), [](const SMessage& a, const SMessage& b) { return a.sendTime < b.sendTime; });
+
+	size_t numDue = 0;
+	while (numDue < m_messages.size() && m_messages[numDue].sendTime <= m_time)
+	{
+		++numDue;
+	}
+
+	// Sending may queue new messages, so take the due ones out first
+	std::vector<SMessage> due(std::make_move_iterator(m_messages.begin()), std::make_move_iterator(m_messages.begin() + numDue));
+	m_messages.erase(m_messages.begin(), m_messages.begin() + numDue);
+
+	for (SMessage& message : due)
+	{
+		message.send();
+	}
+}
+
+void CSimulatedNetworkLink::Clear()
+{
+	m_messages.clear();
+}
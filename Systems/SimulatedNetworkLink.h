@@ -0,0 +1,40 @@
+#pragma once
+
+#include <functional>
+
+////////////////////////////////////////////////////////
+// Holds back outgoing movement messages to fake a bad connection
+// Lets prediction and reconciliation be tested against a loopback server. Controlled with the pl_netSim* cvars,
+// with all of them at 0 messages go out right away.
+////////////////////////////////////////////////////////
+class CSimulatedNetworkLink
+{
+public:
+	CSimulatedNetworkLink();
+	~CSimulatedNetworkLink();
+
+	// Calls send once the simulated latency has passed, returns false if the message was dropped instead
+	bool Send(std::function<void()>&& send);
+
+	// Releases the messages that are due
+	void Update(float frameTime);
+	void Clear();
+
+	bool IsEnabled() const { return m_latency > 0.f || m_jitter > 0.f || m_packetLoss > 0.f; }
+
+protected:
+	struct SMessage
+	{
+		float sendTime;
+		std::function<void()> send;
+	};
+
+	std::vector<SMessage> m_messages;
+	float m_time = 0.f;
+
+	// In milliseconds
+	float m_latency = 0.f;
+	float m_jitter = 0.f;
+	// Chance of a message being dropped, in [0, 1]
+	float m_packetLoss = 0.f;
+};
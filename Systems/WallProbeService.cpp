@@ -0,0 +1,311 @@
+#include "StdAfx.h"
+#include "WallProbeService.h"
+
+#include <CryPhysics/physinterface.h>
+#include <CryEntitySystem/IEntitySystem.h>
+
+#include <chrono>
+
+namespace
+{
+	const uint32 WallProbeQueryFlags = ent_static;
+	const uint32 WallProbeRayFlags = rwi_stop_at_pierceable;
+	// Half size of the box the surface index collects static entities from, larger than any level
+	const float SurfaceIndexWorldExtent = 1e5f;
+
+	// Adds the faces of one geometry placed at geometryToWorld, returns false for the primitives the index has no triangles for
+	bool AddGeometry(CWallSurfaceIndex& index, IGeometry* pGeometry, const Matrix34& geometryToWorld, bool canWallrun)
+	{
+		switch (pGeometry->GetType())
+		{
+			case GEOM_TRIMESH:
+			{
+				const mesh_data* pMesh = static_cast<const mesh_data*>(pGeometry->GetData());
+				for (int triangle = 0; triangle < pMesh->nTris; ++triangle)
+				{
+					const index_t* pIndices = &pMesh->pIndices[triangle * 3];
+					index.AddTriangle(geometryToWorld * pMesh->pVertices[pIndices[0]], geometryToWorld * pMesh->pVertices[pIndices[1]], geometryToWorld * pMesh->pVertices[pIndices[2]], canWallrun);
+				}
+			}
+			return true;
+
+			case GEOM_BOX:
+			{
+				// Box axes are the rows of Basis when it is oriented
+				const primitives::box* pBox = static_cast<const primitives::box*>(pGeometry->GetData());
+				Matrix34 boxToGeometry(IDENTITY, pBox->center);
+				if (pBox->bOriented)
+				{
+					boxToGeometry.SetRotation33(pBox->Basis.GetTransposed());
+				}
+				index.AddBox(geometryToWorld * boxToGeometry, pBox->size, canWallrun);
+			}
+			return true;
+
+			// Cylinders, capsules, spheres, heightfields
+			default:
+				return false;
+		}
+	}
+}
+
+CWallProbeService::CWallProbeService()
+{
+	REGISTER_CVAR2("pl_wallProbeLatency", &m_latencyPolicy, static_cast<int>(ELatencyPolicy::OneFrame), VF_NULL,
+		"Wall probe latency policy\n"
+		"0: Cast wall probes immediately on the main thread\n"
+		"1: Batch wall probes through the deferred raycast queue, results arrive one frame later");
+	REGISTER_CVAR2("pl_wallSurfaceIndex", &m_useSurfaceIndex, 1, VF_NULL,
+		"Answer wall probes from the wall surface index built when gameplay starts\n"
+		"0: Always cast rays against the physics world, also sees static entities that moved or spawned after the index was built\n"
+		"1: Use the index once it is built, rays are only cast next to colliders it has no triangles for");
+
+	// The whole batch should go out in a single frame
+	m_rayCaster.SetQuota(std::numeric_limits<int>::max());
+}
+
+CWallProbeService::~CWallProbeService()
+{
+	Reset();
+
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->UnregisterVariable("pl_wallProbeLatency", true);
+		gEnv->pConsole->UnregisterVariable("pl_wallSurfaceIndex", true);
+	}
+}
+
+CWallProbeService::ProbeHandle CWallProbeService::Register()
+{
+	ProbeHandle handle;
+	if (!m_freeSlots.empty())
+	{
+		handle = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else
+	{
+		handle = static_cast<ProbeHandle>(m_slots.size());
+		m_slots.emplace_back();
+	}
+
+	m_slots[handle] = SProbeSlot();
+	m_slots[handle].isUsed = true;
+	return handle;
+}
+
+void CWallProbeService::Unregister(ProbeHandle handle)
+{
+	if (handle >= m_slots.size() || !m_slots[handle].isUsed)
+		return;
+
+	SProbeSlot& slot = m_slots[handle];
+	CancelQueuedRays(slot);
+	slot.isUsed = false;
+	slot.hasRequest = false;
+
+	stl::find_and_erase(m_requested, handle);
+	m_freeSlots.push_back(handle);
+}
+
+void CWallProbeService::Probe(ProbeHandle handle, const Vec3& origin, const Vec3& rightDir, float range, IPhysicalEntity* pSkipEntity, SWallProbeHit& leftHit, SWallProbeHit& rightHit)
+{
+	CRY_ASSERT(handle < m_slots.size() && m_slots[handle].isUsed);
+	SProbeSlot& slot = m_slots[handle];
+
+	slot.origin = origin;
+	slot.directions[eSide_Left] = -rightDir * range;
+	slot.directions[eSide_Right] = rightDir * range;
+	slot.pSkipEntity = pSkipEntity;
+
+	if (GetLatencyPolicy() == ELatencyPolicy::Immediate)
+	{
+		for (int side = 0; side < eSide_Count; ++side)
+		{
+			slot.hits[side] = CastImmediate(slot.origin, slot.directions[side], pSkipEntity);
+		}
+	}
+	else if (!slot.hasRequest)
+	{
+		// Several movement ticks can run in one frame, only the last request of the frame is cast
+		slot.hasRequest = true;
+		m_requested.push_back(handle);
+	}
+
+	leftHit = slot.hits[eSide_Left];
+	rightHit = slot.hits[eSide_Right];
+}
+
+void CWallProbeService::Flush(float frameTime)
+{
+	for (const ProbeHandle handle : m_requested)
+	{
+		SProbeSlot& slot = m_slots[handle];
+		slot.hasRequest = false;
+
+		// A slow physics frame can leave last frame's rays unanswered, keep the older result rather than piling up
+		if (slot.queuedRays[eSide_Left] != 0 || slot.queuedRays[eSide_Right] != 0)
+			continue;
+
+		for (int side = 0; side < eSide_Count; ++side)
+		{
+			IPhysicalEntity* skipList[] = { slot.pSkipEntity };
+			const RayCastRequest request(slot.origin, slot.directions[side], WallProbeQueryFlags, WallProbeRayFlags, skipList, slot.pSkipEntity != nullptr ? 1 : 0);
+
+			const QueuedRayID rayID = m_rayCaster.Queue(RayCastRequest::HighPriority, request, functor(*this, &CWallProbeService::OnRayCastResult));
+			slot.queuedRays[side] = rayID;
+			m_rayOwners[rayID] = handle * eSide_Count + side;
+		}
+	}
+	m_requested.clear();
+
+	m_rayCaster.Update(frameTime);
+}
+
+void CWallProbeService::Reset()
+{
+	for (SProbeSlot& slot : m_slots)
+	{
+		CancelQueuedRays(slot);
+		slot.hits[eSide_Left] = slot.hits[eSide_Right] = SWallProbeHit();
+		slot.hasRequest = false;
+	}
+
+	m_requested.clear();
+	m_rayOwners.clear();
+}
+
+void CWallProbeService::BuildSurfaceIndex()
+{
+	using TClock = std::chrono::steady_clock;
+	const TClock::time_point start = TClock::now();
+
+	m_surfaceIndex.Clear();
+
+	IPhysicalEntity** ppEntities = nullptr;
+	const int numEntities = gEnv->pPhysicalWorld->GetEntitiesInBox(Vec3(-SurfaceIndexWorldExtent), Vec3(SurfaceIndexWorldExtent), ppEntities, ent_static | ent_allocate_list);
+
+	int numIndexedEntities = 0;
+	for (int i = 0; i < numEntities; ++i)
+	{
+		IPhysicalEntity* pPhysicalEntity = ppEntities[i];
+
+		// Same rule as the rays, only surfaces of entities can be wallrun on. Brushes still stop the probes.
+		const bool canWallrun = gEnv->pEntitySystem->GetEntityFromPhysics(pPhysicalEntity) != nullptr;
+
+		pe_status_pos entityPosition;
+		pe_status_nparts numParts;
+		if (!pPhysicalEntity->GetStatus(&entityPosition))
+			continue;
+
+		const Matrix34 entityToWorld(Vec3(entityPosition.scale), entityPosition.q, entityPosition.pos);
+		for (int part = 0, count = pPhysicalEntity->GetStatus(&numParts); part < count; ++part)
+		{
+			pe_params_part partParams;
+			partParams.ipart = part;
+			if (!pPhysicalEntity->GetParams(&partParams) || (partParams.flags & geom_colltype_ray) == 0)
+				continue;
+
+			// Rays hit the proxy when there is one
+			phys_geometry* pPhysicalGeometry = partParams.pPhysGeomProxy != nullptr ? partParams.pPhysGeomProxy : partParams.pPhysGeom;
+			if (pPhysicalGeometry == nullptr || pPhysicalGeometry->pGeom == nullptr)
+				continue;
+
+			if (!AddGeometry(m_surfaceIndex, pPhysicalGeometry->pGeom, entityToWorld * Matrix34(Vec3(partParams.scale), partParams.q, partParams.pos), canWallrun))
+			{
+				// Probes around it are cast as rays, which see the real shape
+				pe_status_pos partPosition;
+				partPosition.ipart = part;
+				if (pPhysicalEntity->GetStatus(&partPosition))
+				{
+					m_surfaceIndex.AddRayOnlyBounds(AABB(partPosition.pos + partPosition.BBox[0], partPosition.pos + partPosition.BBox[1]));
+				}
+			}
+		}
+		++numIndexedEntities;
+	}
+
+	if (ppEntities != nullptr)
+	{
+		gEnv->pPhysicalWorld->GetPhysUtils()->DeletePointer(ppEntities);
+	}
+
+	m_surfaceIndex.Build();
+
+	const CWallSurfaceIndex::SStats& stats = m_surfaceIndex.GetStats();
+	const float totalMilliseconds = std::chrono::duration<float, std::milli>(TClock::now() - start).count();
+	CryLogAlways("[WallProbeService] Built wall surface index from %d of %d static entities in %.2f ms (%.2f ms bucketing): %u walls, %u blocking triangles, %u flat triangles skipped, %u colliders left to rays, %u cells, %u references, %.1f KB",
+		numIndexedEntities, numEntities, totalMilliseconds, stats.buildNanoseconds * 1e-6f, stats.numTriangles - stats.numBlockers, stats.numBlockers, stats.numRejected, stats.numRayOnly,
+		stats.numCells, stats.numReferences, stats.memoryBytes / 1024.f);
+}
+
+void CWallProbeService::ReleaseSurfaceIndex()
+{
+	if (!m_surfaceIndex.IsBuilt())
+		return;
+
+	CryLogAlways("[WallProbeService] Released wall surface index, %.1f KB", m_surfaceIndex.GetStats().memoryBytes / 1024.f);
+	m_surfaceIndex.Clear();
+}
+
+bool CWallProbeService::ProbeSurfaceIndex(const Vec3& origin, const Vec3& rightDir, float range, SWallProbeHit& leftHit, SWallProbeHit& rightHit) const
+{
+	if (m_useSurfaceIndex == 0 || !m_surfaceIndex.IsBuilt())
+		return false;
+
+	// Near a collider the index could not take in, both probes go to the physics world
+	if (m_surfaceIndex.IsRayOnly(origin, -rightDir * range) || m_surfaceIndex.IsRayOnly(origin, rightDir * range))
+		return false;
+
+	leftHit = m_surfaceIndex.RayCast(origin, -rightDir * range);
+	rightHit = m_surfaceIndex.RayCast(origin, rightDir * range);
+	return true;
+}
+
+void CWallProbeService::OnRayCastResult(const QueuedRayID& rayID, const RayCastResult& result)
+{
+	const auto owner = m_rayOwners.find(rayID);
+	if (owner == m_rayOwners.end())
+		return;
+
+	const uint32 handle = owner->second / eSide_Count;
+	const int side = owner->second % eSide_Count;
+	m_rayOwners.erase(owner);
+
+	SProbeSlot& slot = m_slots[handle];
+	slot.queuedRays[side] = 0;
+	slot.hits[side] = result.hitCount > 0 ? ToWallProbeHit(result[0]) : SWallProbeHit();
+}
+
+void CWallProbeService::CancelQueuedRays(SProbeSlot& slot)
+{
+	for (QueuedRayID& rayID : slot.queuedRays)
+	{
+		if (rayID != 0)
+		{
+			m_rayCaster.Cancel(rayID);
+			m_rayOwners.erase(rayID);
+			rayID = 0;
+		}
+	}
+}
+
+SWallProbeHit CWallProbeService::CastImmediate(const Vec3& origin, const Vec3& direction, IPhysicalEntity* pSkipEntity)
+{
+	std::array<ray_hit, 1> hits;
+
+	// Exclude the player entity from the raycast query
+	const int numHits = gEnv->pPhysicalWorld->RayWorldIntersection(origin, direction, WallProbeQueryFlags, WallProbeRayFlags, hits.data(), hits.max_size(), pSkipEntity);
+	return numHits > 0 ? ToWallProbeHit(hits[0]) : SWallProbeHit();
+}
+
+SWallProbeHit CWallProbeService::ToWallProbeHit(const ray_hit& hit)
+{
+	SWallProbeHit result;
+	result.hit = true;
+	result.point = hit.pt;
+	result.normal = hit.n;
+	result.distance = hit.dist;
+	result.isWallrunnable = gEnv->pEntitySystem->GetEntityFromPhysics(hit.pCollider) != nullptr;
+	return result;
+}
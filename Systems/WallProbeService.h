@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Movement/IMovementPhysics.h"
+#include "Movement/WallSurfaceIndex.h"
+
+#include <CryPhysics/RayCastQueue.h>
+
+////////////////////////////////////////////////////////
+// Batches the left / right wall probes of all players into the deferred raycast queue
+// Players post one request per frame and read back the most recent result, which is normally the one from the previous frame.
+// With pl_wallProbeLatency 0 the probes are cast immediately instead, like before the queue existed.
+// Once the level's wall surface index is built (pl_wallSurfaceIndex), players ask ProbeSurfaceIndex first and rays are only cast
+// next to the colliders the index could not take in.
+////////////////////////////////////////////////////////
+class CWallProbeService
+{
+public:
+	typedef uint32 ProbeHandle;
+	static constexpr ProbeHandle InvalidHandle = ~0u;
+
+	enum class ELatencyPolicy
+	{
+		Immediate = 0,
+		OneFrame = 1
+	};
+
+	CWallProbeService();
+	~CWallProbeService();
+
+	ProbeHandle Register();
+	void Unregister(ProbeHandle handle);
+
+	// Posts the probes for this frame and returns the latest results available for the handle
+	void Probe(ProbeHandle handle, const Vec3& origin, const Vec3& rightDir, float range, IPhysicalEntity* pSkipEntity, SWallProbeHit& leftHit, SWallProbeHit& rightHit);
+
+	// Submits all probes posted since the last call as one batch, should run once per frame before physics
+	void Flush(float frameTime);
+	// Cancels everything in flight and forgets all results
+	void Reset();
+
+	ELatencyPolicy GetLatencyPolicy() const { return static_cast<ELatencyPolicy>(m_latencyPolicy); }
+
+	// Collects the surfaces of all static physics in the level that stop a probe, replacing any previous index
+	void BuildSurfaceIndex();
+	void ReleaseSurfaceIndex();
+	// Answers both probes from the surface index, returns false if it is not built or disabled, or the probes need rays
+	bool ProbeSurfaceIndex(const Vec3& origin, const Vec3& rightDir, float range, SWallProbeHit& leftHit, SWallProbeHit& rightHit) const;
+	const CWallSurfaceIndex& GetSurfaceIndex() const { return m_surfaceIndex; }
+
+	// Casts a single probe on the calling thread
+	static SWallProbeHit CastImmediate(const Vec3& origin, const Vec3& direction, IPhysicalEntity* pSkipEntity);
+
+protected:
+	enum ESide
+	{
+		eSide_Left = 0,
+		eSide_Right,
+		eSide_Count
+	};
+
+	struct SProbeSlot
+	{
+		Vec3 origin = ZERO;
+		Vec3 directions[eSide_Count];
+		IPhysicalEntity* pSkipEntity = nullptr;
+
+		SWallProbeHit hits[eSide_Count];
+		QueuedRayID queuedRays[eSide_Count] = { 0, 0 };
+
+		bool isUsed = false;
+		bool hasRequest = false;
+	};
+
+	void OnRayCastResult(const QueuedRayID& rayID, const RayCastResult& result);
+	static SWallProbeHit ToWallProbeHit(const ray_hit& hit);
+	void CancelQueuedRays(SProbeSlot& slot);
+
+	static constexpr int RayCasterId = 41;
+	RayCastQueue<RayCasterId> m_rayCaster;
+
+	std::vector<SProbeSlot> m_slots;
+	std::vector<ProbeHandle> m_freeSlots;
+	// Slots with a request posted this frame
+	std::vector<ProbeHandle> m_requested;
+	// Maps rays in flight back to slot * eSide_Count + side
+	std::unordered_map<QueuedRayID, uint32> m_rayOwners;
+
+	CWallSurfaceIndex m_surfaceIndex;
+
+	int m_latencyPolicy;
+	int m_useSurfaceIndex;
+};